@@ -131,6 +131,7 @@ int		unknown_ctrls_num = 0;
 
 /* options */
 struct timeval	nettimeout = { -1 , 0 };
+static char	*compress_method = NULL;
 
 typedef int (*print_ctrl_fn)( LDAP *ld, LDAPControl *ctrl );
 
@@ -356,6 +357,7 @@ N_("  -O props   SASL security properties\n"),
 N_("  -o <opt>[=<optparam>] any libldap ldap.conf options, plus\n"),
 N_("             ldif_wrap=<width> (in columns, or \"no\" for no wrapping)\n"),
 N_("             nettimeout=<timeout> (in seconds, or \"none\" or \"max\")\n"),
+N_("             compress=<method> (compress the session after binding)\n"),
 N_("  -Q         use SASL Quiet mode\n"),
 N_("  -R realm   SASL realm\n"),
 N_("  -U authcid SASL authentication identity\n"),
@@ -863,6 +865,17 @@ tool_args( int argc, char **argv )
 					ldif_wrap = (ber_len_t)u;
 				}
 
+			} else if ( strcasecmp( control, "compress" ) == 0 ) {
+				if( compress_method != NULL ) {
+					fprintf( stderr, "compress option previously specified\n");
+					exit( EXIT_FAILURE );
+				}
+				if( cvalue == NULL || cvalue[0] == '\0' ) {
+					fprintf( stderr, "compress: option value expected\n" );
+					usage();
+				}
+				compress_method = ber_strdup( cvalue );
+
 			} else if ( ldap_pvt_conf_option( control, cvalue, 1 ) ) {
 				fprintf( stderr, "Invalid general option name: %s\n",
 					control );
@@ -1646,6 +1659,14 @@ tool_bind( LDAP *ld )
 
 		if ( err != LDAP_SUCCESS ) tool_exit( ld, err );
 	}
+
+	if ( compress_method ) {
+		rc = ldap_start_compress_s( ld, compress_method, NULL, NULL );
+		if ( rc != LDAP_SUCCESS ) {
+			tool_perror( "ldap_start_compress", rc, NULL, NULL, NULL, NULL );
+			tool_exit( ld, rc );
+		}
+	}
 }
 
 void
@@ -147,14 +147,28 @@ typedef struct lber_memory_fns {
 /* Only meaningful ifdef LDAP_PF_LOCAL_SENDMSG */
 #define LBER_SB_OPT_UNGET_BUF	15
 
+/* Fill in a BerCompressStats, for ber_sockbuf_io_deflate */
+#define LBER_SB_OPT_GET_COMPRESS_STATS	16
+
 /* Largest option used by the library */
-#define LBER_SB_OPT_OPT_MAX		15
+#define LBER_SB_OPT_OPT_MAX		16
 
 /* LBER IO operations stacking levels */
 #define LBER_SBIOD_LEVEL_PROVIDER	10
 #define LBER_SBIOD_LEVEL_TRANSPORT	20
 #define LBER_SBIOD_LEVEL_APPLICATION	30
 
+/* Compression sits above any SASL security layer */
+#define LBER_SBIOD_LEVEL_COMPRESS	(LBER_SBIOD_LEVEL_APPLICATION + 5)
+
+typedef struct lber_compress_stats {
+	unsigned long	bcs_raw_in;		/* bytes passed up after inflating */
+	unsigned long	bcs_wire_in;	/* compressed bytes read */
+	unsigned long	bcs_raw_out;	/* bytes handed down for deflating */
+	unsigned long	bcs_wire_out;	/* compressed bytes written */
+	unsigned long	bcs_usec;		/* time spent in the compressor */
+} BerCompressStats;
+
 /* get/set options for Sockbuf */
 #define LBER_OPT_SOCKBUF_DESC		0x1000
 #define LBER_OPT_SOCKBUF_OPTIONS	0x1001
@@ -591,6 +605,7 @@ LBER_V( Sockbuf_IO ) ber_sockbuf_io_readahead;
 LBER_V( Sockbuf_IO ) ber_sockbuf_io_fd;
 LBER_V( Sockbuf_IO ) ber_sockbuf_io_debug;
 LBER_V( Sockbuf_IO ) ber_sockbuf_io_udp;
+LBER_V( Sockbuf_IO ) ber_sockbuf_io_deflate;
 
 /*
  * LBER memory.c
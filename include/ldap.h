@@ -164,6 +164,8 @@ LDAP_BEGIN_DECL
 #define LDAP_OPT_X_TLS_PEERKEY_HASH	0x6019
 #define LDAP_OPT_X_TLS_REQUIRE_SAN	0x601a
 #define LDAP_OPT_X_TLS_PROTOCOL_MAX	0x601b
+#define LDAP_OPT_X_TLS_TICKET_LIFETIME	0x601c
+#define LDAP_OPT_X_TLS_KTLS			0x601d
 
 #define LDAP_OPT_X_TLS_NEVER	0
 #define LDAP_OPT_X_TLS_HARD		1
@@ -433,6 +435,10 @@ typedef struct ldapcontrol {
 #define LDAP_EXOP_WHO_AM_I		"1.3.6.1.4.1.4203.1.11.3"		/* RFC 4532 */
 #define LDAP_EXOP_X_WHO_AM_I	LDAP_EXOP_WHO_AM_I
 
+/* Start Compression - experimental */
+#define LDAP_EXOP_X_START_COMPRESS	"1.3.6.1.4.1.4203.666.6.6"
+#define LDAP_COMPRESS_DEFLATE	"deflate"
+
 /* various works in progress */
 #define LDAP_EXOP_TURN		"1.3.6.1.1.19"				/* RFC 4531 */
 #define LDAP_EXOP_X_TURN	LDAP_EXOP_TURN
@@ -2343,6 +2349,30 @@ ldap_whoami_s LDAP_P((
 	LDAPControl **sctrls,
 	LDAPControl **cctrls ));
 
+/*
+ * LDAP Start Compression
+ *	in compress.c
+ */
+LDAP_F( int )
+ldap_start_compress LDAP_P((
+	LDAP *ld,
+	const char *method,
+	LDAPControl **sctrls,
+	LDAPControl **cctrls,
+	int *msgidp ));
+
+LDAP_F( int )
+ldap_install_compress LDAP_P((
+	LDAP *ld,
+	const char *method ));
+
+LDAP_F( int )
+ldap_start_compress_s LDAP_P((
+	LDAP *ld,
+	const char *method,
+	LDAPControl **sctrls,
+	LDAPControl **cctrls ));
+
 /*
  * LDAP Password Modify
  *	in passwd.c
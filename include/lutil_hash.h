@@ -71,6 +71,35 @@ lutil_HASH64Final LDAP_P((
 	unsigned char digest[LUTIL_HASH64_BYTES],
 	lutil_HASH_CTX *context));
 
+LDAP_LUTIL_F( unsigned long long )
+lutil_wyhash64 LDAP_P((
+	unsigned char const *buf,
+	ber_len_t len,
+	unsigned long long seed));
+
+LDAP_LUTIL_F( void )
+lutil_WYHASHInit LDAP_P((
+	lutil_HASH_CTX *context));
+
+LDAP_LUTIL_F( void )
+lutil_WYHASHUpdate LDAP_P((
+	lutil_HASH_CTX *context,
+	unsigned char const *buf,
+	ber_len_t len));
+
+LDAP_LUTIL_F( void )
+lutil_WYHASHFinal LDAP_P((
+	unsigned char digest[LUTIL_HASH64_BYTES],
+	lutil_HASH_CTX *context));
+
+LDAP_LUTIL_F( void )
+lutil_WYHASHWindows LDAP_P((
+	lutil_HASH_CTX *context,
+	unsigned char const *buf,
+	ber_len_t len,
+	ber_len_t wlen,
+	unsigned char *digests));
+
 #endif /* HAVE_LONG_LONG */
 
 LDAP_END_DECL
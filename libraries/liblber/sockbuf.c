@@ -24,6 +24,7 @@
 #include <ac/errno.h>
 #include <ac/socket.h>
 #include <ac/string.h>
+#include <ac/time.h>
 #include <ac/unistd.h>
 
 #ifdef HAVE_IO_H
@@ -881,6 +882,304 @@ Sockbuf_IO ber_sockbuf_io_debug = {
 	NULL				/* sbi_close */
 };
 
+/*
+ * Support for deflate compressed sessions
+ *
+ * Each direction is a single zlib stream that is flushed with
+ * Z_SYNC_FLUSH after every write, so the peer can decode a PDU as soon
+ * as all of it has arrived. Partial writes are handled the same way as
+ * in the SASL layer: the compressed data stays buffered and the caller
+ * is only told its plaintext was consumed once all of it has gone out.
+ * The optional argument points to an int holding the zlib level.
+ */
+
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+
+struct sb_deflate_data {
+	z_stream		sd_in;
+	z_stream		sd_out;
+	Sockbuf_Buf		sd_buf_in;	/* compressed data read from below */
+	Sockbuf_Buf		sd_buf_out;	/* compressed data not written yet */
+	ber_len_t		sd_partial;	/* plaintext behind sd_buf_out */
+	int				sd_more;	/* inflate may have more output */
+	BerCompressStats	sd_stats;
+};
+
+static unsigned long
+sb_deflate_clock( void )
+{
+#if defined( HAVE_CLOCK_GETTIME ) && defined( CLOCK_THREAD_CPUTIME_ID )
+	struct timespec ts;
+
+	clock_gettime( CLOCK_THREAD_CPUTIME_ID, &ts );
+	return ts.tv_sec * 1000000UL + ts.tv_nsec / 1000;
+#else
+	struct timeval tv;
+
+	gettimeofday( &tv, NULL );
+	return tv.tv_sec * 1000000UL + tv.tv_usec;
+#endif
+}
+
+static int
+sb_deflate_remove( Sockbuf_IO_Desc *sbiod )
+{
+	struct sb_deflate_data	*p;
+
+	assert( sbiod != NULL );
+
+	p = (struct sb_deflate_data *)sbiod->sbiod_pvt;
+	if ( p == NULL )
+		return 0;
+
+	deflateEnd( &p->sd_out );
+	inflateEnd( &p->sd_in );
+	ber_pvt_sb_buf_destroy( &p->sd_buf_in );
+	ber_pvt_sb_buf_destroy( &p->sd_buf_out );
+	LBER_FREE( p );
+	sbiod->sbiod_pvt = NULL;
+	return 0;
+}
+
+static int
+sb_deflate_setup( Sockbuf_IO_Desc *sbiod, void *arg )
+{
+	struct sb_deflate_data	*p;
+	int level = arg ? *(int *)arg : Z_DEFAULT_COMPRESSION;
+
+	assert( sbiod != NULL );
+
+	p = LBER_CALLOC( 1, sizeof( *p ) );
+	if ( p == NULL )
+		return -1;
+	ber_pvt_sb_buf_init( &p->sd_buf_in );
+	ber_pvt_sb_buf_init( &p->sd_buf_out );
+
+	if ( deflateInit( &p->sd_out, level ) != Z_OK ) {
+		LBER_FREE( p );
+		sock_errset(EINVAL);
+		return -1;
+	}
+	if ( inflateInit( &p->sd_in ) != Z_OK ) {
+		deflateEnd( &p->sd_out );
+		LBER_FREE( p );
+		sock_errset(ENOMEM);
+		return -1;
+	}
+	sbiod->sbiod_pvt = p;
+
+	if ( ber_pvt_sb_grow_buffer( &p->sd_buf_in, LBER_MIN_BUFF_SIZE ) < 0 ) {
+		sb_deflate_remove( sbiod );
+		sock_errset(ENOMEM);
+		return -1;
+	}
+	return 0;
+}
+
+static int
+sb_deflate_ctrl( Sockbuf_IO_Desc *sbiod, int opt, void *arg )
+{
+	struct sb_deflate_data	*p;
+
+	p = (struct sb_deflate_data *)sbiod->sbiod_pvt;
+
+	if ( opt == LBER_SB_OPT_DATA_READY ) {
+		if ( p->sd_more || p->sd_in.avail_in ) return 1;
+
+	} else if ( opt == LBER_SB_OPT_GET_COMPRESS_STATS ) {
+		*(BerCompressStats *)arg = p->sd_stats;
+		return 1;
+	}
+
+	return LBER_SBIOD_CTRL_NEXT( sbiod, opt, arg );
+}
+
+static ber_slen_t
+sb_deflate_read( Sockbuf_IO_Desc *sbiod, void *buf, ber_len_t len )
+{
+	struct sb_deflate_data	*p;
+	z_stream		*z;
+	unsigned long	start;
+	ber_slen_t		ret;
+	int				rc, fresh = 0;
+
+	assert( sbiod != NULL );
+	assert( SOCKBUF_VALID( sbiod->sbiod_sb ) );
+
+	p = (struct sb_deflate_data *)sbiod->sbiod_pvt;
+	z = &p->sd_in;
+
+	for (;;) {
+		if ( !p->sd_more && z->avail_in == 0 ) {
+			ret = LBER_SBIOD_READ_NEXT( sbiod, p->sd_buf_in.buf_base,
+				p->sd_buf_in.buf_size );
+#ifdef EINTR
+			if ( ( ret < 0 ) && ( errno == EINTR ) )
+				continue;
+#endif
+			if ( ret <= 0 )
+				return ret;
+			p->sd_stats.bcs_wire_in += ret;
+			z->next_in = (Bytef *)p->sd_buf_in.buf_base;
+			z->avail_in = ret;
+			fresh = 1;
+		}
+
+		z->next_out = buf;
+		z->avail_out = len;
+		start = sb_deflate_clock();
+		rc = inflate( z, Z_SYNC_FLUSH );
+		p->sd_stats.bcs_usec += sb_deflate_clock() - start;
+
+		ret = len - z->avail_out;
+		p->sd_more = ( z->avail_out == 0 );
+		if ( ret > 0 ) {
+			p->sd_stats.bcs_raw_in += ret;
+			return ret;
+		}
+
+		/* nothing came out, only more input can help */
+		if ( ( rc != Z_OK && rc != Z_BUF_ERROR ) || z->avail_in ) {
+			ber_log_printf( LDAP_DEBUG_ANY, sbiod->sbiod_sb->sb_debug,
+				"sb_deflate_read: inflate failed (%d)\n", rc );
+			sock_errset(EIO);
+			return -1;
+		}
+
+		/* the last read filled the caller's buffer exactly and there
+		 * was nothing behind it: we claimed data was ready, so don't
+		 * go and block on a socket the caller never polled */
+		if ( !fresh ) {
+			sock_errset(EWOULDBLOCK);
+			return -1;
+		}
+	}
+}
+
+static ber_slen_t
+sb_deflate_write( Sockbuf_IO_Desc *sbiod, void *buf, ber_len_t len )
+{
+	struct sb_deflate_data	*p;
+	Sockbuf_Buf		*out;
+	z_stream		*z;
+	unsigned long	start;
+	ber_slen_t		ret;
+	int				rc;
+
+	assert( sbiod != NULL );
+	assert( SOCKBUF_VALID( sbiod->sbiod_sb ) );
+
+	p = (struct sb_deflate_data *)sbiod->sbiod_pvt;
+	out = &p->sd_buf_out;
+	z = &p->sd_out;
+
+	/* Is there anything left in the buffer? */
+	if ( out->buf_ptr != out->buf_end ) {
+		ret = ber_pvt_sb_do_write( sbiod, out );
+		if ( ret < 0 ) return ret;
+
+		/* Still have something left?? */
+		if ( out->buf_ptr != out->buf_end ) {
+			sock_errset(EAGAIN);
+			return -1;
+		}
+	}
+
+	/* If we're just retrying a partial write, tell the
+	 * caller it's done. Let them call again if there's
+	 * still more left to write.
+	 */
+	if ( p->sd_partial ) {
+		ret = p->sd_partial;
+		p->sd_partial = 0;
+		return ret;
+	}
+
+	out->buf_ptr = out->buf_end = 0;
+	z->next_in = buf;
+	z->avail_in = len;
+	start = sb_deflate_clock();
+	do {
+		if ( out->buf_size - out->buf_end < 64 &&
+			ber_pvt_sb_grow_buffer( out, out->buf_end + len + 64 ) < 0 )
+		{
+			sock_errset(ENOMEM);
+			return -1;
+		}
+		z->next_out = (Bytef *)out->buf_base + out->buf_end;
+		z->avail_out = out->buf_size - out->buf_end;
+		rc = deflate( z, Z_SYNC_FLUSH );
+		out->buf_end = out->buf_size - z->avail_out;
+	} while ( rc == Z_OK && z->avail_out == 0 );
+	p->sd_stats.bcs_usec += sb_deflate_clock() - start;
+
+	if ( rc != Z_OK && rc != Z_BUF_ERROR ) {
+		ber_log_printf( LDAP_DEBUG_ANY, sbiod->sbiod_sb->sb_debug,
+			"sb_deflate_write: deflate failed (%d)\n", rc );
+		sock_errset(EIO);
+		return -1;
+	}
+	p->sd_stats.bcs_raw_out += len;
+	p->sd_stats.bcs_wire_out += out->buf_end;
+
+	ret = ber_pvt_sb_do_write( sbiod, out );
+
+	if ( ret < 0 ) {
+		/* error? */
+		int err = sock_errno();
+		/* caller can retry this */
+		if ( err == EAGAIN || err == EWOULDBLOCK || err == EINTR )
+			p->sd_partial = len;
+		return ret;
+	} else if ( out->buf_ptr != out->buf_end ) {
+		/* partial write? pretend nothing got written */
+		p->sd_partial = len;
+		sock_errset(EAGAIN);
+		return -1;
+	}
+
+	/* return number of bytes compressed, not written, to ensure
+	 * no byte is compressed twice (even if only sent once).
+	 */
+	return len;
+}
+
+Sockbuf_IO ber_sockbuf_io_deflate = {
+	sb_deflate_setup,	/* sbi_setup */
+	sb_deflate_remove,	/* sbi_remove */
+	sb_deflate_ctrl,	/* sbi_ctrl */
+	sb_deflate_read,	/* sbi_read */
+	sb_deflate_write,	/* sbi_write */
+	NULL				/* sbi_close */
+};
+
+#else /* ! HAVE_ZLIB */
+
+static int
+sb_deflate_setup( Sockbuf_IO_Desc *sbiod, void *arg )
+{
+	sock_errset(ENOSYS);
+	return -1;
+}
+
+static int
+sb_deflate_ctrl( Sockbuf_IO_Desc *sbiod, int opt, void *arg )
+{
+	return LBER_SBIOD_CTRL_NEXT( sbiod, opt, arg );
+}
+
+Sockbuf_IO ber_sockbuf_io_deflate = {
+	sb_deflate_setup,	/* sbi_setup */
+	NULL,				/* sbi_remove */
+	sb_deflate_ctrl,	/* sbi_ctrl */
+	NULL,				/* sbi_read */
+	NULL,				/* sbi_write */
+	NULL				/* sbi_close */
+};
+
+#endif /* HAVE_ZLIB */
+
 #ifdef LDAP_CONNECTIONLESS
 
 /*
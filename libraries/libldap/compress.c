@@ -0,0 +1,127 @@
+/* $OpenLDAP$ */
+/* This work is part of OpenLDAP Software <http://www.openldap.org/>.
+ *
+ * Copyright 1998-2022 The OpenLDAP Foundation.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted only as authorized by the OpenLDAP
+ * Public License.
+ *
+ * A copy of this license is available in the file LICENSE in the
+ * top-level directory of the distribution or, alternatively, at
+ * <http://www.OpenLDAP.org/license.html>.
+ */
+
+#include "portable.h"
+
+#include <stdio.h>
+#include <ac/stdlib.h>
+#include <ac/string.h>
+#include <ac/time.h>
+
+#include "ldap-int.h"
+
+/*
+ * LDAP Start Compression (Extended) Operation (experimental)
+ *
+ * The request value names the compression method. Once the server
+ * has returned success, everything after the response is compressed
+ * in both directions until the connection is closed.
+ */
+
+int
+ldap_start_compress(
+	LDAP *ld,
+	const char *method,
+	LDAPControl **sctrls,
+	LDAPControl **cctrls,
+	int *msgidp )
+{
+	struct berval bv;
+
+	assert( ld != NULL );
+	assert( LDAP_VALID( ld ) );
+	assert( method != NULL );
+	assert( msgidp != NULL );
+
+	ber_str2bv( method, 0, 0, &bv );
+	return ldap_extended_operation( ld, LDAP_EXOP_X_START_COMPRESS,
+		&bv, sctrls, cctrls, msgidp );
+}
+
+int
+ldap_install_compress( LDAP *ld, const char *method )
+{
+	Sockbuf *sb;
+
+	assert( ld != NULL );
+	assert( LDAP_VALID( ld ) );
+
+	if ( strcasecmp( method, LDAP_COMPRESS_DEFLATE ) != 0 ) {
+		return LDAP_NOT_SUPPORTED;
+	}
+	if ( ld->ld_defconn == NULL ) {
+		return LDAP_SERVER_DOWN;
+	}
+
+	sb = ld->ld_defconn->lconn_sb;
+	if ( ber_sockbuf_ctrl( sb, LBER_SB_OPT_HAS_IO, &ber_sockbuf_io_deflate ) ) {
+		return LDAP_LOCAL_ERROR;
+	}
+	if ( ber_sockbuf_add_io( sb, &ber_sockbuf_io_deflate,
+		LBER_SBIOD_LEVEL_COMPRESS, NULL ) < 0 )
+	{
+		ber_sockbuf_remove_io( sb, &ber_sockbuf_io_deflate,
+			LBER_SBIOD_LEVEL_COMPRESS );
+		return LDAP_NOT_SUPPORTED;
+	}
+
+	return LDAP_SUCCESS;
+}
+
+int
+ldap_start_compress_s(
+	LDAP *ld,
+	const char *method,
+	LDAPControl **sctrls,
+	LDAPControl **cctrls )
+{
+	int rc;
+#ifdef HAVE_ZLIB
+	char *rspoid = NULL;
+	struct berval bv, *rspdata = NULL;
+#endif
+
+	assert( ld != NULL );
+	assert( LDAP_VALID( ld ) );
+	assert( method != NULL );
+
+	/* only the default connection gets compressed */
+
+	if ( strcasecmp( method, LDAP_COMPRESS_DEFLATE ) != 0 ) {
+		return LDAP_NOT_SUPPORTED;
+	}
+#ifdef HAVE_ZLIB
+	ber_str2bv( method, 0, 0, &bv );
+	rc = ldap_extended_operation_s( ld, LDAP_EXOP_X_START_COMPRESS,
+		&bv, sctrls, cctrls, &rspoid, &rspdata );
+
+	if ( rspoid != NULL ) {
+		LDAP_FREE( rspoid );
+	}
+
+	if ( rspdata != NULL ) {
+		ber_bvfree( rspdata );
+	}
+
+	if ( rc == LDAP_SUCCESS ) {
+		rc = ldap_install_compress( ld, method );
+	}
+#else
+	/* don't let the server switch if we can't follow */
+	rc = LDAP_NOT_SUPPORTED;
+#endif
+
+	return rc;
+}
@@ -319,9 +319,11 @@ struct ldapoptions {
 	int			ldo_tls_impl;
    	int			ldo_tls_crlcheck;
 	int			ldo_tls_require_san;
+	int			ldo_tls_ticket_lifetime;
+	int			ldo_tls_ktls;
 	char		*ldo_tls_pin_hashalg;
 	struct berval	ldo_tls_pin;
-#define LDAP_LDO_TLS_NULLARG ,0,0,0,{0,0,0,0,0,0,0,0,0},0,0,0,0,0,0,{0,0}
+#define LDAP_LDO_TLS_NULLARG ,0,0,0,{0,0,0,0,0,0,0,0,0},0,0,0,0,0,0,0,0,{0,0}
 #else
 #define LDAP_LDO_TLS_NULLARG
 #endif
@@ -49,6 +49,7 @@ typedef int (TI_session_endpoint)(tls_session *sess, struct berval *buf, int is_
 typedef const char *(TI_session_name)(tls_session *s);
 typedef int (TI_session_peercert)(tls_session *s, struct berval *der);
 typedef int (TI_session_pinning)(LDAP *ld, tls_session *s, char *hashalg, struct berval *hash);
+typedef int (TI_session_flag)(tls_session *s);
 
 typedef void (TI_thr_init)(void);
 
@@ -78,6 +79,8 @@ typedef struct tls_impl {
 	TI_session_name *ti_session_cipher;
 	TI_session_peercert *ti_session_peercert;
 	TI_session_pinning *ti_session_pinning;
+	TI_session_flag *ti_session_resumed;
+	TI_session_flag *ti_session_ktls;
 
 	Sockbuf_IO *ti_sbio;
 
@@ -638,6 +638,32 @@ ldap_pvt_tls_config( LDAP *ld, int option, const char *arg )
 		}
 		return ldap_pvt_tls_set_option( ld, option, &i );
 		}
+	case LDAP_OPT_X_TLS_TICKET_LIFETIME: {
+		char *next;
+		long l;
+		l = strtol( arg, &next, 10 );
+		if ( l < 0 || l > INT_MAX || next == arg || *next != '\0' )
+			return -1;
+		i = l;
+		return ldap_pvt_tls_set_option( ld, option, &i );
+		}
+	case LDAP_OPT_X_TLS_KTLS:
+		i = -1;
+		if ( ( strcasecmp( arg, "on" ) == 0 ) ||
+			( strcasecmp( arg, "yes" ) == 0) ||
+			( strcasecmp( arg, "true" ) == 0 ) )
+		{
+			i = 1;
+		} else if ( ( strcasecmp( arg, "off" ) == 0 ) ||
+			( strcasecmp( arg, "no" ) == 0) ||
+			( strcasecmp( arg, "false" ) == 0 ) )
+		{
+			i = 0;
+		}
+		if (i >= 0) {
+			return ldap_pvt_tls_set_option( ld, option, &i );
+		}
+		return -1;
 #ifdef HAVE_OPENSSL
 	case LDAP_OPT_X_TLS_CRLCHECK:	/* OpenSSL only */
 		i = -1;
@@ -743,6 +769,12 @@ ldap_pvt_tls_get_option( LDAP *ld, int option, void *arg )
 	case LDAP_OPT_X_TLS_PROTOCOL_MAX:
 		*(int *)arg = lo->ldo_tls_protocol_max;
 		break;
+	case LDAP_OPT_X_TLS_TICKET_LIFETIME:
+		*(int *)arg = lo->ldo_tls_ticket_lifetime;
+		break;
+	case LDAP_OPT_X_TLS_KTLS:
+		*(int *)arg = lo->ldo_tls_ktls;
+		break;
 	case LDAP_OPT_X_TLS_RANDOM_FILE:
 		*(char **)arg = lo->ldo_tls_randfile ?
 			LDAP_STRDUP( lo->ldo_tls_randfile ) : NULL;
@@ -974,6 +1006,14 @@ ldap_pvt_tls_set_option( LDAP *ld, int option, void *arg )
 		if ( !arg ) return -1;
 		lo->ldo_tls_protocol_max = *(int *)arg;
 		return 0;
+	case LDAP_OPT_X_TLS_TICKET_LIFETIME:
+		if ( !arg || *(int *)arg < 0 ) return -1;
+		lo->ldo_tls_ticket_lifetime = *(int *)arg;
+		return 0;
+	case LDAP_OPT_X_TLS_KTLS:
+		if ( !arg ) return -1;
+		lo->ldo_tls_ktls = *(int *)arg ? 1 : 0;
+		return 0;
 	case LDAP_OPT_X_TLS_RANDOM_FILE:
 		if ( ld != NULL )
 			return -1;
@@ -1243,6 +1283,22 @@ ldap_pvt_tls_get_strength( void *s )
 	return tls_imp->ti_session_strength( session );
 }
 
+int
+ldap_pvt_tls_get_resumed( void *s )
+{
+	tls_session *session = s;
+
+	return tls_imp->ti_session_resumed( session );
+}
+
+int
+ldap_pvt_tls_get_ktls( void *s )
+{
+	tls_session *session = s;
+
+	return tls_imp->ti_session_ktls( session );
+}
+
 int
 ldap_pvt_tls_get_my_dn( void *s, struct berval *dn, LDAPDN_rewrite_dummy *func, unsigned flags )
 {
@@ -53,6 +53,8 @@ typedef struct tlsg_ctx {
 	int refcount;
 	int reqcert;
 	gnutls_priority_t prios;
+	gnutls_datum_t ticket_key;
+	int ticket_lifetime;
 #ifdef LDAP_R_COMPILE
 	ldap_pvt_thread_mutex_t ref_mutex;
 #endif
@@ -141,6 +143,10 @@ tlsg_ctx_free ( tls_ctx *ctx )
 	gnutls_certificate_free_credentials( c->cred );
 	if ( c->dh_params )
 		gnutls_dh_params_deinit( c->dh_params );
+	if ( c->ticket_key.data ) {
+		gnutls_memset( c->ticket_key.data, 0, c->ticket_key.size );
+		gnutls_free( c->ticket_key.data );
+	}
 	ber_memfree ( c );
 }
 
@@ -395,6 +401,17 @@ tlsg_ctx_init( struct ldapoptions *lo, struct ldaptls *lt, int is_server, char *
 
 	ctx->reqcert = lo->ldo_tls_require_cert;
 
+	/* GnuTLS derives the keys actually used from this one and replaces
+	 * them once they have been in use for the lifetime */
+	if ( is_server && lo->ldo_tls_ticket_lifetime ) {
+		rc = gnutls_session_ticket_key_generate( &ctx->ticket_key );
+		if ( rc ) {
+			strncpy( errmsg, gnutls_strerror( rc ), ERRBUFSIZE );
+			return -1;
+		}
+		ctx->ticket_lifetime = lo->ldo_tls_ticket_lifetime;
+	}
+
 	return 0;
 }
 
@@ -423,6 +440,12 @@ tlsg_session_new ( tls_ctx * ctx, int is_server )
 				flag = GNUTLS_CERT_REQUIRE;
 			gnutls_certificate_server_set_request( session->session, flag );
 		}
+		if ( c->ticket_key.data ) {
+			gnutls_session_ticket_enable_server( session->session,
+				&c->ticket_key );
+			gnutls_db_set_cache_expiration( session->session,
+				c->ticket_lifetime );
+		}
 	}
 	return (tls_session *)session;
 } 
@@ -793,6 +816,21 @@ tlsg_session_strength( tls_session *session )
 	return gnutls_cipher_get_key_size( c ) * 8;
 }
 
+static int
+tlsg_session_resumed( tls_session *session )
+{
+	tlsg_session *s = (tlsg_session *)session;
+
+	return gnutls_session_is_resumed( s->session );
+}
+
+static int
+tlsg_session_ktls( tls_session *session )
+{
+	/* Our transport functions stand between GnuTLS and the socket */
+	return 0;
+}
+
 static int
 tlsg_session_unique( tls_session *sess, struct berval *buf, int is_server)
 {
@@ -1263,6 +1301,8 @@ tls_impl ldap_int_tls_impl = {
 	tlsg_session_cipher,
 	tlsg_session_peercert,
 	tlsg_session_pinning,
+	tlsg_session_resumed,
+	tlsg_session_ktls,
 
 	&tlsg_sbio,
 
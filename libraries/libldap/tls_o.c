@@ -46,6 +46,9 @@
 #include <openssl/bn.h>
 #include <openssl/rsa.h>
 #include <openssl/dh.h>
+#if OPENSSL_VERSION_MAJOR >= 3
+#include <openssl/core_names.h>
+#endif
 #endif
 
 #if OPENSSL_VERSION_NUMBER >= 0x10100000
@@ -62,6 +65,48 @@ typedef SSL tlso_session;
 static BIO_METHOD * tlso_bio_method = NULL;
 static BIO_METHOD * tlso_bio_setup( void );
 
+#if OPENSSL_VERSION_MAJOR >= 3
+#define TLSO_TICKETS
+
+/*
+ * With a ticket lifetime set, a server context encrypts its session tickets
+ * under a key of its own that is replaced once it has been in use for the
+ * lifetime, the previous key is still accepted until then so that tickets
+ * issued just before the change can be used. A client context remembers the
+ * last session it got from each server and offers it when connecting there
+ * again. Either way the state is shared by all threads using the context.
+ */
+#define TLSO_TICKET_SESSIONS	32
+#define TLSO_TICKET_PEERLEN	(256 + INET6_ADDRSTRLEN + sizeof("/:65535"))
+
+typedef struct tlso_ticket_key {
+	unsigned char tk_name[16];
+	unsigned char tk_aes[32];
+	unsigned char tk_hmac[32];
+	time_t tk_created;
+} tlso_ticket_key;
+
+typedef struct tlso_ticket_state {
+	ldap_pvt_thread_mutex_t ts_mutex;
+	int ts_lifetime;
+	tlso_ticket_key ts_keys[2];	/* current and previous */
+	struct {
+		char *host;		/* name/address:port */
+		SSL_SESSION *session;
+	} ts_sessions[TLSO_TICKET_SESSIONS];
+	int ts_next;
+} tlso_ticket_state;
+
+static int tlso_ticket_idx = -1;
+
+static void tlso_ticket_free( void *parent, void *ptr, CRYPTO_EX_DATA *ad,
+	int idx, long argl, void *argp );
+static int tlso_ticket_key_cb( SSL *s, unsigned char key_name[16],
+	unsigned char *iv, EVP_CIPHER_CTX *cctx, EVP_MAC_CTX *hctx, int enc );
+static int tlso_ticket_new_cb( SSL *s, SSL_SESSION *sess );
+static int tlso_ticket_peer( SSL *s, const char *host, char *buf, size_t len );
+#endif
+
 static int  tlso_opt_trace = 1;
 
 static void tlso_report_error( char *errmsg );
@@ -233,6 +278,11 @@ tlso_init( void )
 
 	tlso_bio_method = tlso_bio_setup();
 
+#ifdef TLSO_TICKETS
+	tlso_ticket_idx = SSL_CTX_get_ex_new_index( 0, NULL, NULL, NULL,
+		tlso_ticket_free );
+#endif
+
 	return 0;
 }
 
@@ -641,6 +691,38 @@ tlso_ctx_init( struct ldapoptions *lo, struct ldaptls *lt, int is_server, char *
 	}
 	/* Explicitly honor the server side cipher suite preference */
 	SSL_CTX_set_options( ctx, SSL_OP_CIPHER_SERVER_PREFERENCE );
+
+	if ( lo->ldo_tls_ticket_lifetime ) {
+#ifdef TLSO_TICKETS
+		tlso_ticket_state *ts = LDAP_CALLOC( 1, sizeof(tlso_ticket_state) );
+
+		if ( ts == NULL ) return -1;
+		ldap_pvt_thread_mutex_init( &ts->ts_mutex );
+		ts->ts_lifetime = lo->ldo_tls_ticket_lifetime;
+		SSL_CTX_set_ex_data( ctx, tlso_ticket_idx, ts );
+
+		if ( is_server ) {
+			SSL_CTX_set_timeout( ctx, ts->ts_lifetime );
+			SSL_CTX_set_tlsext_ticket_key_evp_cb( ctx, tlso_ticket_key_cb );
+		} else {
+			SSL_CTX_set_session_cache_mode( ctx,
+				SSL_SESS_CACHE_CLIENT | SSL_SESS_CACHE_NO_INTERNAL_STORE );
+			SSL_CTX_sess_set_new_cb( ctx, tlso_ticket_new_cb );
+		}
+#else
+		Debug0( LDAP_DEBUG_ANY,
+			"TLS: session ticket lifetime needs OpenSSL 3.0 or later, ignored.\n" );
+#endif
+	}
+
+	if ( lo->ldo_tls_ktls ) {
+#ifdef SSL_OP_ENABLE_KTLS
+		SSL_CTX_set_options( ctx, SSL_OP_ENABLE_KTLS );
+#else
+		Debug0( LDAP_DEBUG_ANY,
+			"TLS: kernel TLS is not supported by this OpenSSL, ignored.\n" );
+#endif
+	}
 	return 0;
 }
 
@@ -663,6 +745,33 @@ tlso_session_connect( LDAP *ld, tls_session *sess, const char *name_in )
 		if ( !rc )		/* can fail to strdup the name */
 			return -1;
 	}
+#endif
+#ifdef TLSO_TICKETS
+	/* Only before the handshake starts, we are called again while it runs */
+	if ( SSL_in_before( s ) ) {
+		tlso_ticket_state *ts = SSL_CTX_get_ex_data( SSL_get_SSL_CTX( s ),
+			tlso_ticket_idx );
+		char peer[TLSO_TICKET_PEERLEN];
+
+		if ( ts && !tlso_ticket_peer( s, name_in, peer, sizeof(peer) ) ) {
+			time_t now = time( NULL );
+			int i;
+
+			LDAP_MUTEX_LOCK( &ts->ts_mutex );
+			for ( i = 0; i < TLSO_TICKET_SESSIONS; i++ ) {
+				SSL_SESSION *sess = ts->ts_sessions[i].session;
+
+				if ( !ts->ts_sessions[i].host ||
+						strcasecmp( ts->ts_sessions[i].host, peer ) )
+					continue;
+				if ( SSL_SESSION_is_resumable( sess ) &&
+						SSL_SESSION_get_time( sess ) + ts->ts_lifetime > now )
+					SSL_set_session( s, sess );
+				break;
+			}
+			LDAP_MUTEX_UNLOCK( &ts->ts_mutex );
+		}
+	}
 #endif
 	/* Caller expects 0 = success, OpenSSL returns 1 = success */
 	rc = SSL_connect( s ) - 1;
@@ -1033,6 +1142,26 @@ tlso_session_unique( tls_session *sess, struct berval *buf, int is_server)
 	return buf->bv_len;
 }
 
+static int
+tlso_session_resumed( tls_session *sess )
+{
+	tlso_session *s = (tlso_session *)sess;
+
+	return SSL_session_reused( s );
+}
+
+static int
+tlso_session_ktls( tls_session *sess )
+{
+#ifdef BIO_get_ktls_send
+	tlso_session *s = (tlso_session *)sess;
+
+	return BIO_get_ktls_send( SSL_get_wbio( s ) );
+#else
+	return 0;
+#endif
+}
+
 static int
 tlso_session_endpoint( tls_session *sess, struct berval *buf, int is_server )
 {
@@ -1335,6 +1464,27 @@ tlso_sb_setup( Sockbuf_IO_Desc *sbiod, void *arg )
 	
 	p->session = arg;
 	p->sbiod = sbiod;
+#ifdef SSL_OP_ENABLE_KTLS
+	/* OpenSSL can only hand the connection over to the kernel when it
+	 * talks to the socket itself, that is fine as long as nothing but
+	 * debug output sits between us and the plain TCP provider */
+	if ( SSL_get_options( p->session ) & SSL_OP_ENABLE_KTLS ) {
+		Sockbuf_IO_Desc *next = sbiod->sbiod_next;
+
+		while ( next && next->sbiod_io == &ber_sockbuf_io_debug )
+			next = next->sbiod_next;
+		if ( next && next->sbiod_io == &ber_sockbuf_io_tcp ) {
+			bio = BIO_new_socket( sbiod->sbiod_sb->sb_fd, BIO_NOCLOSE );
+			if ( bio == NULL ) {
+				LBER_FREE( p );
+				return -1;
+			}
+			SSL_set_bio( p->session, bio, bio );
+			sbiod->sbiod_pvt = p;
+			return 0;
+		}
+	}
+#endif
 	bio = BIO_new( tlso_bio_method );
 	BIO_set_data( bio, p );
 	SSL_set_bio( p->session, bio, bio );
@@ -1456,6 +1606,202 @@ static Sockbuf_IO tlso_sbio =
 	tlso_sb_close		/* sbi_close */
 };
 
+#ifdef TLSO_TICKETS
+static void
+tlso_ticket_free( void *parent, void *ptr, CRYPTO_EX_DATA *ad,
+	int idx, long argl, void *argp )
+{
+	tlso_ticket_state *ts = ptr;
+	int i;
+
+	if ( ts == NULL ) return;
+
+	for ( i = 0; i < TLSO_TICKET_SESSIONS; i++ ) {
+		if ( ts->ts_sessions[i].host ) {
+			LDAP_FREE( ts->ts_sessions[i].host );
+			SSL_SESSION_free( ts->ts_sessions[i].session );
+		}
+	}
+	OPENSSL_cleanse( ts->ts_keys, sizeof(ts->ts_keys) );
+	ldap_pvt_thread_mutex_destroy( &ts->ts_mutex );
+	LDAP_FREE( ts );
+}
+
+/*
+ * Encrypt new tickets under the current key, decrypt offered ones under
+ * whichever key they name. Returns 2 when a ticket under the previous key, or
+ * any TLSv1.3 ticket, is accepted, so that the client is given a new one.
+ */
+static int
+tlso_ticket_key_cb( SSL *s, unsigned char key_name[16],
+	unsigned char *iv, EVP_CIPHER_CTX *cctx, EVP_MAC_CTX *hctx, int enc )
+{
+	tlso_ticket_state *ts = SSL_CTX_get_ex_data( SSL_get_SSL_CTX( s ),
+		tlso_ticket_idx );
+	tlso_ticket_key key;
+	OSSL_PARAM params[3];
+	time_t now = time( NULL );
+	int rc = 1;
+
+	if ( ts == NULL ) return -1;
+
+	LDAP_MUTEX_LOCK( &ts->ts_mutex );
+	if ( now - ts->ts_keys[0].tk_created >= ts->ts_lifetime ) {
+		/* Nothing issued under a key this old can be valid anymore */
+		if ( now - ts->ts_keys[0].tk_created >= 2 * (time_t)ts->ts_lifetime ) {
+			OPENSSL_cleanse( &ts->ts_keys[0], sizeof(tlso_ticket_key) );
+		}
+		ts->ts_keys[1] = ts->ts_keys[0];
+		if ( RAND_bytes( ts->ts_keys[0].tk_name, sizeof(key.tk_name) ) <= 0 ||
+				RAND_bytes( ts->ts_keys[0].tk_aes, sizeof(key.tk_aes) ) <= 0 ||
+				RAND_bytes( ts->ts_keys[0].tk_hmac, sizeof(key.tk_hmac) ) <= 0 ) {
+			/* Do not leave a half made key behind */
+			ts->ts_keys[0] = ts->ts_keys[1];
+			LDAP_MUTEX_UNLOCK( &ts->ts_mutex );
+			return -1;
+		}
+		ts->ts_keys[0].tk_created = now;
+	}
+
+	if ( enc || !memcmp( key_name, ts->ts_keys[0].tk_name, sizeof(key.tk_name) ) ) {
+		key = ts->ts_keys[0];
+		/* TLSv1.3 clients use a ticket only once, give them another */
+		if ( !enc && SSL_version( s ) >= TLS1_3_VERSION )
+			rc = 2;
+	} else if ( ts->ts_keys[1].tk_created &&
+			!memcmp( key_name, ts->ts_keys[1].tk_name, sizeof(key.tk_name) ) ) {
+		key = ts->ts_keys[1];
+		rc = 2;
+	} else {
+		/* Unknown or retired key, do a full handshake */
+		LDAP_MUTEX_UNLOCK( &ts->ts_mutex );
+		return 0;
+	}
+	LDAP_MUTEX_UNLOCK( &ts->ts_mutex );
+
+	if ( enc ) {
+		memcpy( key_name, key.tk_name, sizeof(key.tk_name) );
+		if ( RAND_bytes( iv, EVP_CIPHER_get_iv_length( EVP_aes_256_cbc() ) ) <= 0 ||
+				!EVP_EncryptInit_ex( cctx, EVP_aes_256_cbc(), NULL, key.tk_aes, iv ) )
+			rc = -1;
+	} else if ( !EVP_DecryptInit_ex( cctx, EVP_aes_256_cbc(), NULL, key.tk_aes, iv ) ) {
+		rc = -1;
+	}
+
+	params[0] = OSSL_PARAM_construct_octet_string( OSSL_MAC_PARAM_KEY,
+		key.tk_hmac, sizeof(key.tk_hmac) );
+	params[1] = OSSL_PARAM_construct_utf8_string( OSSL_MAC_PARAM_DIGEST,
+		"sha256", 0 );
+	params[2] = OSSL_PARAM_construct_end();
+	if ( rc > 0 && !EVP_MAC_CTX_set_params( hctx, params ) )
+		rc = -1;
+
+	OPENSSL_cleanse( &key, sizeof(key) );
+	return rc;
+}
+
+/*
+ * Identify the server by the name we asked for, if any, and the address and
+ * port we are connected to. Returns 0 with buf set to "name/address:port".
+ */
+static int
+tlso_ticket_peer( SSL *s, const char *host, char *buf, size_t len )
+{
+	BIO *bio = SSL_get_rbio( s );
+	struct sockaddr_storage sa;
+	socklen_t salen = sizeof(sa);
+	char addr[INET6_ADDRSTRLEN];
+	ber_socket_t fd;
+	int port;
+
+	if ( bio == NULL )
+		return -1;
+
+	if ( BIO_method_type( bio ) == BIO_TYPE_SOCKET ) {
+		fd = BIO_get_fd( bio, NULL );
+	} else {
+		struct tls_data *p = (struct tls_data *)BIO_get_data( bio );
+
+		if ( p == NULL )
+			return -1;
+		fd = p->sbiod->sbiod_sb->sb_fd;
+	}
+
+	if ( getpeername( fd, (struct sockaddr *)&sa, &salen ) < 0 )
+		return -1;
+	switch ( sa.ss_family ) {
+#ifdef LDAP_PF_INET6
+	case AF_INET6: {
+		struct sockaddr_in6 *sin6 = (struct sockaddr_in6 *)&sa;
+
+		if ( !inet_ntop( AF_INET6, &sin6->sin6_addr, addr, sizeof(addr) ) )
+			return -1;
+		port = ntohs( sin6->sin6_port );
+		} break;
+#endif
+	case AF_INET: {
+		struct sockaddr_in *sin = (struct sockaddr_in *)&sa;
+
+		if ( !inet_ntop( AF_INET, &sin->sin_addr, addr, sizeof(addr) ) )
+			return -1;
+		port = ntohs( sin->sin_port );
+		} break;
+	default:
+		return -1;
+	}
+
+	if ( snprintf( buf, len, "%s/%s:%d", host ? host : "", addr, port ) >= len )
+		return -1;
+	return 0;
+}
+
+/*
+ * Keep the newest session for each server we connect to, replacing the
+ * oldest entry when there is no room left.
+ */
+static int
+tlso_ticket_new_cb( SSL *s, SSL_SESSION *sess )
+{
+	tlso_ticket_state *ts = SSL_CTX_get_ex_data( SSL_get_SSL_CTX( s ),
+		tlso_ticket_idx );
+	char host[TLSO_TICKET_PEERLEN];
+	int i;
+
+	if ( ts == NULL || !SSL_SESSION_is_resumable( sess ) ||
+			tlso_ticket_peer( s, SSL_get_servername( s,
+				TLSEXT_NAMETYPE_host_name ), host, sizeof(host) ) )
+		return 0;
+
+	LDAP_MUTEX_LOCK( &ts->ts_mutex );
+	for ( i = 0; i < TLSO_TICKET_SESSIONS; i++ ) {
+		if ( ts->ts_sessions[i].host &&
+				!strcasecmp( ts->ts_sessions[i].host, host ) )
+			break;
+	}
+	if ( i == TLSO_TICKET_SESSIONS ) {
+		char *copy = LDAP_STRDUP( host );
+
+		if ( copy == NULL ) {
+			LDAP_MUTEX_UNLOCK( &ts->ts_mutex );
+			return 0;
+		}
+		i = ts->ts_next;
+		ts->ts_next = ( ts->ts_next + 1 ) % TLSO_TICKET_SESSIONS;
+		if ( ts->ts_sessions[i].host ) {
+			LDAP_FREE( ts->ts_sessions[i].host );
+			SSL_SESSION_free( ts->ts_sessions[i].session );
+		}
+		ts->ts_sessions[i].host = copy;
+	} else {
+		SSL_SESSION_free( ts->ts_sessions[i].session );
+	}
+	/* Returning 1 hands our reference over */
+	ts->ts_sessions[i].session = sess;
+	LDAP_MUTEX_UNLOCK( &ts->ts_mutex );
+	return 1;
+}
+#endif /* TLSO_TICKETS */
+
 /* Derived from openssl/apps/s_cb.c */
 static void
 tlso_info_cb( const SSL *ssl, int where, int ret )
@@ -1713,6 +2059,8 @@ tls_impl ldap_int_tls_impl = {
 	tlso_session_cipher,
 	tlso_session_peercert,
 	tlso_session_pinning,
+	tlso_session_resumed,
+	tlso_session_ktls,
 
 	&tlso_sbio,
 
@@ -102,6 +102,107 @@ void ucstr2upper(
 	}
 }
 
+/*
+ * Word-at-a-time helpers for the ASCII runs that make up most
+ * directory data.  Each word is tested for bytes with the high bit
+ * set; in an all-ASCII word the bytes in 'A'..'Z' are found without
+ * carries between bytes and get 0x20 added.
+ */
+#define	UC_ONES		(~0UL / 0xff)
+#define	UC_HIGHS	(UC_ONES * 0x80)
+
+#define	UC_WORD_FOLD(w) \
+	((w) | (((((w) + UC_ONES * (0x80 - 'A')) ^ \
+		((w) + UC_ONES * (0x7f - 'Z'))) & UC_HIGHS) >> 2))
+
+/* return the number of leading ASCII bytes of s */
+static int
+ucascii_span( const char *s, int len )
+{
+	unsigned long w;
+	int i = 0;
+
+	for ( ; i + (int)sizeof(w) <= len; i += sizeof(w) ) {
+		AC_MEMCPY( &w, s + i, sizeof(w) );
+		if ( w & UC_HIGHS ) {
+			break;
+		}
+	}
+	while ( i < len && LDAP_UTF8_ISASCII( s + i ) ) {
+		i++;
+	}
+	return i;
+}
+
+/* copy len ASCII bytes, optionally lowercasing them */
+static void
+ucascii_copy( char *out, const char *s, int len, unsigned casefold )
+{
+	unsigned long w;
+	int i = 0;
+
+	if ( !casefold ) {
+		AC_MEMCPY( out, s, len );
+		return;
+	}
+	for ( ; i + (int)sizeof(w) <= len; i += sizeof(w) ) {
+		AC_MEMCPY( &w, s + i, sizeof(w) );
+		w = UC_WORD_FOLD( w );
+		AC_MEMCPY( out + i, &w, sizeof(w) );
+	}
+	for ( ; i < len; i++ ) {
+		out[i] = TOLOWER( s[i] );
+	}
+}
+
+/*
+ * NFKC quick check: true if compatibility decomposition followed by
+ * canonical composition would return ucs unchanged.  That holds when
+ * all characters are starters that either do not decompose or only
+ * decompose canonically into something composing back to them, and
+ * no two neighbours compose.  Hangul syllables recompose to
+ * themselves, but conjoining jamo may not.  With decomp_only no
+ * character may decompose at all, as for approximate matching.
+ */
+static int
+ucnfkc_stable( const ac_uint4 *ucs, int len, int decomp_only )
+{
+	ac_uint4 num, knum, k, *decomp, *kdecomp, comp;
+	int i;
+
+	for ( i = 0; i < len; i++ ) {
+		if ( ucs[i] >= 0x1100 && ucs[i] < 0x1200 ) {
+			return 0;
+		}
+		if ( decomp_only && ucishangul( ucs[i] ) ) {
+			return 0;
+		}
+		if ( uccombining_class( ucs[i] ) != 0 ) {
+			return 0;
+		}
+		if ( uckdecomp( ucs[i], &knum, &kdecomp ) ) {
+			if ( decomp_only ||
+				!ucdecomp( ucs[i], &num, &decomp ) || num != knum ||
+				memcmp( decomp, kdecomp, num * sizeof(*decomp) ) ) {
+				return 0;
+			}
+			comp = decomp[0];
+			for ( k = 1; k < num; k++ ) {
+				if ( !uccomp( comp, decomp[k], &comp ) ) {
+					return 0;
+				}
+			}
+			if ( comp != ucs[i] ) {
+				return 0;
+			}
+		}
+		if ( i + 1 < len && uccomp( ucs[i], ucs[i+1], &comp ) ) {
+			return 0;
+		}
+	}
+	return 1;
+}
+
 struct berval * UTF8bvnormalize(
 	struct berval *bv,
 	struct berval *newbv,
@@ -142,55 +243,31 @@ struct berval * UTF8bvnormalize(
 	 */
 
 	/* finish off everything up to character before first non-ascii */
-	if ( LDAP_UTF8_ISASCII( s ) ) {
-		if ( casefold ) {
-			outsize = len + 7;
-			out = (char *) ber_memalloc_x( outsize, ctx );
-			if ( out == NULL ) {
-fail:
-				if ( didnewbv )
-					ber_memfree_x( newbv, ctx );
-				return NULL;
-			}
-			outpos = 0;
+	i = ucascii_span( s, len );
+	if ( i == len && !casefold ) {
+		return ber_str2bv_x( s, len, 1, newbv, ctx );
+	}
 
-			for ( i = 1; (i < len) && LDAP_UTF8_ISASCII(s + i); i++ ) {
-				out[outpos++] = TOLOWER( s[i-1] );
-			}
-			if ( i == len ) {
-				out[outpos++] = TOLOWER( s[len-1] );
-				out[outpos] = '\0';
-				newbv->bv_val = out;
-				newbv->bv_len = outpos;
-				return newbv;
-			}
-		} else {
-			for ( i = 1; (i < len) && LDAP_UTF8_ISASCII(s + i); i++ ) {
-				/* empty */
-			}
+	outsize = len + 7;
+	out = (char *) ber_memalloc_x( outsize, ctx );
+	if ( out == NULL ) {
+fail:
+		if ( didnewbv )
+			ber_memfree_x( newbv, ctx );
+		return NULL;
+	}
 
-			if ( i == len ) {
-				return ber_str2bv_x( s, len, 1, newbv, ctx );
-			}
-				
-			outsize = len + 7;
-			out = (char *) ber_memalloc_x( outsize, ctx );
-			if ( out == NULL ) {
-				goto fail;
-			}
-			outpos = i - 1;
-			memcpy(out, s, outpos);
-		}
-	} else {
-		outsize = len + 7;
-		out = (char *) ber_memalloc_x( outsize, ctx );
-		if ( out == NULL ) {
-			goto fail;
-		}
-		outpos = 0;
-		i = 0;
+	if ( i == len ) {
+		ucascii_copy( out, s, len, casefold );
+		out[len] = '\0';
+		newbv->bv_val = out;
+		newbv->bv_len = len;
+		return newbv;
 	}
 
+	outpos = i ? i - 1 : 0;
+	ucascii_copy( out, s, outpos, casefold );
+
 	p = ucs = ber_memalloc_x( len * sizeof(*ucs), ctx );
 	if ( ucs == NULL ) {
 		ber_memfree_x(out, ctx);
@@ -235,8 +312,16 @@ fail:
 			}
 			p++;
 		}
-		/* normalize ucs of length p - ucs */
-		uccompatdecomp( ucs, p - ucs, &ucsout, &ucsoutlen, ctx );
+		/* normalize ucs of length p - ucs, unless already normal */
+		if ( ucnfkc_stable( ucs, p - ucs, approx ) ) {
+			ucsout = ucs;
+			ucsoutlen = p - ucs;
+		} else {
+			uccompatdecomp( ucs, p - ucs, &ucsout, &ucsoutlen, ctx );
+			if ( !approx ) {
+				ucsoutlen = uccanoncomp( ucsout, ucsoutlen );
+			}
+		}
 		if ( approx ) {
 			for ( j = 0; j < ucsoutlen; j++ ) {
 				if ( ucsout[j] < 0x80 ) {
@@ -244,7 +329,6 @@ fail:
 				}
 			}
 		} else {
-			ucsoutlen = uccanoncomp( ucsout, ucsoutlen );
 			/* convert ucs to utf-8 and store in out */
 			for ( j = 0; j < ucsoutlen; j++ ) {
 				/* allocate more space if not enough room for
@@ -253,7 +337,8 @@ fail:
 					outsize = ucsoutlen - j + outpos + 6;
 					outtmp = (char *) ber_memrealloc_x( out, outsize, ctx );
 					if ( outtmp == NULL ) {
-						ber_memfree_x( ucsout, ctx );
+						if ( ucsout != ucs )
+							ber_memfree_x( ucsout, ctx );
 						ber_memfree_x( ucs, ctx );
 						ber_memfree_x( out, ctx );
 						goto fail;
@@ -264,7 +349,8 @@ fail:
 			}
 		}
 
-		ber_memfree_x( ucsout, ctx );
+		if ( ucsout != ucs )
+			ber_memfree_x( ucsout, ctx );
 		ucsout = NULL;
 		
 		if ( i == len ) {
@@ -287,13 +373,15 @@ fail:
 
 		/* s[i] is ascii */
 		/* finish off everything up to char before next non-ascii */
-		for ( i++; (i < len) && LDAP_UTF8_ISASCII(s + i); i++ ) {
-			out[outpos++] = casefold ? TOLOWER( s[i-1] ) : s[i-1];
-		}
-		if ( i == len ) {
-			out[outpos++] = casefold ? TOLOWER( s[len-1] ) : s[len-1];
+		j = ucascii_span( s + i, len - i );
+		if ( i + j == len ) {
+			ucascii_copy( &out[outpos], s + i, j, casefold );
+			outpos += j;
 			break;
 		}
+		ucascii_copy( &out[outpos], s + i, j - 1, casefold );
+		outpos += j - 1;
+		i += j;
 
 		/* convert character before next non-ascii to ucs-4 */
 		*ucs = casefold ? TOLOWER( s[i-1] ) : s[i-1];
@@ -342,6 +430,26 @@ int UTF8bvnormcmp(
 	s2 = bv2->bv_val;
 	done = s1 + len;
 
+	/* skip over equal ASCII words */
+	while ( done - s1 >= (int)sizeof(unsigned long) ) {
+		unsigned long w1, w2;
+
+		AC_MEMCPY( &w1, s1, sizeof(w1) );
+		AC_MEMCPY( &w2, s2, sizeof(w2) );
+		if ( (w1 | w2) & UC_HIGHS ) {
+			break;
+		}
+		if ( casefold ) {
+			w1 = UC_WORD_FOLD( w1 );
+			w2 = UC_WORD_FOLD( w2 );
+		}
+		if ( w1 != w2 ) {
+			break;
+		}
+		s1 += sizeof(w1);
+		s2 += sizeof(w2);
+	}
+
 	while ( (s1 < done) && LDAP_UTF8_ISASCII(s1) && LDAP_UTF8_ISASCII(s2) ) {
 		if (casefold) {
 			char c1 = TOLOWER(*s1);
@@ -410,7 +518,7 @@ int UTF8bvnormcmp(
 		len = LDAP_UTF8_CHARLEN( s1 + i );
 	}
 
-	if ( norm1 ) {
+	if ( norm1 || ucnfkc_stable( ucs, ulen, 0 ) ) {
 		ucsout1 = ucs;
 		l1 = ulen;
 		ucs = malloc( l2 * sizeof(*ucs) );
@@ -434,7 +542,7 @@ int UTF8bvnormcmp(
 		len = LDAP_UTF8_CHARLEN( s2 + i );
 	}
 
-	if ( norm2 ) {
+	if ( norm2 || ucnfkc_stable( ucs, ulen, 0 ) ) {
 		ucsout2 = ucs;
 		l2 = ulen;
 	} else {
@@ -17,6 +17,11 @@
 /* This implements the Fowler / Noll / Vo (FNV-1) hash algorithm.
  * A summary of the algorithm can be found at:
  *   http://www.isthe.com/chongo/tech/comp/fnv/index.html
+ *
+ * It also implements wyhash (final version 4), a seeded 64 bit hash
+ * that consumes its input a word at a time. wyhash is in the public
+ * domain; its reference implementation can be found at:
+ *   https://github.com/wangyi-fudan/wyhash
  */
 
 #include "portable.h"
@@ -138,4 +143,207 @@ lutil_HASH64Final( unsigned char *digest, lutil_HASH_CTX *ctx )
 	digest[6] = (h>>48) & 0xffU;
 	digest[7] = (h>>56) & 0xffU;
 }
+
+/* wyhash, seeded 64 bit hash.
+ *
+ * Input is always read as little-endian words so that the digests,
+ * which end up on disk as index keys, are identical on every platform.
+ */
+
+static const unsigned long long wy_secret[4] = {
+	0x2d358dccaa6c78a5ULL, 0x8bb84b93962eacc9ULL,
+	0x4b33a62ed433d4a3ULL, 0x4d5a2da51de1aa47ULL
+};
+
+/* 64x64 -> 128 bit multiply, low half in *A and high half in *B */
+static void
+wy_mum( unsigned long long *A, unsigned long long *B )
+{
+#ifdef __SIZEOF_INT128__
+	__uint128_t r = *A;
+	r *= *B;
+	*A = (unsigned long long)r;
+	*B = (unsigned long long)(r >> 64);
+#else
+	unsigned long long ha = *A >> 32, hb = *B >> 32,
+		la = *A & 0xffffffffULL, lb = *B & 0xffffffffULL, hi, lo;
+	unsigned long long rh = ha * hb, rm0 = ha * lb, rm1 = hb * la,
+		rl = la * lb, t = rl + (rm0 << 32), c = t < rl;
+
+	lo = t + (rm1 << 32);
+	c += lo < t;
+	hi = rh + (rm0 >> 32) + (rm1 >> 32) + c;
+	*A = lo;
+	*B = hi;
+#endif
+}
+
+static unsigned long long
+wy_mix( unsigned long long A, unsigned long long B )
+{
+	wy_mum( &A, &B );
+	return A ^ B;
+}
+
+static unsigned long long
+wy_r8( const unsigned char *p )
+{
+	return (unsigned long long)p[0] |
+		((unsigned long long)p[1] << 8) |
+		((unsigned long long)p[2] << 16) |
+		((unsigned long long)p[3] << 24) |
+		((unsigned long long)p[4] << 32) |
+		((unsigned long long)p[5] << 40) |
+		((unsigned long long)p[6] << 48) |
+		((unsigned long long)p[7] << 56);
+}
+
+static unsigned long long
+wy_r4( const unsigned char *p )
+{
+	return (unsigned long long)p[0] |
+		((unsigned long long)p[1] << 8) |
+		((unsigned long long)p[2] << 16) |
+		((unsigned long long)p[3] << 24);
+}
+
+/* Seed setup; it does not depend on the input and may be done once
+ * for any number of keys hashed with the same seed.
+ */
+static unsigned long long
+wy_seed( unsigned long long seed )
+{
+	return seed ^ wy_mix( seed ^ wy_secret[0], wy_secret[1] );
+}
+
+static unsigned long long
+wy_hash( const unsigned char *p, ber_len_t len, unsigned long long seed )
+{
+	unsigned long long a, b;
+
+	if ( len <= 16 ) {
+		if ( len >= 4 ) {
+			ber_len_t off = ( len >> 3 ) << 2;
+			a = ( wy_r4( p ) << 32 ) | wy_r4( p + off );
+			b = ( wy_r4( p + len - 4 ) << 32 ) | wy_r4( p + len - 4 - off );
+		} else if ( len > 0 ) {
+			a = ( (unsigned long long)p[0] << 16 ) |
+				( (unsigned long long)p[len >> 1] << 8 ) | p[len - 1];
+			b = 0;
+		} else {
+			a = b = 0;
+		}
+	} else {
+		ber_len_t i = len;
+
+		if ( i > 48 ) {
+			/* three independent lanes */
+			unsigned long long see1 = seed, see2 = seed;
+			do {
+				seed = wy_mix( wy_r8( p ) ^ wy_secret[1],
+					wy_r8( p + 8 ) ^ seed );
+				see1 = wy_mix( wy_r8( p + 16 ) ^ wy_secret[2],
+					wy_r8( p + 24 ) ^ see1 );
+				see2 = wy_mix( wy_r8( p + 32 ) ^ wy_secret[3],
+					wy_r8( p + 40 ) ^ see2 );
+				p += 48;
+				i -= 48;
+			} while ( i > 48 );
+			seed ^= see1 ^ see2;
+		}
+		while ( i > 16 ) {
+			seed = wy_mix( wy_r8( p ) ^ wy_secret[1], wy_r8( p + 8 ) ^ seed );
+			i -= 16;
+			p += 16;
+		}
+		a = wy_r8( p + i - 16 );
+		b = wy_r8( p + i - 8 );
+	}
+	a ^= wy_secret[1];
+	b ^= seed;
+	wy_mum( &a, &b );
+	return wy_mix( a ^ wy_secret[0] ^ len, b ^ wy_secret[1] );
+}
+
+static void
+wy_digest( unsigned char *digest, unsigned long long h )
+{
+	digest[0] = h & 0xffU;
+	digest[1] = (h>>8) & 0xffU;
+	digest[2] = (h>>16) & 0xffU;
+	digest[3] = (h>>24) & 0xffU;
+	digest[4] = (h>>32) & 0xffU;
+	digest[5] = (h>>40) & 0xffU;
+	digest[6] = (h>>48) & 0xffU;
+	digest[7] = (h>>56) & 0xffU;
+}
+
+/*
+ * One-shot hash of buf with the given seed
+ */
+unsigned long long
+lutil_wyhash64(
+    const unsigned char		*buf,
+    ber_len_t		len,
+    unsigned long long	seed )
+{
+	return wy_hash( buf, len, wy_seed( seed ));
+}
+
+/*
+ * Initialize context
+ */
+void
+lutil_WYHASHInit( lutil_HASH_CTX *ctx )
+{
+	ctx->hash64 = 0;
+}
+
+/*
+ * Update hash. Each update hashes buf seeded with the hash so far,
+ * so unlike FNV the result depends on how the input is split up.
+ */
+void
+lutil_WYHASHUpdate(
+    lutil_HASH_CTX	*ctx,
+    const unsigned char		*buf,
+    ber_len_t		len )
+{
+	ctx->hash64 = wy_hash( buf, len, wy_seed( ctx->hash64 ));
+}
+
+/*
+ * Save hash
+ */
+void
+lutil_WYHASHFinal( unsigned char *digest, lutil_HASH_CTX *ctx )
+{
+	wy_digest( digest, ctx->hash64 );
+}
+
+/*
+ * Hash every wlen byte window of buf, as if each had been passed to
+ * lutil_WYHASHUpdate on a copy of ctx followed by lutil_WYHASHFinal.
+ * The len - wlen + 1 digests are stored back to back in digests.
+ */
+void
+lutil_WYHASHWindows(
+    lutil_HASH_CTX	*ctx,
+    const unsigned char		*buf,
+    ber_len_t		len,
+    ber_len_t		wlen,
+    unsigned char	*digests )
+{
+	unsigned long long seed;
+	ber_len_t i;
+
+	if ( wlen > len )
+		return;
+
+	seed = wy_seed( ctx->hash64 );
+	for ( i = 0; i <= len - wlen; i++ ) {
+		wy_digest( digests, wy_hash( buf + i, wlen, seed ));
+		digests += LUTIL_HASH64_BYTES;
+	}
+}
 #endif /* HAVE_LONG_LONG */
@@ -299,7 +299,10 @@ try_upstream(
     CONNECTION_LOCK(c);
     if ( c->c_state == LLOAD_C_READY && !c->c_pendingber &&
             ( b->b_max_conn_pending == 0 ||
-                    c->c_n_ops_executing < b->b_max_conn_pending ) ) {
+                    c->c_n_ops_executing < b->b_max_conn_pending ) &&
+            ( lload_op_classes[op->o_class].max_pending == 0 ||
+                    c->c_n_ops_class[op->o_class] <
+                        lload_op_classes[op->o_class].max_pending ) ) {
         Debug( LDAP_DEBUG_CONNS, "try_upstream: "
                 "selected connection connid=%lu for client "
                 "connid=%lu msgid=%d\n",
@@ -323,6 +326,7 @@ try_upstream(
             b->b_counters[LLOAD_STATS_OPS_OTHER].lc_ops_received++;
         }
         c->c_n_ops_executing++;
+        c->c_n_ops_class[op->o_class]++;
         c->c_counters.lc_ops_received++;
 
         *res = LDAP_SUCCESS;
@@ -345,6 +349,7 @@ backend_select(
 {
     lload_c_head *head;
     LloadConnection *c;
+    int affinity = 0;
 
     assert_locked( &b->b_mutex );
     if ( b->b_max_pending && b->b_n_ops_executing >= b->b_max_pending ) {
@@ -373,7 +378,25 @@ backend_select(
     *res = LDAP_BUSY;
     *message = "server busy";
 
+    if ( (lload_features & LLOAD_FEATURE_AFFINITY) &&
+            lload_daemon_threads > 1 ) {
+        /* Prefer connections handled by the client's own I/O thread */
+        affinity = 1;
+        LDAP_CIRCLEQ_FOREACH( c, head, c_next ) {
+            if ( c->c_tid == op->o_client_tid &&
+                    try_upstream( b, head, op, c, res, message ) ) {
+                *cp = c;
+                CONNECTION_ASSERT_LOCKED(c);
+                assert_locked( &c->c_io_mutex );
+                return 1;
+            }
+        }
+    }
+
     LDAP_CIRCLEQ_FOREACH( c, head, c_next ) {
+        if ( affinity && c->c_tid == op->o_client_tid ) {
+            continue;
+        }
         if ( try_upstream( b, head, op, c, res, message ) ) {
             *cp = c;
             CONNECTION_ASSERT_LOCKED(c);
@@ -385,6 +408,172 @@ backend_select(
     return 1;
 }
 
+/*
+ * Queue an upstream connection to be considered by backend_select_ready, to
+ * be called with b_mutex held whenever it might have become able to take
+ * another operation. Operations waiting for a slot get another chance too.
+ */
+void
+backend_conn_ready( LloadBackend *b, LloadConnection *c )
+{
+    assert_locked( &b->b_mutex );
+
+    lload_queue_wakeup();
+
+    /* Once not alive, upstream_unlink might have dequeued it already */
+    if ( c->c_ready_queued || !IS_ALIVE( c, c_live ) ) {
+        return;
+    }
+    if ( c->c_type == LLOAD_C_BIND ) {
+        LDAP_TAILQ_INSERT_TAIL( &b->b_bindready, c, c_ready_next );
+    } else if ( c->c_type == LLOAD_C_OPEN ) {
+        LDAP_TAILQ_INSERT_TAIL( &b->b_ready, c, c_ready_next );
+    } else {
+        return;
+    }
+    c->c_ready_queued = 1;
+}
+
+void
+backend_conn_unready( LloadBackend *b, LloadConnection *c )
+{
+    assert_locked( &b->b_mutex );
+
+    if ( !c->c_ready_queued ) {
+        return;
+    }
+    if ( c->c_type == LLOAD_C_BIND ) {
+        LDAP_TAILQ_REMOVE( &b->b_bindready, c, c_ready_next );
+    } else {
+        LDAP_TAILQ_REMOVE( &b->b_ready, c, c_ready_next );
+    }
+    c->c_ready_queued = 0;
+}
+
+/*
+ * Try a connection just taken off the ready queue and put it back if it can
+ * take more operations. Returns 1 if it was selected (and is locked), -1 if it
+ * could not be used right now but stays queued and 0 if it has been dropped
+ * from the queue.
+ */
+static int
+backend_try_ready(
+        LloadBackend *b,
+        lload_r_head *ready,
+        LloadOperation *op,
+        LloadConnection *c,
+        int *res,
+        char **message )
+{
+    int usable;
+
+    if ( try_upstream( b, NULL, op, c, res, message ) ) {
+        if ( b->b_max_conn_pending == 0 ||
+                c->c_n_ops_executing < b->b_max_conn_pending ) {
+            LDAP_TAILQ_INSERT_TAIL( ready, c, c_ready_next );
+        } else {
+            c->c_ready_queued = 0;
+        }
+        CONNECTION_ASSERT_LOCKED(c);
+        assert_locked( &c->c_io_mutex );
+        return 1;
+    }
+
+    /* Only busy writing? Keep it around but don't try it again now */
+    CONNECTION_LOCK(c);
+    usable = c->c_state == LLOAD_C_READY &&
+            ( b->b_max_conn_pending == 0 ||
+                    c->c_n_ops_executing < b->b_max_conn_pending );
+    CONNECTION_UNLOCK(c);
+    if ( usable ) {
+        LDAP_TAILQ_INSERT_TAIL( ready, c, c_ready_next );
+        return -1;
+    }
+    c->c_ready_queued = 0;
+    return 0;
+}
+
+/*
+ * Like backend_select, but only consider the connections queued as ready
+ * rather than walking all of them. Connections that cannot take any more
+ * operations are dequeued until backend_conn_ready is called for them.
+ */
+int
+backend_select_ready(
+        LloadBackend *b,
+        LloadOperation *op,
+        LloadConnection **cp,
+        int *res,
+        char **message )
+{
+    lload_c_head *head;
+    lload_r_head *ready;
+    LloadConnection *c, *first = NULL;
+    int rc;
+
+    assert_locked( &b->b_mutex );
+    if ( b->b_max_pending && b->b_n_ops_executing >= b->b_max_pending ) {
+        Debug( LDAP_DEBUG_CONNS, "backend_select_ready: "
+                "backend %s too busy\n",
+                b->b_uri.bv_val );
+        *res = LDAP_BUSY;
+        *message = "server busy";
+        return 1;
+    }
+
+    if ( op->o_tag == LDAP_REQ_BIND
+#ifdef LDAP_API_FEATURE_VERIFY_CREDENTIALS
+            && !(lload_features & LLOAD_FEATURE_VC)
+#endif /* LDAP_API_FEATURE_VERIFY_CREDENTIALS */
+            ) {
+        head = &b->b_bindconns;
+        ready = &b->b_bindready;
+    } else {
+        head = &b->b_conns;
+        ready = &b->b_ready;
+    }
+
+    if ( LDAP_CIRCLEQ_EMPTY( head ) ) {
+        return 0;
+    }
+
+    *res = LDAP_BUSY;
+    *message = "server busy";
+
+    if ( (lload_features & LLOAD_FEATURE_AFFINITY) &&
+            lload_daemon_threads > 1 ) {
+        /* Prefer a connection handled by the client's own I/O thread */
+        LDAP_TAILQ_FOREACH ( c, ready, c_ready_next ) {
+            if ( c->c_tid == op->o_client_tid ) {
+                break;
+            }
+        }
+        if ( c ) {
+            LDAP_TAILQ_REMOVE( ready, c, c_ready_next );
+            rc = backend_try_ready( b, ready, op, c, res, message );
+            if ( rc > 0 ) {
+                *cp = c;
+                return 1;
+            } else if ( rc < 0 ) {
+                first = c;
+            }
+        }
+    }
+
+    while ( (c = LDAP_TAILQ_FIRST( ready )) && c != first ) {
+        LDAP_TAILQ_REMOVE( ready, c, c_ready_next );
+        rc = backend_try_ready( b, ready, op, c, res, message );
+        if ( rc > 0 ) {
+            *cp = c;
+            return 1;
+        } else if ( rc < 0 && !first ) {
+            first = c;
+        }
+    }
+
+    return 1;
+}
+
 int
 upstream_select(
         LloadOperation *op,
@@ -709,6 +898,8 @@ lload_backend_new( void )
     LDAP_CIRCLEQ_INIT( &b->b_conns );
     LDAP_CIRCLEQ_INIT( &b->b_bindconns );
     LDAP_CIRCLEQ_INIT( &b->b_preparing );
+    LDAP_TAILQ_INIT( &b->b_ready );
+    LDAP_TAILQ_INIT( &b->b_bindready );
     LDAP_CIRCLEQ_ENTRY_INIT( b, b_next );
 
     b->b_numconns = 1;
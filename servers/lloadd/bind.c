@@ -333,6 +333,31 @@ request_bind( LloadConnection *client, LloadOperation *op )
         goto fail;
     }
 
+    if ( tag == LDAP_AUTH_SIMPLE &&
+            lload_bind_cache_check( op, &binddn, &auth ) == LDAP_SUCCESS ) {
+        Debug( LDAP_DEBUG_STATS, "request_bind: "
+                "connid=%lu msgid=%d credentials verified from the cache\n",
+                op->o_client_connid, op->o_client_msgid );
+
+        client->c_state = LLOAD_C_READY;
+        client->c_type = LLOAD_C_OPEN;
+        if ( !ber_bvstrcasecmp( &client->c_auth, &lloadd_identity ) ) {
+            client->c_type = LLOAD_C_PRIVILEGED;
+        }
+        op->o_res = LLOAD_OP_COMPLETED;
+        CONNECTION_UNLOCK(client);
+
+        operation_send_reject( op, LDAP_SUCCESS, "", 1 );
+
+        /* terminate the upstream side if client abandoned a SASL bind */
+        if ( pin ) {
+            operation_abandon( op );
+        }
+
+        ber_free( copy, 0 );
+        return LDAP_SUCCESS;
+    }
+
     rc = ldap_tavl_insert( &client->c_ops, op, operation_client_cmp, ldap_avl_dup_error );
     assert( rc == LDAP_SUCCESS );
     client->c_n_ops_executing++;
@@ -397,10 +422,12 @@ request_bind( LloadConnection *client, LloadOperation *op )
             LloadBackend *b = upstream->c_backend;
 
             upstream->c_n_ops_executing--;
+            upstream->c_n_ops_class[op->o_class]--;
             CONNECTION_UNLOCK(upstream);
 
             checked_lock( &b->b_mutex );
             b->b_n_ops_executing--;
+            backend_conn_ready( b, upstream );
             operation_update_backend_counters( op, b );
             checked_unlock( &b->b_mutex );
         } else {
@@ -447,11 +474,13 @@ request_bind( LloadConnection *client, LloadOperation *op )
         LloadBackend *b = upstream->c_backend;
 
         upstream->c_n_ops_executing--;
+        upstream->c_n_ops_class[op->o_class]--;
         checked_unlock( &upstream->c_io_mutex );
         CONNECTION_UNLOCK(upstream);
 
         checked_lock( &b->b_mutex );
         b->b_n_ops_executing--;
+        backend_conn_ready( b, upstream );
         checked_unlock( &b->b_mutex );
 
         assert( !IS_ALIVE( client, c_live ) );
@@ -475,13 +504,21 @@ request_bind( LloadConnection *client, LloadOperation *op )
 
     Debug( LDAP_DEBUG_TRACE, "request_bind: "
             "added bind from client connid=%lu to upstream connid=%lu "
-            "as msgid=%d\n",
-            op->o_client_connid, op->o_upstream_connid, op->o_upstream_msgid );
+            "as msgid=%d, I/O thread %d to %d\n",
+            op->o_client_connid, op->o_upstream_connid, op->o_upstream_msgid,
+            op->o_client_tid, upstream->c_tid );
     if ( ldap_tavl_insert( &upstream->c_ops, op, operation_upstream_cmp,
                  ldap_avl_dup_error ) ) {
         assert(0);
     }
-    upstream->c_state = LLOAD_C_BINDING;
+#ifdef LDAP_API_FEATURE_VERIFY_CREDENTIALS
+    /* Verifying credentials does not change the connection's identity, other
+     * operations (and binds) can be pipelined on it in the meantime */
+    if ( !(lload_features & LLOAD_FEATURE_VC) )
+#endif /* LDAP_API_FEATURE_VERIFY_CREDENTIALS */
+    {
+        upstream->c_state = LLOAD_C_BINDING;
+    }
     CONNECTION_UNLOCK(upstream);
 
 #ifdef LDAP_API_FEATURE_VERIFY_CREDENTIALS
@@ -599,7 +636,7 @@ handle_bind_response(
     LloadOperation *removed;
     ber_int_t result;
     ber_tag_t tag;
-    int rc = LDAP_SUCCESS;
+    int rc = LDAP_SUCCESS, simple_finished = 0, has_ctrls = 0;
 
     if ( (copy = ber_alloc()) == NULL ) {
         rc = -1;
@@ -619,6 +656,19 @@ handle_bind_response(
         goto done;
     }
 
+    /* Look for response controls without disturbing ber for forwarding */
+    if ( lload_bind_cache_size ) {
+        ber_len_t len;
+
+        if ( (copy = ber_dup( ber )) == NULL ) {
+            has_ctrls = 1;
+        } else {
+            ber_skip_element( copy, &response );
+            has_ctrls = ( ber_peek_tag( copy, &len ) == LDAP_TAG_CONTROLS );
+            ber_free( copy, 0 );
+        }
+    }
+
     Debug( LDAP_DEBUG_STATS, "handle_bind_response: "
             "received response for bind request msgid=%d by client "
             "connid=%lu, result=%d\n",
@@ -688,9 +738,14 @@ handle_bind_response(
             return finish_sasl_bind( upstream, op, ber );
         }
         op->o_res = LLOAD_OP_COMPLETED;
+        simple_finished = !sasl_finished;
     }
     CONNECTION_UNLOCK(upstream);
 
+    if ( simple_finished ) {
+        lload_bind_cache_result( op, result, has_ctrls );
+    }
+
     if ( !op->o_pin_id ) {
         operation_unlink_upstream( op, upstream );
     }
@@ -967,6 +1022,11 @@ handle_vc_bind_response(
     }
     CONNECTION_UNLOCK(client);
 
+    if ( result != LDAP_SASL_BIND_IN_PROGRESS ) {
+        lload_bind_cache_result(
+                op, result, !BER_BVISEMPTY( &controls ) );
+    }
+
     checked_lock( &client->c_io_mutex );
     output = client->c_pendingber;
     if ( output == NULL && (output = ber_alloc()) == NULL ) {
@@ -0,0 +1,1285 @@
+/* cache.c - read-through cache of search responses and bind results */
+/* $OpenLDAP$ */
+/* This work is part of OpenLDAP Software <http://www.openldap.org/>.
+ *
+ * Copyright 1998-2022 The OpenLDAP Foundation.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted only as authorized by the OpenLDAP
+ * Public License.
+ *
+ * A copy of this license is available in the file LICENSE in the
+ * top-level directory of the distribution or, alternatively, at
+ * <http://www.OpenLDAP.org/license.html>.
+ */
+
+#include "portable.h"
+
+#include <ac/string.h>
+#include <ac/time.h>
+#include <ac/unistd.h>
+
+#include "lutil.h"
+#include "lutil_sha1.h"
+#include "lload.h"
+#include "lutil_ldap.h"
+
+/*
+ * Responses to searches are kept keyed by the identity the request is
+ * forwarded with and the encoded request and controls. Each entry holds the
+ * responses without their message ID, ready to be replayed to a client:
+ * one SEQUENCE per PDU containing the protocolOp and optional controls.
+ *
+ * Entries are dropped when they expire, when the cache is full (least
+ * recently used first), when a write forwarded through us might affect them
+ * or when the change feed set up with cache_watch reports a modification to
+ * an entry that might affect them. While the feed is configured but not
+ * running, the cache is not used at all.
+ *
+ * Responses that are being collected remember the cache generation they
+ * started at and are thrown away if anything got invalidated in the meantime,
+ * they might have been computed before the change.
+ */
+
+/*
+ * Successful simple binds are remembered as a salted hash of the normalised
+ * DN and the password, keyed by the DN. A bind with the same credentials is
+ * then answered without asking an upstream until bind_cache_ttl expires. Only
+ * the latest password that worked is kept for each DN, a failed bind forgets
+ * it and so does a change to the entry (or one above it) reported by the
+ * change feed. Binds in flight while anything got invalidated are not
+ * remembered, they have been verified against what might be old data.
+ */
+
+unsigned int lload_cache_size = 0;
+unsigned int lload_cache_ttl = 60;
+char *lload_cache_watch = NULL;
+
+struct LloadCacheEntry {
+    struct berval ce_key;
+    struct berval ce_base; /* normalised search base */
+    int ce_scope;
+
+    /* protected by cache_mutex */
+    uintptr_t ce_refcnt;
+    time_t ce_expires;
+    LDAP_TAILQ_ENTRY(LloadCacheEntry) ce_next;
+
+    /* only used while collecting the responses */
+    unsigned long ce_gen;
+    BerElement *ce_ber;
+    ber_len_t ce_size;
+
+    struct berval ce_pdus;
+};
+
+static ldap_pvt_thread_mutex_t cache_mutex;
+static TAvlnode *cache_tree;
+static LDAP_TAILQ_HEAD(CacheLRU, LloadCacheEntry) cache_lru =
+        LDAP_TAILQ_HEAD_INITIALIZER( cache_lru );
+static unsigned int cache_nentries;
+static unsigned long cache_gen;
+static int cache_feed_up;
+
+static ldap_pvt_thread_t cache_watch_tid;
+static volatile int cache_watch_running;
+
+unsigned int lload_bind_cache_size = 0;
+unsigned int lload_bind_cache_ttl = 10;
+
+#define BIND_CACHE_SALT 8
+
+struct bind_cache_entry {
+    struct berval be_ndn;
+    unsigned char be_salt[BIND_CACHE_SALT];
+    unsigned char be_digest[LUTIL_SHA1_BYTES];
+    time_t be_expires;
+    LDAP_TAILQ_ENTRY(bind_cache_entry) be_next;
+};
+
+/* protected by cache_mutex */
+static TAvlnode *bind_cache_tree;
+static LDAP_TAILQ_HEAD(BindCacheLRU, bind_cache_entry) bind_cache_lru =
+        LDAP_TAILQ_HEAD_INITIALIZER( bind_cache_lru );
+static unsigned int bind_cache_nentries;
+
+static int
+cache_entry_cmp( const void *left, const void *right )
+{
+    const LloadCacheEntry *l = left, *r = right;
+    return ber_bvcmp( &l->ce_key, &r->ce_key );
+}
+
+static void
+cache_entry_free( LloadCacheEntry *ce )
+{
+    if ( ce->ce_ber ) {
+        ber_free( ce->ce_ber, 1 );
+    }
+    ch_free( ce->ce_key.bv_val );
+    ch_free( ce->ce_base.bv_val );
+    ch_free( ce->ce_pdus.bv_val );
+    ch_free( ce );
+}
+
+static void
+cache_entry_release( LloadCacheEntry *ce )
+{
+    assert_locked( &cache_mutex );
+    if ( !--ce->ce_refcnt ) {
+        cache_entry_free( ce );
+    }
+}
+
+static void
+cache_entry_remove( LloadCacheEntry *ce )
+{
+    LloadCacheEntry *removed;
+
+    assert_locked( &cache_mutex );
+    removed = ldap_tavl_delete( &cache_tree, ce, cache_entry_cmp );
+    assert( removed == ce );
+
+    LDAP_TAILQ_REMOVE( &cache_lru, ce, ce_next );
+    cache_nentries--;
+    cache_entry_release( ce );
+}
+
+static int
+bind_cache_cmp( const void *left, const void *right )
+{
+    const struct bind_cache_entry *l = left, *r = right;
+    return ber_bvcmp( &l->be_ndn, &r->be_ndn );
+}
+
+static void
+bind_cache_remove( struct bind_cache_entry *be )
+{
+    struct bind_cache_entry *removed;
+
+    assert_locked( &cache_mutex );
+    removed = ldap_tavl_delete( &bind_cache_tree, be, bind_cache_cmp );
+    assert( removed == be );
+
+    LDAP_TAILQ_REMOVE( &bind_cache_lru, be, be_next );
+    bind_cache_nentries--;
+    ch_free( be->be_ndn.bv_val );
+    ch_free( be );
+}
+
+static void
+cache_flush_locked( void )
+{
+    LloadCacheEntry *ce;
+    struct bind_cache_entry *be;
+
+    assert_locked( &cache_mutex );
+    cache_gen++;
+    while ( (ce = LDAP_TAILQ_FIRST( &cache_lru )) ) {
+        cache_entry_remove( ce );
+    }
+    while ( (be = LDAP_TAILQ_FIRST( &bind_cache_lru )) ) {
+        bind_cache_remove( be );
+    }
+}
+
+/*
+ * Normalise a DN well enough to decide whether two DNs are related. Values
+ * are case folded regardless of their matching rules, which at worst makes us
+ * drop more than strictly necessary.
+ */
+int
+lload_dn_normalize( struct berval *dn, struct berval *ndn )
+{
+    char *in, *out = NULL;
+    int rc;
+
+    in = ch_malloc( dn->bv_len + 1 );
+    AC_MEMCPY( in, dn->bv_val, dn->bv_len );
+    in[dn->bv_len] = '\0';
+
+    rc = ldap_dn_normalize(
+            in, LDAP_DN_FORMAT_LDAP, &out, LDAP_DN_FORMAT_LDAPV3 );
+    ch_free( in );
+    if ( rc != LDAP_SUCCESS ) {
+        return rc;
+    }
+
+    if ( out == NULL ) {
+        ber_str2bv( "", 0, 1, ndn );
+    } else {
+        ldap_pvt_str2lower( out );
+        ber_str2bv( out, 0, 1, ndn );
+        ldap_memfree( out );
+    }
+    return LDAP_SUCCESS;
+}
+
+/* Is dn the same as or below base? */
+static int
+cache_dn_within( struct berval *dn, struct berval *base )
+{
+    if ( BER_BVISEMPTY( base ) ) {
+        return 1;
+    }
+    if ( dn->bv_len < base->bv_len ) {
+        return 0;
+    }
+    if ( dn->bv_len > base->bv_len &&
+            dn->bv_val[dn->bv_len - base->bv_len - 1] != ',' ) {
+        return 0;
+    }
+    return !memcmp( dn->bv_val + dn->bv_len - base->bv_len, base->bv_val,
+            base->bv_len );
+}
+
+/*
+ * Syncrepl only tells us about the entry that changed, not about the entries
+ * a rename moved along with it, so anything based at or below the changed DN
+ * goes too. Base scoped searches are unaffected by changes below them.
+ */
+static int
+cache_entry_affected( LloadCacheEntry *ce, struct berval *ndn )
+{
+    if ( cache_dn_within( &ce->ce_base, ndn ) ) {
+        return 1;
+    }
+    return ce->ce_scope != LDAP_SCOPE_BASE &&
+            cache_dn_within( ndn, &ce->ce_base );
+}
+
+void
+lload_cache_invalidate( struct berval *dn )
+{
+    LloadCacheEntry *ce, *next;
+    struct bind_cache_entry *be, *be_next;
+    struct berval ndn;
+    int n = 0, nbinds = 0;
+
+    if ( lload_dn_normalize( dn, &ndn ) ) {
+        Debug( LDAP_DEBUG_ANY, "lload_cache_invalidate: "
+                "unparseable DN \"%.*s\", flushing the cache\n",
+                (int)dn->bv_len, dn->bv_val );
+        lload_cache_flush();
+        return;
+    }
+
+    checked_lock( &cache_mutex );
+    cache_gen++;
+    for ( ce = LDAP_TAILQ_FIRST( &cache_lru ); ce; ce = next ) {
+        next = LDAP_TAILQ_NEXT( ce, ce_next );
+        if ( cache_entry_affected( ce, &ndn ) ) {
+            cache_entry_remove( ce );
+            n++;
+        }
+    }
+    for ( be = LDAP_TAILQ_FIRST( &bind_cache_lru ); be; be = be_next ) {
+        be_next = LDAP_TAILQ_NEXT( be, be_next );
+        if ( cache_dn_within( &be->be_ndn, &ndn ) ) {
+            bind_cache_remove( be );
+            nbinds++;
+        }
+    }
+    checked_unlock( &cache_mutex );
+
+    Debug( LDAP_DEBUG_TRACE, "lload_cache_invalidate: "
+            "change to \"%s\" dropped %d cached responses and %d binds\n",
+            ndn.bv_val, n, nbinds );
+    ch_free( ndn.bv_val );
+}
+
+static const struct berval cache_exop_whoami = BER_BVC(LDAP_EXOP_WHO_AM_I),
+        cache_exop_cancel = BER_BVC(LDAP_EXOP_CANCEL),
+        cache_exop_passwd = BER_BVC(LDAP_EXOP_MODIFY_PASSWD);
+
+/* Invalidate the parent of dn, everything if it has none or won't parse */
+static void
+cache_invalidate_parent( struct berval *dn )
+{
+    LDAPDN ldn = NULL;
+    struct berval pdn = BER_BVNULL;
+
+    if ( ldap_bv2dn( dn, &ldn, LDAP_DN_FORMAT_LDAP ) == LDAP_SUCCESS &&
+            ldn && ldn[0] &&
+            ldap_dn2bv( ldn + 1, &pdn, LDAP_DN_FORMAT_LDAPV3 ) ==
+                    LDAP_SUCCESS &&
+            !BER_BVISNULL( &pdn ) ) {
+        lload_cache_invalidate( &pdn );
+        ldap_memfree( pdn.bv_val );
+    } else {
+        lload_cache_flush();
+    }
+    if ( ldn ) {
+        ldap_dnfree( ldn );
+    }
+}
+
+/*
+ * A write is about to be forwarded or its result has just arrived, drop
+ * whatever it might have changed. Doing it on the way out stops stale
+ * responses from being served while the write is in progress, doing it again
+ * once it is done catches searches that read the old data in the meantime.
+ * The second time happens before the client sees the result, so a client
+ * reading its own writes always gets them.
+ *
+ * A rename affects both the old and the new place of the entry, so the old
+ * parent and the new superior go. A password change through the exop drops
+ * the cached binds for the user, any other extended operation might have done
+ * anything and flushes the lot.
+ */
+void
+lload_cache_write( LloadOperation *op )
+{
+    BerElementBuffer berbuf;
+    BerElement *ber = (BerElement *)&berbuf;
+    struct berval dn, bv;
+    ber_len_t len;
+
+    if ( !__atomic_load_n( &lload_cache_size, __ATOMIC_RELAXED ) &&
+            !__atomic_load_n( &lload_bind_cache_size, __ATOMIC_RELAXED ) ) {
+        return;
+    }
+
+    ber_init2( ber, &op->o_request, 0 );
+    switch ( op->o_tag ) {
+        case LDAP_REQ_ADD:
+        case LDAP_REQ_MODIFY:
+            if ( ber_get_stringbv( ber, &dn, LBER_BV_NOTERM ) == LBER_ERROR ) {
+                break;
+            }
+            lload_cache_invalidate( &dn );
+            return;
+
+        case LDAP_REQ_DELETE:
+            lload_cache_invalidate( &op->o_request );
+            return;
+
+        case LDAP_REQ_MODRDN: {
+            ber_int_t deleteoldrdn;
+
+            if ( ber_get_stringbv( ber, &dn, LBER_BV_NOTERM ) == LBER_ERROR ||
+                    ber_get_stringbv( ber, &bv, LBER_BV_NOTERM ) ==
+                            LBER_ERROR ||
+                    ber_get_boolean( ber, &deleteoldrdn ) == LBER_ERROR ) {
+                break;
+            }
+            cache_invalidate_parent( &dn );
+            if ( ber_peek_tag( ber, &len ) == LDAP_TAG_NEWSUPERIOR &&
+                    ber_get_stringbv( ber, &bv, LBER_BV_NOTERM ) !=
+                            LBER_ERROR ) {
+                lload_cache_invalidate( &bv );
+            }
+            return;
+        }
+
+        case LDAP_REQ_EXTENDED: {
+            BerElementBuffer value_berbuf;
+            BerElement *value_ber = (BerElement *)&value_berbuf;
+            struct berval value = BER_BVNULL;
+
+            if ( ber_get_stringbv( ber, &bv, LBER_BV_NOTERM ) == LBER_ERROR ) {
+                break;
+            }
+            if ( ber_peek_tag( ber, &len ) == LDAP_TAG_EXOP_REQ_VALUE ) {
+                ber_get_stringbv( ber, &value, LBER_BV_NOTERM );
+            }
+            if ( !ber_bvcmp( &bv, &cache_exop_whoami ) ||
+                    !ber_bvcmp( &bv, &cache_exop_cancel ) ) {
+                return;
+            }
+            if ( ber_bvcmp( &bv, &cache_exop_passwd ) ||
+                    BER_BVISNULL( &value ) ) {
+                break;
+            }
+
+            /* Without a userIdentity it's the bound user, we don't know who
+             * that is by the time the result arrives */
+            ber_init2( value_ber, &value, 0 );
+            if ( ber_scanf( value_ber, "{" /* "}" */ ) == LBER_ERROR ||
+                    ber_peek_tag( value_ber, &len ) !=
+                            LDAP_TAG_EXOP_MODIFY_PASSWD_ID ||
+                    ber_get_stringbv( value_ber, &dn, LBER_BV_NOTERM ) ==
+                            LBER_ERROR ) {
+                break;
+            }
+            if ( dn.bv_len > STRLENOF("dn:") &&
+                    !strncasecmp( dn.bv_val, "dn:", STRLENOF("dn:") ) ) {
+                dn.bv_val += STRLENOF("dn:");
+                dn.bv_len -= STRLENOF("dn:");
+            }
+            lload_cache_invalidate( &dn );
+            return;
+        }
+
+        default:
+            return;
+    }
+
+    Debug( LDAP_DEBUG_TRACE, "lload_cache_write: "
+            "connid=%lu msgid=%d cannot tell what %s affects, "
+            "flushing the cache\n",
+            op->o_client_connid, op->o_client_msgid,
+            lload_msgtype2str( op->o_tag ) );
+    lload_cache_flush();
+}
+
+void
+lload_cache_flush( void )
+{
+    checked_lock( &cache_mutex );
+    cache_flush_locked();
+    checked_unlock( &cache_mutex );
+}
+
+void
+lload_cache_resize( unsigned int size )
+{
+    LloadCacheEntry *ce;
+
+    checked_lock( &cache_mutex );
+    lload_cache_size = size;
+    while ( cache_nentries > size &&
+            (ce = LDAP_TAILQ_LAST( &cache_lru, CacheLRU )) ) {
+        cache_entry_remove( ce );
+    }
+    checked_unlock( &cache_mutex );
+}
+
+void
+lload_bind_cache_resize( unsigned int size )
+{
+    struct bind_cache_entry *be;
+
+    checked_lock( &cache_mutex );
+    __atomic_store_n( &lload_bind_cache_size, size, __ATOMIC_RELAXED );
+    while ( bind_cache_nentries > size &&
+            (be = LDAP_TAILQ_LAST( &bind_cache_lru, BindCacheLRU )) ) {
+        bind_cache_remove( be );
+    }
+    checked_unlock( &cache_mutex );
+}
+
+/*
+ * Controls that make the response depend on state kept by the server, we
+ * cannot replay those.
+ */
+static const char *const cache_control_skip[] = {
+    LDAP_CONTROL_SYNC,
+    LDAP_CONTROL_PAGEDRESULTS,
+    LDAP_CONTROL_PERSIST_REQUEST,
+    LDAP_CONTROL_VLVREQUEST,
+    NULL
+};
+
+static int
+cache_controls_ok( struct berval *ctrls )
+{
+    BerElementBuffer berbuf;
+    BerElement *ber = (BerElement *)&berbuf;
+    struct berval control;
+
+    if ( BER_BVISNULL( ctrls ) ) {
+        return 1;
+    }
+
+    ber_init2( ber, ctrls, 0 );
+    while ( ber_skip_element( ber, &control ) == LBER_SEQUENCE ) {
+        BerElementBuffer control_berbuf;
+        BerElement *control_ber = (BerElement *)&control_berbuf;
+        struct berval oid;
+        int i;
+
+        ber_init2( control_ber, &control, 0 );
+        if ( ber_skip_element( control_ber, &oid ) == LBER_ERROR ) {
+            return 0;
+        }
+        for ( i = 0; cache_control_skip[i]; i++ ) {
+            if ( oid.bv_len == strlen( cache_control_skip[i] ) &&
+                    !memcmp( oid.bv_val, cache_control_skip[i],
+                            oid.bv_len ) ) {
+                return 0;
+            }
+        }
+    }
+    return 1;
+}
+
+static void
+cache_send( LloadConnection *client, LloadOperation *op, LloadCacheEntry *ce )
+{
+    BerElementBuffer berbuf;
+    BerElement *ber = (BerElement *)&berbuf, *output;
+    struct berval pdu;
+
+    if ( !operation_unlink_client( op, client ) ) {
+        /* Abandoned in the meantime */
+        return;
+    }
+
+    checked_lock( &client->c_io_mutex );
+    output = client->c_pendingber;
+    if ( output == NULL && (output = ber_alloc()) == NULL ) {
+        checked_unlock( &client->c_io_mutex );
+        Debug( LDAP_DEBUG_ANY, "cache_send: "
+                "ber_alloc failed, closing connid=%lu\n",
+                client->c_connid );
+        CONNECTION_LOCK_DESTROY(client);
+        return;
+    }
+    client->c_pendingber = output;
+
+    ber_init2( ber, &ce->ce_pdus, 0 );
+    while ( ber_skip_element( ber, &pdu ) == LBER_SEQUENCE ) {
+        ber_printf( output, "t{ti" /* "}" */, LDAP_TAG_MESSAGE,
+                LDAP_TAG_MSGID, op->o_client_msgid );
+        ber_write( output, pdu.bv_val, pdu.bv_len, 0 );
+        ber_printf( output, /* "{" */ "}" );
+    }
+    checked_unlock( &client->c_io_mutex );
+
+    connection_write_cb( -1, 0, client );
+}
+
+/*
+ * Try to answer a search from the cache. If we can, the operation is
+ * finished and LDAP_SUCCESS is returned. Otherwise the operation might be
+ * set up to have its responses collected and the caller should forward it
+ * as usual.
+ */
+int
+lload_cache_request( LloadConnection *client, LloadOperation *op )
+{
+    BerElementBuffer berbuf;
+    BerElement *ber = (BerElement *)&berbuf;
+    LloadCacheEntry *ce, needle = {};
+    struct berval base;
+    ber_int_t scope;
+    int privileged, rc = LDAP_OTHER;
+    time_t now;
+
+    assert( op->o_tag == LDAP_REQ_SEARCH );
+
+    if ( !cache_controls_ok( &op->o_ctrls ) ) {
+        return rc;
+    }
+
+    /* o_request is forwarded as is later, do not let ber_scanf terminate the
+     * DN in place */
+    ber_init2( ber, &op->o_request, 0 );
+    if ( ber_get_stringbv( ber, &base, LBER_BV_NOTERM ) == LBER_ERROR ||
+            ber_get_enum( ber, &scope ) == LBER_ERROR ) {
+        return rc;
+    }
+
+    /* Responses depend on who the upstream thinks is asking */
+    ber = ber_alloc_t( LBER_USE_DER );
+    if ( ber == NULL ) {
+        return rc;
+    }
+    CONNECTION_LOCK(client);
+    privileged = !( lload_features & LLOAD_FEATURE_PROXYAUTHZ ) ||
+            client->c_type == LLOAD_C_PRIVILEGED;
+    if ( ber_printf( ber, "{bOOO}", privileged,
+                 privileged ? &lloadd_identity : &client->c_auth,
+                 &op->o_request, &op->o_ctrls ) < 0 ) {
+        CONNECTION_UNLOCK(client);
+        ber_free( ber, 1 );
+        return rc;
+    }
+    CONNECTION_UNLOCK(client);
+    ber_flatten2( ber, &needle.ce_key, 1 );
+    ber_free( ber, 1 );
+
+    now = slap_get_time();
+    checked_lock( &cache_mutex );
+    if ( !lload_cache_size || ( lload_cache_watch && !cache_feed_up ) ) {
+        checked_unlock( &cache_mutex );
+        ch_free( needle.ce_key.bv_val );
+        return rc;
+    }
+
+    ce = ldap_tavl_find( cache_tree, &needle, cache_entry_cmp );
+    if ( ce && ce->ce_expires && ce->ce_expires <= now ) {
+        cache_entry_remove( ce );
+        ce = NULL;
+    }
+
+    if ( ce ) {
+        LDAP_TAILQ_REMOVE( &cache_lru, ce, ce_next );
+        LDAP_TAILQ_INSERT_HEAD( &cache_lru, ce, ce_next );
+        ce->ce_refcnt++;
+        lload_stats.counters[LLOAD_STATS_OPS_OTHER].lc_ops_cache_hits++;
+        checked_unlock( &cache_mutex );
+        ch_free( needle.ce_key.bv_val );
+
+        Debug( LDAP_DEBUG_STATS, "lload_cache_request: "
+                "connid=%lu msgid=%d answered from the cache\n",
+                op->o_client_connid, op->o_client_msgid );
+
+        op->o_res = LLOAD_OP_COMPLETED;
+        cache_send( client, op, ce );
+        operation_unlink( op );
+
+        checked_lock( &cache_mutex );
+        cache_entry_release( ce );
+        checked_unlock( &cache_mutex );
+        return LDAP_SUCCESS;
+    }
+
+    lload_stats.counters[LLOAD_STATS_OPS_OTHER].lc_ops_cache_misses++;
+    needle.ce_gen = cache_gen;
+    checked_unlock( &cache_mutex );
+
+    ce = ch_calloc( 1, sizeof(LloadCacheEntry) );
+    ce->ce_key = needle.ce_key;
+    ce->ce_gen = needle.ce_gen;
+    ce->ce_scope = scope;
+    if ( lload_dn_normalize( &base, &ce->ce_base ) ||
+            (ce->ce_ber = ber_alloc_t( LBER_USE_DER )) == NULL ) {
+        cache_entry_free( ce );
+        return rc;
+    }
+
+    op->o_cache = ce;
+    return rc;
+}
+
+static void
+cache_commit( LloadOperation *op, LloadCacheEntry *ce )
+{
+    LloadCacheEntry *old;
+
+    if ( ber_flatten2( ce->ce_ber, &ce->ce_pdus, 1 ) ) {
+        cache_entry_free( ce );
+        return;
+    }
+    ber_free( ce->ce_ber, 1 );
+    ce->ce_ber = NULL;
+    ce->ce_refcnt = 1;
+
+    checked_lock( &cache_mutex );
+    if ( ce->ce_gen != cache_gen || !lload_cache_size ||
+            ( lload_cache_watch && !cache_feed_up ) ) {
+        checked_unlock( &cache_mutex );
+        cache_entry_free( ce );
+        return;
+    }
+
+    if ( lload_cache_ttl ) {
+        ce->ce_expires = slap_get_time() + lload_cache_ttl;
+    }
+
+    /* Someone else got there first, take the fresher copy */
+    if ( (old = ldap_tavl_find( cache_tree, ce, cache_entry_cmp )) ) {
+        cache_entry_remove( old );
+    }
+    while ( cache_nentries >= lload_cache_size &&
+            (old = LDAP_TAILQ_LAST( &cache_lru, CacheLRU )) ) {
+        cache_entry_remove( old );
+    }
+
+    Debug( LDAP_DEBUG_TRACE, "cache_commit: "
+            "caching %lu bytes of responses to client connid=%lu msgid=%d\n",
+            ce->ce_pdus.bv_len, op->o_client_connid, op->o_client_msgid );
+
+    ldap_tavl_insert( &cache_tree, ce, cache_entry_cmp, ldap_avl_dup_error );
+    LDAP_TAILQ_INSERT_HEAD( &cache_lru, ce, ce_next );
+    cache_nentries++;
+    checked_unlock( &cache_mutex );
+}
+
+/*
+ * Called with each response forwarded for an operation that is being
+ * collected, in order. Only successful searches made entirely of entries and
+ * references are kept.
+ */
+void
+lload_cache_collect(
+        LloadOperation *op,
+        ber_tag_t tag,
+        struct berval *response,
+        struct berval *controls )
+{
+    LloadCacheEntry *ce = op->o_cache;
+    int keep = 0;
+
+    assert( ce != NULL );
+
+    switch ( tag ) {
+        case LDAP_RES_SEARCH_ENTRY:
+        case LDAP_RES_SEARCH_REFERENCE:
+            keep = 1;
+            break;
+
+        case LDAP_RES_SEARCH_RESULT: {
+            BerElementBuffer berbuf;
+            BerElement *ber = (BerElement *)&berbuf;
+            ber_int_t result;
+
+            ber_init2( ber, response, 0 );
+            keep = ber_scanf( ber, "e", &result ) != LBER_ERROR &&
+                    result == LDAP_SUCCESS;
+        } break;
+    }
+
+    ce->ce_size += response->bv_len + controls->bv_len;
+    if ( keep && ce->ce_size <= LLOAD_CACHE_MAX_RESPONSE &&
+            ber_printf( ce->ce_ber, "{tOtO}", tag, response,
+                    LDAP_TAG_CONTROLS, BER_BV_OPTIONAL( controls ) ) >= 0 ) {
+        if ( tag != LDAP_RES_SEARCH_RESULT ) {
+            return;
+        }
+        op->o_cache = NULL;
+        cache_commit( op, ce );
+        return;
+    }
+
+    op->o_cache = NULL;
+    cache_entry_free( ce );
+}
+
+void
+lload_cache_abandon( LloadOperation *op )
+{
+    if ( op->o_cache ) {
+        cache_entry_free( op->o_cache );
+        op->o_cache = NULL;
+    }
+}
+
+static void
+bind_cache_digest(
+        struct berval *ndn,
+        struct berval *cred,
+        unsigned char *salt,
+        unsigned char *digest )
+{
+    lutil_SHA1_CTX ctx;
+
+    lutil_SHA1Init( &ctx );
+    lutil_SHA1Update( &ctx, (unsigned char *)ndn->bv_val, ndn->bv_len + 1 );
+    lutil_SHA1Update( &ctx, (unsigned char *)cred->bv_val, cred->bv_len );
+    lutil_SHA1Update( &ctx, salt, BIND_CACHE_SALT );
+    lutil_SHA1Final( digest, &ctx );
+}
+
+/*
+ * Have these credentials been verified recently? If not, the operation
+ * remembers the cache generation for lload_bind_cache_result.
+ */
+int
+lload_bind_cache_check(
+        LloadOperation *op,
+        struct berval *dn,
+        struct berval *cred )
+{
+    struct bind_cache_entry *be, needle = {};
+    unsigned char digest[LUTIL_SHA1_BYTES], diff = 0;
+    int i, rc = LDAP_OTHER;
+    time_t now;
+
+    if ( !__atomic_load_n( &lload_bind_cache_size, __ATOMIC_RELAXED ) ||
+            BER_BVISEMPTY( dn ) || BER_BVISEMPTY( cred ) ||
+            !BER_BVISNULL( &op->o_ctrls ) ) {
+        return rc;
+    }
+
+    if ( lload_dn_normalize( dn, &needle.be_ndn ) ) {
+        return rc;
+    }
+
+    now = slap_get_time();
+    checked_lock( &cache_mutex );
+    op->o_cache_gen = cache_gen;
+    if ( !lload_bind_cache_size || ( lload_cache_watch && !cache_feed_up ) ) {
+        checked_unlock( &cache_mutex );
+        ch_free( needle.be_ndn.bv_val );
+        return rc;
+    }
+
+    be = ldap_tavl_find( bind_cache_tree, &needle, bind_cache_cmp );
+    if ( be && be->be_expires && be->be_expires <= now ) {
+        bind_cache_remove( be );
+        be = NULL;
+    }
+
+    if ( be ) {
+        bind_cache_digest( &needle.be_ndn, cred, be->be_salt, digest );
+        for ( i = 0; i < LUTIL_SHA1_BYTES; i++ ) {
+            diff |= digest[i] ^ be->be_digest[i];
+        }
+        if ( !diff ) {
+            LDAP_TAILQ_REMOVE( &bind_cache_lru, be, be_next );
+            LDAP_TAILQ_INSERT_HEAD( &bind_cache_lru, be, be_next );
+            rc = LDAP_SUCCESS;
+        }
+    }
+
+    if ( rc == LDAP_SUCCESS ) {
+        lload_stats.counters[LLOAD_STATS_OPS_BIND].lc_ops_cache_hits++;
+    } else {
+        lload_stats.counters[LLOAD_STATS_OPS_BIND].lc_ops_cache_misses++;
+    }
+    checked_unlock( &cache_mutex );
+
+    ch_free( needle.be_ndn.bv_val );
+    return rc;
+}
+
+/*
+ * A simple bind has been answered by an upstream, remember the credentials if
+ * they worked or forget what we have for the DN if they did not. A response
+ * that carried controls (e.g. a password policy warning) is never cached, a
+ * cache hit could not replay them.
+ */
+void
+lload_bind_cache_result( LloadOperation *op, int result, int has_ctrls )
+{
+    BerElementBuffer berbuf;
+    BerElement *ber = (BerElement *)&berbuf;
+    struct bind_cache_entry *be, *old;
+    struct berval dn, cred, ndn;
+    ber_int_t version;
+    time_t now;
+
+    if ( !__atomic_load_n( &lload_bind_cache_size, __ATOMIC_RELAXED ) ||
+            op->o_tag != LDAP_REQ_BIND || !BER_BVISNULL( &op->o_ctrls ) ) {
+        return;
+    }
+
+    ber_init2( ber, &op->o_request, 0 );
+    if ( ber_get_int( ber, &version ) == LBER_ERROR ||
+            ber_get_stringbv( ber, &dn, LBER_BV_NOTERM ) == LBER_ERROR ||
+            ber_skip_element( ber, &cred ) != LDAP_AUTH_SIMPLE ||
+            BER_BVISEMPTY( &dn ) || BER_BVISEMPTY( &cred ) ) {
+        return;
+    }
+
+    if ( lload_dn_normalize( &dn, &ndn ) ) {
+        return;
+    }
+
+    be = ch_calloc( 1, sizeof(struct bind_cache_entry) );
+    be->be_ndn = ndn;
+    if ( result != LDAP_SUCCESS || has_ctrls ||
+            lutil_entropy( be->be_salt, BIND_CACHE_SALT ) < 0 ) {
+        result = LDAP_OTHER;
+    } else {
+        bind_cache_digest( &ndn, &cred, be->be_salt, be->be_digest );
+    }
+
+    now = slap_get_time();
+    checked_lock( &cache_mutex );
+    old = ldap_tavl_find( bind_cache_tree, be, bind_cache_cmp );
+    if ( old ) {
+        bind_cache_remove( old );
+    }
+
+    if ( result != LDAP_SUCCESS || op->o_cache_gen != cache_gen ||
+            !lload_bind_cache_size ||
+            ( lload_cache_watch && !cache_feed_up ) ) {
+        checked_unlock( &cache_mutex );
+        ch_free( be->be_ndn.bv_val );
+        ch_free( be );
+        return;
+    }
+
+    if ( lload_bind_cache_ttl ) {
+        be->be_expires = now + lload_bind_cache_ttl;
+    }
+    ldap_tavl_insert( &bind_cache_tree, be, bind_cache_cmp, ldap_avl_dup_error );
+    LDAP_TAILQ_INSERT_HEAD( &bind_cache_lru, be, be_next );
+    bind_cache_nentries++;
+
+    while ( bind_cache_nentries > lload_bind_cache_size &&
+            (be = LDAP_TAILQ_LAST( &bind_cache_lru, BindCacheLRU )) ) {
+        bind_cache_remove( be );
+    }
+    checked_unlock( &cache_mutex );
+}
+
+/*
+ * The change feed: a refreshAndPersist syncrepl session against the server
+ * named in cache_watch, starting from its current contextCSN so that we only
+ * hear about changes. Only the DNs of the changed entries are of interest.
+ */
+static int
+cache_watch_connect( LDAP **ldp, LDAPURLDesc *lud )
+{
+    LDAP *ld;
+    LDAPURLDesc server = *lud;
+    struct timeval tv;
+    char *url;
+    int rc, version = LDAP_VERSION3;
+
+    /* ldap_initialize takes a list of servers, not a search URL */
+    server.lud_next = NULL;
+    server.lud_dn = NULL;
+    server.lud_attrs = NULL;
+    server.lud_scope = LDAP_SCOPE_DEFAULT;
+    server.lud_filter = NULL;
+    server.lud_exts = NULL;
+    url = ldap_url_desc2str( &server );
+    if ( url == NULL ) {
+        return LDAP_NO_MEMORY;
+    }
+    rc = ldap_initialize( &ld, url );
+    ldap_memfree( url );
+    if ( rc != LDAP_SUCCESS ) {
+        return rc;
+    }
+    ldap_set_option( ld, LDAP_OPT_PROTOCOL_VERSION, &version );
+    ldap_set_option( ld, LDAP_OPT_REFERRALS, LDAP_OPT_OFF );
+    if ( bindconf.sb_timeout_api ) {
+        tv.tv_sec = bindconf.sb_timeout_api;
+        tv.tv_usec = 0;
+        ldap_set_option( ld, LDAP_OPT_TIMEOUT, &tv );
+    }
+    if ( bindconf.sb_timeout_net ) {
+        tv.tv_sec = bindconf.sb_timeout_net;
+        tv.tv_usec = 0;
+        ldap_set_option( ld, LDAP_OPT_NETWORK_TIMEOUT, &tv );
+    }
+
+#ifdef HAVE_TLS
+    if ( lload_bindconf_tls_set( &bindconf, ld ) ) {
+        rc = LDAP_LOCAL_ERROR;
+        goto done;
+    }
+    if ( bindconf.sb_tls && strcasecmp( lud->lud_scheme, "ldaps" ) ) {
+        rc = ldap_start_tls_s( ld, NULL, NULL );
+        if ( rc != LDAP_SUCCESS ) {
+            Debug( LDAP_DEBUG_ANY, "cache_watch_connect: "
+                    "%s, StartTLS failed (%d)\n",
+                    bindconf.sb_tls == SB_TLS_CRITICAL ? "Error" : "Warning",
+                    rc );
+            if ( bindconf.sb_tls == SB_TLS_CRITICAL ) {
+                goto done;
+            }
+        }
+    }
+#endif /* HAVE_TLS */
+
+    if ( bindconf.sb_method == LDAP_AUTH_SASL ) {
+#ifdef HAVE_CYRUS_SASL
+        void *defaults;
+
+        if ( bindconf.sb_secprops ) {
+            ldap_set_option( ld, LDAP_OPT_X_SASL_SECPROPS,
+                    bindconf.sb_secprops );
+        }
+        defaults = lutil_sasl_defaults( ld, bindconf.sb_saslmech.bv_val,
+                bindconf.sb_realm.bv_val, bindconf.sb_authcId.bv_val,
+                bindconf.sb_cred.bv_val, bindconf.sb_authzId.bv_val );
+        rc = ldap_sasl_interactive_bind_s( ld, bindconf.sb_binddn.bv_val,
+                bindconf.sb_saslmech.bv_val, NULL, NULL, LDAP_SASL_QUIET,
+                lutil_sasl_interact, defaults );
+        lutil_sasl_freedefs( defaults );
+#else /* ! HAVE_CYRUS_SASL */
+        rc = LDAP_NOT_SUPPORTED;
+#endif /* ! HAVE_CYRUS_SASL */
+    } else {
+        rc = ldap_sasl_bind_s( ld, bindconf.sb_binddn.bv_val,
+                LDAP_SASL_SIMPLE, &bindconf.sb_cred, NULL, NULL, NULL );
+    }
+
+#ifdef HAVE_TLS
+done:
+#endif /* HAVE_TLS */
+    if ( rc != LDAP_SUCCESS ) {
+        ldap_unbind_ext( ld, NULL, NULL );
+        return rc;
+    }
+    *ldp = ld;
+    return rc;
+}
+
+/* Start from the provider's contextCSN so the refresh is (nearly) empty */
+static void
+cache_watch_cookie( LDAP *ld, LDAPURLDesc *lud, struct berval *cookie )
+{
+    LDAPMessage *res = NULL, *e;
+    struct berval **vals = NULL;
+    char *attrs[] = { "contextCSN", NULL }, *ptr;
+    ber_len_t len;
+    int i;
+
+    BER_BVZERO( cookie );
+    if ( ldap_search_ext_s( ld, lud->lud_dn, LDAP_SCOPE_BASE, NULL, attrs, 0,
+                 NULL, NULL, NULL, 1, &res ) != LDAP_SUCCESS ||
+            (e = ldap_first_entry( ld, res )) == NULL ||
+            (vals = ldap_get_values_len( ld, e, attrs[0] )) == NULL ) {
+        goto done;
+    }
+
+    len = STRLENOF("csn=");
+    for ( i = 0; vals[i]; i++ ) {
+        len += vals[i]->bv_len + 1;
+    }
+    cookie->bv_val = ptr = ch_malloc( len );
+    ptr = lutil_strcopy( ptr, "csn=" );
+    for ( i = 0; vals[i]; i++ ) {
+        if ( i ) *ptr++ = ';';
+        ptr = lutil_strncopy( ptr, vals[i]->bv_val, vals[i]->bv_len );
+    }
+    *ptr = '\0';
+    cookie->bv_len = ptr - cookie->bv_val;
+
+done:
+    ber_bvecfree( vals );
+    ldap_msgfree( res );
+}
+
+static void
+cache_watch_feed( int up )
+{
+    checked_lock( &cache_mutex );
+    cache_flush_locked();
+    cache_feed_up = up;
+    checked_unlock( &cache_mutex );
+}
+
+/* Has the refresh phase finished? */
+static int
+cache_watch_info( LDAP *ld, LDAPMessage *msg )
+{
+    BerElementBuffer berbuf;
+    BerElement *ber = (BerElement *)&berbuf;
+    struct berval *data = NULL;
+    char *oid = NULL;
+    ber_tag_t tag;
+    ber_len_t len;
+    ber_int_t done = 1;
+
+    if ( ldap_parse_intermediate( ld, msg, &oid, &data, NULL, 0 ) !=
+                    LDAP_SUCCESS ||
+            !oid || strcmp( oid, LDAP_SYNC_INFO ) || !data ) {
+        goto out;
+    }
+
+    ber_init2( ber, data, 0 );
+    tag = ber_peek_tag( ber, &len );
+    switch ( tag ) {
+        case LDAP_TAG_SYNC_REFRESH_DELETE:
+        case LDAP_TAG_SYNC_REFRESH_PRESENT:
+            ber_scanf( ber, "{" /*"}"*/ );
+            if ( ber_peek_tag( ber, &len ) == LDAP_TAG_SYNC_COOKIE ) {
+                ber_skip_tag( ber, &len );
+                ber_skip_data( ber, len );
+            }
+            if ( ber_peek_tag( ber, &len ) == LDAP_TAG_REFRESHDONE ) {
+                ber_get_boolean( ber, &done );
+            }
+            break;
+        case LDAP_TAG_SYNC_ID_SET:
+            /* deletions we cannot map to DNs */
+            done = -1;
+            break;
+        default:
+            done = 0;
+            break;
+    }
+
+out:
+    ldap_memfree( oid );
+    ber_bvfree( data );
+    return done;
+}
+
+static int
+cache_watch_run( LDAP *ld, LDAPURLDesc *lud )
+{
+    BerElementBuffer berbuf;
+    BerElement *ber = (BerElement *)&berbuf;
+    LDAPControl c, *ctrls[2] = { &c, NULL };
+    LDAPMessage *res, *msg;
+    struct berval cookie;
+    struct timeval tv = { 1, 0 };
+    char *attrs[] = { LDAP_NO_ATTRS, NULL };
+    int rc, msgid, up = 0;
+
+    cache_watch_cookie( ld, lud, &cookie );
+
+    ber_init2( ber, NULL, LBER_USE_DER );
+    ber_printf( ber, "{e" /*"}"*/, LDAP_SYNC_REFRESH_AND_PERSIST );
+    if ( !BER_BVISNULL( &cookie ) ) {
+        ber_printf( ber, "O", &cookie );
+    }
+    ber_printf( ber, /*"{"*/ "N}" );
+    ch_free( cookie.bv_val );
+    if ( ber_flatten2( ber, &c.ldctl_value, 0 ) ) {
+        ber_free_buf( ber );
+        return LDAP_NO_MEMORY;
+    }
+    c.ldctl_oid = LDAP_CONTROL_SYNC;
+    c.ldctl_iscritical = 1;
+
+    rc = ldap_search_ext( ld, lud->lud_dn,
+            lud->lud_scope == LDAP_SCOPE_DEFAULT ? LDAP_SCOPE_SUBTREE :
+                                                   lud->lud_scope,
+            lud->lud_filter, attrs, 0, ctrls, NULL, NULL, 0, &msgid );
+    ber_free_buf( ber );
+    if ( rc != LDAP_SUCCESS ) {
+        return rc;
+    }
+
+    while ( cache_watch_running ) {
+        rc = ldap_result( ld, msgid, LDAP_MSG_RECEIVED, &tv, &res );
+        if ( rc == 0 ) {
+            continue;
+        } else if ( rc < 0 ) {
+            ldap_get_option( ld, LDAP_OPT_RESULT_CODE, &rc );
+            break;
+        }
+
+        for ( msg = ldap_first_message( ld, res ); msg;
+                msg = ldap_next_message( ld, msg ) ) {
+            switch ( ldap_msgtype( msg ) ) {
+                case LDAP_RES_SEARCH_ENTRY:
+                    if ( up ) {
+                        char *dn = ldap_get_dn( ld, msg );
+
+                        if ( dn ) {
+                            struct berval bv;
+
+                            ber_str2bv( dn, 0, 0, &bv );
+                            lload_cache_invalidate( &bv );
+                            ldap_memfree( dn );
+                        } else {
+                            lload_cache_flush();
+                        }
+                    }
+                    break;
+
+                case LDAP_RES_INTERMEDIATE:
+                    switch ( cache_watch_info( ld, msg ) ) {
+                        case 1:
+                            if ( !up ) {
+                                Debug( LDAP_DEBUG_STATS, "cache_watch_run: "
+                                        "watching %s for changes\n",
+                                        lload_cache_watch );
+                                cache_watch_feed( up = 1 );
+                            }
+                            break;
+                        case -1:
+                            if ( up ) lload_cache_flush();
+                            break;
+                    }
+                    break;
+
+                case LDAP_RES_SEARCH_RESULT:
+                    ldap_parse_result(
+                            ld, msg, &rc, NULL, NULL, NULL, NULL, 0 );
+                    if ( rc == LDAP_SUCCESS ) {
+                        rc = LDAP_OTHER;
+                    }
+                    ldap_msgfree( res );
+                    return rc;
+            }
+        }
+        ldap_msgfree( res );
+    }
+
+    return rc;
+}
+
+static void *
+cache_watch_task( void *arg )
+{
+    LDAPURLDesc *lud = arg;
+
+    while ( cache_watch_running ) {
+        LDAP *ld = NULL;
+        int rc, i;
+
+        rc = cache_watch_connect( &ld, lud );
+        if ( rc == LDAP_SUCCESS ) {
+            rc = cache_watch_run( ld, lud );
+            ldap_unbind_ext( ld, NULL, NULL );
+        }
+        cache_watch_feed( 0 );
+
+        if ( !cache_watch_running ) {
+            break;
+        }
+        Debug( LDAP_DEBUG_ANY, "cache_watch_task: "
+                "change feed from %s lost (%d), cache disabled until it is "
+                "reestablished\n",
+                lload_cache_watch, rc );
+
+        for ( i = 0; cache_watch_running && i < LLOAD_CACHE_WATCH_RETRY;
+                i++ ) {
+            sleep( 1 );
+        }
+    }
+
+    ldap_free_urldesc( lud );
+    return NULL;
+}
+
+int
+lload_cache_watch_start( void )
+{
+    LDAPURLDesc *lud;
+    int rc;
+
+    if ( !lload_cache_watch ) {
+        /* Nothing would ever tell us a password has changed */
+        if ( lload_bind_cache_size && !lload_bind_cache_ttl ) {
+            Debug( LDAP_DEBUG_ANY, "lload_cache_watch_start: "
+                    "bind_cache_ttl 0 requires cache_watch\n" );
+            return -1;
+        }
+        return LDAP_SUCCESS;
+    }
+
+    /* Watch the whole subtree unless told otherwise */
+    if ( ldap_url_parse_ext( lload_cache_watch, &lud,
+                 LDAP_PVT_URL_PARSE_NOEMPTY_HOST |
+                         LDAP_PVT_URL_PARSE_DEF_PORT ) != LDAP_URL_SUCCESS ) {
+        Debug( LDAP_DEBUG_ANY, "lload_cache_watch_start: "
+                "cannot parse URL %s\n",
+                lload_cache_watch );
+        return -1;
+    }
+
+    cache_watch_running = 1;
+    rc = ldap_pvt_thread_create(
+            &cache_watch_tid, 0, cache_watch_task, lud );
+    if ( rc ) {
+        Debug( LDAP_DEBUG_ANY, "lload_cache_watch_start: "
+                "ldap_pvt_thread_create failed (%d)\n",
+                rc );
+        cache_watch_running = 0;
+        ldap_free_urldesc( lud );
+    }
+    return rc;
+}
+
+void
+lload_cache_watch_stop( void )
+{
+    if ( cache_watch_running ) {
+        cache_watch_running = 0;
+        ldap_pvt_thread_join( cache_watch_tid, (void *)NULL );
+    }
+}
+
+void
+lload_cache_init( void )
+{
+    ldap_pvt_thread_mutex_init( &cache_mutex );
+}
+
+void
+lload_cache_destroy( void )
+{
+    lload_cache_flush();
+    ldap_pvt_thread_mutex_destroy( &cache_mutex );
+
+    if ( lload_cache_watch ) {
+        ch_free( lload_cache_watch );
+        lload_cache_watch = NULL;
+    }
+}
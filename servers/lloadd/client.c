@@ -177,6 +177,19 @@ request_process( LloadConnection *client, LloadOperation *op )
     }
     CONNECTION_UNLOCK(client);
 
+    /* Only consult the cache once, we might be coming back from the queue */
+    if ( op->o_tag == LDAP_REQ_SEARCH && lload_cache_size && !op->o_cache &&
+            op->o_restricted == LLOAD_OP_NOT_RESTRICTED &&
+            lload_cache_request( client, op ) == LDAP_SUCCESS ) {
+        return rc;
+    }
+    lload_cache_write( op );
+
+    /* Do not overtake operations already waiting for a slot */
+    if ( lload_queue_operation( op, 0 ) == LDAP_SUCCESS ) {
+        return rc;
+    }
+
     if ( upstream ) {
         b = upstream->c_backend;
         checked_lock( &b->b_mutex );
@@ -191,6 +204,14 @@ request_process( LloadConnection *client, LloadOperation *op )
     }
 
     if ( !upstream ) {
+        if ( res == LDAP_BUSY &&
+                lload_queue_operation( op, 1 ) == LDAP_SUCCESS ) {
+            Debug( LDAP_DEBUG_TRACE, "request_process: "
+                    "connid=%lu, msgid=%d queued until a connection is "
+                    "available\n",
+                    op->o_client_connid, op->o_client_msgid );
+            return rc;
+        }
         Debug( LDAP_DEBUG_STATS, "request_process: "
                 "connid=%lu, msgid=%d no available connection found\n",
                 op->o_client_connid, op->o_client_msgid );
@@ -210,11 +231,13 @@ request_process( LloadConnection *client, LloadOperation *op )
         LloadBackend *b = upstream->c_backend;
 
         upstream->c_n_ops_executing--;
+        upstream->c_n_ops_class[op->o_class]--;
         checked_unlock( &upstream->c_io_mutex );
         CONNECTION_UNLOCK(upstream);
 
         checked_lock( &b->b_mutex );
         b->b_n_ops_executing--;
+        backend_conn_ready( b, upstream );
         checked_unlock( &b->b_mutex );
 
         assert( !IS_ALIVE( client, c_live ) );
@@ -231,11 +254,13 @@ request_process( LloadConnection *client, LloadOperation *op )
         LloadBackend *b = upstream->c_backend;
 
         upstream->c_n_ops_executing--;
+        upstream->c_n_ops_class[op->o_class]--;
         CONNECTION_UNLOCK(upstream);
         checked_unlock( &upstream->c_io_mutex );
 
         checked_lock( &b->b_mutex );
         b->b_n_ops_executing--;
+        backend_conn_ready( b, upstream );
         operation_update_backend_counters( op, b );
         checked_unlock( &b->b_mutex );
 
@@ -263,9 +288,10 @@ request_process( LloadConnection *client, LloadOperation *op )
 
     Debug( LDAP_DEBUG_TRACE, "request_process: "
             "client connid=%lu added %s msgid=%d to upstream connid=%lu as "
-            "msgid=%d\n",
+            "msgid=%d, I/O thread %d to %d\n",
             op->o_client_connid, lload_msgtype2str( op->o_tag ),
-            op->o_client_msgid, op->o_upstream_connid, op->o_upstream_msgid );
+            op->o_client_msgid, op->o_upstream_connid, op->o_upstream_msgid,
+            op->o_client_tid, upstream->c_tid );
     assert( rc == LDAP_SUCCESS );
 
     lload_stats.counters[LLOAD_STATS_OPS_OTHER].lc_ops_forwarded++;
@@ -459,7 +485,7 @@ client_tls_handshake_cb( evutil_socket_t s, short what, void *arg )
      * permitted to Abandon a StartTLS exop per RFC4511 anyway.
      */
     checked_lock( &c->c_io_mutex );
-    if ( c->c_pendingber ) {
+    if ( c->c_pendingber || c->c_outq_len ) {
         checked_unlock( &c->c_io_mutex );
         connection_write_cb( s, what, arg );
 
@@ -470,7 +496,7 @@ client_tls_handshake_cb( evutil_socket_t s, short what, void *arg )
         /* Do we still have data pending? If so, connection_write_cb would
          * already have arranged the write callback to trigger again */
         checked_lock( &c->c_io_mutex );
-        if ( c->c_pendingber ) {
+        if ( c->c_pendingber || c->c_outq_len ) {
             checked_unlock( &c->c_io_mutex );
             return;
         }
@@ -509,6 +535,7 @@ client_tls_handshake_cb( evutil_socket_t s, short what, void *arg )
                 c->c_connid );
 
         c->c_is_tls = LLOAD_TLS_ESTABLISHED;
+        connection_tls_established( c, 0 );
         CONNECTION_UNLOCK(c);
         return;
     } else if ( ber_sockbuf_ctrl( c->c_sb, LBER_SB_OPT_NEEDS_WRITE, NULL ) ) {
@@ -576,6 +603,8 @@ client_init(
         if ( rc ) {
             c->c_read_timeout = lload_timeout_net;
             read_cb = write_cb = client_tls_handshake_cb;
+        } else {
+            connection_tls_established( c, 0 );
         }
 #else /* ! HAVE_TLS */
         assert(0);
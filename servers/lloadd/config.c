@@ -113,6 +113,7 @@ static ConfigDriver config_tier;
 static ConfigDriver config_backend;
 static ConfigDriver config_bindconf;
 static ConfigDriver config_restrict_oid;
+static ConfigDriver config_class_limit;
 #ifdef LDAP_TCP_BUFFER
 static ConfigDriver config_tcp_buffer;
 #endif /* LDAP_TCP_BUFFER */
@@ -175,6 +176,13 @@ enum {
     CFG_RESTRICT_CONTROL,
     CFG_TIER,
     CFG_WEIGHT,
+    CFG_CACHE_SIZE,
+    CFG_CACHE_WATCH,
+    CFG_CLASS_LIMIT,
+    CFG_BIND_CACHE_SIZE,
+    CFG_BIND_CACHE_TTL,
+    CFG_TLS_TICKET_LIFETIME,
+    CFG_TLS_KTLS,
 
     CFG_LAST
 };
@@ -615,6 +623,36 @@ static ConfigTable config_back_cf_table[] = {
             "SINGLE-VALUE )",
         NULL, NULL
     },
+    { "TLSTicketLifetime", NULL, 2, 2, 0,
+#ifdef HAVE_TLS
+        CFG_TLS_TICKET_LIFETIME|ARG_STRING|ARG_MAGIC,
+        &config_tls_config,
+#else
+        ARG_IGNORED,
+        NULL,
+#endif
+        "( OLcfgBkAt:13.50 "
+            "NAME 'olcBkLloadTLSTicketLifetime' "
+            "EQUALITY integerMatch "
+            "SYNTAX OMsInteger "
+            "SINGLE-VALUE )",
+        NULL, NULL
+    },
+    { "TLSKTLS", NULL, 2, 2, 0,
+#ifdef HAVE_TLS
+        CFG_TLS_KTLS|ARG_STRING|ARG_MAGIC,
+        &config_tls_config,
+#else
+        ARG_IGNORED,
+        NULL,
+#endif
+        "( OLcfgBkAt:13.51 "
+            "NAME 'olcBkLloadTLSKTLS' "
+            "EQUALITY booleanMatch "
+            "SYNTAX OMsBoolean "
+            "SINGLE-VALUE )",
+        NULL, NULL
+    },
     { "TLSShareSlapdCTX", NULL, 2, 2, 0,
 #if defined(HAVE_TLS) && defined(BALANCER_MODULE)
         CFG_TLS_SHARE_CTX|ARG_ON_OFF|ARG_MAGIC,
@@ -686,6 +724,111 @@ static ConfigTable config_back_cf_table[] = {
             "SYNTAX OMsDirectoryString )",
         NULL, NULL
     },
+    { "cache_size", "entries", 2, 2, 0,
+        ARG_UINT|ARG_MAGIC|CFG_CACHE_SIZE,
+        &config_generic,
+        "( OLcfgBkAt:13.41 "
+            "NAME 'olcBkLloadCacheSize' "
+            "DESC 'Number of search responses to cache' "
+            "EQUALITY integerMatch "
+            "SYNTAX OMsInteger "
+            "SINGLE-VALUE )",
+        NULL,
+        { .v_uint = 0 }
+    },
+    { "cache_ttl", "seconds", 2, 2, 0,
+        ARG_UINT,
+        &lload_cache_ttl,
+        "( OLcfgBkAt:13.42 "
+            "NAME 'olcBkLloadCacheTTL' "
+            "DESC 'How long to keep a cached search response' "
+            "EQUALITY integerMatch "
+            "SYNTAX OMsInteger "
+            "SINGLE-VALUE )",
+        NULL,
+        { .v_uint = 60 }
+    },
+    { "cache_watch", "URL", 2, 2, 0,
+        ARG_STRING|ARG_MAGIC|CFG_CACHE_WATCH,
+        &config_generic,
+        "( OLcfgBkAt:13.43 "
+            "NAME 'olcBkLloadCacheWatch' "
+            "DESC 'Server to watch for changes invalidating the cache' "
+            "EQUALITY caseIgnoreMatch "
+            "SYNTAX OMsDirectoryString "
+            "SINGLE-VALUE )",
+        NULL, NULL
+    },
+    { "class_limit", "class> <max pending> <queue timeout", 4, 4, 0,
+        ARG_MAGIC|CFG_CLASS_LIMIT,
+        &config_class_limit,
+        "( OLcfgBkAt:13.44 "
+            "NAME 'olcBkLloadClassLimit' "
+            "DESC 'Per upstream connection limit and queueing timeout for a class of operations' "
+            "EQUALITY caseIgnoreMatch "
+            "SYNTAX OMsDirectoryString )",
+        NULL, NULL
+    },
+    { "queue_max", "operations", 2, 2, 0,
+        ARG_UINT,
+        &lload_queue_max,
+        "( OLcfgBkAt:13.45 "
+            "NAME 'olcBkLloadQueueMax' "
+            "DESC 'Maximum number of operations waiting for an upstream connection' "
+            "EQUALITY integerMatch "
+            "SYNTAX OMsInteger "
+            "SINGLE-VALUE )",
+        NULL,
+        { .v_uint = 1024 }
+    },
+    { "bind_cache_size", "entries", 2, 2, 0,
+        ARG_UINT|ARG_MAGIC|CFG_BIND_CACHE_SIZE,
+        &config_generic,
+        "( OLcfgBkAt:13.46 "
+            "NAME 'olcBkLloadBindCacheSize' "
+            "DESC 'Number of verified simple bind credentials to remember' "
+            "EQUALITY integerMatch "
+            "SYNTAX OMsInteger "
+            "SINGLE-VALUE )",
+        NULL,
+        { .v_uint = 0 }
+    },
+    { "bind_cache_ttl", "seconds", 2, 2, 0,
+        ARG_UINT|ARG_MAGIC|CFG_BIND_CACHE_TTL,
+        &config_generic,
+        "( OLcfgBkAt:13.47 "
+            "NAME 'olcBkLloadBindCacheTTL' "
+            "DESC 'How long to remember verified bind credentials' "
+            "EQUALITY integerMatch "
+            "SYNTAX OMsInteger "
+            "SINGLE-VALUE )",
+        NULL,
+        { .v_uint = 10 }
+    },
+    { "hash_depth", "rdns", 2, 2, 0,
+        ARG_UINT,
+        &lload_hash_depth,
+        "( OLcfgBkAt:13.48 "
+            "NAME 'olcBkLloadHashDepth' "
+            "DESC 'Number of trailing RDNs of the target DN the hash tier routes on' "
+            "EQUALITY integerMatch "
+            "SYNTAX OMsInteger "
+            "SINGLE-VALUE )",
+        NULL,
+        { .v_uint = 0 }
+    },
+    { "hash_load_bound", "percent", 2, 2, 0,
+        ARG_UINT,
+        &lload_hash_load_bound,
+        "( OLcfgBkAt:13.49 "
+            "NAME 'olcBkLloadHashLoadBound' "
+            "DESC 'How far above the average load the hash tier lets a backend go' "
+            "EQUALITY integerMatch "
+            "SYNTAX OMsInteger "
+            "SINGLE-VALUE )",
+        NULL,
+        { .v_uint = 125 }
+    },
 
     /* cn=config only options */
 #ifdef BALANCER_MODULE
@@ -818,12 +961,23 @@ static ConfigOCs lloadocs[] = {
             "$ olcBkLloadTLSDHParamFile "
             "$ olcBkLloadTLSECName "
             "$ olcBkLloadTLSProtocolMin "
+            "$ olcBkLloadTLSTicketLifetime "
+            "$ olcBkLloadTLSKTLS "
             "$ olcBkLloadTLSCRLFile "
             "$ olcBkLloadTLSShareSlapdCTX "
             "$ olcBkLloadClientMaxPending "
             "$ olcBkLloadWriteCoherence "
             "$ olcBkLloadRestrictExop "
             "$ olcBkLloadRestrictControl "
+            "$ olcBkLloadCacheSize "
+            "$ olcBkLloadCacheTTL "
+            "$ olcBkLloadCacheWatch "
+            "$ olcBkLloadClassLimit "
+            "$ olcBkLloadQueueMax "
+            "$ olcBkLloadBindCacheSize "
+            "$ olcBkLloadBindCacheTTL "
+            "$ olcBkLloadHashDepth "
+            "$ olcBkLloadHashLoadBound "
         ") )",
         Cft_Backend, config_back_cf_table,
         NULL,
@@ -910,6 +1064,22 @@ config_generic( ConfigArgs *c )
             case CFG_CLIENT_PENDING:
                 c->value_uint = lload_client_max_pending;
                 break;
+            case CFG_CACHE_SIZE:
+                c->value_uint = lload_cache_size;
+                break;
+            case CFG_BIND_CACHE_SIZE:
+                c->value_uint = lload_bind_cache_size;
+                break;
+            case CFG_BIND_CACHE_TTL:
+                c->value_uint = lload_bind_cache_ttl;
+                break;
+            case CFG_CACHE_WATCH:
+                if ( lload_cache_watch ) {
+                    c->value_string = ch_strdup( lload_cache_watch );
+                } else {
+                    rc = 1;
+                }
+                break;
             default:
                 rc = 1;
                 break;
@@ -918,8 +1088,21 @@ config_generic( ConfigArgs *c )
 
     } else if ( c->op == LDAP_MOD_DELETE ) {
         /* We only need to worry about deletions to multi-value or MAY
-         * attributes that belong to the lloadd module - we don't have any at
-         * the moment */
+         * attributes that belong to the lloadd module */
+        switch ( c->type ) {
+            case CFG_CACHE_SIZE:
+                lload_cache_resize( 0 );
+                break;
+            case CFG_BIND_CACHE_SIZE:
+                lload_bind_cache_resize( 0 );
+                break;
+            case CFG_CACHE_WATCH:
+                snprintf( c->cr_msg, sizeof(c->cr_msg),
+                        "cache_watch changes will not take effect until "
+                        "restart" );
+                Debug( LDAP_DEBUG_ANY, "%s: %s\n", c->log, c->cr_msg );
+                break;
+        }
         return rc;
     }
 
@@ -1056,6 +1239,52 @@ config_generic( ConfigArgs *c )
         case CFG_CLIENT_PENDING:
             lload_client_max_pending = c->value_uint;
             break;
+        case CFG_CACHE_SIZE:
+            lload_cache_resize( c->value_uint );
+            break;
+        case CFG_BIND_CACHE_SIZE:
+            if ( lloadd_inited && c->value_uint && !lload_bind_cache_ttl &&
+                    !lload_cache_watch ) {
+                snprintf( c->cr_msg, sizeof(c->cr_msg),
+                        "bind_cache_ttl 0 requires cache_watch" );
+                goto fail;
+            }
+            lload_bind_cache_resize( c->value_uint );
+            break;
+        case CFG_BIND_CACHE_TTL:
+            if ( lloadd_inited && !c->value_uint && lload_bind_cache_size &&
+                    !lload_cache_watch ) {
+                snprintf( c->cr_msg, sizeof(c->cr_msg),
+                        "bind_cache_ttl 0 requires cache_watch" );
+                goto fail;
+            }
+            lload_bind_cache_ttl = c->value_uint;
+            break;
+        case CFG_CACHE_WATCH: {
+            LDAPURLDesc *lud;
+
+            if ( ldap_url_parse( c->value_string, &lud ) ) {
+                snprintf( c->cr_msg, sizeof(c->cr_msg),
+                        "string %s could not be parsed as an LDAP URL",
+                        c->value_string );
+                ch_free( c->value_string );
+                goto fail;
+            }
+            ldap_free_urldesc( lud );
+
+            if ( lloadd_inited ) {
+                snprintf( c->cr_msg, sizeof(c->cr_msg),
+                        "cache_watch changes will not take effect until "
+                        "restart" );
+                Debug( LDAP_DEBUG_ANY, "%s: %s\n", c->log, c->cr_msg );
+                ch_free( c->value_string );
+                break;
+            }
+            if ( lload_cache_watch ) {
+                ch_free( lload_cache_watch );
+            }
+            lload_cache_watch = c->value_string;
+        } break;
         default:
             Debug( LDAP_DEBUG_ANY, "%s: unknown CFG_TYPE %d\n",
                     c->log, c->type );
@@ -1517,6 +1746,77 @@ done:
     return rc;
 }
 
+static int
+config_class_limit( ConfigArgs *c )
+{
+    struct lload_op_class_limits *oc;
+    long max_pending;
+    unsigned int queue_timeout;
+    int i;
+
+    if ( c->op == SLAP_CONFIG_EMIT ) {
+        struct berval bv = { .bv_val = c->cr_msg };
+
+        for ( oc = lload_op_classes; oc->name; oc++ ) {
+            if ( !oc->max_pending && !oc->queue_timeout ) {
+                continue;
+            }
+            bv.bv_len = snprintf( bv.bv_val, sizeof(c->cr_msg), "%s %ld %u",
+                    oc->name, oc->max_pending, oc->queue_timeout );
+            value_add_one( &c->rvalue_vals, &bv );
+        }
+        return LDAP_SUCCESS;
+
+    } else if ( c->op == LDAP_MOD_DELETE ) {
+        for ( oc = lload_op_classes; oc->name; oc++ ) {
+            size_t len = strlen( oc->name );
+
+            if ( !c->line || ( !strncasecmp( c->line, oc->name, len ) &&
+                                     c->line[len] == ' ' ) ) {
+                oc->max_pending = 0;
+                oc->queue_timeout = 0;
+            }
+        }
+        return LDAP_SUCCESS;
+    }
+
+    for ( i = 0; lload_op_classes[i].name; i++ ) {
+        if ( !strcasecmp( c->argv[1], lload_op_classes[i].name ) ) {
+            break;
+        }
+    }
+    oc = &lload_op_classes[i];
+
+    if ( !oc->name ) {
+        snprintf( c->cr_msg, sizeof(c->cr_msg), "Unknown operation class %s",
+                c->argv[1] );
+        goto fail;
+    }
+    if ( lutil_atol( &max_pending, c->argv[2] ) || max_pending < 0 ) {
+        snprintf( c->cr_msg, sizeof(c->cr_msg),
+                "Invalid maximum pending operations %s", c->argv[2] );
+        goto fail;
+    }
+    if ( lutil_atoux( &queue_timeout, c->argv[3], 0 ) ) {
+        snprintf( c->cr_msg, sizeof(c->cr_msg), "Invalid queue timeout %s",
+                c->argv[3] );
+        goto fail;
+    }
+    if ( i == LLOAD_OPCLASS_BIND && queue_timeout ) {
+        snprintf( c->cr_msg, sizeof(c->cr_msg),
+                "Bind operations cannot be queued" );
+        goto fail;
+    }
+
+    oc->max_pending = max_pending;
+    oc->queue_timeout = queue_timeout;
+    return LDAP_SUCCESS;
+
+fail:
+    Debug( LDAP_DEBUG_ANY, "%s: %s\n", c->log, c->cr_msg );
+    return 1;
+}
+
 static int
 config_tier( ConfigArgs *c )
 {
@@ -2025,6 +2325,7 @@ config_feature( ConfigArgs *c )
 #endif /* LDAP_API_FEATURE_VERIFY_CREDENTIALS */
         { BER_BVC("proxyauthz"), LLOAD_FEATURE_PROXYAUTHZ },
         { BER_BVC("read_pause"), LLOAD_FEATURE_PAUSE },
+        { BER_BVC("affinity"), LLOAD_FEATURE_AFFINITY },
         { BER_BVNULL, 0 }
     };
     slap_mask_t mask = 0;
@@ -2194,6 +2495,12 @@ config_tls_config( ConfigArgs *c )
         case CFG_TLS_PROTOCOL_MIN:
             flag = LDAP_OPT_X_TLS_PROTOCOL_MIN;
             break;
+        case CFG_TLS_TICKET_LIFETIME:
+            flag = LDAP_OPT_X_TLS_TICKET_LIFETIME;
+            break;
+        case CFG_TLS_KTLS:
+            flag = LDAP_OPT_X_TLS_KTLS;
+            break;
         default:
             Debug( LDAP_DEBUG_ANY, "%s: "
                     "unknown tls_option <0x%x>\n",
@@ -2868,6 +3175,8 @@ static slap_cf_aux_table bindkey[] = {
     { BER_BVC("tls_cipher_suite="), offsetof(slap_bindconf, sb_tls_cipher_suite), 's', 0, NULL },
     { BER_BVC("tls_protocol_min="), offsetof(slap_bindconf, sb_tls_protocol_min), 's', 0, NULL },
     { BER_BVC("tls_ecname="), offsetof(slap_bindconf, sb_tls_ecname), 's', 0, NULL },
+    { BER_BVC("tls_ticket_lifetime="), offsetof(slap_bindconf, sb_tls_ticket_lifetime), 's', 0, NULL },
+    { BER_BVC("tls_ktls="), offsetof(slap_bindconf, sb_tls_ktls), 's', 0, NULL },
 #ifdef HAVE_OPENSSL
     { BER_BVC("tls_crlcheck="), offsetof(slap_bindconf, sb_tls_crlcheck), 's', 0, NULL },
 #endif
@@ -3130,6 +3439,21 @@ lload_tls_get_config( LDAP *ld, int opt, char **val )
             *val = ch_strdup( buf );
             return 0;
         }
+        case LDAP_OPT_X_TLS_TICKET_LIFETIME: {
+            char buf[16];
+            ldap_pvt_tls_get_option( ld, opt, &ival );
+            if ( ival ) {
+                snprintf( buf, sizeof(buf), "%d", ival );
+                *val = ch_strdup( buf );
+            }
+            return 0;
+        }
+        case LDAP_OPT_X_TLS_KTLS:
+            ldap_pvt_tls_get_option( ld, opt, &ival );
+            if ( ival ) {
+                *val = ch_strdup( "TRUE" );
+            }
+            return 0;
         default:
             return -1;
     }
@@ -3220,6 +3544,28 @@ lload_bindconf_tls_set( slap_bindconf *bc, LDAP *ld )
             } else
                 newctx = 1;
         }
+        if ( bc->sb_tls_ticket_lifetime ) {
+            rc = ldap_pvt_tls_config( ld, LDAP_OPT_X_TLS_TICKET_LIFETIME,
+                    bc->sb_tls_ticket_lifetime );
+            if ( rc ) {
+                Debug( LDAP_DEBUG_ANY, "lload_bindconf_tls_set: "
+                        "failed to set tls_ticket_lifetime to %s\n",
+                        bc->sb_tls_ticket_lifetime );
+                res = -1;
+            } else
+                newctx = 1;
+        }
+        if ( bc->sb_tls_ktls ) {
+            rc = ldap_pvt_tls_config(
+                    ld, LDAP_OPT_X_TLS_KTLS, bc->sb_tls_ktls );
+            if ( rc ) {
+                Debug( LDAP_DEBUG_ANY, "lload_bindconf_tls_set: "
+                        "failed to set tls_ktls to %s\n",
+                        bc->sb_tls_ktls );
+                res = -1;
+            } else
+                newctx = 1;
+        }
 #ifdef HAVE_OPENSSL
         if ( bc->sb_tls_crlcheck ) {
             rc = ldap_pvt_tls_config(
@@ -3364,6 +3710,14 @@ lload_bindconf_free( slap_bindconf *bc )
         ch_free( bc->sb_tls_protocol_min );
         bc->sb_tls_protocol_min = NULL;
     }
+    if ( bc->sb_tls_ticket_lifetime ) {
+        ch_free( bc->sb_tls_ticket_lifetime );
+        bc->sb_tls_ticket_lifetime = NULL;
+    }
+    if ( bc->sb_tls_ktls ) {
+        ch_free( bc->sb_tls_ktls );
+        bc->sb_tls_ktls = NULL;
+    }
 #ifdef HAVE_OPENSSL_CRL
     if ( bc->sb_tls_crlcheck ) {
         ch_free( bc->sb_tls_crlcheck );
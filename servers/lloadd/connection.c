@@ -295,6 +295,31 @@ out:
     epoch_leave( epoch );
 }
 
+/*
+ * Write out everything queued on the connection, spliced PDUs first. Returns
+ * non-zero if not all of it could be written.
+ */
+static int
+connection_flush( LloadConnection *c )
+{
+    assert_locked( &c->c_io_mutex );
+
+    while ( c->c_outq_len ) {
+        if ( ber_flush( c->c_sb, c->c_outq[c->c_outq_head], 1 ) ) {
+            return -1;
+        }
+        c->c_outq[c->c_outq_head] = NULL;
+        c->c_outq_head = ( c->c_outq_head + 1 ) % LLOAD_OUTQ_SIZE;
+        c->c_outq_len--;
+    }
+
+    if ( c->c_pendingber && ber_flush( c->c_sb, c->c_pendingber, 1 ) ) {
+        return -1;
+    }
+    c->c_pendingber = NULL;
+    return 0;
+}
+
 void
 connection_write_cb( evutil_socket_t s, short what, void *arg )
 {
@@ -337,7 +362,7 @@ connection_write_cb( evutil_socket_t s, short what, void *arg )
             c->c_connid );
 
     /* We might have been beaten to flushing the data by another thread */
-    if ( c->c_pendingber && ber_flush( c->c_sb, c->c_pendingber, 1 ) ) {
+    if ( connection_flush( c ) ) {
         int err = sock_errno();
 
         if ( err != EWOULDBLOCK && err != EAGAIN ) {
@@ -361,7 +386,6 @@ connection_write_cb( evutil_socket_t s, short what, void *arg )
         /* TODO: Do not reset write timeout unless we wrote something */
         event_add( c->c_write_event, lload_write_timeout );
     } else {
-        c->c_pendingber = NULL;
         if ( c->c_io_state & LLOAD_C_READ_PAUSE ) {
             c->c_io_state ^= LLOAD_C_READ_PAUSE;
             Debug( LDAP_DEBUG_CONNS, "connection_write_cb: "
@@ -404,6 +428,12 @@ connection_destroy( LloadConnection *c )
         ber_free( c->c_pendingber, 1 );
         c->c_pendingber = NULL;
     }
+    while ( c->c_outq_len ) {
+        ber_free( c->c_outq[c->c_outq_head], 1 );
+        c->c_outq[c->c_outq_head] = NULL;
+        c->c_outq_head = ( c->c_outq_head + 1 ) % LLOAD_OUTQ_SIZE;
+        c->c_outq_len--;
+    }
 
     if ( !BER_BVISNULL( &c->c_sasl_bind_mech ) ) {
         ber_memfree( c->c_sasl_bind_mech.bv_val );
@@ -512,6 +542,47 @@ connections_walk(
     return connections_walk_last( cq_mutex, cq, cq_last, cb, arg );
 }
 
+#ifdef HAVE_TLS
+/*
+ * Account for a finished TLS handshake, upstream is set when we were the
+ * client.
+ */
+void
+connection_tls_established( LloadConnection *c, int upstream )
+{
+    void *ssl = ldap_pvt_tls_sb_ctx( c->c_sb );
+    int resumed;
+
+    if ( !ssl ) return;
+
+    resumed = ldap_pvt_tls_get_resumed( ssl );
+    if ( upstream ) {
+        __atomic_add_fetch( &lload_stats.global_tls_upstream_handshakes, 1,
+                __ATOMIC_RELAXED );
+        if ( resumed ) {
+            __atomic_add_fetch( &lload_stats.global_tls_upstream_resumed, 1,
+                    __ATOMIC_RELAXED );
+        }
+    } else {
+        __atomic_add_fetch( &lload_stats.global_tls_client_handshakes, 1,
+                __ATOMIC_RELAXED );
+        if ( resumed ) {
+            __atomic_add_fetch( &lload_stats.global_tls_client_resumed, 1,
+                    __ATOMIC_RELAXED );
+        }
+    }
+    if ( ldap_pvt_tls_get_ktls( ssl ) ) {
+        __atomic_add_fetch( &lload_stats.global_ktls, 1, __ATOMIC_RELAXED );
+    }
+
+    Debug( LDAP_DEBUG_CONNS, "connection_tls_established: "
+            "connid=%lu %s %s session%s\n",
+            c->c_connid, upstream ? "upstream" : "client",
+            resumed ? "resumed" : "new",
+            ldap_pvt_tls_get_ktls( ssl ) ? ", kernel TLS" : "" );
+}
+#endif /* HAVE_TLS */
+
 int
 lload_connection_close( LloadConnection *c, void *arg )
 {
@@ -596,6 +667,7 @@ lload_connection_init( ber_socket_t s, const char *peername, int flags )
     c = ch_calloc( 1, sizeof(LloadConnection) );
 
     c->c_fd = s;
+    c->c_tid = lload_get_tid( s );
     c->c_sb = ber_sockbuf_alloc();
     ber_sockbuf_ctrl( c->c_sb, LBER_SB_OPT_SET_FD, &s );
 
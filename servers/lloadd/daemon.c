@@ -781,6 +781,10 @@ lloadd_daemon_destroy( void )
 
         event_free( lload_stats_event );
         event_free( lload_timeout_event );
+        if ( lload_queue_event ) {
+            event_free( lload_queue_event );
+            lload_queue_event = NULL;
+        }
 
         event_base_free( daemon_base );
         daemon_base = NULL;
@@ -1286,6 +1290,10 @@ lloadd_daemon( struct event_base *daemon_base )
         }
     }
 
+    if ( lload_cache_watch_start() ) {
+        return -1;
+    }
+
     event = event_new( daemon_base, -1, EV_TIMEOUT|EV_PERSIST,
             lload_tiers_update, NULL );
     if ( !event ) {
@@ -1310,6 +1318,15 @@ lloadd_daemon( struct event_base *daemon_base )
         event_add( event, lload_timeout_api );
     }
 
+    /* Only ever activated or added by itself */
+    event = evtimer_new( daemon_base, lload_queue_dispatch, event_self_cbarg() );
+    if ( !event ) {
+        Debug( LDAP_DEBUG_ANY, "lloadd: "
+                "failed to allocate queue dispatch event\n" );
+        return -1;
+    }
+    lload_queue_event = event;
+
     checked_lock( &lload_wait_mutex );
     lloadd_inited = 1;
     ldap_pvt_thread_cond_signal( &lload_wait_cond );
@@ -1333,6 +1350,9 @@ lloadd_daemon( struct event_base *daemon_base )
     /* wait for the listener threads to complete */
     destroy_listeners();
 
+    /* No more cache invalidation from now on */
+    lload_cache_watch_stop();
+
     /* Mark upstream connections closing and prevent from opening new ones */
     lload_tiers_shutdown();
 
@@ -1364,6 +1384,7 @@ lloadd_daemon( struct event_base *daemon_base )
 
     lload_tiers_destroy();
     clients_destroy( 0 );
+    lload_cache_flush();
     lload_bindconf_free( &bindconf );
     evdns_base_free( dnsbase, 0 );
 
@@ -1704,6 +1725,8 @@ lload_handle_global_invalidation( LloadChange *change )
          *   - off: clear c_auth/privileged on each client
          * - read pause (WIP):
          *   - nothing needed?
+         * - affinity:
+         *   - nothing needed, connections stay on the thread they are on
          */
 
         assert( change->target );
@@ -1714,6 +1737,9 @@ lload_handle_global_invalidation( LloadChange *change )
         if ( feature_diff & LLOAD_FEATURE_PAUSE ) {
             feature_diff &= ~LLOAD_FEATURE_PAUSE;
         }
+        if ( feature_diff & LLOAD_FEATURE_AFFINITY ) {
+            feature_diff &= ~LLOAD_FEATURE_AFFINITY;
+        }
         if ( feature_diff & LLOAD_FEATURE_PROXYAUTHZ ) {
             if ( !(lload_features & LLOAD_FEATURE_PROXYAUTHZ) ) {
                 LloadConnection *c;
@@ -1927,6 +1953,19 @@ lload_get_base( ber_socket_t s )
     return lload_daemon[tid].base;
 }
 
+int
+lload_get_tid( ber_socket_t s )
+{
+    return DAEMON_ID(s);
+}
+
+struct event_base *
+lload_get_tid_base( int tid )
+{
+    assert( tid >= 0 && tid < lload_daemon_threads );
+    return lload_daemon[tid].base;
+}
+
 LloadListener **
 lloadd_get_listeners( void )
 {
@@ -98,6 +98,8 @@ lload_global_init( void )
 
     ldap_pvt_thread_mutex_init( &clients_mutex );
     ldap_pvt_thread_mutex_init( &lload_pin_mutex );
+    lload_cache_init();
+    lload_queue_init();
 
     if ( lload_exop_init() ) {
         return -1;
@@ -120,9 +122,11 @@ lload_global_destroy( void )
 #ifdef HAVE_TLS
     if ( lload_tls_backend_ld ) {
         ldap_unbind_ext( lload_tls_backend_ld, NULL, NULL );
+        lload_tls_backend_ld = NULL;
     }
     if ( lload_tls_ld ) {
         ldap_unbind_ext( lload_tls_ld, NULL, NULL );
+        lload_tls_ld = NULL;
     }
 #endif
 
@@ -132,6 +136,8 @@ lload_global_destroy( void )
 
     ldap_pvt_thread_mutex_destroy( &clients_mutex );
     ldap_pvt_thread_mutex_destroy( &lload_pin_mutex );
+    lload_cache_destroy();
+    lload_queue_destroy();
 
     lload_libevent_destroy();
 
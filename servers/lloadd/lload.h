@@ -82,6 +82,17 @@ LDAP_BEGIN_DECL
 
 #define LLOAD_CONN_MAX_PDUS_PER_CYCLE_DEFAULT 10
 
+/* Weight of the latest sample in the latency average is 2^-LLOAD_EWMA_SHIFT */
+#define LLOAD_EWMA_SHIFT 3
+
+#define LLOAD_CACHE_MAX_RESPONSE ( 1 << 16 )
+#define LLOAD_CACHE_WATCH_RETRY 10
+
+/* Search entries at least this large are passed on without being copied */
+#define LLOAD_SPLICE_MIN ( 1 << 12 )
+/* How many spliced PDUs can be waiting to be written on a connection */
+#define LLOAD_OUTQ_SIZE 16
+
 #define BER_BV_OPTIONAL( bv ) ( BER_BVISNULL( bv ) ? NULL : ( bv ) )
 
 #include <epoch.h>
@@ -104,11 +115,14 @@ typedef struct LloadPendingConnection LloadPendingConnection;
 typedef struct LloadConnection LloadConnection;
 typedef struct LloadOperation LloadOperation;
 typedef struct LloadChange LloadChange;
+typedef struct LloadCacheEntry LloadCacheEntry;
 /* end of forward declarations */
 
 typedef LDAP_STAILQ_HEAD(TierSt, LloadTier) lload_t_head;
 typedef LDAP_CIRCLEQ_HEAD(BeSt, LloadBackend) lload_b_head;
 typedef LDAP_CIRCLEQ_HEAD(ConnSt, LloadConnection) lload_c_head;
+typedef LDAP_TAILQ_HEAD(ReadySt, LloadConnection) lload_r_head;
+typedef LDAP_TAILQ_HEAD(OpQueueSt, LloadOperation) lload_o_head;
 
 LDAP_SLAPD_V (lload_t_head) tiers;
 LDAP_SLAPD_V (lload_c_head) clients;
@@ -181,10 +195,12 @@ typedef enum {
 #endif /* LDAP_API_FEATURE_VERIFY_CREDENTIALS */
     LLOAD_FEATURE_PROXYAUTHZ = 1 << 1,
     LLOAD_FEATURE_PAUSE = 1 << 2,
+    LLOAD_FEATURE_AFFINITY = 1 << 3,
 } lload_features_t;
 
 #define LLOAD_FEATURE_SUPPORTED_MASK ( \
     LLOAD_FEATURE_PROXYAUTHZ | \
+    LLOAD_FEATURE_AFFINITY | \
     0 )
 
 #ifdef BALANCER_MODULE
@@ -216,6 +232,8 @@ typedef struct lload_counters_t {
     ldap_pvt_mp_t lc_ops_forwarded;
     ldap_pvt_mp_t lc_ops_rejected;
     ldap_pvt_mp_t lc_ops_failed;
+    ldap_pvt_mp_t lc_ops_cache_hits;
+    ldap_pvt_mp_t lc_ops_cache_misses;
 } lload_counters_t;
 
 enum {
@@ -224,10 +242,26 @@ enum {
     LLOAD_STATS_OPS_LAST
 };
 
+/* Counts of samples by upper bound, the last bucket has no upper bound */
+typedef struct lload_histogram_t {
+    int lh_nbuckets;
+    const unsigned long *lh_bounds;
+    uintptr_t *lh_counts;
+} lload_histogram_t;
+
 typedef struct lload_global_stats_t {
     ldap_pvt_mp_t global_incoming;
     ldap_pvt_mp_t global_outgoing;
     lload_counters_t counters[LLOAD_STATS_OPS_LAST];
+
+    /* TLS handshakes completed with clients and with upstream servers, how
+     * many of them resumed an earlier session and how many connections had
+     * their encryption taken over by the kernel */
+    uintptr_t global_tls_client_handshakes;
+    uintptr_t global_tls_client_resumed;
+    uintptr_t global_tls_upstream_handshakes;
+    uintptr_t global_tls_upstream_resumed;
+    uintptr_t global_ktls;
 } lload_global_stats_t;
 
 typedef LloadTier *(LloadTierInit)( void );
@@ -301,6 +335,8 @@ struct LloadBackend {
     lload_c_head b_conns, b_bindconns, b_preparing;
     LDAP_LIST_HEAD(ConnectingSt, LloadPendingConnection) b_connecting;
     LloadConnection *b_last_conn, *b_last_bindconn;
+    /* Connections that might have room for another operation */
+    lload_r_head b_ready, b_bindready;
 
     long b_max_pending, b_max_conn_pending;
     long b_n_ops_executing;
@@ -315,6 +351,13 @@ struct LloadBackend {
 
     uintptr_t b_operation_count;
     uintptr_t b_operation_time;
+    /* Moving average of response latency (usec), updated atomically */
+    uintptr_t b_latency;
+
+    /* Hash tier: share of the ring owned in parts per million, operations
+     * for keys it owns and those taken over from other backends */
+    uintptr_t b_hash_share;
+    uintptr_t b_hash_owned, b_hash_taken;
 
 #ifdef BALANCER_MODULE
     monitor_subsys_t *b_monitor;
@@ -380,6 +423,23 @@ enum op_restriction {
                                  * or rejected */
 };
 
+/* Operation classes, each with its own limits, see lload_op_classes */
+enum lload_op_class {
+    LLOAD_OPCLASS_BIND,
+    LLOAD_OPCLASS_BASE, /* base scoped search */
+    LLOAD_OPCLASS_SEARCH, /* any other search */
+    LLOAD_OPCLASS_WRITE,
+    LLOAD_OPCLASS_OTHER, /* compare and extended operations */
+
+    LLOAD_OPCLASS_LAST
+};
+
+struct lload_op_class_limits {
+    char *name;
+    long max_pending; /* per upstream connection, 0 means no limit */
+    unsigned int queue_timeout; /* in milliseconds, 0 disables queueing */
+};
+
 /*
  * represents a connection from an ldap client/to ldap server
  */
@@ -388,6 +448,7 @@ struct LloadConnection {
     enum sc_type c_type;
     enum sc_io_state c_io_state;
     ber_socket_t c_fd;
+    int c_tid; /* I/O thread handling the connection's events */
 
 /*
  * LloadConnection reference counting:
@@ -476,6 +537,9 @@ struct LloadConnection {
 
     BerElement *c_currentber; /* ber we're attempting to read */
     BerElement *c_pendingber; /* ber we're attempting to write */
+    /* PDUs to write out ahead of c_pendingber, oldest first */
+    BerElement *c_outq[LLOAD_OUTQ_SIZE];
+    int c_outq_head, c_outq_len;
 
     TAvlnode *c_ops; /* Operations pending on the connection */
 
@@ -484,6 +548,7 @@ struct LloadConnection {
 #endif
 
     long c_n_ops_executing;      /* num of ops currently executing */
+    long c_n_ops_class[LLOAD_OPCLASS_LAST]; /* upstream only, same by class */
     long c_n_ops_completed;      /* num of ops completed */
     lload_counters_t c_counters; /* per connection operation counters */
 
@@ -505,6 +570,10 @@ struct LloadConnection {
      * - Upstream: b->b_mutex
      */
     LDAP_CIRCLEQ_ENTRY(LloadConnection) c_next;
+
+    /* Upstream only, protected by b->b_mutex */
+    LDAP_TAILQ_ENTRY(LloadConnection) c_ready_next;
+    int c_ready_queued;
 };
 
 enum op_state {
@@ -534,6 +603,7 @@ struct LloadOperation {
 
     LloadConnection *o_client;
     unsigned long o_client_connid;
+    int o_client_tid;
     ber_int_t o_client_msgid;
     ber_int_t o_saved_msgid;
     enum op_restriction o_restricted;
@@ -547,12 +617,22 @@ struct LloadOperation {
     ldap_pvt_thread_mutex_t o_link_mutex;
 
     ber_tag_t o_tag;
+    enum lload_op_class o_class;
     struct timeval o_start;
     unsigned long o_pin_id;
 
     enum op_result o_res;
     BerElement *o_ber;
     BerValue o_request, o_ctrls;
+
+    /* Responses being collected for the cache, if any */
+    LloadCacheEntry *o_cache;
+    unsigned long o_cache_gen; /* cache generation a bind was forwarded at */
+
+    /* Protected by lload_queue_mutex */
+    struct timeval o_queued; /* when first queued, unset if never */
+    int o_in_queue;
+    LDAP_TAILQ_ENTRY(LloadOperation) o_queue_next;
 };
 
 struct restriction_entry {
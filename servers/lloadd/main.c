@@ -890,9 +890,10 @@ stop:
     lloadd_daemon_destroy();
 
 #ifdef HAVE_TLS
-    if ( lload_tls_ld ) {
+    /* lload_global_destroy() has already released lload_tls_ld */
+    if ( lload_tls_ctx ) {
         ldap_pvt_tls_ctx_free( lload_tls_ctx );
-        ldap_unbind_ext( lload_tls_ld, NULL, NULL );
+        lload_tls_ctx = NULL;
     }
     ldap_pvt_tls_destroy();
 #endif
@@ -86,6 +86,19 @@ static AttributeDescription *ad_olmForwardedOps;
 static AttributeDescription *ad_olmRejectedOps;
 static AttributeDescription *ad_olmCompletedOps;
 static AttributeDescription *ad_olmFailedOps;
+static AttributeDescription *ad_olmCacheHitOps;
+static AttributeDescription *ad_olmCacheMissOps;
+static AttributeDescription *ad_olmQueuedOps;
+static AttributeDescription *ad_olmQueueDepth;
+static AttributeDescription *ad_olmQueueWaitTime;
+static AttributeDescription *ad_olmHashKeyShare;
+static AttributeDescription *ad_olmHashOwnedOps;
+static AttributeDescription *ad_olmHashTakenOps;
+static AttributeDescription *ad_olmClientTLSHandshakes;
+static AttributeDescription *ad_olmClientTLSResumed;
+static AttributeDescription *ad_olmUpstreamTLSHandshakes;
+static AttributeDescription *ad_olmUpstreamTLSResumed;
+static AttributeDescription *ad_olmKTLSConnections;
 static AttributeDescription *ad_olmConnectionType;
 static AttributeDescription *ad_olmConnectionState;
 static AttributeDescription *ad_olmPendingOps;
@@ -208,6 +221,101 @@ static struct {
       "SYNTAX 1.3.6.1.4.1.1466.115.121.1.15 "
       "USAGE dSAOperation )",
         &ad_olmConnectionState },
+    { "( olmBalancerAttributes:14 "
+      "NAME ( 'olmCacheHitOps' ) "
+      "DESC 'monitor operations answered from the cache' "
+      "SUP monitorCounter "
+      "NO-USER-MODIFICATION "
+      "USAGE dSAOperation )",
+        &ad_olmCacheHitOps },
+    { "( olmBalancerAttributes:15 "
+      "NAME ( 'olmCacheMissOps' ) "
+      "DESC 'monitor cacheable operations not found in the cache' "
+      "SUP monitorCounter "
+      "NO-USER-MODIFICATION "
+      "USAGE dSAOperation )",
+        &ad_olmCacheMissOps },
+    { "( olmBalancerAttributes:16 "
+      "NAME ( 'olmQueuedOps' ) "
+      "DESC 'monitor operations waiting for an upstream connection' "
+      "SUP monitorCounter "
+      "NO-USER-MODIFICATION "
+      "USAGE dSAOperation )",
+        &ad_olmQueuedOps },
+    { "( olmBalancerAttributes:17 "
+      "NAME ( 'olmQueueDepth' ) "
+      "DESC 'Operations already waiting when one was queued, "
+            "as <upper bound> <count> pairs' "
+      "SYNTAX 1.3.6.1.4.1.1466.115.121.1.15 "
+      "NO-USER-MODIFICATION "
+      "USAGE dSAOperation )",
+        &ad_olmQueueDepth },
+    { "( olmBalancerAttributes:18 "
+      "NAME ( 'olmQueueWaitTime' ) "
+      "DESC 'Time operations spent waiting in milliseconds, "
+            "as <upper bound> <count> pairs' "
+      "SYNTAX 1.3.6.1.4.1.1466.115.121.1.15 "
+      "NO-USER-MODIFICATION "
+      "USAGE dSAOperation )",
+        &ad_olmQueueWaitTime },
+    { "( olmBalancerAttributes:19 "
+      "NAME ( 'olmHashKeyShare' ) "
+      "DESC 'Share of the keys hashed to the server, in parts per million' "
+      "EQUALITY integerMatch "
+      "SYNTAX 1.3.6.1.4.1.1466.115.121.1.27 "
+      "NO-USER-MODIFICATION "
+      "USAGE dSAOperation )",
+        &ad_olmHashKeyShare },
+    { "( olmBalancerAttributes:20 "
+      "NAME ( 'olmHashOwnedOps' ) "
+      "DESC 'monitor operations forwarded to the server their key hashed to' "
+      "SUP monitorCounter "
+      "NO-USER-MODIFICATION "
+      "USAGE dSAOperation )",
+        &ad_olmHashOwnedOps },
+    { "( olmBalancerAttributes:21 "
+      "NAME ( 'olmHashTakenOps' ) "
+      "DESC 'monitor operations taken over from another server' "
+      "SUP monitorCounter "
+      "NO-USER-MODIFICATION "
+      "USAGE dSAOperation )",
+        &ad_olmHashTakenOps },
+    { "( olmBalancerAttributes:22 "
+      "NAME ( 'olmClientTLSHandshakes' ) "
+      "DESC 'monitor TLS handshakes completed with clients' "
+      "SUP monitorCounter "
+      "NO-USER-MODIFICATION "
+      "USAGE dSAOperation )",
+        &ad_olmClientTLSHandshakes },
+    { "( olmBalancerAttributes:23 "
+      "NAME ( 'olmClientTLSResumed' ) "
+      "DESC 'monitor TLS handshakes with clients that resumed a session' "
+      "SUP monitorCounter "
+      "NO-USER-MODIFICATION "
+      "USAGE dSAOperation )",
+        &ad_olmClientTLSResumed },
+    { "( olmBalancerAttributes:24 "
+      "NAME ( 'olmUpstreamTLSHandshakes' ) "
+      "DESC 'monitor TLS handshakes completed with upstream servers' "
+      "SUP monitorCounter "
+      "NO-USER-MODIFICATION "
+      "USAGE dSAOperation )",
+        &ad_olmUpstreamTLSHandshakes },
+    { "( olmBalancerAttributes:25 "
+      "NAME ( 'olmUpstreamTLSResumed' ) "
+      "DESC 'monitor TLS handshakes with upstream servers that resumed "
+            "a session' "
+      "SUP monitorCounter "
+      "NO-USER-MODIFICATION "
+      "USAGE dSAOperation )",
+        &ad_olmUpstreamTLSResumed },
+    { "( olmBalancerAttributes:26 "
+      "NAME ( 'olmKTLSConnections' ) "
+      "DESC 'monitor TLS connections handed over to kernel TLS' "
+      "SUP monitorCounter "
+      "NO-USER-MODIFICATION "
+      "USAGE dSAOperation )",
+        &ad_olmKTLSConnections },
 
     { NULL }
 };
@@ -232,6 +340,14 @@ static struct {
       "MAY ( "
       "olmIncomingConnections "
       "$ olmOutgoingConnections "
+      "$ olmQueuedOps "
+      "$ olmQueueDepth "
+      "$ olmQueueWaitTime "
+      "$ olmClientTLSHandshakes "
+      "$ olmClientTLSResumed "
+      "$ olmUpstreamTLSHandshakes "
+      "$ olmUpstreamTLSResumed "
+      "$ olmKTLSConnections "
       ") )",
         &oc_olmBalancer },
     { "( olmBalancerObjectClasses:2 "
@@ -245,6 +361,9 @@ static struct {
       "$ olmReceivedOps "
       "$ olmCompletedOps "
       "$ olmFailedOps "
+      "$ olmHashKeyShare "
+      "$ olmHashOwnedOps "
+      "$ olmHashTakenOps "
       ") )",
         &oc_olmBalancerServer },
 
@@ -257,6 +376,8 @@ static struct {
       "$ olmRejectedOps "
       "$ olmCompletedOps "
       "$ olmFailedOps "
+      "$ olmCacheHitOps "
+      "$ olmCacheMissOps "
       ") )",
         &oc_olmBalancerOperation },
     { "( olmBalancerObjectClasses:4 "
@@ -343,6 +464,57 @@ lload_monitor_balancer_free( Entry *e, void **priv )
     return LDAP_SUCCESS;
 }
 
+/* One "<upper bound> <count>" value per bucket */
+static void
+lload_monitor_histogram_value(
+        lload_histogram_t *h,
+        int i,
+        char *buf,
+        size_t size,
+        struct berval *bv )
+{
+    unsigned long count = __atomic_load_n( &h->lh_counts[i], __ATOMIC_RELAXED );
+
+    bv->bv_val = buf;
+    if ( i < h->lh_nbuckets - 1 ) {
+        bv->bv_len = snprintf( buf, size, "%lu %lu", h->lh_bounds[i], count );
+    } else {
+        bv->bv_len = snprintf( buf, size, "+inf %lu", count );
+    }
+}
+
+static void
+lload_monitor_histogram_update( Attribute *a, lload_histogram_t *h )
+{
+    char buf[64];
+    struct berval bv;
+    int i;
+
+    assert( a->a_numvals == h->lh_nbuckets );
+    assert( a->a_nvals == a->a_vals );
+
+    for ( i = 0; i < h->lh_nbuckets; i++ ) {
+        lload_monitor_histogram_value( h, i, buf, sizeof(buf), &bv );
+        ber_bvreplace( &a->a_vals[i], &bv );
+    }
+}
+
+static void
+lload_monitor_histogram_init(
+        Entry *e,
+        AttributeDescription *ad,
+        lload_histogram_t *h )
+{
+    char buf[64];
+    struct berval bv;
+    int i;
+
+    for ( i = 0; i < h->lh_nbuckets; i++ ) {
+        lload_monitor_histogram_value( h, i, buf, sizeof(buf), &bv );
+        attr_merge_one( e, ad, &bv, NULL );
+    }
+}
+
 static int
 lload_monitor_balancer_update(
         Operation *op,
@@ -351,6 +523,7 @@ lload_monitor_balancer_update(
         void *priv )
 {
     Attribute *a;
+    ldap_pvt_mp_t queued;
 
     a = attr_find( e->e_attrs, ad_olmIncomingConnections );
     assert( a != NULL );
@@ -361,6 +534,49 @@ lload_monitor_balancer_update(
     assert( a != NULL );
 
     UI2BV( &a->a_vals[0], lload_stats.global_outgoing );
+
+    a = attr_find( e->e_attrs, ad_olmQueuedOps );
+    assert( a != NULL );
+    queued = (ldap_pvt_mp_t)__atomic_load_n( &lload_queued, __ATOMIC_RELAXED );
+    UI2BV( &a->a_vals[0], queued );
+
+    a = attr_find( e->e_attrs, ad_olmQueueDepth );
+    assert( a != NULL );
+    lload_monitor_histogram_update( a, &lload_queue_depth );
+
+    a = attr_find( e->e_attrs, ad_olmQueueWaitTime );
+    assert( a != NULL );
+    lload_monitor_histogram_update( a, &lload_queue_wait );
+
+    a = attr_find( e->e_attrs, ad_olmClientTLSHandshakes );
+    assert( a != NULL );
+    UI2BV( &a->a_vals[0], (long long unsigned int)__atomic_load_n(
+                                  &lload_stats.global_tls_client_handshakes,
+                                  __ATOMIC_RELAXED ) );
+
+    a = attr_find( e->e_attrs, ad_olmClientTLSResumed );
+    assert( a != NULL );
+    UI2BV( &a->a_vals[0], (long long unsigned int)__atomic_load_n(
+                                  &lload_stats.global_tls_client_resumed,
+                                  __ATOMIC_RELAXED ) );
+
+    a = attr_find( e->e_attrs, ad_olmUpstreamTLSHandshakes );
+    assert( a != NULL );
+    UI2BV( &a->a_vals[0], (long long unsigned int)__atomic_load_n(
+                                  &lload_stats.global_tls_upstream_handshakes,
+                                  __ATOMIC_RELAXED ) );
+
+    a = attr_find( e->e_attrs, ad_olmUpstreamTLSResumed );
+    assert( a != NULL );
+    UI2BV( &a->a_vals[0], (long long unsigned int)__atomic_load_n(
+                                  &lload_stats.global_tls_upstream_resumed,
+                                  __ATOMIC_RELAXED ) );
+
+    a = attr_find( e->e_attrs, ad_olmKTLSConnections );
+    assert( a != NULL );
+    UI2BV( &a->a_vals[0], (long long unsigned int)__atomic_load_n(
+                                  &lload_stats.global_ktls, __ATOMIC_RELAXED ) );
+
     return SLAP_CB_CONTINUE;
 }
 
@@ -390,6 +606,17 @@ lload_monitor_ops_update( Operation *op, SlapReply *rs, Entry *e, void *priv )
     assert( a != NULL );
     UI2BV( &a->a_vals[0], counters->lc_ops_failed );
 
+    /* Only searches and binds are cached */
+    a = attr_find( e->e_attrs, ad_olmCacheHitOps );
+    if ( a != NULL ) {
+        UI2BV( &a->a_vals[0], counters->lc_ops_cache_hits );
+    }
+
+    a = attr_find( e->e_attrs, ad_olmCacheMissOps );
+    if ( a != NULL ) {
+        UI2BV( &a->a_vals[0], counters->lc_ops_cache_misses );
+    }
+
     return SLAP_CB_CONTINUE;
 }
 
@@ -441,6 +668,14 @@ lload_monitor_balancer_init( BackendDB *be, monitor_subsys_t *ms )
 
     attr_merge_normalize_one( e, ad_olmIncomingConnections, &value, NULL );
     attr_merge_normalize_one( e, ad_olmOutgoingConnections, &value, NULL );
+    attr_merge_normalize_one( e, ad_olmQueuedOps, &value, NULL );
+    lload_monitor_histogram_init( e, ad_olmQueueDepth, &lload_queue_depth );
+    lload_monitor_histogram_init( e, ad_olmQueueWaitTime, &lload_queue_wait );
+    attr_merge_normalize_one( e, ad_olmClientTLSHandshakes, &value, NULL );
+    attr_merge_normalize_one( e, ad_olmClientTLSResumed, &value, NULL );
+    attr_merge_normalize_one( e, ad_olmUpstreamTLSHandshakes, &value, NULL );
+    attr_merge_normalize_one( e, ad_olmUpstreamTLSResumed, &value, NULL );
+    attr_merge_normalize_one( e, ad_olmKTLSConnections, &value, NULL );
 
     rc = mbe->register_entry( e, cb, ms, 0 );
     if ( rc != LDAP_SUCCESS ) {
@@ -522,6 +757,10 @@ lload_monitor_ops_init( BackendDB *be, monitor_subsys_t *ms )
         attr_merge_normalize_one( e, ad_olmRejectedOps, &value, NULL );
         attr_merge_normalize_one( e, ad_olmCompletedOps, &value, NULL );
         attr_merge_normalize_one( e, ad_olmFailedOps, &value, NULL );
+        if ( i == LLOAD_STATS_OPS_BIND || i == LLOAD_STATS_OPS_OTHER ) {
+            attr_merge_normalize_one( e, ad_olmCacheHitOps, &value, NULL );
+            attr_merge_normalize_one( e, ad_olmCacheMissOps, &value, NULL );
+        }
 
         rc = mbe->register_entry( e, cb, ms, 0 );
 
@@ -882,6 +1121,22 @@ lload_monitor_server_update(
     assert( a != NULL );
     UI2BV( &a->a_vals[0], failed );
 
+    /* Only there for servers in a hash tier */
+    if ( (a = attr_find( e->e_attrs, ad_olmHashKeyShare )) ) {
+        UI2BV( &a->a_vals[0], (long long unsigned int)__atomic_load_n(
+                                      &b->b_hash_share, __ATOMIC_RELAXED ) );
+
+        a = attr_find( e->e_attrs, ad_olmHashOwnedOps );
+        assert( a != NULL );
+        UI2BV( &a->a_vals[0], (long long unsigned int)__atomic_load_n(
+                                      &b->b_hash_owned, __ATOMIC_RELAXED ) );
+
+        a = attr_find( e->e_attrs, ad_olmHashTakenOps );
+        assert( a != NULL );
+        UI2BV( &a->a_vals[0], (long long unsigned int)__atomic_load_n(
+                                      &b->b_hash_taken, __ATOMIC_RELAXED ) );
+    }
+
     return SLAP_CB_CONTINUE;
 }
 
@@ -924,6 +1179,11 @@ lload_monitor_backend_open( BackendDB *be, monitor_subsys_t *ms )
     attr_merge_normalize_one( e, ad_olmReceivedOps, &value, NULL );
     attr_merge_normalize_one( e, ad_olmCompletedOps, &value, NULL );
     attr_merge_normalize_one( e, ad_olmFailedOps, &value, NULL );
+    if ( tier->t_type.tier_select == hash_tier.tier_select ) {
+        attr_merge_normalize_one( e, ad_olmHashKeyShare, &value, NULL );
+        attr_merge_normalize_one( e, ad_olmHashOwnedOps, &value, NULL );
+        attr_merge_normalize_one( e, ad_olmHashTakenOps, &value, NULL );
+    }
 
     rc = mbe->register_entry( e, cb, ms, 0 );
 
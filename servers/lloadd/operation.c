@@ -130,6 +130,33 @@ operation_upstream_cmp( const void *left, const void *right )
 /*
  * Entered holding c_mutex for now.
  */
+static enum lload_op_class
+operation_class( LloadOperation *op )
+{
+    BerElementBuffer copy_berbuf;
+    BerElement *copy = (BerElement *)&copy_berbuf;
+    ber_int_t scope;
+
+    switch ( op->o_tag ) {
+        case LDAP_REQ_BIND:
+            return LLOAD_OPCLASS_BIND;
+        case LDAP_REQ_SEARCH:
+            ber_init2( copy, &op->o_request, 0 );
+            if ( ber_scanf( copy, "xe", &scope ) != LBER_ERROR &&
+                    scope == LDAP_SCOPE_BASE ) {
+                return LLOAD_OPCLASS_BASE;
+            }
+            return LLOAD_OPCLASS_SEARCH;
+        case LDAP_REQ_ADD:
+        case LDAP_REQ_DELETE:
+        case LDAP_REQ_MODIFY:
+        case LDAP_REQ_MODRDN:
+            return LLOAD_OPCLASS_WRITE;
+        default:
+            return LLOAD_OPCLASS_OTHER;
+    }
+}
+
 LloadOperation *
 operation_init( LloadConnection *c, BerElement *ber )
 {
@@ -145,6 +172,7 @@ operation_init( LloadConnection *c, BerElement *ber )
     op = ch_calloc( 1, sizeof(LloadOperation) );
     op->o_client = c;
     op->o_client_connid = c->c_connid;
+    op->o_client_tid = c->c_tid;
     op->o_ber = ber;
     gettimeofday( &op->o_start, NULL );
 
@@ -195,6 +223,7 @@ operation_init( LloadConnection *c, BerElement *ber )
             lload_stats.counters[LLOAD_STATS_OPS_OTHER].lc_ops_received++;
             break;
     }
+    op->o_class = operation_class( op );
 
     Debug( LDAP_DEBUG_STATS, "operation_init: "
             "received a new operation, %s with msgid=%d for client "
@@ -222,6 +251,7 @@ operation_destroy( LloadOperation *op )
     assert( op->o_client == NULL );
     assert( op->o_upstream == NULL );
 
+    lload_cache_abandon( op );
     ber_free( op->o_ber, 1 );
     ldap_pvt_thread_mutex_destroy( &op->o_link_mutex );
     ch_free( op );
@@ -241,6 +271,8 @@ operation_unlink( LloadOperation *op )
 
     assert( prev_refcnt == 1 );
 
+    lload_queue_remove( op );
+
     Debug( LDAP_DEBUG_TRACE, "operation_unlink: "
             "unlinking operation between client connid=%lu and upstream "
             "connid=%lu "
@@ -345,6 +377,7 @@ operation_unlink_upstream( LloadOperation *op, LloadConnection *upstream )
 
         assert( op == removed );
         upstream->c_n_ops_executing--;
+        upstream->c_n_ops_class[op->o_class]--;
 
         if ( upstream->c_state == LLOAD_C_BINDING ) {
             assert( op->o_tag == LDAP_REQ_BIND && upstream->c_ops == NULL );
@@ -366,6 +399,7 @@ operation_unlink_upstream( LloadOperation *op, LloadConnection *upstream )
     if ( b ) {
         checked_lock( &b->b_mutex );
         b->b_n_ops_executing--;
+        backend_conn_ready( b, upstream );
         operation_update_backend_counters( op, b );
         checked_unlock( &b->b_mutex );
     }
@@ -589,6 +623,7 @@ connection_timeout( LloadConnection *upstream, void *arg )
                 lload_msgtype2str( op->o_tag ), op->o_client_connid,
                 op->o_client_msgid, op->o_upstream_connid,
                 op->o_upstream_msgid );
+        upstream->c_n_ops_class[op->o_class]--;
         nops++;
     }
 
@@ -605,6 +640,7 @@ connection_timeout( LloadConnection *upstream, void *arg )
 
     checked_lock( &b->b_mutex );
     b->b_n_ops_executing -= nops;
+    backend_conn_ready( b, upstream );
     checked_unlock( &b->b_mutex );
 
     for ( node = ldap_tavl_end( ops, TAVL_DIR_LEFT ); node;
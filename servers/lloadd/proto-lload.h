@@ -42,6 +42,9 @@ LDAP_SLAPD_F (void *) backend_connect_task( void *ctx, void *arg );
 LDAP_SLAPD_F (void) backend_retry( LloadBackend *b );
 LDAP_SLAPD_F (int) upstream_select( LloadOperation *op, LloadConnection **c, int *res, char **message );
 LDAP_SLAPD_F (int) backend_select( LloadBackend *b, LloadOperation *op, LloadConnection **c, int *res, char **message );
+LDAP_SLAPD_F (int) backend_select_ready( LloadBackend *b, LloadOperation *op, LloadConnection **c, int *res, char **message );
+LDAP_SLAPD_F (void) backend_conn_ready( LloadBackend *b, LloadConnection *c );
+LDAP_SLAPD_F (void) backend_conn_unready( LloadBackend *b, LloadConnection *c );
 LDAP_SLAPD_F (int) try_upstream( LloadBackend *b, lload_c_head *head, LloadOperation *op, LloadConnection *c, int *res, char **message );
 LDAP_SLAPD_F (void) backend_reset( LloadBackend *b, int gentle );
 LDAP_SLAPD_F (LloadBackend *) lload_backend_new( void );
@@ -55,6 +58,30 @@ LDAP_SLAPD_F (int) handle_bind_response( LloadConnection *client, LloadOperation
 LDAP_SLAPD_F (int) handle_whoami_response( LloadConnection *client, LloadOperation *op, BerElement *ber );
 LDAP_SLAPD_F (int) handle_vc_bind_response( LloadConnection *client, LloadOperation *op, BerElement *ber );
 
+/*
+ * cache.c
+ */
+LDAP_SLAPD_F (int) lload_cache_request( LloadConnection *client, LloadOperation *op );
+LDAP_SLAPD_F (void) lload_cache_collect( LloadOperation *op, ber_tag_t tag, struct berval *response, struct berval *controls );
+LDAP_SLAPD_F (void) lload_cache_abandon( LloadOperation *op );
+LDAP_SLAPD_F (void) lload_cache_invalidate( struct berval *dn );
+LDAP_SLAPD_F (void) lload_cache_write( LloadOperation *op );
+LDAP_SLAPD_F (void) lload_cache_flush( void );
+LDAP_SLAPD_F (int) lload_dn_normalize( struct berval *dn, struct berval *ndn );
+LDAP_SLAPD_F (void) lload_cache_resize( unsigned int size );
+LDAP_SLAPD_F (void) lload_bind_cache_resize( unsigned int size );
+LDAP_SLAPD_F (int) lload_bind_cache_check( LloadOperation *op, struct berval *dn, struct berval *cred );
+LDAP_SLAPD_F (void) lload_bind_cache_result( LloadOperation *op, int result, int has_ctrls );
+LDAP_SLAPD_F (int) lload_cache_watch_start( void );
+LDAP_SLAPD_F (void) lload_cache_watch_stop( void );
+LDAP_SLAPD_F (void) lload_cache_init( void );
+LDAP_SLAPD_F (void) lload_cache_destroy( void );
+LDAP_SLAPD_V (unsigned int) lload_cache_size;
+LDAP_SLAPD_V (unsigned int) lload_cache_ttl;
+LDAP_SLAPD_V (char *) lload_cache_watch;
+LDAP_SLAPD_V (unsigned int) lload_bind_cache_size;
+LDAP_SLAPD_V (unsigned int) lload_bind_cache_ttl;
+
 /*
  * client.c
  */
@@ -102,6 +129,9 @@ LDAP_SLAPD_F (void) connections_walk_last( ldap_pvt_thread_mutex_t *cq_mutex,
         CONNCB cb,
         void *arg );
 LDAP_SLAPD_F (void) connections_walk( ldap_pvt_thread_mutex_t *cq_mutex, lload_c_head *cq, CONNCB cb, void *arg );
+#ifdef HAVE_TLS
+LDAP_SLAPD_F (void) connection_tls_established( LloadConnection *c, int upstream );
+#endif /* HAVE_TLS */
 
 /*
  * daemon.c
@@ -113,6 +143,8 @@ LDAP_SLAPD_F (int) lloadd_daemon( struct event_base *daemon_base );
 LDAP_SLAPD_F (LloadListener **) lloadd_get_listeners( void );
 LDAP_SLAPD_F (void) listeners_reactivate( void );
 LDAP_SLAPD_F (struct event_base *) lload_get_base( ber_socket_t s );
+LDAP_SLAPD_F (int) lload_get_tid( ber_socket_t s );
+LDAP_SLAPD_F (struct event_base *) lload_get_tid_base( int tid );
 LDAP_SLAPD_V (int) lload_daemon_threads;
 LDAP_SLAPD_V (int) lload_daemon_mask;
 
@@ -201,6 +233,22 @@ LDAP_SLAPD_F (void) operation_update_conn_counters( LloadOperation *op, LloadCon
 LDAP_SLAPD_F (void) operation_update_backend_counters( LloadOperation *op, LloadBackend *b );
 LDAP_SLAPD_F (void) operation_update_global_rejected( LloadOperation *op );
 
+/*
+ * queue.c
+ */
+LDAP_SLAPD_V (struct lload_op_class_limits) lload_op_classes[];
+LDAP_SLAPD_V (struct event *) lload_queue_event;
+LDAP_SLAPD_V (unsigned int) lload_queue_max;
+LDAP_SLAPD_V (uintptr_t) lload_queued;
+LDAP_SLAPD_V (lload_histogram_t) lload_queue_depth;
+LDAP_SLAPD_V (lload_histogram_t) lload_queue_wait;
+LDAP_SLAPD_F (int) lload_queue_operation( LloadOperation *op, int busy );
+LDAP_SLAPD_F (void) lload_queue_remove( LloadOperation *op );
+LDAP_SLAPD_F (void) lload_queue_wakeup( void );
+LDAP_SLAPD_F (void) lload_queue_dispatch( evutil_socket_t s, short what, void *arg );
+LDAP_SLAPD_F (void) lload_queue_init( void );
+LDAP_SLAPD_F (void) lload_queue_destroy( void );
+
 /*
  * tier.c
  */
@@ -213,6 +261,13 @@ LDAP_SLAPD_F (void) lload_tiers_update( evutil_socket_t s, short what, void *arg
 LDAP_SLAPD_F (void) lload_tiers_destroy( void );
 LDAP_SLAPD_F (struct lload_tier_type *) lload_tier_find( char *type );
 
+/*
+ * tier_hash.c
+ */
+LDAP_SLAPD_V (struct lload_tier_type) hash_tier;
+LDAP_SLAPD_V (unsigned int) lload_hash_depth;
+LDAP_SLAPD_V (unsigned int) lload_hash_load_bound;
+
 /*
  * upstream.c
  */
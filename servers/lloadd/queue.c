@@ -0,0 +1,356 @@
+/* queue.c - operations waiting for an upstream connection */
+/* $OpenLDAP$ */
+/* This work is part of OpenLDAP Software <http://www.openldap.org/>.
+ *
+ * Copyright 1998-2022 The OpenLDAP Foundation.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted only as authorized by the OpenLDAP
+ * Public License.
+ *
+ * A copy of this license is available in the file LICENSE in the
+ * top-level directory of the distribution or, alternatively, at
+ * <http://www.OpenLDAP.org/license.html>.
+ */
+
+#include "portable.h"
+
+#include <ac/time.h>
+
+#include "lload.h"
+
+/*
+ * Each operation class can be limited in how many of its operations an
+ * upstream connection takes at the same time (enforced in try_upstream) and
+ * how long an operation of that class may wait for a slot when none is
+ * available, rather than being rejected with LDAP_BUSY straight away.
+ *
+ * Waiting operations are kept in a FIFO per class. Whenever an upstream
+ * connection might be able to take another operation, backend_conn_ready
+ * activates lload_queue_event and the daemon thread retries the operations
+ * in order until one of them has to go back to wait. The same event doubles
+ * as the timer for the earliest deadline. No more than lload_queue_max
+ * operations are allowed to wait at any one time.
+ *
+ * Only operations handled by request_process are queued, a Bind has already
+ * reset the client by the time an upstream is selected for it.
+ */
+struct lload_op_class_limits lload_op_classes[] = {
+    [LLOAD_OPCLASS_BIND] = { "bind" },
+    [LLOAD_OPCLASS_BASE] = { "base" },
+    [LLOAD_OPCLASS_SEARCH] = { "search" },
+    [LLOAD_OPCLASS_WRITE] = { "write" },
+    [LLOAD_OPCLASS_OTHER] = { "other" },
+    [LLOAD_OPCLASS_LAST] = { NULL }
+};
+
+struct event *lload_queue_event;
+
+/* How many operations can wait across all classes */
+unsigned int lload_queue_max = 1024;
+
+static ldap_pvt_thread_mutex_t lload_queue_mutex;
+static lload_o_head lload_queues[LLOAD_OPCLASS_LAST];
+
+/* Also read without the mutex to skip locking when nothing is queued */
+uintptr_t lload_queued;
+
+/* How many operations were waiting when another one joined them */
+static const unsigned long queue_depth_bounds[] = {
+    1, 2, 4, 8, 16, 32, 64, 128, 256, 512, 1024
+};
+static uintptr_t queue_depth_counts[ sizeof(queue_depth_bounds) /
+        sizeof(queue_depth_bounds[0]) + 1 ];
+
+lload_histogram_t lload_queue_depth = {
+    .lh_nbuckets = sizeof(queue_depth_counts) / sizeof(queue_depth_counts[0]),
+    .lh_bounds = queue_depth_bounds,
+    .lh_counts = queue_depth_counts,
+};
+
+/* How long operations waited, in milliseconds */
+static const unsigned long queue_wait_bounds[] = {
+    1, 2, 5, 10, 20, 50, 100, 200, 500, 1000, 2000, 5000
+};
+static uintptr_t queue_wait_counts[ sizeof(queue_wait_bounds) /
+        sizeof(queue_wait_bounds[0]) + 1 ];
+
+lload_histogram_t lload_queue_wait = {
+    .lh_nbuckets = sizeof(queue_wait_counts) / sizeof(queue_wait_counts[0]),
+    .lh_bounds = queue_wait_bounds,
+    .lh_counts = queue_wait_counts,
+};
+
+static void
+histogram_add( lload_histogram_t *h, unsigned long value )
+{
+    int i;
+
+    for ( i = 0; i < h->lh_nbuckets - 1; i++ ) {
+        if ( value <= h->lh_bounds[i] ) {
+            break;
+        }
+    }
+    __atomic_add_fetch( &h->lh_counts[i], 1, __ATOMIC_RELAXED );
+}
+
+/* Record how long the operation spent waiting, now that it has left */
+static void
+queue_waited( LloadOperation *op, struct timeval *now )
+{
+    struct timeval waited;
+
+    timersub( now, &op->o_queued, &waited );
+    histogram_add( &lload_queue_wait,
+            waited.tv_sec * 1000 + waited.tv_usec / 1000 );
+}
+
+static void
+queue_deadline( LloadOperation *op, struct timeval *deadline )
+{
+    unsigned int timeout = lload_op_classes[op->o_class].queue_timeout;
+    struct timeval tv = {
+        .tv_sec = timeout / 1000,
+        .tv_usec = ( timeout % 1000 ) * 1000,
+    };
+
+    timeradd( &op->o_queued, &tv, deadline );
+}
+
+/*
+ * Park the operation until a slot frees up. With busy unset, only do so if
+ * other operations of the same class are already waiting, so that it does not
+ * overtake them. Returns LDAP_SUCCESS if the operation has been queued and
+ * the caller should leave it alone.
+ */
+int
+lload_queue_operation( LloadOperation *op, int busy )
+{
+    lload_o_head *queue = &lload_queues[op->o_class];
+    int empty, requeue = timerisset( &op->o_queued );
+
+    if ( op->o_tag == LDAP_REQ_BIND ||
+            !lload_op_classes[op->o_class].queue_timeout ) {
+        return -1;
+    }
+
+    /* Coming back from the queue, it is first in line already */
+    if ( !busy && requeue ) {
+        return -1;
+    }
+
+    checked_lock( &lload_queue_mutex );
+    empty = LDAP_TAILQ_EMPTY( queue );
+    if ( !busy && empty ) {
+        checked_unlock( &lload_queue_mutex );
+        return -1;
+    }
+
+    /* Operations coming back already hold their place */
+    if ( !requeue && lload_queue_max && lload_queued >= lload_queue_max ) {
+        checked_unlock( &lload_queue_mutex );
+        if ( !busy ) {
+            return -1;
+        }
+        Debug( LDAP_DEBUG_STATS, "lload_queue_operation: "
+                "connid=%lu msgid=%d not queued, %lu operations are "
+                "waiting already\n",
+                op->o_client_connid, op->o_client_msgid,
+                (unsigned long)lload_queued );
+        return -1;
+    }
+
+    if ( requeue ) {
+        LDAP_TAILQ_INSERT_HEAD( queue, op, o_queue_next );
+    } else {
+        histogram_add( &lload_queue_depth, lload_queued );
+        gettimeofday( &op->o_queued, NULL );
+        LDAP_TAILQ_INSERT_TAIL( queue, op, o_queue_next );
+    }
+    op->o_in_queue = 1;
+    __atomic_add_fetch( &lload_queued, 1, __ATOMIC_SEQ_CST );
+
+    /* Pairs with lload_queue_remove, we might be racing operation_unlink */
+    if ( !IS_ALIVE( op, o_refcnt ) ) {
+        LDAP_TAILQ_REMOVE( queue, op, o_queue_next );
+        op->o_in_queue = 0;
+        __atomic_sub_fetch( &lload_queued, 1, __ATOMIC_SEQ_CST );
+        checked_unlock( &lload_queue_mutex );
+        return -1;
+    }
+    checked_unlock( &lload_queue_mutex );
+
+    /* Make sure the timer is set up for its deadline */
+    if ( empty && !requeue && lload_queue_event ) {
+        event_active( lload_queue_event, EV_TIMEOUT, 0 );
+    }
+
+    Debug( LDAP_DEBUG_TRACE, "lload_queue_operation: "
+            "connid=%lu msgid=%d waiting for an upstream connection\n",
+            op->o_client_connid, op->o_client_msgid );
+    return LDAP_SUCCESS;
+}
+
+/*
+ * Called from operation_unlink once the operation is dead, it must not stay
+ * reachable from the queue.
+ */
+void
+lload_queue_remove( LloadOperation *op )
+{
+    assert( !IS_ALIVE( op, o_refcnt ) );
+
+    if ( !__atomic_load_n( &lload_queued, __ATOMIC_SEQ_CST ) ) {
+        return;
+    }
+
+    checked_lock( &lload_queue_mutex );
+    if ( op->o_in_queue ) {
+        struct timeval now;
+
+        LDAP_TAILQ_REMOVE( &lload_queues[op->o_class], op, o_queue_next );
+        op->o_in_queue = 0;
+        __atomic_sub_fetch( &lload_queued, 1, __ATOMIC_SEQ_CST );
+
+        gettimeofday( &now, NULL );
+        queue_waited( op, &now );
+    }
+    checked_unlock( &lload_queue_mutex );
+}
+
+void
+lload_queue_wakeup( void )
+{
+    if ( lload_queue_event &&
+            __atomic_load_n( &lload_queued, __ATOMIC_RELAXED ) ) {
+        event_active( lload_queue_event, EV_TIMEOUT, 0 );
+    }
+}
+
+static LloadOperation *
+queue_pop( lload_o_head *queue )
+{
+    LloadOperation *op;
+
+    assert_locked( &lload_queue_mutex );
+
+    op = LDAP_TAILQ_FIRST( queue );
+    if ( op ) {
+        LDAP_TAILQ_REMOVE( queue, op, o_queue_next );
+        op->o_in_queue = 0;
+        __atomic_sub_fetch( &lload_queued, 1, __ATOMIC_SEQ_CST );
+    }
+    return op;
+}
+
+void
+lload_queue_dispatch( evutil_socket_t s, short what, void *arg )
+{
+    struct event *self = arg;
+    lload_o_head expired = LDAP_TAILQ_HEAD_INITIALIZER( expired );
+    LloadOperation *op, *next;
+    struct timeval now, deadline, earliest;
+    epoch_t epoch;
+    int i;
+
+    epoch = epoch_join();
+    gettimeofday( &now, NULL );
+
+    checked_lock( &lload_queue_mutex );
+    for ( i = 0; i < LLOAD_OPCLASS_LAST; i++ ) {
+        while ( (op = LDAP_TAILQ_FIRST( &lload_queues[i] )) ) {
+            queue_deadline( op, &deadline );
+            if ( timercmp( &deadline, &now, > ) ) {
+                break;
+            }
+            queue_pop( &lload_queues[i] );
+            queue_waited( op, &now );
+            LDAP_TAILQ_INSERT_TAIL( &expired, op, o_queue_next );
+        }
+    }
+    checked_unlock( &lload_queue_mutex );
+
+    for ( op = LDAP_TAILQ_FIRST( &expired ); op; op = next ) {
+        next = LDAP_TAILQ_NEXT( op, o_queue_next );
+
+        Debug( LDAP_DEBUG_STATS, "lload_queue_dispatch: "
+                "connid=%lu msgid=%d no upstream connection became "
+                "available in time\n",
+                op->o_client_connid, op->o_client_msgid );
+        operation_send_reject( op, LDAP_BUSY, "server busy", 0 );
+    }
+
+    for ( i = 0; i < LLOAD_OPCLASS_LAST; i++ ) {
+        for ( ;; ) {
+            LloadConnection *client;
+            int requeued;
+
+            checked_lock( &lload_queue_mutex );
+            op = queue_pop( &lload_queues[i] );
+            checked_unlock( &lload_queue_mutex );
+            if ( !op ) break;
+
+            checked_lock( &op->o_link_mutex );
+            client = op->o_client;
+            checked_unlock( &op->o_link_mutex );
+            if ( !client || !IS_ALIVE( client, c_live ) ||
+                    !IS_ALIVE( op, o_refcnt ) ) {
+                continue;
+            }
+
+            gettimeofday( &now, NULL );
+            request_process( client, op );
+
+            checked_lock( &lload_queue_mutex );
+            requeued = op->o_in_queue;
+            checked_unlock( &lload_queue_mutex );
+
+            /* Still nothing available for this class */
+            if ( requeued ) break;
+
+            queue_waited( op, &now );
+        }
+    }
+
+    timerclear( &earliest );
+    checked_lock( &lload_queue_mutex );
+    for ( i = 0; i < LLOAD_OPCLASS_LAST; i++ ) {
+        if ( (op = LDAP_TAILQ_FIRST( &lload_queues[i] )) ) {
+            queue_deadline( op, &deadline );
+            if ( !timerisset( &earliest ) ||
+                    timercmp( &deadline, &earliest, < ) ) {
+                earliest = deadline;
+            }
+        }
+    }
+    checked_unlock( &lload_queue_mutex );
+
+    if ( timerisset( &earliest ) ) {
+        if ( timercmp( &earliest, &now, > ) ) {
+            timersub( &earliest, &now, &deadline );
+        } else {
+            timerclear( &deadline );
+        }
+        evtimer_add( self, &deadline );
+    }
+
+    epoch_leave( epoch );
+}
+
+void
+lload_queue_init( void )
+{
+    int i;
+
+    ldap_pvt_thread_mutex_init( &lload_queue_mutex );
+    for ( i = 0; i < LLOAD_OPCLASS_LAST; i++ ) {
+        LDAP_TAILQ_INIT( &lload_queues[i] );
+    }
+}
+
+void
+lload_queue_destroy( void )
+{
+    ldap_pvt_thread_mutex_destroy( &lload_queue_mutex );
+}
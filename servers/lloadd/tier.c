@@ -142,6 +142,8 @@ lload_tiers_update( evutil_socket_t s, short what, void *arg )
 extern struct lload_tier_type roundrobin_tier;
 extern struct lload_tier_type weighted_tier;
 extern struct lload_tier_type bestof_tier;
+extern struct lload_tier_type ewma_tier;
+extern struct lload_tier_type hash_tier;
 
 struct {
     char *name;
@@ -150,6 +152,8 @@ struct {
         { "roundrobin", &roundrobin_tier },
         { "weighted", &weighted_tier },
         { "bestof", &bestof_tier },
+        { "ewma", &ewma_tier },
+        { "hash", &hash_tier },
 
         { NULL }
 };
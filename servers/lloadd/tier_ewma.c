@@ -0,0 +1,276 @@
+/* $OpenLDAP$ */
+/* This work is part of OpenLDAP Software <http://www.openldap.org/>.
+ *
+ * Copyright 1998-2022 The OpenLDAP Foundation.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted only as authorized by the OpenLDAP
+ * Public License.
+ *
+ * A copy of this license is available in the file LICENSE in the
+ * top-level directory of the distribution or, alternatively, at
+ * <http://www.OpenLDAP.org/license.html>.
+ */
+
+#include "portable.h"
+
+#include "lload.h"
+
+static LloadTierInit ewma_init;
+static LloadTierBackendCb ewma_add_backend;
+static LloadTierBackendCb ewma_remove_backend;
+static LloadTierCb ewma_update;
+static LloadTierCb ewma_destroy;
+static LloadTierSelect ewma_select;
+
+struct lload_tier_type ewma_tier;
+
+/*
+ * Backends are kept in an array so that two can be picked at random without
+ * walking t_backends. b_latency is maintained by handle_one_response for
+ * every backend, we only have to decay it for backends that have gone quiet,
+ * otherwise one bad sample would keep a backend from being tried again.
+ */
+struct ewma_private {
+    LloadBackend **backends;
+    int size;
+    uint64_t seed;
+};
+
+/* xorshift, see tier_bestof.c */
+static uint64_t
+ewma_rand( struct ewma_private *priv )
+{
+    uint64_t val = priv->seed;
+    val ^= val << 13;
+    val ^= val >> 7;
+    val ^= val << 17;
+    priv->seed = val;
+    return val;
+}
+
+/*
+ * Expected cost of sending another operation to the backend: its average
+ * latency scaled by the number of operations already waiting there.
+ */
+static uint64_t
+ewma_cost( LloadBackend *b )
+{
+    uint64_t latency, pending;
+
+    latency = __atomic_load_n( &b->b_latency, __ATOMIC_RELAXED );
+    pending = __atomic_load_n( &b->b_n_ops_executing, __ATOMIC_RELAXED );
+
+    return ( latency + 1 ) * ( pending + 1 );
+}
+
+static LloadTier *
+ewma_init( void )
+{
+    LloadTier *tier;
+    struct ewma_private *priv;
+    int seed;
+
+    tier = ch_calloc( 1, sizeof(LloadTier) );
+    priv = ch_calloc( 1, sizeof(struct ewma_private) );
+
+    tier->t_type = ewma_tier;
+    ldap_pvt_thread_mutex_init( &tier->t_mutex );
+    LDAP_CIRCLEQ_INIT( &tier->t_backends );
+
+    /* Make sure we don't pass 0 as a seed */
+    do {
+        seed = rand();
+    } while ( !seed );
+    priv->seed = seed;
+    tier->t_private = priv;
+
+    return tier;
+}
+
+static int
+ewma_add_backend( LloadTier *tier, LloadBackend *b )
+{
+    struct ewma_private *priv = tier->t_private;
+
+    assert( b->b_tier == tier );
+
+    if ( tier->t_nbackends == priv->size ) {
+        priv->size = priv->size ? 2 * priv->size : 4;
+        priv->backends = ch_realloc(
+                priv->backends, priv->size * sizeof(LloadBackend *) );
+    }
+    priv->backends[tier->t_nbackends] = b;
+
+    LDAP_CIRCLEQ_INSERT_TAIL( &tier->t_backends, b, b_next );
+    tier->t_nbackends++;
+    return LDAP_SUCCESS;
+}
+
+static int
+ewma_remove_backend( LloadTier *tier, LloadBackend *b )
+{
+    struct ewma_private *priv = tier->t_private;
+    int i;
+
+    assert_locked( &tier->t_mutex );
+    assert_locked( &b->b_mutex );
+
+    assert( b->b_tier == tier );
+
+    for ( i = 0; i < tier->t_nbackends; i++ ) {
+        if ( priv->backends[i] == b ) {
+            break;
+        }
+    }
+    assert( i < tier->t_nbackends );
+    priv->backends[i] = priv->backends[--tier->t_nbackends];
+
+    LDAP_CIRCLEQ_REMOVE( &tier->t_backends, b, b_next );
+    LDAP_CIRCLEQ_ENTRY_INIT( b, b_next );
+    return LDAP_SUCCESS;
+}
+
+static int
+ewma_update( LloadTier *tier )
+{
+    LloadBackend *b;
+
+    LDAP_CIRCLEQ_FOREACH ( b, &tier->t_backends, b_next ) {
+        uintptr_t latency;
+
+        /* Nothing heard back in the last second, forget half of what we knew
+         * unless it is sitting on unanswered operations */
+        if ( __atomic_exchange_n(
+                     &b->b_operation_count, 0, __ATOMIC_RELAXED ) ||
+                __atomic_load_n( &b->b_n_ops_executing, __ATOMIC_RELAXED ) ) {
+            continue;
+        }
+
+        latency = __atomic_load_n( &b->b_latency, __ATOMIC_RELAXED );
+        while ( latency &&
+                !__atomic_compare_exchange_n( &b->b_latency, &latency,
+                        latency / 2, 0, __ATOMIC_RELAXED, __ATOMIC_RELAXED ) )
+            /* retry */;
+    }
+
+    return LDAP_SUCCESS;
+}
+
+static int
+ewma_destroy( LloadTier *tier )
+{
+    struct ewma_private *priv = tier->t_private;
+    int rc;
+
+    /* Removes the backends, still needs priv */
+    rc = tier_destroy( tier );
+
+    ch_free( priv->backends );
+    ch_free( priv );
+    return rc;
+}
+
+static int
+ewma_select(
+        LloadTier *tier,
+        LloadOperation *op,
+        LloadConnection **cp,
+        int *res,
+        char **message )
+{
+    struct ewma_private *priv = tier->t_private;
+    LloadBackend *b, *b0 = NULL, *b1 = NULL;
+    int i, start = 0, n, rc = 0, result;
+
+    checked_lock( &tier->t_mutex );
+    n = tier->t_nbackends;
+    if ( n == 1 ) {
+        b0 = priv->backends[0];
+    } else if ( n > 1 ) {
+        /* Pick two distinct backends at random, try the cheaper one first */
+        int i0 = ewma_rand( priv ) % n, i1 = ewma_rand( priv ) % ( n - 1 );
+
+        if ( i1 >= i0 ) {
+            i1 += 1;
+        }
+        b0 = priv->backends[i0];
+        b1 = priv->backends[i1];
+        start = i1;
+    }
+    checked_unlock( &tier->t_mutex );
+
+    if ( !b0 ) return rc;
+
+    if ( b1 && ewma_cost( b1 ) < ewma_cost( b0 ) ) {
+        b = b0;
+        b0 = b1;
+        b1 = b;
+    }
+
+    checked_lock( &b0->b_mutex );
+    result = backend_select_ready( b0, op, cp, res, message );
+    checked_unlock( &b0->b_mutex );
+
+    rc |= result;
+    if ( result && *cp ) {
+        return rc;
+    }
+
+    if ( !b1 ) return rc;
+
+    checked_lock( &b1->b_mutex );
+    result = backend_select_ready( b1, op, cp, res, message );
+    checked_unlock( &b1->b_mutex );
+
+    rc |= result;
+    if ( result && *cp ) {
+        return rc;
+    }
+
+    /* Both were unusable, try the rest in turn */
+    for ( i = 1; i < n; i++ ) {
+        checked_lock( &tier->t_mutex );
+        if ( n != tier->t_nbackends ) {
+            /* Changed under us, give up */
+            checked_unlock( &tier->t_mutex );
+            break;
+        }
+        b = priv->backends[( start + i ) % n];
+        checked_unlock( &tier->t_mutex );
+
+        if ( b == b0 || b == b1 ) {
+            continue;
+        }
+
+        checked_lock( &b->b_mutex );
+        result = backend_select_ready( b, op, cp, res, message );
+        checked_unlock( &b->b_mutex );
+
+        rc |= result;
+        if ( result && *cp ) {
+            return rc;
+        }
+    }
+
+    return rc;
+}
+
+struct lload_tier_type ewma_tier = {
+        .tier_name = "ewma",
+
+        .tier_init = ewma_init,
+        .tier_startup = tier_startup,
+        .tier_update = ewma_update,
+        .tier_reset = tier_reset,
+        .tier_destroy = ewma_destroy,
+
+        .tier_oc = BER_BVC("olcBkLloadTierConfig"),
+        .tier_backend_oc = BER_BVC("olcBkLloadBackendConfig"),
+
+        .tier_add_backend = ewma_add_backend,
+        .tier_remove_backend = ewma_remove_backend,
+
+        .tier_select = ewma_select,
+};
@@ -0,0 +1,377 @@
+/* $OpenLDAP$ */
+/* This work is part of OpenLDAP Software <http://www.openldap.org/>.
+ *
+ * Copyright 1998-2022 The OpenLDAP Foundation.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted only as authorized by the OpenLDAP
+ * Public License.
+ *
+ * A copy of this license is available in the file LICENSE in the
+ * top-level directory of the distribution or, alternatively, at
+ * <http://www.OpenLDAP.org/license.html>.
+ */
+
+#include "portable.h"
+
+#include <ac/string.h>
+
+#include "lload.h"
+#include "lutil_hash.h"
+
+static LloadTierInit hash_init;
+static LloadTierBackendCb hash_add_backend;
+static LloadTierBackendCb hash_remove_backend;
+static LloadTierCb hash_destroy;
+static LloadTierSelect hash_select;
+
+struct lload_tier_type hash_tier;
+
+/* How many of the last RDNs of the target DN make up the key, 0 for all */
+unsigned int lload_hash_depth = 0;
+
+/* How far above the average a backend may be loaded, in percent */
+unsigned int lload_hash_load_bound = 125;
+
+/*
+ * Each backend is placed on a ring of 64-bit hashes at HASH_POINTS points
+ * per unit of weight. An operation is hashed on its target DN (or the bind
+ * DN) and goes to the first backend at or after that point, then to the
+ * next distinct backends along the ring if that one is unavailable. Keys
+ * only move between backends when backends are added or removed.
+ *
+ * To avoid hot spots, a backend is passed over while it has more operations
+ * pending than lload_hash_load_bound percent of the average across the
+ * tier, those operations are only sent there once every other backend has
+ * turned out to be busy as well.
+ */
+#define HASH_POINTS 100
+
+struct hash_point {
+    uint64_t hp_hash;
+    LloadBackend *hp_backend;
+};
+
+struct hash_private {
+    struct hash_point *ring;
+    int npoints;
+};
+
+static int
+hash_point_cmp( const void *left, const void *right )
+{
+    const struct hash_point *l = left, *r = right;
+
+    return ( l->hp_hash < r->hp_hash ) ? -1 : ( l->hp_hash > r->hp_hash );
+}
+
+/*
+ * Rebuild the ring from t_backends and work out what share of the key space
+ * each backend ends up owning.
+ */
+static void
+hash_rebuild( LloadTier *tier )
+{
+    struct hash_private *priv = tier->t_private;
+    LloadBackend *b;
+    uint64_t *owned;
+    int i, j, n = 0;
+
+    LDAP_CIRCLEQ_FOREACH ( b, &tier->t_backends, b_next ) {
+        n += HASH_POINTS * ( b->b_weight > 0 ? b->b_weight : 1 );
+    }
+
+    priv->npoints = 0;
+    if ( !n ) {
+        ch_free( priv->ring );
+        priv->ring = NULL;
+        return;
+    }
+    priv->ring = ch_realloc( priv->ring, n * sizeof(struct hash_point) );
+
+    LDAP_CIRCLEQ_FOREACH ( b, &tier->t_backends, b_next ) {
+        int points = HASH_POINTS * ( b->b_weight > 0 ? b->b_weight : 1 );
+
+        for ( j = 0; j < points; j++ ) {
+            priv->ring[priv->npoints].hp_hash = lutil_wyhash64(
+                    (unsigned char *)b->b_uri.bv_val, b->b_uri.bv_len, j );
+            priv->ring[priv->npoints].hp_backend = b;
+            priv->npoints++;
+        }
+    }
+    qsort( priv->ring, priv->npoints, sizeof(struct hash_point),
+            hash_point_cmp );
+
+    /* Each point owns the keys between the previous point and itself */
+    owned = ch_calloc( tier->t_nbackends, sizeof(uint64_t) );
+    for ( i = 0; i < priv->npoints; i++ ) {
+        uint64_t prev = priv->ring[i ? i - 1 : priv->npoints - 1].hp_hash;
+
+        j = 0;
+        LDAP_CIRCLEQ_FOREACH ( b, &tier->t_backends, b_next ) {
+            if ( b == priv->ring[i].hp_backend ) break;
+            j++;
+        }
+        owned[j] += priv->ring[i].hp_hash - prev;
+    }
+
+    j = 0;
+    LDAP_CIRCLEQ_FOREACH ( b, &tier->t_backends, b_next ) {
+        uintptr_t share = 1000000;
+
+        /* On its own, the arcs add up to the whole ring and wrap around */
+        if ( tier->t_nbackends > 1 ) {
+            share = (double)owned[j] / 18446744073709551616.0 * 1000000;
+        }
+        __atomic_store_n( &b->b_hash_share, share, __ATOMIC_RELAXED );
+        j++;
+    }
+    ch_free( owned );
+}
+
+/*
+ * Work out where on the ring the operation belongs. Operations that do not
+ * name an entry are hashed on the client connection so that they at least
+ * stay together.
+ */
+static uint64_t
+hash_key( LloadOperation *op )
+{
+    BerElementBuffer copy_berbuf;
+    BerElement *copy = (BerElement *)&copy_berbuf;
+    struct berval dn = BER_BVNULL, ndn;
+    ber_int_t version;
+    uint64_t key;
+
+    /* The request is forwarded as it is, leave it untouched */
+    ber_init2( copy, &op->o_request, 0 );
+    switch ( op->o_tag ) {
+        case LDAP_REQ_DELETE:
+            dn = op->o_request;
+            break;
+        case LDAP_REQ_BIND:
+            if ( ber_get_int( copy, &version ) == LBER_ERROR ) {
+                break;
+            }
+            /* FALLTHRU */
+        case LDAP_REQ_SEARCH:
+        case LDAP_REQ_ADD:
+        case LDAP_REQ_MODIFY:
+        case LDAP_REQ_MODRDN:
+        case LDAP_REQ_COMPARE:
+            if ( ber_get_stringbv( copy, &dn, LBER_BV_NOTERM ) ==
+                    LBER_ERROR ) {
+                BER_BVZERO( &dn );
+            }
+            break;
+    }
+
+    if ( BER_BVISNULL( &dn ) ) {
+        return lutil_wyhash64( (unsigned char *)&op->o_client_connid,
+                sizeof(op->o_client_connid), 0 );
+    }
+
+    if ( lload_dn_normalize( &dn, &ndn ) ) {
+        /* Not a DN we can make sense of, take it as it is */
+        return lutil_wyhash64( (unsigned char *)dn.bv_val, dn.bv_len, 0 );
+    }
+
+    dn = ndn;
+    if ( lload_hash_depth ) {
+        unsigned int rdns = 0;
+        char *p;
+
+        /* Keep the last lload_hash_depth RDNs, skipping escaped commas */
+        for ( p = ndn.bv_val + ndn.bv_len - 1; p > ndn.bv_val; p-- ) {
+            char *q = p;
+
+            if ( *p != ',' ) continue;
+            while ( q > ndn.bv_val && q[-1] == '\\' ) q--;
+            if ( ( p - q ) % 2 ) continue;
+
+            if ( ++rdns == lload_hash_depth ) {
+                dn.bv_val = p + 1;
+                dn.bv_len = ndn.bv_val + ndn.bv_len - dn.bv_val;
+                break;
+            }
+        }
+    }
+
+    key = lutil_wyhash64( (unsigned char *)dn.bv_val, dn.bv_len, 0 );
+    ch_free( ndn.bv_val );
+    return key;
+}
+
+static LloadTier *
+hash_init( void )
+{
+    LloadTier *tier;
+
+    tier = ch_calloc( 1, sizeof(LloadTier) );
+
+    tier->t_type = hash_tier;
+    ldap_pvt_thread_mutex_init( &tier->t_mutex );
+    LDAP_CIRCLEQ_INIT( &tier->t_backends );
+    tier->t_private = ch_calloc( 1, sizeof(struct hash_private) );
+
+    return tier;
+}
+
+static int
+hash_add_backend( LloadTier *tier, LloadBackend *b )
+{
+    assert( b->b_tier == tier );
+
+    checked_lock( &tier->t_mutex );
+    /* Called again after the backend has been modified, its URI or weight
+     * might have changed */
+    if ( !LDAP_CIRCLEQ_NEXT( b, b_next ) ) {
+        LDAP_CIRCLEQ_INSERT_TAIL( &tier->t_backends, b, b_next );
+        tier->t_nbackends++;
+    }
+    hash_rebuild( tier );
+    checked_unlock( &tier->t_mutex );
+
+    return LDAP_SUCCESS;
+}
+
+static int
+hash_remove_backend( LloadTier *tier, LloadBackend *b )
+{
+    assert_locked( &tier->t_mutex );
+    assert_locked( &b->b_mutex );
+
+    assert( b->b_tier == tier );
+    assert( tier->t_nbackends );
+
+    LDAP_CIRCLEQ_REMOVE( &tier->t_backends, b, b_next );
+    LDAP_CIRCLEQ_ENTRY_INIT( b, b_next );
+    tier->t_nbackends--;
+
+    hash_rebuild( tier );
+    return LDAP_SUCCESS;
+}
+
+static int
+hash_destroy( LloadTier *tier )
+{
+    struct hash_private *priv = tier->t_private;
+    int rc;
+
+    /* Removes the backends, still needs priv */
+    rc = tier_destroy( tier );
+
+    ch_free( priv->ring );
+    ch_free( priv );
+    return rc;
+}
+
+static int
+hash_select(
+        LloadTier *tier,
+        LloadOperation *op,
+        LloadConnection **cp,
+        int *res,
+        char **message )
+{
+    struct hash_private *priv = tier->t_private;
+    LloadBackend *b, **order;
+    uint64_t key = hash_key( op );
+    long limit = 0;
+    int i, lo, hi, n = 0, pass, rc = 0;
+
+    checked_lock( &tier->t_mutex );
+    if ( !priv->npoints ) {
+        checked_unlock( &tier->t_mutex );
+        return rc;
+    }
+
+    /* Find the first point at or after the key */
+    lo = 0;
+    hi = priv->npoints;
+    while ( lo < hi ) {
+        int mid = ( lo + hi ) / 2;
+
+        if ( priv->ring[mid].hp_hash < key ) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+
+    /* Then collect the backends in the order we come across them */
+    order = ch_malloc( tier->t_nbackends * sizeof(LloadBackend *) );
+    for ( i = 0; i < priv->npoints && n < tier->t_nbackends; i++ ) {
+        int j;
+
+        b = priv->ring[( lo + i ) % priv->npoints].hp_backend;
+        for ( j = 0; j < n; j++ ) {
+            if ( order[j] == b ) break;
+        }
+        if ( j == n ) {
+            order[n++] = b;
+        }
+    }
+    checked_unlock( &tier->t_mutex );
+
+    if ( lload_hash_load_bound && n > 1 ) {
+        long total = 1;
+
+        for ( i = 0; i < n; i++ ) {
+            total += __atomic_load_n(
+                    &order[i]->b_n_ops_executing, __ATOMIC_RELAXED );
+        }
+        /* ceil( bound * total / n ) */
+        limit = ( total * lload_hash_load_bound + 100 * n - 1 ) / ( 100 * n );
+    }
+
+    /* Respect the bound first, then take whichever backend is available */
+    for ( pass = 0; pass < ( limit ? 2 : 1 ); pass++ ) {
+        for ( i = 0; i < n; i++ ) {
+            int over, result;
+
+            b = order[i];
+            over = limit && __atomic_load_n( &b->b_n_ops_executing,
+                                    __ATOMIC_RELAXED ) >= limit;
+            if ( over != pass ) {
+                continue;
+            }
+
+            checked_lock( &b->b_mutex );
+            result = backend_select_ready( b, op, cp, res, message );
+            checked_unlock( &b->b_mutex );
+
+            rc |= result;
+            if ( result && *cp ) {
+                if ( i ) {
+                    __atomic_add_fetch( &b->b_hash_taken, 1, __ATOMIC_RELAXED );
+                } else {
+                    __atomic_add_fetch( &b->b_hash_owned, 1, __ATOMIC_RELAXED );
+                }
+                goto done;
+            }
+        }
+    }
+
+done:
+    ch_free( order );
+    return rc;
+}
+
+struct lload_tier_type hash_tier = {
+        .tier_name = "hash",
+
+        .tier_init = hash_init,
+        .tier_startup = tier_startup,
+        .tier_reset = tier_reset,
+        .tier_destroy = hash_destroy,
+
+        .tier_oc = BER_BVC("olcBkLloadTierConfig"),
+        .tier_backend_oc = BER_BVC("olcBkLloadBackendConfig"),
+
+        .tier_add_backend = hash_add_backend,
+        .tier_remove_backend = hash_remove_backend,
+
+        .tier_select = hash_select,
+};
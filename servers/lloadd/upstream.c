@@ -61,6 +61,49 @@ linked_upstream_lost( LloadConnection *client )
     lload_connection_close( client, &gentle );
 }
 
+/*
+ * Overwrite the message ID at the start of a PDU as read from the network,
+ * keeping its encoded length the same. Should the new ID be shorter, the
+ * length octets are padded out in long form. Returns -1 if it does not fit.
+ */
+static int
+splice_msgid( struct berval *tlv, ber_int_t msgid )
+{
+    unsigned char *p = (unsigned char *)tlv->bv_val;
+    ber_len_t i, n = 1, lenlen;
+
+    while ( n < sizeof(ber_int_t) && ( msgid >> ( 8 * n - 1 ) ) ) {
+        n++;
+    }
+    if ( tlv->bv_len < n + 2 || p[0] != LBER_INTEGER ) {
+        return -1;
+    }
+
+    lenlen = tlv->bv_len - n - 1;
+    if ( lenlen > 1 + sizeof(ber_int_t) ) {
+        return -1;
+    }
+
+    if ( lenlen == 1 ) {
+        p[1] = n;
+    } else {
+        p[1] = 0x80 | ( lenlen - 1 );
+        for ( i = 2; i < lenlen; i++ ) {
+            p[i] = 0;
+        }
+        p[lenlen] = n;
+    }
+    for ( i = 0; i < n; i++ ) {
+        p[lenlen + 1 + i] = ( msgid >> ( 8 * ( n - 1 - i ) ) ) & 0xff;
+    }
+    return 0;
+}
+
+/*
+ * Large search entries are not re-encoded, the message ID is rewritten in
+ * place and the PDU we read is queued on the client as is, behind a new
+ * LDAPMessage header.
+ */
 int
 forward_response( LloadConnection *client, LloadOperation *op, BerElement *ber )
 {
@@ -68,7 +111,8 @@ forward_response( LloadConnection *client, LloadOperation *op, BerElement *ber )
     BerValue response, controls = BER_BVNULL;
     ber_int_t msgid;
     ber_tag_t tag, response_tag;
-    ber_len_t len;
+    ber_len_t len, total, msgid_len;
+    int splice = 0;
 
     CONNECTION_LOCK(client);
     if ( op->o_client_msgid ) {
@@ -80,6 +124,10 @@ forward_response( LloadConnection *client, LloadOperation *op, BerElement *ber )
     }
     CONNECTION_UNLOCK(client);
 
+    ber_get_option( ber, LBER_OPT_BER_TOTAL_BYTES, &total );
+    ber_get_option( ber, LBER_OPT_BER_REMAINING_BYTES, &len );
+    msgid_len = total - len;
+
     response_tag = ber_skip_element( ber, &response );
 
     tag = ber_peek_tag( ber, &len );
@@ -87,6 +135,25 @@ forward_response( LloadConnection *client, LloadOperation *op, BerElement *ber )
         ber_skip_element( ber, &controls );
     }
 
+    ber_get_option( ber, LBER_OPT_BER_REMAINING_BYTES, &len );
+    if ( response_tag == LDAP_RES_SEARCH_ENTRY &&
+            response.bv_len >= LLOAD_SPLICE_MIN && !len ) {
+        struct berval tlv;
+
+        /* Nothing follows the last element, find where the PDU starts */
+        if ( BER_BVISNULL( &controls ) ) {
+            tlv.bv_val = response.bv_val + response.bv_len - total;
+        } else {
+            tlv.bv_val = controls.bv_val + controls.bv_len - total;
+        }
+        tlv.bv_len = msgid_len;
+        splice = !splice_msgid( &tlv, msgid );
+    }
+
+    if ( op->o_cache ) {
+        lload_cache_collect( op, response_tag, &response, &controls );
+    }
+
     Debug( LDAP_DEBUG_TRACE, "forward_response: "
             "%s to client connid=%lu request msgid=%d\n",
             lload_msgtype2str( response_tag ), op->o_client_connid, msgid );
@@ -100,6 +167,29 @@ forward_response( LloadConnection *client, LloadOperation *op, BerElement *ber )
     }
     client->c_pendingber = output;
 
+    if ( splice && client->c_outq_len + 2 <= LLOAD_OUTQ_SIZE ) {
+        unsigned char header[] = {
+            LDAP_TAG_MESSAGE, 0x84,
+            ( total >> 24 ) & 0xff, ( total >> 16 ) & 0xff,
+            ( total >> 8 ) & 0xff, total & 0xff,
+        };
+        int i = ( client->c_outq_head + client->c_outq_len ) % LLOAD_OUTQ_SIZE;
+
+        ber_write( output, (char *)header, sizeof(header), 0 );
+
+        /* Everything we have read is to be written out again */
+        ber_reset( ber, 0 );
+
+        client->c_outq[i] = output;
+        client->c_outq[( i + 1 ) % LLOAD_OUTQ_SIZE] = ber;
+        client->c_outq_len += 2;
+        client->c_pendingber = NULL;
+        checked_unlock( &client->c_io_mutex );
+
+        connection_write_cb( -1, 0, client );
+        return 0;
+    }
+
     ber_printf( output, "t{titOtO}", LDAP_TAG_MESSAGE,
             LDAP_TAG_MSGID, msgid,
             response_tag, &response,
@@ -125,6 +215,7 @@ forward_final_response(
             "client connid=%lu\n",
             op->o_upstream_connid, op->o_upstream_msgid, op->o_client_connid );
 
+    lload_cache_write( op );
     rc = forward_response( client, op, ber );
 
     op->o_res = LLOAD_OP_COMPLETED;
@@ -255,12 +346,25 @@ handle_one_response( LloadConnection *c )
         gettimeofday( &tv, NULL );
         if ( !timerisset( &op->o_last_response ) ) {
             LloadBackend *b = c->c_backend;
+            uintptr_t latency, update;
 
             timersub( &tv, &op->o_start, &tvdiff );
             diff = 1000000 * tvdiff.tv_sec + tvdiff.tv_usec;
 
             __atomic_add_fetch( &b->b_operation_count, 1, __ATOMIC_RELAXED );
             __atomic_add_fetch( &b->b_operation_time, diff, __ATOMIC_RELAXED );
+
+            latency = __atomic_load_n( &b->b_latency, __ATOMIC_RELAXED );
+            do {
+                if ( latency ) {
+                    update = latency +
+                            ( (intptr_t)diff - (intptr_t)latency ) /
+                                    ( 1 << LLOAD_EWMA_SHIFT );
+                } else {
+                    update = diff;
+                }
+            } while ( !__atomic_compare_exchange_n( &b->b_latency, &latency,
+                    update, 0, __ATOMIC_RELAXED, __ATOMIC_RELAXED ) );
         }
         op->o_last_response = tv;
 
@@ -541,6 +645,7 @@ upstream_bind_cb( LloadConnection *c )
                 LDAP_CIRCLEQ_INSERT_HEAD( &b->b_conns, c, c_next );
             }
             b->b_last_conn = c;
+            backend_conn_ready( b, c );
             backend_retry( b );
             checked_unlock( &b->b_mutex );
             break;
@@ -686,6 +791,7 @@ upstream_finish( LloadConnection *c )
             LDAP_CIRCLEQ_INSERT_HEAD( &b->b_bindconns, c, c_next );
         }
         b->b_last_bindconn = c;
+        backend_conn_ready( b, c );
     } else if ( bindconf.sb_method == LDAP_AUTH_NONE ) {
         LDAP_CIRCLEQ_REMOVE( &b->b_preparing, c, c_next );
         c->c_state = LLOAD_C_READY;
@@ -699,6 +805,7 @@ upstream_finish( LloadConnection *c )
             LDAP_CIRCLEQ_INSERT_HEAD( &b->b_conns, c, c_next );
         }
         b->b_last_conn = c;
+        backend_conn_ready( b, c );
     } else {
         if ( ldap_pvt_thread_pool_submit(
                      &connection_pool, upstream_bind, c ) ) {
@@ -770,6 +877,7 @@ upstream_tls_handshake_cb( evutil_socket_t s, short what, void *arg )
                 "connid=%lu finished\n",
                 c->c_connid );
         c->c_is_tls = LLOAD_TLS_ESTABLISHED;
+        connection_tls_established( c, 1 );
 
         CONNECTION_UNLOCK(c);
         checked_lock( &b->b_mutex );
@@ -913,6 +1021,36 @@ fail:
 }
 #endif /* HAVE_TLS */
 
+/*
+ * With the affinity feature on, spread the backend's connections evenly over
+ * the I/O threads so that clients on any of them can be served by an upstream
+ * connection on the same thread.
+ */
+static int
+upstream_affinity_tid( LloadBackend *b, ber_socket_t s )
+{
+    lload_c_head *heads[] = { &b->b_conns, &b->b_bindconns, &b->b_preparing };
+    LloadConnection *c;
+    int i, j, best = -1, best_count = 0, start = lload_get_tid( s );
+
+    assert_locked( &b->b_mutex );
+
+    for ( i = 0; i < lload_daemon_threads; i++ ) {
+        int tid = ( start + i ) % lload_daemon_threads, count = 0;
+
+        for ( j = 0; j < sizeof(heads) / sizeof(heads[0]); j++ ) {
+            LDAP_CIRCLEQ_FOREACH ( c, heads[j], c_next ) {
+                if ( c->c_tid == tid ) count++;
+            }
+        }
+        if ( best < 0 || count < best_count ) {
+            best = tid;
+            best_count = count;
+        }
+    }
+    return best;
+}
+
 /*
  * We must already hold b->b_mutex when called.
  */
@@ -920,12 +1058,17 @@ LloadConnection *
 upstream_init( ber_socket_t s, LloadBackend *b )
 {
     LloadConnection *c;
-    struct event_base *base = lload_get_base( s );
+    struct event_base *base;
     struct event *event;
-    int flags;
+    int flags, tid = lload_get_tid( s );
 
     assert( b != NULL );
 
+    if ( lload_features & LLOAD_FEATURE_AFFINITY ) {
+        tid = upstream_affinity_tid( b, s );
+    }
+    base = lload_get_tid_base( tid );
+
     flags = (b->b_proto == LDAP_PROTO_IPC) ? CONN_IS_IPC : 0;
     if ( (c = lload_connection_init( s, b->b_host, flags )) == NULL ) {
         return NULL;
@@ -933,6 +1076,7 @@ upstream_init( ber_socket_t s, LloadBackend *b )
 
     CONNECTION_LOCK(c);
     c->c_backend = b;
+    c->c_tid = tid;
 #ifdef HAVE_TLS
     c->c_is_tls = b->b_tls;
 #endif
@@ -1076,6 +1220,7 @@ upstream_unlink( LloadConnection *c )
     c->c_ops = NULL;
     executing = c->c_n_ops_executing;
     c->c_n_ops_executing = 0;
+    memset( c->c_n_ops_class, 0, sizeof(c->c_n_ops_class) );
 
     linked_root = c->c_linked;
     c->c_linked = NULL;
@@ -1101,6 +1246,7 @@ upstream_unlink( LloadConnection *c )
     }
 
     checked_lock( &b->b_mutex );
+    backend_conn_unready( b, c );
     if ( c->c_type == LLOAD_C_PREPARING ) {
         LDAP_CIRCLEQ_REMOVE( &b->b_preparing, c, c_next );
         b->b_opening--;
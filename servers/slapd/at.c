@@ -258,6 +258,9 @@ at_delete( AttributeType *at )
 	LDAP_STAILQ_REMOVE(&attr_list, at, AttributeType, sat_next);
 
 	at_delete_names( at );
+
+	/* cached DNs may have been normalized with it */
+	dn_cache_flush();
 }
 
 static void
@@ -444,6 +447,9 @@ at_insert(
 	char			**names = NULL;
 	AttributeType	*sat = *rat;
 
+	/* cached DNs may have used it as an undefined attribute */
+	dn_cache_flush();
+
 	if ( sat->sat_oid ) {
 		air = (struct aindexrec *)
 			ch_calloc( 1, sizeof(struct aindexrec) );
@@ -816,6 +816,84 @@ int mdb_ad_get( struct mdb_info *mdb, MDB_txn *txn, AttributeDescription *ad )
 	return rc;
 }
 
+/* The index hash function a database was indexed with is recorded
+ * under key 0 of the ad2id DB, which never holds an attribute.
+ * Databases without the record predate it and were indexed with FNV.
+ */
+int mdb_ad_hash_stamp( struct mdb_info *mdb, MDB_txn *txn )
+{
+	int rc, zero = 0;
+	MDB_val key, val;
+	struct berval bv;
+
+	enum_to_verb( slap_index_hashes, slap_index_hash( -1 ), &bv );
+
+	key.mv_size = sizeof(int);
+	key.mv_data = &zero;
+	val.mv_size = bv.bv_len;
+	val.mv_data = bv.bv_val;
+
+	rc = mdb_put( txn, mdb->mi_ad2id, &key, &val, 0 );
+	if ( rc == MDB_SUCCESS ) {
+		mdb->mi_flags &= ~MDB_NEED_REHASH;
+	} else {
+		Debug( LDAP_DEBUG_ANY,
+			"mdb_ad_hash_stamp: mdb_put failed %s(%d)\n",
+			mdb_strerror(rc), rc );
+	}
+
+	return rc;
+}
+
+int mdb_ad_hash_check( BackendDB *be, MDB_txn *txn, ConfigReply *cr )
+{
+	struct mdb_info *mdb = (struct mdb_info *) be->be_private;
+	int i, rc, zero = 0, alg = SLAP_INDEX_HASH_FNV;
+	MDB_val key, data;
+	MDB_stat st;
+	struct berval bv, cur;
+
+	key.mv_size = sizeof(int);
+	key.mv_data = &zero;
+
+	BER_BVSTR( &bv, "fnv" );
+	rc = mdb_get( txn, mdb->mi_ad2id, &key, &data );
+	if ( rc == MDB_SUCCESS ) {
+		bv.bv_len = data.mv_size;
+		bv.bv_val = data.mv_data;
+		i = bverb_to_mask( &bv, slap_index_hashes );
+		alg = BER_BVISNULL( &slap_index_hashes[i].word ) ?
+			-1 : slap_index_hashes[i].mask;
+	} else if ( rc != MDB_NOTFOUND ) {
+		return rc;
+	}
+
+	if ( alg == slap_index_hash( -1 ) )
+		return 0;
+
+	rc = mdb_stat( txn, mdb->mi_id2entry, &st );
+	if ( rc )
+		return rc;
+
+	if ( !st.ms_entries ) {
+		/* nothing indexed yet, just record the current function */
+		if ( slapMode & SLAP_TOOL_READONLY )
+			return 0;
+		return mdb_ad_hash_stamp( mdb, txn );
+	}
+
+	enum_to_verb( slap_index_hashes, slap_index_hash( -1 ), &cur );
+	snprintf( cr->msg, sizeof(cr->msg),
+		"database \"%s\": indexed with \"%.*s\" hashes but index_hash "
+		"is \"%s\", run \"slapindex -t\".",
+		be->be_suffix[0].bv_val, (int)bv.bv_len, bv.bv_val, cur.bv_val );
+	Debug( LDAP_DEBUG_ANY, "mdb_ad_hash_check: %s\n", cr->msg );
+	mdb->mi_flags |= MDB_NEED_REHASH;
+
+	/* the tools may still read the database, or rebuild its indices */
+	return ( slapMode & SLAP_SERVER_MODE ) ? LDAP_OTHER : 0;
+}
+
 void mdb_ad_unwind( struct mdb_info *mdb, int prev_ads )
 {
 	int i;
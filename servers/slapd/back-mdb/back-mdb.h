@@ -104,6 +104,7 @@ struct mdb_info {
 #define	MDB_DEL_INDEX	0x08
 #define	MDB_RE_OPEN		0x10
 #define	MDB_NEED_UPGRADE	0x20
+#define	MDB_NEED_REHASH	0x40
 
 	int mi_numads;
 
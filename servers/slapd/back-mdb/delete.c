@@ -372,6 +372,9 @@ mdb_delete( Operation *op, SlapReply *rs )
 			rs->sr_err = mdb_txn_commit( txn );
 		}
 		txn = NULL;
+	} else {
+		/* the txn owner commits, don't leak the children check */
+		rs->sr_err = LDAP_SUCCESS;
 	}
 
 	if( rs->sr_err != 0 ) {
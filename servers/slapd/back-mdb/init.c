@@ -277,6 +277,12 @@ mdb_db_open( BackendDB *be, ConfigReply *cr )
 		goto fail;
 	}
 
+	rc = mdb_ad_hash_check( be, txn, cr );
+	if ( rc ) {
+		mdb_txn_abort( txn );
+		goto fail;
+	}
+
 	/* slapcat doesn't need indexes. avoid a failure if
 	 * a configured index wasn't created yet.
 	 */
@@ -58,6 +58,8 @@ void mdb_attr_info_free( AttrInfo *ai );
 int mdb_ad_read( struct mdb_info *mdb, MDB_txn *txn );
 int mdb_ad_get( struct mdb_info *mdb, MDB_txn *txn, AttributeDescription *ad );
 void mdb_ad_unwind( struct mdb_info *mdb, int prev_ads );
+int mdb_ad_hash_check( BackendDB *be, MDB_txn *txn, ConfigReply *cr );
+int mdb_ad_hash_stamp( struct mdb_info *mdb, MDB_txn *txn );
 
 /*
  * config.c
@@ -437,6 +437,7 @@ mdb_search( Operation *op, SlapReply *rs )
 	MDB_cursor	*mci, *mcd;
 	ww_ctx wwctx;
 	slap_callback cb = { 0 };
+	FilterProg	*fprog = NULL;
 
 	mdb_op_info	opinfo = {{{0}}}, *moi = &opinfo;
 	MDB_txn			*ltid = NULL;
@@ -1083,7 +1084,9 @@ notfound:
 		}
 
 		/* if it matches the filter and scope, send it */
-		rs->sr_err = test_filter( op, e, op->oq_search.rs_filter );
+		if ( !fprog )
+			fprog = filter_compile( op->oq_search.rs_filter, op->o_tmpmemctx );
+		rs->sr_err = test_filter_prog( op, e, fprog );
 
 		if ( rs->sr_err == LDAP_COMPARE_TRUE ) {
 			/* check size limit */
@@ -1239,6 +1242,8 @@ done:
 	}
 	if (base)
 		mdb_entry_return( op, base );
+	if ( fprog )
+		filter_prog_free( fprog, op->o_tmpmemctx );
 	scope_chunk_ret( op, scopes );
 	if ( candidates != c0 ) {
 		ch_free( candidates );
@@ -673,6 +673,17 @@ ID mdb_tool_entry_put(
 
 	mdb = (struct mdb_info *) be->be_private;
 
+	/* new keys would not match the ones already in the indices */
+	if ( mdb->mi_flags & MDB_NEED_REHASH ) {
+		snprintf( text->bv_val, text->bv_len,
+			"indices were built with another index_hash, "
+			"run \"slapindex -t\" first" );
+		Debug( LDAP_DEBUG_ANY,
+			"=> " LDAP_XSTRING(mdb_tool_entry_put) ": %s\n",
+			 text->bv_val );
+		return NOID;
+	}
+
 	if ( !mdb_tool_txn ) {
 		rc = mdb_txn_begin( mdb->mi_dbenv, NULL, 0, &mdb_tool_txn );
 		if( rc != 0 ) {
@@ -880,6 +891,18 @@ int mdb_tool_entry_reindex(
 		mi->mi_nattrs = i;
 	}
 
+	/* anything short of a full reindex from empty indices would mix
+	 * old and new keys */
+	if ( ( mi->mi_flags & MDB_NEED_REHASH ) &&
+		( adv || !( slapMode & SLAP_TRUNCATE_MODE )) )
+	{
+		Debug( LDAP_DEBUG_ANY,
+			LDAP_XSTRING(mdb_tool_entry_reindex)
+			": indices were built with another index_hash, "
+			"all of them must be rebuilt with \"slapindex -t\"\n" );
+		return -1;
+	}
+
 	e = mdb_tool_entry_get( be, id );
 
 	if( e == NULL ) {
@@ -901,6 +924,13 @@ int mdb_tool_entry_reindex(
 		}
 	}
 
+	/* a full reindex from empty indices brings them in line with index_hash */
+	if ( mi->mi_flags & MDB_NEED_REHASH ) {
+		rc = mdb_ad_hash_stamp( mi, txi );
+		if ( rc )
+			return -1;
+	}
+
 	if ( slapMode & SLAP_TRUNCATE_MODE ) {
 		int i;
 		for ( i=0; i < mi->mi_nattrs; i++ ) {
@@ -1008,6 +1038,17 @@ ID mdb_tool_entry_modify(
 
 	mdb = (struct mdb_info *) be->be_private;
 
+	/* new keys would not match the ones already in the indices */
+	if ( mdb->mi_flags & MDB_NEED_REHASH ) {
+		snprintf( text->bv_val, text->bv_len,
+			"indices were built with another index_hash, "
+			"run \"slapindex -t\" first" );
+		Debug( LDAP_DEBUG_ANY,
+			"=> " LDAP_XSTRING(mdb_tool_entry_modify) ": %s\n",
+			 text->bv_val );
+		return NOID;
+	}
+
 	if( cursor ) {
 		mdb_cursor_close( cursor );
 		cursor = NULL;
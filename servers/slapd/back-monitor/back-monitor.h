@@ -140,6 +140,8 @@ typedef struct monitor_info_t {
 	AttributeDescription	*mi_ad_monitorConnectionOpsAsync;
 	AttributeDescription	*mi_ad_monitorLogLevel;
 	AttributeDescription	*mi_ad_monitorDebugLevel;
+	AttributeDescription	*mi_ad_monitorConnectionCompression;
+	AttributeDescription	*mi_ad_monitorConnectionCompressTime;
 
 	/*
 	 * Generic description attribute
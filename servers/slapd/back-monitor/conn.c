@@ -403,6 +403,25 @@ conn_create(
 
 	attr_merge_normalize_one( e, mi->mi_ad_monitorConnectionActivityTime, &mtmbv, NULL );
 
+#ifdef HAVE_ZLIB
+	if ( c->c_is_compressed ) {
+		BerCompressStats	st = { 0 };
+
+		(void)ber_sockbuf_ctrl( c->c_sb, LBER_SB_OPT_GET_COMPRESS_STATS, &st );
+
+		bv.bv_len = snprintf( buf, sizeof( buf ),
+			"deflate rawIn=%lu wireIn=%lu rawOut=%lu wireOut=%lu ratio=%.2f",
+			st.bcs_raw_in, st.bcs_wire_in, st.bcs_raw_out, st.bcs_wire_out,
+			st.bcs_wire_in + st.bcs_wire_out ?
+				(double)( st.bcs_raw_in + st.bcs_raw_out ) /
+				( st.bcs_wire_in + st.bcs_wire_out ) : 1.0 );
+		attr_merge_normalize_one( e, mi->mi_ad_monitorConnectionCompression, &bv, NULL );
+
+		bv.bv_len = snprintf( buf, sizeof( buf ), "%lu", st.bcs_usec );
+		attr_merge_one( e, mi->mi_ad_monitorConnectionCompressTime, &bv, NULL );
+	}
+#endif /* HAVE_ZLIB */
+
 	mp = monitor_entrypriv_create();
 	if ( mp == NULL ) {
 		return LDAP_OTHER;
@@ -1956,6 +1956,21 @@ monitor_back_initialize(
 			"SYNTAX 1.3.6.1.4.1.1466.115.121.1.15 "
 			"USAGE dSAOperation )", SLAP_AT_FINAL|SLAP_AT_HIDE,
 			offsetof(monitor_info_t, mi_ad_monitorDebugLevel) },
+		{ "( 1.3.6.1.4.1.4203.666.1.55.34 "
+			"NAME 'monitorConnectionCompression' "
+			"DESC 'monitor connection compression method and byte counts' "
+			"SUP monitoredInfo "
+			"SINGLE-VALUE "
+			"NO-USER-MODIFICATION "
+			"USAGE dSAOperation )", SLAP_AT_FINAL|SLAP_AT_HIDE,
+			offsetof(monitor_info_t, mi_ad_monitorConnectionCompression) },
+		{ "( 1.3.6.1.4.1.4203.666.1.55.35 "
+			"NAME 'monitorConnectionCompressTime' "
+			"DESC 'microseconds spent compressing and decompressing on the connection' "
+			"SUP monitorCounter "
+			"NO-USER-MODIFICATION "
+			"USAGE dSAOperation )", SLAP_AT_FINAL|SLAP_AT_HIDE,
+			offsetof(monitor_info_t, mi_ad_monitorConnectionCompressTime) },
 		{ NULL, 0, -1 }
 	};
 
@@ -43,6 +43,9 @@ enum {
 	MONITOR_SENT_PDU,
 	MONITOR_SENT_ENTRIES,
 	MONITOR_SENT_REFERRALS,
+	MONITOR_SENT_DN_CACHE_HITS,
+	MONITOR_SENT_DN_CACHE_MISSES,
+	MONITOR_SENT_DN_CACHE_EVICTIONS,
 
 	MONITOR_SENT_LAST
 };
@@ -55,6 +58,9 @@ struct monitor_sent_t {
 	{ BER_BVC("cn=PDU"),		BER_BVNULL },
 	{ BER_BVC("cn=Entries"),	BER_BVNULL },
 	{ BER_BVC("cn=Referrals"),	BER_BVNULL },
+	{ BER_BVC("cn=DN Cache Hits"),	BER_BVNULL },
+	{ BER_BVC("cn=DN Cache Misses"),	BER_BVNULL },
+	{ BER_BVC("cn=DN Cache Evictions"),	BER_BVNULL },
 	{ BER_BVNULL,			BER_BVNULL }
 };
 
@@ -160,6 +166,7 @@ monitor_subsys_sent_update(
 	ldap_pvt_mp_t		n;
 	Attribute		*a;
 	slap_counters_t *sc;
+	unsigned long		hits, misses, evictions;
 	int			i;
 
 	assert( mi != NULL );
@@ -215,6 +222,21 @@ monitor_subsys_sent_update(
 		}
 		break;
 
+	case MONITOR_SENT_DN_CACHE_HITS:
+		dn_cache_stats( &hits, &misses, &evictions );
+		ldap_pvt_mp_init_set( n, hits );
+		break;
+
+	case MONITOR_SENT_DN_CACHE_MISSES:
+		dn_cache_stats( &hits, &misses, &evictions );
+		ldap_pvt_mp_init_set( n, misses );
+		break;
+
+	case MONITOR_SENT_DN_CACHE_EVICTIONS:
+		dn_cache_stats( &hits, &misses, &evictions );
+		ldap_pvt_mp_init_set( n, evictions );
+		break;
+
 	default:
 		assert(0);
 	}
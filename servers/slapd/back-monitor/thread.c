@@ -33,6 +33,7 @@ typedef enum {
 	MT_UNKNOWN,
 	MT_RUNQUEUE,
 	MT_TASKLIST,
+	MT_SLAB,
 
 	MT_LAST
 } monitor_thread_t;
@@ -86,6 +87,9 @@ static struct {
 	{ BER_BVC( "cn=Tasklist" ),
 		BER_BVC("List of running plus standby threads - besides those handling operations"),
 		BER_BVNULL,	LDAP_PVT_THREAD_POOL_PARAM_UNKNOWN,	MT_TASKLIST },
+	{ BER_BVC( "cn=Slab Memory" ),
+		BER_BVC("Per-thread operation memory: slab size, overflow and fragmentation counters"),
+		BER_BVNULL,	LDAP_PVT_THREAD_POOL_PARAM_UNKNOWN,	MT_SLAB },
 
 	{ BER_BVNULL }
 };
@@ -96,6 +100,34 @@ monitor_subsys_thread_update(
 	SlapReply		*rs,
 	Entry 			*e );
 
+struct slab_vals {
+	BerVarray	vals;
+	int		i;
+};
+
+static int
+monitor_subsys_thread_slab( slap_sl_stats_t *ss, void *arg )
+{
+	struct slab_vals	*sv = arg;
+	char			buf[ BACKMONITOR_BUFSIZE ];
+	struct berval		bv;
+
+	bv.bv_val = buf;
+	bv.bv_len = snprintf( buf, sizeof( buf ), "{%d}size=%lu tasks=%lu "
+		"overflowTasks=%lu overflowAllocs=%lu chunks=%lu chunkBytes=%lu "
+		"chunkPeak=%lu reused=%lu nonLIFOFrees=%lu fragBytes=%lu",
+		sv->i, (unsigned long)ss->ss_size, ss->ss_resets,
+		ss->ss_overflow_tasks, ss->ss_overflow, ss->ss_chunks,
+		(unsigned long)ss->ss_chunk_bytes, (unsigned long)ss->ss_chunk_peak,
+		ss->ss_reused, ss->ss_nonlifo, (unsigned long)ss->ss_frag );
+	if ( bv.bv_len < sizeof( buf ) ) {
+		value_add_one( &sv->vals, &bv );
+	}
+	sv->i++;
+
+	return 0;
+}
+
 /*
  * initializes log subentry
  */
@@ -305,6 +337,30 @@ monitor_subsys_thread_update(
 			}
 			break;
 
+		case MT_SLAB: {
+			struct slab_vals	sv = { NULL, 0 };
+
+			if ( a != NULL ) {
+				if ( a->a_nvals != a->a_vals ) {
+					ber_bvarray_free( a->a_nvals );
+				}
+				ber_bvarray_free( a->a_vals );
+				a->a_vals = NULL;
+				a->a_nvals = NULL;
+				a->a_numvals = 0;
+			}
+
+			slap_sl_mem_foreach( monitor_subsys_thread_slab, &sv );
+
+			if ( sv.vals ) {
+				attr_merge_normalize( e, mi->mi_ad_monitoredInfo, sv.vals, NULL );
+				ber_bvarray_free( sv.vals );
+
+			} else {
+				attr_delete( &e->e_attrs, mi->mi_ad_monitoredInfo );
+			}
+			} break;
+
 		default:
 			assert( 0 );
 		}
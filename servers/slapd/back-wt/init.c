@@ -71,6 +71,15 @@ wt_db_open( BackendDB *be, ConfigReply *cr )
 		   "wt_db_open: \"%s\", home=%s, config=%s\n",
 		   be->be_suffix[0].bv_val, wi->wi_home, wi->wi_config );
 
+	/* back-wt does not record which hash its index keys were built with */
+	if ( slap_index_hash( -1 ) != SLAP_INDEX_HASH_FNV ) {
+		snprintf( cr->msg, sizeof(cr->msg),
+			"database \"%s\": index_hash must be \"fnv\" with back-wt.",
+			be->be_suffix[0].bv_val );
+		Debug( LDAP_DEBUG_ANY, "wt_db_open: %s\n", cr->msg );
+		return -1;
+	}
+
 	/* Check existence of home. Any error means trouble */
 	rc = stat( wi->wi_home, &st );
 	if( rc ) {
@@ -335,6 +335,7 @@ wt_search( Operation *op, SlapReply *rs )
 	Entry *base = NULL;
 	slap_mask_t mask;
 	time_t stoptime;
+	FilterProg *fprog = NULL;
 
 	ID candidates[WT_IDL_UM_SIZE];
 	ID scopes[WT_IDL_DB_SIZE];
@@ -663,7 +664,9 @@ loop_begin:
 		}
 
 		/* if it matches the filter and scope, send it */
-		rs->sr_err = test_filter( op, e, op->oq_search.rs_filter );
+		if ( !fprog )
+			fprog = filter_compile( op->oq_search.rs_filter, op->o_tmpmemctx );
+		rs->sr_err = test_filter_prog( op, e, fprog );
 		if ( rs->sr_err == LDAP_COMPARE_TRUE ) {
 			/* check size limit */
 			if ( get_pagedresults(op) > SLAP_CONTROL_IGNORED ) {
@@ -747,6 +750,10 @@ done:
 		wt_entry_return( ae );
 	}
 
+	if( fprog ) {
+		filter_prog_free( fprog, op->o_tmpmemctx );
+	}
+
     return rs->sr_err;
 }
 
@@ -195,12 +195,16 @@ enum {
 	CFG_SYNC_SUBENTRY,
 	CFG_LTHREADS,
 	CFG_IX_HASH64,
+	CFG_IX_HASH,
 	CFG_DISABLED,
 	CFG_THREADQS,
 	CFG_TLS_ECNAME,
 	CFG_TLS_CACERT,
 	CFG_TLS_CERT,
 	CFG_TLS_KEY,
+	CFG_DN_CACHE,
+	CFG_TLS_TICKET_LIFETIME,
+	CFG_TLS_KTLS,
 
 	CFG_LAST
 };
@@ -376,6 +380,10 @@ static ConfigTable config_back_cf_table[] = {
 		&config_generic, "( OLcfgDbAt:0.21 NAME 'olcDisabled' "
 			"EQUALITY booleanMatch "
 			"SYNTAX OMsBoolean SINGLE-VALUE )", NULL, NULL },
+	{ "dn_cache_size", "entries", 2, 2, 0, ARG_UINT|ARG_MAGIC|CFG_DN_CACHE,
+		&config_generic, "( OLcfgGlAt:105 NAME 'olcDnCacheSize' "
+			"EQUALITY integerMatch "
+			"SYNTAX OMsInteger SINGLE-VALUE )", NULL, NULL },
 	{ "disallows", "features", 2, 0, 8, ARG_PRE_DB|ARG_MAGIC,
 		&config_disallows, "( OLcfgGlAt:15 NAME 'olcDisallows' "
 			"EQUALITY caseIgnoreMatch "
@@ -411,6 +419,10 @@ static ConfigTable config_back_cf_table[] = {
 	{ "include", "file", 2, 2, 0, ARG_MAGIC,
 		&config_include, "( OLcfgGlAt:19 NAME 'olcInclude' "
 			"SUP labeledURI )", NULL, NULL },
+	{ "index_hash", "fnv|wyhash", 2, 2, 0, ARG_MAGIC|CFG_IX_HASH,
+		&config_generic, "( OLcfgGlAt:106 NAME 'olcIndexHash' "
+			"EQUALITY caseIgnoreMatch "
+			"SYNTAX OMsDirectoryString SINGLE-VALUE )", NULL, NULL },
 	{ "index_hash64", "on|off", 2, 2, 0, ARG_ON_OFF|ARG_MAGIC|CFG_IX_HASH64,
 		&config_generic, "( OLcfgGlAt:94 NAME 'olcIndexHash64' "
 			"EQUALITY booleanMatch "
@@ -919,6 +931,24 @@ static ConfigTable config_back_cf_table[] = {
 		"( OLcfgGlAt:87 NAME 'olcTLSProtocolMin' "
 			"EQUALITY caseExactMatch "
 			"SYNTAX OMsDirectoryString SINGLE-VALUE )", NULL, NULL },
+	{ "TLSTicketLifetime", NULL, 2, 2, 0,
+#ifdef HAVE_TLS
+		CFG_TLS_TICKET_LIFETIME|ARG_STRING|ARG_MAGIC, &config_tls_config,
+#else
+		ARG_IGNORED, NULL,
+#endif
+		"( OLcfgGlAt:107 NAME 'olcTLSTicketLifetime' "
+			"EQUALITY integerMatch "
+			"SYNTAX OMsInteger SINGLE-VALUE )", NULL, NULL },
+	{ "TLSKTLS", NULL, 2, 2, 0,
+#ifdef HAVE_TLS
+		CFG_TLS_KTLS|ARG_STRING|ARG_MAGIC, &config_tls_config,
+#else
+		ARG_IGNORED, NULL,
+#endif
+		"( OLcfgGlAt:108 NAME 'olcTLSKTLS' "
+			"EQUALITY booleanMatch "
+			"SYNTAX OMsBoolean SINGLE-VALUE )", NULL, NULL },
 	{ "tool-threads", "count", 2, 2, 0, ARG_INT|ARG_MAGIC|CFG_TTHREADS,
 		&config_generic, "( OLcfgGlAt:80 NAME 'olcToolThreads' "
 			"EQUALITY integerMatch "
@@ -985,9 +1015,9 @@ static ConfigOCs cf_ocs[] = {
 		 "olcAttributeOptions $ olcAuthIDRewrite $ "
 		 "olcAuthzPolicy $ olcAuthzRegexp $ olcConcurrency $ "
 		 "olcConnMaxPending $ olcConnMaxPendingAuth $ "
-		 "olcDisallows $ olcGentleHUP $ olcIdleTimeout $ "
+		 "olcDisallows $ olcDnCacheSize $ olcGentleHUP $ olcIdleTimeout $ "
 		 "olcIndexSubstrIfMaxLen $ olcIndexSubstrIfMinLen $ "
-		 "olcIndexSubstrAnyLen $ olcIndexSubstrAnyStep $ olcIndexHash64 $ "
+		 "olcIndexSubstrAnyLen $ olcIndexSubstrAnyStep $ olcIndexHash64 $ olcIndexHash $ "
 		 "olcIndexIntLen $ "
 		 "olcListenerThreads $ olcLocalSSF $ olcLogFile $ olcLogFileFormat $ olcLogLevel $ "
 		 "olcLogFileOnly $ olcLogFileRotate $ olcMaxFilterDepth $ "
@@ -1006,7 +1036,8 @@ static ConfigOCs cf_ocs[] = {
 		 "olcTLSCertificateKeyFile $ olcTLSCipherSuite $ olcTLSCRLCheck $ "
 		 "olcTLSCACertificate $ olcTLSCertificate $ olcTLSCertificateKey $ "
 		 "olcTLSRandFile $ olcTLSVerifyClient $ olcTLSDHParamFile $ olcTLSECName $ "
-		 "olcTLSCRLFile $ olcTLSProtocolMin $ olcToolThreads $ olcWriteTimeout $ "
+		 "olcTLSCRLFile $ olcTLSProtocolMin $ olcTLSTicketLifetime $ olcTLSKTLS $ "
+		 "olcToolThreads $ olcWriteTimeout $ "
 		 "olcObjectIdentifier $ olcAttributeTypes $ olcObjectClasses $ "
 		 "olcDitContentRules $ olcLdapSyntaxes ) )", Cft_Global },
 	{ "( OLcfgGlOc:2 "
@@ -1410,9 +1441,21 @@ config_generic(ConfigArgs *c) {
 		case CFG_SSTR_IF_MIN:
 			c->value_uint = index_substr_if_minlen;
 			break;
+		case CFG_DN_CACHE:
+			c->value_uint = slap_dn_cache_size;
+			break;
 		case CFG_IX_HASH64:
 			c->value_int = slap_hash64( -1 );
 			break;
+		case CFG_IX_HASH:
+			if ( slap_index_hash( -1 ) != SLAP_INDEX_HASH_FNV ) {
+				struct berval bv;
+				enum_to_verb( slap_index_hashes, slap_index_hash( -1 ), &bv );
+				value_add_one( &c->rvalue_vals, &bv );
+			} else {
+				rc = 1;
+			}
+			break;
 		case CFG_IX_INTLEN:
 			c->value_int = index_intlen;
 			break;
@@ -1537,6 +1580,10 @@ config_generic(ConfigArgs *c) {
 			config_push_cleanup( c, config_substr_if_check );
 			break;
 
+		case CFG_DN_CACHE:
+			dn_cache_init( 0 );
+			break;
+
 		case CFG_ACL_ADD:
 			SLAP_DBFLAGS(c->be) &= ~SLAP_DBFLAG_ACL_ADD;
 			break;
@@ -1652,6 +1699,21 @@ config_generic(ConfigArgs *c) {
 			slap_hash64( 0 );
 			break;
 
+		case CFG_IX_HASH:
+			/* existing index keys would no longer be found */
+			if ( ( slapMode & SLAP_SERVER_RUNNING ) &&
+				slap_index_hash( -1 ) != SLAP_INDEX_HASH_FNV )
+			{
+				snprintf( c->cr_msg, sizeof( c->cr_msg ),
+					"<%s> cannot be changed while slapd is running",
+					c->argv[0] );
+				Debug( LDAP_DEBUG_ANY, "%s: %s\n", c->log, c->cr_msg );
+				rc = 1;
+				break;
+			}
+			slap_index_hash( SLAP_INDEX_HASH_FNV );
+			break;
+
 		case CFG_IX_INTLEN:
 			index_intlen = SLAP_INDEX_INTLEN_DEFAULT;
 			index_intlen_strlen = SLAP_INDEX_INTLEN_STRLEN(
@@ -2213,6 +2275,30 @@ config_generic(ConfigArgs *c) {
 				return 1;
 			break;
 
+		case CFG_IX_HASH:
+			i = verb_to_mask( c->argv[1], slap_index_hashes );
+			if ( ( slapMode & SLAP_SERVER_RUNNING ) &&
+				!BER_BVISNULL( &slap_index_hashes[i].word ) &&
+				slap_index_hashes[i].mask != slap_index_hash( -1 ) )
+			{
+				snprintf( c->cr_msg, sizeof( c->cr_msg ),
+					"<%s> cannot be changed while slapd is running",
+					c->argv[0] );
+				Debug( LDAP_DEBUG_ANY, "%s: %s \"%s\"\n",
+					c->log, c->cr_msg, c->argv[1] );
+				return 1;
+			}
+			if ( BER_BVISNULL( &slap_index_hashes[i].word ) ||
+				slap_index_hash( slap_index_hashes[i].mask ))
+			{
+				snprintf( c->cr_msg, sizeof( c->cr_msg ),
+					"<%s> unsupported hash function", c->argv[0] );
+				Debug( LDAP_DEBUG_ANY, "%s: %s \"%s\"\n",
+					c->log, c->cr_msg, c->argv[1] );
+				return 1;
+			}
+			break;
+
 		case CFG_IX_INTLEN:
 			if ( c->value_int < SLAP_INDEX_INTLEN_DEFAULT )
 				c->value_int = SLAP_INDEX_INTLEN_DEFAULT;
@@ -2495,6 +2581,10 @@ sortval_reject:
 			config_push_cleanup( c, config_substr_if_check );
 			break;
 
+		case CFG_DN_CACHE:
+			dn_cache_init( c->value_uint );
+			break;
+
 #ifdef SLAPD_MODULES
 		case CFG_MODLOAD:
 			/* If we're just adding a module on an existing modpath,
@@ -4113,6 +4203,8 @@ config_tls_config(ConfigArgs *c) {
 	case CFG_TLS_CRLCHECK:	flag = LDAP_OPT_X_TLS_CRLCHECK; break;
 	case CFG_TLS_VERIFY:	flag = LDAP_OPT_X_TLS_REQUIRE_CERT; break;
 	case CFG_TLS_PROTOCOL_MIN: flag = LDAP_OPT_X_TLS_PROTOCOL_MIN; break;
+	case CFG_TLS_TICKET_LIFETIME: flag = LDAP_OPT_X_TLS_TICKET_LIFETIME; break;
+	case CFG_TLS_KTLS:	flag = LDAP_OPT_X_TLS_KTLS; break;
 	default:
 		Debug(LDAP_DEBUG_ANY, "%s: "
 				"unknown tls_option <0x%x>\n",
@@ -154,7 +154,7 @@ do_bind(
 	 * However, we must dup with regular malloc when storing any
 	 * resulting DNs in the op or conn structures.
 	 */
-	rs->sr_err = dnPrettyNormal( NULL, &dn, &op->o_req_dn, &op->o_req_ndn,
+	rs->sr_err = dnPrettyNormalCached( &dn, &op->o_req_dn, &op->o_req_ndn,
 		op->o_tmpmemctx );
 	if ( rs->sr_err != LDAP_SUCCESS ) {
 		Debug( LDAP_DEBUG_ANY, "%s do_bind: invalid dn (%s)\n",
@@ -0,0 +1,94 @@
+/* $OpenLDAP$ */
+/* This work is part of OpenLDAP Software <http://www.openldap.org/>.
+ *
+ * Copyright 1998-2022 The OpenLDAP Foundation.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted only as authorized by the OpenLDAP
+ * Public License.
+ *
+ * A copy of this license is available in the file LICENSE in the
+ * top-level directory of the distribution or, alternatively, at
+ * <http://www.OpenLDAP.org/license.html>.
+ */
+
+#include "portable.h"
+
+#include <stdio.h>
+#include <ac/socket.h>
+#include <ac/string.h>
+
+#include "slap.h"
+#include "lber_pvt.h"
+
+const struct berval slap_EXOP_START_COMPRESS = BER_BVC(LDAP_EXOP_X_START_COMPRESS);
+
+#ifdef HAVE_ZLIB
+static const struct berval compress_deflate = BER_BVC(LDAP_COMPRESS_DEFLATE);
+
+int
+compress_extop ( Operation *op, SlapReply *rs )
+{
+	int rc;
+
+	Debug( LDAP_DEBUG_STATS, "%s STARTCOMPRESS\n",
+	    op->o_log_prefix );
+
+	/* the request value names the method, deflate is all we offer */
+	if ( op->ore_reqdata == NULL ) {
+		rs->sr_text = "no compression method requested";
+		return LDAP_PROTOCOL_ERROR;
+	}
+
+	if ( ber_bvstrcasecmp( op->ore_reqdata, &compress_deflate ) != 0 ) {
+		rs->sr_text = "unsupported compression method";
+		return LDAP_UNWILLING_TO_PERFORM;
+	}
+
+	ldap_pvt_thread_mutex_lock( &op->o_conn->c_mutex );
+
+	if ( op->o_conn->c_is_compressed != 0 ) {
+		rs->sr_text = "compression already started";
+		rc = LDAP_OPERATIONS_ERROR;
+		goto done;
+	}
+
+	/* compressing what an attacker can partly choose under encryption
+	 * leaks the rest through the ciphertext length (CRIME) */
+	if ( op->o_conn->c_sasl_ssf || op->o_conn->c_sasl_layers
+#ifdef HAVE_TLS
+		|| op->o_conn->c_is_tls
+#endif
+		)
+	{
+		rs->sr_text = "cannot start compression over a security layer";
+		rc = LDAP_UNWILLING_TO_PERFORM;
+		goto done;
+	}
+
+	/* same as StartTLS, the layer goes in between two PDUs */
+	if (( !LDAP_STAILQ_EMPTY(&op->o_conn->c_ops) &&
+			(LDAP_STAILQ_FIRST(&op->o_conn->c_ops) != op ||
+			LDAP_STAILQ_NEXT(op, o_next) != NULL)) ||
+		( !LDAP_STAILQ_EMPTY(&op->o_conn->c_pending_ops) ))
+	{
+		rs->sr_text = "cannot start compression when operations are outstanding";
+		rc = LDAP_OPERATIONS_ERROR;
+		goto done;
+	}
+
+	op->o_conn->c_is_compressed = 1;
+	op->o_conn->c_needs_compress = 1;
+
+	rc = LDAP_SUCCESS;
+
+done:
+	ldap_pvt_thread_mutex_unlock( &op->o_conn->c_mutex );
+
+	/* the response goes out uncompressed, the layer is pushed by
+	 * connection_read() before the next PDU is read, as for StartTLS */
+	return rc;
+}
+
+#endif	/* HAVE_ZLIB */
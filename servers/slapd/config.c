@@ -1295,6 +1295,8 @@ static slap_cf_aux_table bindkey[] = {
 	{ BER_BVC("tls_cipher_suite="), offsetof(slap_bindconf, sb_tls_cipher_suite), 's', 0, NULL },
 	{ BER_BVC("tls_protocol_min="), offsetof(slap_bindconf, sb_tls_protocol_min), 's', 0, NULL },
 	{ BER_BVC("tls_ecname="), offsetof(slap_bindconf, sb_tls_ecname), 's', 0, NULL },
+	{ BER_BVC("tls_ticket_lifetime="), offsetof(slap_bindconf, sb_tls_ticket_lifetime), 's', 0, NULL },
+	{ BER_BVC("tls_ktls="), offsetof(slap_bindconf, sb_tls_ktls), 's', 0, NULL },
 #ifdef HAVE_OPENSSL
 	{ BER_BVC("tls_crlcheck="), offsetof(slap_bindconf, sb_tls_crlcheck), 's', 0, NULL },
 #endif
@@ -1553,6 +1555,20 @@ slap_tls_get_config( LDAP *ld, int opt, char **val )
 		*val = ch_strdup( buf );
 		return 0;
 		}
+	case LDAP_OPT_X_TLS_TICKET_LIFETIME: {
+		char buf[16];
+		ldap_pvt_tls_get_option( ld, opt, &ival );
+		if ( ival ) {
+			snprintf( buf, sizeof( buf ), "%d", ival );
+			*val = ch_strdup( buf );
+		}
+		return 0;
+		}
+	case LDAP_OPT_X_TLS_KTLS:
+		ldap_pvt_tls_get_option( ld, opt, &ival );
+		if ( ival )
+			*val = ch_strdup( "TRUE" );
+		return 0;
 	default:
 		return -1;
 	}
@@ -1676,6 +1692,14 @@ void bindconf_free( slap_bindconf *bc ) {
 		ch_free( bc->sb_tls_ecname );
 		bc->sb_tls_ecname = NULL;
 	}
+	if ( bc->sb_tls_ticket_lifetime ) {
+		ch_free( bc->sb_tls_ticket_lifetime );
+		bc->sb_tls_ticket_lifetime = NULL;
+	}
+	if ( bc->sb_tls_ktls ) {
+		ch_free( bc->sb_tls_ktls );
+		bc->sb_tls_ktls = NULL;
+	}
 #ifdef HAVE_OPENSSL
 	if ( bc->sb_tls_crlcheck ) {
 		ch_free( bc->sb_tls_crlcheck );
@@ -1798,6 +1822,28 @@ int bindconf_tls_set( slap_bindconf *bc, LDAP *ld )
 			} else
 				newctx = 1;
 		}
+		if ( bc->sb_tls_ticket_lifetime ) {
+			rc = ldap_pvt_tls_config( ld, LDAP_OPT_X_TLS_TICKET_LIFETIME,
+				bc->sb_tls_ticket_lifetime );
+			if ( rc ) {
+				Debug( LDAP_DEBUG_ANY,
+					"bindconf_tls_set: failed to set tls_ticket_lifetime to %s\n",
+						bc->sb_tls_ticket_lifetime );
+				res = -1;
+			} else
+				newctx = 1;
+		}
+		if ( bc->sb_tls_ktls ) {
+			rc = ldap_pvt_tls_config( ld, LDAP_OPT_X_TLS_KTLS,
+				bc->sb_tls_ktls );
+			if ( rc ) {
+				Debug( LDAP_DEBUG_ANY,
+					"bindconf_tls_set: failed to set tls_ktls to %s\n",
+						bc->sb_tls_ktls );
+				res = -1;
+			} else
+				newctx = 1;
+		}
 #ifdef HAVE_OPENSSL
 		if ( bc->sb_tls_crlcheck ) {
 			rc = ldap_pvt_tls_config( ld, LDAP_OPT_X_TLS_CRLCHECK,
@@ -530,6 +530,10 @@ Connection * connection_init(
 		c->c_needs_tls_accept = 0;
 	}
 #endif
+#ifdef HAVE_ZLIB
+	c->c_is_compressed = 0;
+	c->c_needs_compress = 0;
+#endif
 
 	slap_sasl_open( c, 0 );
 	slap_sasl_external( c, ssf, authid );
@@ -1429,6 +1433,29 @@ connection_read( ber_socket_t s, conn_readinfo *cri )
 	}
 #endif
 
+#ifdef HAVE_ZLIB
+	if ( c->c_needs_compress ) {
+		c->c_needs_compress = 0;
+
+		if ( ber_sockbuf_add_io( c->c_sb, &ber_sockbuf_io_deflate,
+			LBER_SBIOD_LEVEL_COMPRESS, NULL ) < 0 )
+		{
+			Debug( LDAP_DEBUG_TRACE,
+				"connection_read(%d): compression install error "
+				"id=%lu, closing\n",
+				s, c->c_connid );
+
+			ber_sockbuf_remove_io( c->c_sb, &ber_sockbuf_io_deflate,
+				LBER_SBIOD_LEVEL_COMPRESS );
+			/* c_mutex is locked */
+			connection_closing( c, "compression layer install failure" );
+			connection_close( c );
+			connection_return( c );
+			return 0;
+		}
+	}
+#endif
+
 #define CONNECTION_INPUT_LOOP 1
 /* #define	DATA_READY_LOOP 1 */
 
@@ -776,6 +776,269 @@ dnPrettyNormal(
 	return LDAP_SUCCESS;
 }
 
+/*
+ * Cache of pretty/normalized forms of request DNs, keyed on the raw
+ * DN string as received.  It is split in shards, each with its own
+ * mutex and a fixed number of slots recycled in CLOCK order, so that
+ * lookups from different threads rarely contend and memory stays
+ * bounded.  Only successful normalizations are cached; the cache is
+ * flushed whenever attribute types change, since they drive
+ * normalization.
+ */
+#define	DN_CACHE_SHARDS	16
+
+typedef struct dn_cache_entry {
+	struct dn_cache_entry	*de_next;
+	unsigned int		de_hash;
+	int			de_ref;
+	struct berval		de_raw;
+	struct berval		de_pretty;
+	struct berval		de_normal;
+} dn_cache_entry;
+
+typedef struct dn_cache_shard {
+	ldap_pvt_thread_mutex_t	ds_mutex;
+	dn_cache_entry		**ds_buckets;
+	dn_cache_entry		**ds_slots;
+	unsigned int		ds_nbuckets;
+	unsigned int		ds_nslots;
+	unsigned int		ds_hand;
+	unsigned int		ds_count;
+	unsigned long		ds_hits;
+	unsigned long		ds_misses;
+	unsigned long		ds_evictions;
+} dn_cache_shard;
+
+unsigned int slap_dn_cache_size;
+static dn_cache_shard *dn_cache;
+
+static unsigned int
+dn_cache_hash( struct berval *bv )
+{
+	unsigned int h = 2166136261U;
+	ber_len_t i;
+
+	/* FNV-1a */
+	for ( i = 0; i < bv->bv_len; i++ ) {
+		h ^= (unsigned char)bv->bv_val[i];
+		h *= 16777619U;
+	}
+	return h;
+}
+
+static void
+dn_cache_shard_flush( dn_cache_shard *ds )
+{
+	unsigned int i;
+
+	if ( !ds->ds_count )
+		return;
+
+	for ( i = 0; i < ds->ds_nslots; i++ ) {
+		if ( ds->ds_slots[i] ) {
+			ch_free( ds->ds_slots[i] );
+			ds->ds_slots[i] = NULL;
+		}
+	}
+	memset( ds->ds_buckets, 0, ds->ds_nbuckets * sizeof(dn_cache_entry *) );
+	ds->ds_hand = 0;
+	ds->ds_count = 0;
+}
+
+void
+dn_cache_destroy( void )
+{
+	int i;
+
+	if ( !dn_cache )
+		return;
+
+	for ( i = 0; i < DN_CACHE_SHARDS; i++ ) {
+		dn_cache_shard_flush( &dn_cache[i] );
+		ch_free( dn_cache[i].ds_buckets );
+		ch_free( dn_cache[i].ds_slots );
+		ldap_pvt_thread_mutex_destroy( &dn_cache[i].ds_mutex );
+	}
+	ch_free( dn_cache );
+	dn_cache = NULL;
+}
+
+/* Must only be called while no operations are running */
+int
+dn_cache_init( unsigned int size )
+{
+	unsigned int nslots, nbuckets;
+	int i;
+
+	dn_cache_destroy();
+	slap_dn_cache_size = size;
+	if ( !size )
+		return 0;
+
+	nslots = ( size + DN_CACHE_SHARDS - 1 ) / DN_CACHE_SHARDS;
+	for ( nbuckets = 1; nbuckets < nslots; nbuckets <<= 1 )
+		;
+
+	dn_cache = ch_calloc( DN_CACHE_SHARDS, sizeof(dn_cache_shard) );
+	for ( i = 0; i < DN_CACHE_SHARDS; i++ ) {
+		dn_cache_shard *ds = &dn_cache[i];
+
+		ldap_pvt_thread_mutex_init( &ds->ds_mutex );
+		ds->ds_nslots = nslots;
+		ds->ds_nbuckets = nbuckets;
+		ds->ds_slots = ch_calloc( nslots, sizeof(dn_cache_entry *) );
+		ds->ds_buckets = ch_calloc( nbuckets, sizeof(dn_cache_entry *) );
+	}
+	return 0;
+}
+
+void
+dn_cache_flush( void )
+{
+	int i;
+
+	if ( !dn_cache )
+		return;
+
+	for ( i = 0; i < DN_CACHE_SHARDS; i++ ) {
+		ldap_pvt_thread_mutex_lock( &dn_cache[i].ds_mutex );
+		dn_cache_shard_flush( &dn_cache[i] );
+		ldap_pvt_thread_mutex_unlock( &dn_cache[i].ds_mutex );
+	}
+}
+
+void
+dn_cache_stats( unsigned long *hits, unsigned long *misses,
+	unsigned long *evictions )
+{
+	int i;
+
+	*hits = *misses = *evictions = 0;
+	if ( !dn_cache )
+		return;
+
+	for ( i = 0; i < DN_CACHE_SHARDS; i++ ) {
+		ldap_pvt_thread_mutex_lock( &dn_cache[i].ds_mutex );
+		*hits += dn_cache[i].ds_hits;
+		*misses += dn_cache[i].ds_misses;
+		*evictions += dn_cache[i].ds_evictions;
+		ldap_pvt_thread_mutex_unlock( &dn_cache[i].ds_mutex );
+	}
+}
+
+static void
+dn_cache_insert( dn_cache_shard *ds, unsigned int h, struct berval *raw,
+	struct berval *pretty, struct berval *normal )
+{
+	dn_cache_entry *de, **prev;
+	unsigned int slot;
+	char *ptr;
+
+	de = ch_malloc( sizeof(dn_cache_entry) + raw->bv_len +
+		pretty->bv_len + normal->bv_len + 3 );
+	de->de_hash = h;
+	de->de_ref = 0;
+	ptr = (char *)(de + 1);
+	de->de_raw.bv_val = ptr;
+	de->de_raw.bv_len = raw->bv_len;
+	ptr = lutil_strbvcopy( ptr, raw );
+	*ptr++ = '\0';
+	de->de_pretty.bv_val = ptr;
+	de->de_pretty.bv_len = pretty->bv_len;
+	ptr = lutil_strbvcopy( ptr, pretty );
+	*ptr++ = '\0';
+	de->de_normal.bv_val = ptr;
+	de->de_normal.bv_len = normal->bv_len;
+	ptr = lutil_strbvcopy( ptr, normal );
+	*ptr = '\0';
+
+	ldap_pvt_thread_mutex_lock( &ds->ds_mutex );
+
+	/* Someone else may have raced us to it */
+	for ( prev = &ds->ds_buckets[ h & (ds->ds_nbuckets-1) ]; *prev;
+			prev = &(*prev)->de_next ) {
+		if ( (*prev)->de_hash == h && ber_bvcmp( &(*prev)->de_raw, raw ) == 0 ) {
+			ldap_pvt_thread_mutex_unlock( &ds->ds_mutex );
+			ch_free( de );
+			return;
+		}
+	}
+
+	/* CLOCK: skip recently used entries, clearing their mark */
+	for ( ;; ) {
+		slot = ds->ds_hand;
+		ds->ds_hand = ( ds->ds_hand + 1 ) % ds->ds_nslots;
+		if ( !ds->ds_slots[slot] || !ds->ds_slots[slot]->de_ref )
+			break;
+		ds->ds_slots[slot]->de_ref = 0;
+	}
+
+	if ( ds->ds_slots[slot] ) {
+		dn_cache_entry *old = ds->ds_slots[slot];
+
+		for ( prev = &ds->ds_buckets[ old->de_hash & (ds->ds_nbuckets-1) ];
+				*prev != old; prev = &(*prev)->de_next )
+			;
+		*prev = old->de_next;
+		ch_free( old );
+		ds->ds_evictions++;
+	} else {
+		ds->ds_count++;
+	}
+
+	ds->ds_slots[slot] = de;
+	prev = &ds->ds_buckets[ h & (ds->ds_nbuckets-1) ];
+	de->de_next = *prev;
+	*prev = de;
+
+	ldap_pvt_thread_mutex_unlock( &ds->ds_mutex );
+}
+
+/*
+ * Same as dnPrettyNormal( NULL, ... ), looking the DN up in the
+ * DN cache first.  Intended for DNs taken from requests.
+ */
+int
+dnPrettyNormalCached(
+	struct berval *val,
+	struct berval *pretty,
+	struct berval *normal,
+	void *ctx )
+{
+	dn_cache_shard *ds;
+	dn_cache_entry *de;
+	unsigned int h;
+	int rc;
+
+	if ( !dn_cache || BER_BVISEMPTY( val ) || val->bv_len > SLAP_LDAPDN_MAXLEN )
+		return dnPrettyNormal( NULL, val, pretty, normal, ctx );
+
+	h = dn_cache_hash( val );
+	ds = &dn_cache[ h % DN_CACHE_SHARDS ];
+
+	ldap_pvt_thread_mutex_lock( &ds->ds_mutex );
+	for ( de = ds->ds_buckets[ h & (ds->ds_nbuckets-1) ]; de; de = de->de_next ) {
+		if ( de->de_hash == h && ber_bvcmp( &de->de_raw, val ) == 0 )
+			break;
+	}
+	if ( de ) {
+		de->de_ref = 1;
+		ds->ds_hits++;
+		ber_dupbv_x( pretty, &de->de_pretty, ctx );
+		ber_dupbv_x( normal, &de->de_normal, ctx );
+		ldap_pvt_thread_mutex_unlock( &ds->ds_mutex );
+		return LDAP_SUCCESS;
+	}
+	ds->ds_misses++;
+	ldap_pvt_thread_mutex_unlock( &ds->ds_mutex );
+
+	rc = dnPrettyNormal( NULL, val, pretty, normal, ctx );
+	if ( rc == LDAP_SUCCESS )
+		dn_cache_insert( ds, h, val, pretty, normal );
+
+	return rc;
+}
+
 /*
  * dnMatch routine
  */
@@ -39,9 +39,12 @@
 
 static int	test_filter_and( Operation *op, Entry *e, Filter *flist );
 static int	test_filter_or( Operation *op, Entry *e, Filter *flist );
-static int	test_substrings_filter( Operation *op, Entry *e, Filter *f);
+static int	test_substrings_filter( Operation *op, Entry *e, Filter *f,
+	MatchingRule *smr );
 static int	test_ava_filter( Operation *op,
 	Entry *e, AttributeAssertion *ava, int type );
+static int	test_ava_values( Operation *op,
+	Entry *e, AttributeAssertion *ava, int type, MatchingRule *amr, int ause );
 static int	test_mra_filter( Operation *op,
 	Entry *e, MatchingRuleAssertion *mra );
 static int	test_presence_filter( Operation *op,
@@ -90,7 +93,7 @@ test_filter(
 
 	case LDAP_FILTER_SUBSTRINGS:
 		Debug( LDAP_DEBUG_FILTER, "    SUBSTRINGS\n" );
-		rc = test_substrings_filter( op, e, f );
+		rc = test_substrings_filter( op, e, f, NULL );
 		break;
 
 	case LDAP_FILTER_GE:
@@ -531,11 +534,6 @@ test_ava_filter(
 	int		type )
 {
 	int rc;
-	Attribute	*a;
-#ifdef LDAP_COMP_MATCH
-	int i, num_attr_vals = 0;
-	AttributeAliasing *a_alias = NULL;
-#endif
 
 	if ( !access_allowed( op, e,
 		ava->aa_desc, &ava->aa_value, ACL_SEARCH, NULL ) )
@@ -599,6 +597,60 @@ test_ava_filter(
 		return LDAP_COMPARE_FALSE;
 	}
 
+	return test_ava_values( op, e, ava, type, NULL, 0 );
+}
+
+/* Select the matching rule an assertion of the given type uses
+ * for values of the given attribute type.
+ */
+static MatchingRule *
+ava_mr(
+	AttributeType	*at,
+	int		type,
+	int		*use )
+{
+	*use = SLAP_MR_EQUALITY;
+
+	switch ( type ) {
+	case LDAP_FILTER_APPROX:
+		*use = SLAP_MR_EQUALITY_APPROX;
+		if( at->sat_approx != NULL ) return at->sat_approx;
+
+		/* fallthru: use EQUALITY matching rule if no APPROX rule */
+
+	case LDAP_FILTER_EQUALITY:
+		/* use variable set above so fall thru use is not clobbered */
+		return at->sat_equality;
+
+	case LDAP_FILTER_GE:
+	case LDAP_FILTER_LE:
+		*use = SLAP_MR_ORDERING;
+		return at->sat_ordering;
+	}
+
+	return NULL;
+}
+
+/* Test the values of an entry against an assertion. If amr is set,
+ * it and ause are the rule and usage already selected for the
+ * assertion's own attribute type.
+ */
+static int
+test_ava_values(
+	Operation	*op,
+	Entry		*e,
+	AttributeAssertion *ava,
+	int		type,
+	MatchingRule	*amr,
+	int		ause )
+{
+	int rc;
+	Attribute	*a;
+#ifdef LDAP_COMP_MATCH
+	int i, num_attr_vals = 0;
+	AttributeAliasing *a_alias = NULL;
+#endif
+
 	rc = LDAP_COMPARE_FALSE;
 
 #ifdef LDAP_COMP_MATCH
@@ -627,29 +679,11 @@ test_ava_filter(
 			continue;
 		}
 
-		use = SLAP_MR_EQUALITY;
-
-		switch ( type ) {
-		case LDAP_FILTER_APPROX:
-			use = SLAP_MR_EQUALITY_APPROX;
-			mr = a->a_desc->ad_type->sat_approx;
-			if( mr != NULL ) break;
-
-			/* fallthru: use EQUALITY matching rule if no APPROX rule */
-
-		case LDAP_FILTER_EQUALITY:
-			/* use variable set above so fall thru use is not clobbered */
-			mr = a->a_desc->ad_type->sat_equality;
-			break;
-
-		case LDAP_FILTER_GE:
-		case LDAP_FILTER_LE:
-			use = SLAP_MR_ORDERING;
-			mr = a->a_desc->ad_type->sat_ordering;
-			break;
-
-		default:
-			mr = NULL;
+		if ( amr && a->a_desc->ad_type == ava->aa_desc->ad_type ) {
+			mr = amr;
+			use = ause;
+		} else {
+			mr = ava_mr( a->a_desc->ad_type, type, &use );
 		}
 
 		if( mr == NULL ) {
@@ -930,7 +964,8 @@ static int
 test_substrings_filter(
 	Operation	*op,
 	Entry	*e,
-	Filter	*f )
+	Filter	*f,
+	MatchingRule *smr )
 {
 	Attribute	*a;
 	int rc;
@@ -959,7 +994,11 @@ test_substrings_filter(
 			continue;
 		}
 
-		mr = a->a_desc->ad_type->sat_substr;
+		if ( smr && a->a_desc->ad_type == f->f_sub_desc->ad_type ) {
+			mr = smr;
+		} else {
+			mr = a->a_desc->ad_type->sat_substr;
+		}
 		if( mr == NULL ) {
 			rc = LDAP_INAPPROPRIATE_MATCHING;
 			continue;
@@ -984,3 +1023,290 @@ test_substrings_filter(
 		rc );
 	return rc;
 }
+
+/*
+ * Compiled filters
+ *
+ * filter_compile() flattens a filter into an array of instructions in
+ * prefix order. Each instruction records the index just past its own
+ * subtree, so AND/OR/NOT step through their children in the array and
+ * short-circuit by returning early. Matching rules are bound, special
+ * attributes resolved and constant subfilters folded once, when the
+ * filter is compiled, instead of for every candidate entry.
+ */
+
+enum {
+	FI_CONST = 0,	/* fi_result */
+	FI_AND,
+	FI_OR,
+	FI_NOT,
+	FI_PRESENT,
+	FI_AVA,			/* value assertion with bound rule */
+	FI_AVA_SPECIAL,	/* hasSubordinates, entryDN, component match */
+	FI_SUBSTRINGS,
+	FI_EXT
+};
+
+typedef struct FilterInsn {
+	int		fi_op;
+	int		fi_end;		/* index past this subtree */
+	int		fi_type;	/* LDAP_FILTER_* for value assertions */
+	int		fi_use;		/* SLAP_MR_* usage of fi_mr */
+	ber_int_t	fi_result;
+	MatchingRule	*fi_mr;
+	Filter		*fi_f;
+} FilterInsn;
+
+struct FilterProg {
+	int		fp_ninsns;
+	FilterInsn	fp_insns[1];
+};
+
+static int
+filter_prog_count( Filter *f )
+{
+	int n = 1;
+
+	if ( f->f_choice & SLAPD_FILTER_UNDEFINED )
+		return n;
+
+	switch ( f->f_choice ) {
+	case LDAP_FILTER_AND:
+	case LDAP_FILTER_OR:
+	case LDAP_FILTER_NOT:
+		for ( f = f->f_list; f; f = f->f_next )
+			n += filter_prog_count( f );
+		break;
+	}
+	return n;
+}
+
+/* Compile f at fp_insns[i], return the index past it */
+static int
+filter_prog_fill( FilterProg *fp, Filter *f, int i )
+{
+	FilterInsn *fi = &fp->fp_insns[i];
+	AttributeDescription *ad;
+	Filter *fc;
+	int j, k;
+
+	fi->fi_f = f;
+	fi->fi_mr = NULL;
+	fi->fi_end = i + 1;
+
+	if ( f->f_choice & SLAPD_FILTER_UNDEFINED ) {
+		fi->fi_op = FI_CONST;
+		fi->fi_result = SLAPD_COMPARE_UNDEFINED;
+		return fi->fi_end;
+	}
+
+	switch ( f->f_choice ) {
+	case SLAPD_FILTER_COMPUTED:
+		fi->fi_op = FI_CONST;
+		fi->fi_result = f->f_result;
+		break;
+
+	case LDAP_FILTER_AND:
+	case LDAP_FILTER_OR: {
+		/* a child with this result decides the outcome, one with
+		 * the opposite result can be dropped */
+		ber_int_t decide = f->f_choice == LDAP_FILTER_AND ?
+			LDAP_COMPARE_FALSE : LDAP_COMPARE_TRUE;
+
+		fi->fi_op = f->f_choice == LDAP_FILTER_AND ? FI_AND : FI_OR;
+		j = i + 1;
+		for ( fc = f->f_list; fc; fc = fc->f_next ) {
+			k = filter_prog_fill( fp, fc, j );
+			if ( fp->fp_insns[j].fi_op == FI_CONST ) {
+				if ( fp->fp_insns[j].fi_result == decide ) {
+					fi->fi_op = FI_CONST;
+					fi->fi_result = decide;
+					fi->fi_end = i + 1;
+					return fi->fi_end;
+				}
+				if ( fp->fp_insns[j].fi_result ==
+					( decide == LDAP_COMPARE_TRUE ?
+						LDAP_COMPARE_FALSE : LDAP_COMPARE_TRUE ))
+				{
+					continue;
+				}
+			}
+			j = k;
+		}
+		if ( j == i + 1 ) {
+			/* empty, or nothing but neutral children */
+			fi->fi_op = FI_CONST;
+			fi->fi_result = decide == LDAP_COMPARE_FALSE ?
+				LDAP_COMPARE_TRUE : LDAP_COMPARE_FALSE;
+		}
+		fi->fi_end = j;
+		} break;
+
+	case LDAP_FILTER_NOT:
+		fi->fi_op = FI_NOT;
+		fi->fi_end = filter_prog_fill( fp, f->f_not, i + 1 );
+		if ( fp->fp_insns[i + 1].fi_op == FI_CONST ) {
+			fi->fi_op = FI_CONST;
+			switch ( fp->fp_insns[i + 1].fi_result ) {
+			case LDAP_COMPARE_TRUE:
+				fi->fi_result = LDAP_COMPARE_FALSE;
+				break;
+			case LDAP_COMPARE_FALSE:
+				fi->fi_result = LDAP_COMPARE_TRUE;
+				break;
+			default:
+				fi->fi_result = fp->fp_insns[i + 1].fi_result;
+			}
+			fi->fi_end = i + 1;
+		}
+		break;
+
+	case LDAP_FILTER_PRESENT:
+		fi->fi_op = FI_PRESENT;
+		break;
+
+	case LDAP_FILTER_EQUALITY:
+	case LDAP_FILTER_APPROX:
+	case LDAP_FILTER_GE:
+	case LDAP_FILTER_LE:
+		fi->fi_type = f->f_choice;
+		ad = f->f_av_desc;
+		if ( ad == slap_schema.si_ad_hasSubordinates ||
+			ad == slap_schema.si_ad_entryDN
+#ifdef LDAP_COMP_MATCH
+			|| f->f_ava->aa_cf
+#endif
+			)
+		{
+			fi->fi_op = FI_AVA_SPECIAL;
+		} else {
+			fi->fi_op = FI_AVA;
+			fi->fi_mr = ava_mr( ad->ad_type, fi->fi_type, &fi->fi_use );
+		}
+		break;
+
+	case LDAP_FILTER_SUBSTRINGS:
+		fi->fi_op = FI_SUBSTRINGS;
+		fi->fi_mr = f->f_sub_desc->ad_type->sat_substr;
+		break;
+
+	case LDAP_FILTER_EXT:
+		fi->fi_op = FI_EXT;
+		break;
+
+	default:
+		fi->fi_op = FI_CONST;
+		fi->fi_result = LDAP_PROTOCOL_ERROR;
+	}
+
+	return fi->fi_end;
+}
+
+/*
+ * filter_compile - compile a filter for repeated evaluation with
+ * test_filter_prog(). The filter must not be changed or freed while
+ * the program is in use.
+ */
+FilterProg *
+filter_compile( Filter *f, void *memctx )
+{
+	FilterProg *fp;
+	int n;
+
+	n = filter_prog_count( f );
+	fp = slap_sl_malloc( sizeof( FilterProg ) +
+		( n - 1 ) * sizeof( FilterInsn ), memctx );
+	fp->fp_ninsns = filter_prog_fill( fp, f, 0 );
+
+	return fp;
+}
+
+void
+filter_prog_free( FilterProg *fp, void *memctx )
+{
+	slap_sl_free( fp, memctx );
+}
+
+static int
+test_filter_insn( Operation *op, Entry *e, FilterInsn *insns, int i )
+{
+	FilterInsn *fi = &insns[i];
+	Filter *f = fi->fi_f;
+	int rc, rtn, j;
+
+	switch ( fi->fi_op ) {
+	case FI_CONST:
+		return fi->fi_result;
+
+	case FI_AND:
+		rtn = LDAP_COMPARE_TRUE;
+		for ( j = i + 1; j < fi->fi_end; j = insns[j].fi_end ) {
+			rc = test_filter_insn( op, e, insns, j );
+			if ( rc == LDAP_COMPARE_FALSE )
+				return rc;
+			if ( rc != LDAP_COMPARE_TRUE )
+				rtn = rc;
+		}
+		return rtn;
+
+	case FI_OR:
+		rtn = LDAP_COMPARE_FALSE;
+		for ( j = i + 1; j < fi->fi_end; j = insns[j].fi_end ) {
+			rc = test_filter_insn( op, e, insns, j );
+			if ( rc == LDAP_COMPARE_TRUE )
+				return rc;
+			if ( rc != LDAP_COMPARE_FALSE )
+				rtn = rc;
+		}
+		return rtn;
+
+	case FI_NOT:
+		rc = test_filter_insn( op, e, insns, i + 1 );
+		if ( rc == LDAP_COMPARE_TRUE )
+			return LDAP_COMPARE_FALSE;
+		if ( rc == LDAP_COMPARE_FALSE )
+			return LDAP_COMPARE_TRUE;
+		return rc;
+
+	case FI_PRESENT:
+		return test_presence_filter( op, e, f->f_desc );
+
+	case FI_AVA:
+		if ( !access_allowed( op, e,
+			f->f_av_desc, &f->f_av_value, ACL_SEARCH, NULL ) )
+		{
+			return LDAP_INSUFFICIENT_ACCESS;
+		}
+		return test_ava_values( op, e, f->f_ava, fi->fi_type,
+			fi->fi_mr, fi->fi_use );
+
+	case FI_AVA_SPECIAL:
+		return test_ava_filter( op, e, f->f_ava, fi->fi_type );
+
+	case FI_SUBSTRINGS:
+		return test_substrings_filter( op, e, f, fi->fi_mr );
+
+	case FI_EXT:
+		return test_mra_filter( op, e, f->f_mra );
+	}
+
+	return LDAP_PROTOCOL_ERROR;
+}
+
+/*
+ * test_filter_prog - test a compiled filter against a single entry.
+ * Returns the same results as test_filter() on the source filter.
+ */
+int
+test_filter_prog(
+	Operation	*op,
+	Entry	*e,
+	FilterProg	*fp )
+{
+	int	rc;
+
+	rc = test_filter_insn( op, e, fp->fp_insns, 0 );
+	Debug( LDAP_DEBUG_FILTER, "<= test_filter_prog %d\n", rc );
+
+	return rc;
+}
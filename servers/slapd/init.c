@@ -263,6 +263,7 @@ int slap_destroy(void)
 	 * because it may use entry_free() */
 	root_dse_destroy();
 	entry_destroy();
+	dn_cache_destroy();
 
 	switch ( slapMode & SLAP_MODE ) {
 	case SLAP_SERVER_MODE:
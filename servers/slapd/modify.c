@@ -93,7 +93,7 @@ do_modify(
 		goto cleanup;
 	}
 
-	rs->sr_err = dnPrettyNormal( NULL, &dn, &op->o_req_dn, &op->o_req_ndn,
+	rs->sr_err = dnPrettyNormalCached( &dn, &op->o_req_dn, &op->o_req_ndn,
 		op->o_tmpmemctx );
 	if( rs->sr_err != LDAP_SUCCESS ) {
 		Debug( LDAP_DEBUG_ANY, "%s do_modify: invalid dn (%s)\n",
@@ -79,6 +79,8 @@ typedef struct log_info {
 	log_attr *li_oldattrs;
 	struct berval li_uuid;
 	int li_success;
+	int li_lazycommit;
+	int li_binmods;
 	log_base *li_bases;
 	BerVarray li_mincsn;
 	int *li_sids, li_numcsns;
@@ -106,7 +108,9 @@ enum {
 	LOG_SUCCESS,
 	LOG_OLD,
 	LOG_OLDATTR,
-	LOG_BASE
+	LOG_BASE,
+	LOG_LAZYCOMMIT,
+	LOG_BINMODS
 };
 
 static ConfigTable log_cfats[] = {
@@ -147,6 +151,16 @@ static ConfigTable log_cfats[] = {
 			"DESC 'Operation types to log under a specific branch' "
 			"EQUALITY caseIgnoreMatch "
 			"SYNTAX OMsDirectoryString )", NULL, NULL },
+	{ "loglazycommit", NULL, 2, 2, 0, ARG_MAGIC|ARG_ON_OFF|LOG_LAZYCOMMIT,
+		log_cf_gen, "( OLcfgOvAt:4.8 NAME 'olcAccessLogLazyCommit' "
+			"DESC 'Skip the meta page sync when committing log writes' "
+			"EQUALITY booleanMatch "
+			"SYNTAX OMsBoolean SINGLE-VALUE )", NULL, NULL },
+	{ "logbinarymods", NULL, 2, 2, 0, ARG_MAGIC|ARG_ON_OFF|LOG_BINMODS,
+		log_cf_gen, "( OLcfgOvAt:4.9 NAME 'olcAccessLogBinaryMods' "
+			"DESC 'Also log modifications in binary form' "
+			"EQUALITY booleanMatch "
+			"SYNTAX OMsBoolean SINGLE-VALUE )", NULL, NULL },
 	{ NULL }
 };
 
@@ -157,7 +171,8 @@ static ConfigOCs log_cfocs[] = {
 		"SUP olcOverlayConfig "
 		"MUST olcAccessLogDB "
 		"MAY ( olcAccessLogOps $ olcAccessLogPurge $ olcAccessLogSuccess $ "
-			"olcAccessLogOld $ olcAccessLogOldAttr $ olcAccessLogBase ) )",
+			"olcAccessLogOld $ olcAccessLogOldAttr $ olcAccessLogBase $ "
+			"olcAccessLogLazyCommit $ olcAccessLogBinaryMods ) )",
 			Cft_Overlay, log_cfats },
 	{ NULL }
 };
@@ -216,7 +231,7 @@ static AttributeDescription *ad_reqDN, *ad_reqStart, *ad_reqEnd, *ad_reqType,
 	*ad_reqSizeLimit, *ad_reqTimeLimit, *ad_reqAttrsOnly, *ad_reqData,
 	*ad_reqId, *ad_reqMessage, *ad_reqVersion, *ad_reqDerefAliases,
 	*ad_reqReferral, *ad_reqOld, *ad_auditContext, *ad_reqEntryUUID,
-	*ad_minCSN, *ad_reqNewDN;
+	*ad_minCSN, *ad_reqNewDN, *ad_reqModBinary;
 
 static int
 logSchemaControlValidate(
@@ -449,6 +464,11 @@ static struct {
 		"EQUALITY distinguishedNameMatch "
 		"SYNTAX OMsDN "
 		"SINGLE-VALUE )", &ad_reqNewDN },
+	{ "( " LOG_SCHEMA_AT ".34 NAME 'reqModBinary' "
+		"DESC 'Modifications of request, BER encoded' "
+		"EQUALITY octetStringMatch "
+		"SYNTAX OMsOctetString "
+		"SINGLE-VALUE )", &ad_reqModBinary },
 	{ NULL, NULL }
 };
 
@@ -480,7 +500,8 @@ static struct {
 	{ "( " LOG_SCHEMA_OC ".5 NAME 'auditAdd' "
 		"DESC 'Add operation' "
 		"SUP auditWriteObject STRUCTURAL "
-		"MUST reqMod )", &log_ocs[LOG_EN_ADD] },
+		"MUST reqMod "
+		"MAY reqModBinary )", &log_ocs[LOG_EN_ADD] },
 	{ "( " LOG_SCHEMA_OC ".6 NAME 'auditBind' "
 		"DESC 'Bind operation' "
 		"SUP auditObject STRUCTURAL "
@@ -496,12 +517,13 @@ static struct {
 	{ "( " LOG_SCHEMA_OC ".9 NAME 'auditModify' "
 		"DESC 'Modify operation' "
 		"SUP auditWriteObject STRUCTURAL "
-		"MAY ( reqOld $ reqMod ) )", &log_ocs[LOG_EN_MODIFY] },
+		"MAY ( reqOld $ reqMod $ reqModBinary ) )", &log_ocs[LOG_EN_MODIFY] },
 	{ "( " LOG_SCHEMA_OC ".10 NAME 'auditModRDN' "
 		"DESC 'ModRDN operation' "
 		"SUP auditWriteObject STRUCTURAL "
 		"MUST ( reqNewRDN $ reqDeleteOldRDN ) "
-		"MAY ( reqNewSuperior $ reqMod $ reqOld $ reqNewDN ) )",
+		"MAY ( reqNewSuperior $ reqMod $ reqOld $ reqNewDN $ "
+			"reqModBinary ) )",
 		&log_ocs[LOG_EN_MODRDN] },
 	{ "( " LOG_SCHEMA_OC ".11 NAME 'auditSearch' "
 		"DESC 'Search operation' "
@@ -624,6 +646,7 @@ log_age_unparse( int age, struct berval *agebv, size_t size )
 static slap_callback nullsc;
 
 #define PURGE_INCREMENT	100
+#define PURGE_BATCH	1000	/* deletes per transaction */
 
 typedef struct purge_data {
 	struct log_info *li;
@@ -741,7 +764,8 @@ accesslog_purge( void *ctx, void *arg )
 	op->o_tmpfree( op->ors_filterstr.bv_val, op->o_tmpmemctx );
 
 	if ( pd.used ) {
-		int i;
+		OpExtra *txn = NULL;
+		int i, batch, ntxn = 0;
 
 		op->o_callback = &nullsc;
 		op->o_dont_replicate = 1;
@@ -775,17 +799,53 @@ accesslog_purge( void *ctx, void *arg )
 			ldap_pvt_thread_mutex_unlock( &li->li_log_mutex );
 		}
 
-		/* delete the expired entries */
+		/* delete the expired entries, PURGE_BATCH of them per
+		 * transaction if the log database can do that */
 		op->o_tag = LDAP_REQ_DELETE;
+		batch = SLAP_TXNS( li->li_db ) ? PURGE_BATCH : 0;
 		for (i=0; i<pd.used; i++) {
 			op->o_req_dn = pd.dn[i];
 			op->o_req_ndn = pd.ndn[i];
 			if ( !slapd_shutdown ) {
+				if ( batch && !txn ) {
+					if ( op->o_bd->bd_info->bi_op_txn( op, SLAP_TXN_BEGIN, &txn )) {
+						txn = NULL;
+						batch = 0;
+					}
+					ntxn = 0;
+				} else if ( txn ) {
+					LDAP_SLIST_INSERT_HEAD( &op->o_extra, txn, oe_next );
+				}
 				rs_reinit( &rs, REP_RESULT );
 				op->o_bd->be_delete( op, &rs );
+				if ( txn ) {
+					LDAP_SLIST_REMOVE( &op->o_extra, txn, OpExtra, oe_next );
+					if ( rs.sr_err != LDAP_SUCCESS ) {
+						/* the rest goes one at a time, this batch
+						 * is left for the next purge */
+						Debug( LDAP_DEBUG_ANY, "accesslog_purge: "
+							"delete of %s failed (%d), aborting batch\n",
+							op->o_req_dn.bv_val, rs.sr_err );
+						op->o_bd->bd_info->bi_op_txn( op, SLAP_TXN_ABORT, &txn );
+						txn = NULL;
+						batch = 0;
+					} else {
+						ntxn++;
+					}
+				}
 			}
 			ch_free( pd.ndn[i].bv_val );
 			ch_free( pd.dn[i].bv_val );
+			if ( txn && ( ntxn >= batch || i == pd.used - 1 || slapd_shutdown ||
+				ldap_pvt_thread_pool_pausing( &connection_pool )))
+			{
+				/* don't sit on the write lock during a pause */
+				if ( op->o_bd->bd_info->bi_op_txn( op, SLAP_TXN_COMMIT, &txn )) {
+					Debug( LDAP_DEBUG_ANY, "accesslog_purge: "
+						"commit of %d deletes failed\n", ntxn );
+				}
+				txn = NULL;
+			}
 			ldap_pvt_thread_pool_pausewait( &connection_pool );
 		}
 		ch_free( pd.ndn );
@@ -851,6 +911,18 @@ log_cf_gen(ConfigArgs *c)
 			else
 				rc = 1;
 			break;
+		case LOG_LAZYCOMMIT:
+			if ( li->li_lazycommit )
+				c->value_int = li->li_lazycommit;
+			else
+				rc = 1;
+			break;
+		case LOG_BINMODS:
+			if ( li->li_binmods )
+				c->value_int = li->li_binmods;
+			else
+				rc = 1;
+			break;
 		case LOG_OLD:
 			if ( li->li_oldf ) {
 				filter2bv( li->li_oldf, &agebv );
@@ -911,6 +983,12 @@ log_cf_gen(ConfigArgs *c)
 		case LOG_SUCCESS:
 			li->li_success = 0;
 			break;
+		case LOG_LAZYCOMMIT:
+			li->li_lazycommit = 0;
+			break;
+		case LOG_BINMODS:
+			li->li_binmods = 0;
+			break;
 		case LOG_OLD:
 			if ( li->li_oldf ) {
 				filter_free( li->li_oldf );
@@ -1030,6 +1108,12 @@ log_cf_gen(ConfigArgs *c)
 		case LOG_SUCCESS:
 			li->li_success = c->value_int;
 			break;
+		case LOG_LAZYCOMMIT:
+			li->li_lazycommit = c->value_int;
+			break;
+		case LOG_BINMODS:
+			li->li_binmods = c->value_int;
+			break;
 		case LOG_OLD:
 			li->li_oldf = str2filter( c->argv[1] );
 			if ( !li->li_oldf ) {
@@ -1538,6 +1622,73 @@ static void accesslog_val2val(AttributeDescription *ad, struct berval *val,
 	dst->bv_val[dst->bv_len] = '\0';
 }
 
+/* Encode the changes of an Add, Modify or ModRDN as the modification
+ * list of an LDAP ModifyRequest, so a consumer can decode them with
+ * ber_scanf instead of parsing every reqMod value. This comes on top
+ * of reqMod, not instead of it: auditAdd requires reqMod and delta-MPR
+ * conflict resolution reads it back from the local log.
+ */
+static void
+accesslog_mods2bin( Operation *op, int logop, Entry *e )
+{
+	BerElementBuffer berbuf;
+	BerElement *ber = (BerElement *)&berbuf;
+	struct berval bv;
+	int rc;
+
+	ber_init_w_nullc( ber, LBER_USE_DER );
+	rc = ber_printf( ber, "{" );
+
+	if ( logop == LOG_EN_ADD ) {
+		Attribute *a;
+
+		for ( a = op->ora_e->e_attrs; a && rc != -1; a = a->a_next ) {
+			rc = ber_printf( ber, "{e{O[W]N}N}", LDAP_MOD_ADD,
+				&a->a_desc->ad_cname, a->a_vals );
+		}
+	} else {
+		Modifications *m;
+
+		for ( m = op->orm_modlist; m && rc != -1; m = m->sml_next ) {
+			ber_int_t mop;
+
+			/* same selection as reqMod */
+			if ( logop == LOG_EN_MODRDN &&
+				( m->sml_op == SLAP_MOD_SOFTADD ||
+				  m->sml_op == LDAP_MOD_DELETE ) )
+			{
+				continue;
+			}
+			switch ( m->sml_op ) {
+			case LDAP_MOD_ADD:	/* FALLTHRU */
+			case SLAP_MOD_SOFTADD: mop = LDAP_MOD_ADD; break;
+			case LDAP_MOD_DELETE: /* FALLTHRU */
+			case SLAP_MOD_SOFTDEL: mop = LDAP_MOD_DELETE; break;
+			case LDAP_MOD_REPLACE:	mop = LDAP_MOD_REPLACE; break;
+			case LDAP_MOD_INCREMENT:	mop = LDAP_MOD_INCREMENT; break;
+			default: continue;
+			}
+			if ( !m->sml_values &&
+				( mop == LDAP_MOD_ADD || mop == LDAP_MOD_INCREMENT ))
+			{
+				continue;
+			}
+			rc = ber_printf( ber, "{e{O[W]N}N}", mop,
+				&m->sml_desc->ad_cname, m->sml_values );
+		}
+	}
+
+	if ( rc != -1 )
+		rc = ber_printf( ber, "N}" );
+	if ( rc != -1 && ber_flatten2( ber, &bv, 0 ) == 0 ) {
+		attr_merge_one( e, ad_reqModBinary, &bv, NULL );
+	} else {
+		Debug( LDAP_DEBUG_ANY, "%s accesslog_mods2bin: "
+			"encoding failed\n", op->o_log_prefix );
+	}
+	ber_free_buf( ber );
+}
+
 static int
 accesslog_op2logop( Operation *op )
 {
@@ -1625,6 +1776,10 @@ accesslog_response(Operation *op, SlapReply *rs)
 	op2.o_bd = li->li_db;
 	op2.o_csn.bv_val = csnbuf;
 	op2.o_csn.bv_len = sizeof(csnbuf);
+#ifdef SLAP_CONTROL_X_LAZY_COMMIT
+	if ( li->li_lazycommit )
+		op2.o_lazyCommit = SLAP_CONTROL_NONCRITICAL;
+#endif
 
 	if ( !( lo->mask & LOG_OP_WRITES ) ) {
 		ldap_pvt_thread_mutex_lock( &li->li_op_rmutex );
@@ -1953,6 +2108,12 @@ accesslog_response(Operation *op, SlapReply *rs)
 		break;
 	}
 
+	if ( li->li_binmods && ( logop == LOG_EN_ADD ||
+		logop == LOG_EN_MODIFY || logop == LOG_EN_MODRDN ))
+	{
+		accesslog_mods2bin( op, logop, e );
+	}
+
 	if ( e_uuid || !BER_BVISNULL( &uuid ) ) {
 		struct berval *pbv = NULL;
 
@@ -2253,6 +2414,10 @@ accesslog_unbind( Operation *op, SlapReply *rs )
 	op2.o_bd = li->li_db;
 	op2.o_csn.bv_val = csnbuf;
 	op2.o_csn.bv_len = sizeof(csnbuf);
+#ifdef SLAP_CONTROL_X_LAZY_COMMIT
+	if ( li->li_lazycommit )
+		op2.o_lazyCommit = SLAP_CONTROL_NONCRITICAL;
+#endif
 
 	ldap_pvt_thread_mutex_lock( &li->li_op_rmutex );
 
@@ -2333,6 +2498,10 @@ accesslog_abandon( Operation *op, SlapReply *rs )
 	op2.o_bd = li->li_db;
 	op2.o_csn.bv_val = csnbuf;
 	op2.o_csn.bv_len = sizeof(csnbuf);
+#ifdef SLAP_CONTROL_X_LAZY_COMMIT
+	if ( li->li_lazycommit )
+		op2.o_lazyCommit = SLAP_CONTROL_NONCRITICAL;
+#endif
 
 	ldap_pvt_thread_mutex_lock( &li->li_op_rmutex );
 	if ( SLAP_LASTMOD( li->li_db ) ) {
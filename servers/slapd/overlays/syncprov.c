@@ -23,7 +23,11 @@
 #ifdef SLAPD_OVER_SYNCPROV
 
 #include <ac/string.h>
+#include <ac/errno.h>
+#include <ac/unistd.h>
+#include <fcntl.h>
 #include "lutil.h"
+#include "lutil_hash.h"
 #include "slap.h"
 #include "slap-config.h"
 #include "ldap_rq.h"
@@ -45,12 +49,24 @@ typedef struct modtarget {
 	ldap_pvt_thread_mutex_t mt_mutex;
 } modtarget;
 
+/* An encoded search entry, shared by the psearches that would
+ * have produced the same encoding
+ */
+typedef struct syncenc {
+	struct syncenc *se_next;
+	struct berval se_key;	/* see syncprov_enckey */
+	struct berval se_ber;	/* protocolOp of the SearchResultEntry */
+	int se_rc;
+} syncenc;
+
 /* All the info of a psearch result that's shared between
  * multiple queues
  */
 typedef struct resinfo {
 	struct syncres *ri_list;
 	Entry *ri_e;
+	syncenc *ri_enc;
+	int ri_encok;	/* -1 until known if encodings can be shared */
 	struct berval ri_dn;
 	struct berval ri_ndn;
 	struct berval ri_uuid;
@@ -78,6 +94,9 @@ typedef struct syncops {
 	int		s_rid;
 	int		s_sid;
 	struct berval s_filterstr;
+	Filter		*s_fsrc;	/* filter s_fprog was compiled from */
+	FilterProg	*s_fprog;
+	unsigned	s_mark;		/* candidate stamp, see syncprov_psindex_mark */
 	int		s_flags;	/* search status */
 #define	PS_IS_REFRESHING	0x01
 #define	PS_IS_DETACHED		0x02
@@ -85,10 +104,12 @@ typedef struct syncops {
 #define	PS_FIND_BASE		0x08
 #define	PS_FIX_FILTER		0x10
 #define	PS_TASK_QUEUED		0x20
+#define	PS_QUEUE_FULL		0x40
 
 	int		s_inuse;	/* reference count */
 	struct syncres *s_res;
 	struct syncres *s_restail;
+	int		s_qlen;		/* number of queued responses */
 	void *s_pool_cookie;
 	ldap_pvt_thread_mutex_t	s_mutex;
 } syncops;
@@ -133,6 +154,7 @@ typedef struct sessionlog {
 	int		sl_playing;
 	TAvlnode *sl_entries;
 	ldap_pvt_thread_rdwr_t sl_mutex;
+	struct slog_file *sl_file;
 } sessionlog;
 
 /* Accesslog callback data */
@@ -148,9 +170,27 @@ typedef struct syncprov_accesslog_deletes {
 	char *uuid_buf;
 } syncprov_accesslog_deletes;
 
+/* A node of the persistent search index. Nodes with a NULL pn_desc
+ * are keyed on the normalized search base of unanchored psearches,
+ * the others on an equality assertion value the psearch filter
+ * requires every matching entry to hold.
+ */
+typedef struct psnode {
+	AttributeDescription *pn_desc;
+	struct berval pn_val;
+	int pn_num;
+	int pn_max;
+	syncops **pn_ops;
+} psnode;
+
 /* The main state for this overlay */
 typedef struct syncprov_info_t {
 	syncops		*si_ops;
+	unsigned	si_ops_gen;	/* bumped whenever si_ops changes */
+	unsigned	si_psgen;	/* si_ops_gen the index was built for */
+	unsigned	si_psmark;	/* last candidate stamp handed out */
+	TAvlnode	*si_psindex;	/* psnodes */
+	AttributeDescription **si_psads;	/* anchor attributes in use */
 	struct berval	si_contextdn;
 	struct berval	si_logbase;
 	BerVarray	si_ctxcsn;	/* ldapsync context */
@@ -161,12 +201,15 @@ typedef struct syncprov_info_t {
 	int		si_numops;	/* number of ops since last checkpoint */
 	int		si_nopres;	/* Skip present phase */
 	int		si_usehint;	/* use reload hint */
+	int		si_qlimit;	/* max responses queued per psearch */
 	int		si_active;	/* True if there are active mods */
 	int		si_dirty;	/* True if the context is dirty, i.e changes
 						 * have been made without updating the csn. */
 	time_t	si_chklast;	/* time of last checkpoint */
 	Avlnode	*si_mods;	/* entries being modified */
 	sessionlog	*si_logs;
+	char		*si_logfile;	/* where the sessionlog is kept */
+	int		si_logfilesize;	/* ops kept in the file */
 	ldap_pvt_thread_rdwr_t	si_csn_rwlock;
 	ldap_pvt_thread_mutex_t	si_ops_mutex;
 	ldap_pvt_thread_mutex_t	si_mods_mutex;
@@ -860,7 +903,15 @@ static void free_resinfo( syncres *sr )
 	}
 	ldap_pvt_thread_mutex_unlock( &ri->ri_mutex );
 	if ( freeit ) {
+		syncenc *se, *senext;
+
 		ldap_pvt_thread_mutex_destroy( &ri->ri_mutex );
+		for ( se = ri->ri_enc; se; se = senext ) {
+			senext = se->se_next;
+			if ( se->se_ber.bv_val )
+				ber_memfree( se->se_ber.bv_val );
+			ch_free( se );
+		}
 		if ( ri->ri_e )
 			entry_free( ri->ri_e );
 		if ( !BER_BVISNULL( &ri->ri_cookie ))
@@ -893,6 +944,7 @@ syncprov_free_syncop( syncops *so, int flags )
 		for ( sop = &so->s_si->si_ops; *sop; sop = &(*sop)->s_next ) {
 			if ( *sop == so ) {
 				*sop = so->s_next;
+				so->s_si->si_ops_gen++;
 				break;
 			}
 		}
@@ -906,6 +958,8 @@ syncprov_free_syncop( syncops *so, int flags )
 		}
 		ch_free( so->s_op );
 	}
+	if ( so->s_fprog )
+		filter_prog_free( so->s_fprog, NULL );
 	ch_free( so->s_base.bv_val );
 	for ( sr=so->s_res; sr; sr=srnext ) {
 		srnext = sr->s_next;
@@ -917,6 +971,127 @@ syncprov_free_syncop( syncops *so, int flags )
 	return 1;
 }
 
+/* Whether ACL decisions for an entry depend only on the identity and
+ * security factors of the consumer, so that psearches sharing those
+ * can share the encoded entry.
+ */
+static int
+syncprov_acl_shareable( AccessControl *acl )
+{
+	Access *b;
+
+	for ( ; acl; acl = acl->acl_next ) {
+		for ( b = acl->acl_access; b; b = b->a_next ) {
+			if ( !BER_BVISNULL( &b->a_peername_pat ) ||
+				!BER_BVISNULL( &b->a_sockname_pat ) ||
+				!BER_BVISNULL( &b->a_domain_pat ) ||
+				!BER_BVISNULL( &b->a_sockurl_pat ))
+				return 0;
+#ifdef SLAP_DYNACL
+			if ( b->a_dynacl )
+				return 0;
+#endif /* SLAP_DYNACL */
+		}
+	}
+	return 1;
+}
+
+/* Everything send_search_entry looks at that can differ between
+ * psearches on the same database
+ */
+static void
+syncprov_enckey( Operation *op, struct berval *key )
+{
+	AttributeName *an;
+	char *ptr;
+	int i;
+
+	key->bv_len = 4 * STRLENOF( "4294967295." ) + STRLENOF( "1:" ) +
+		op->o_ndn.bv_len;
+	for ( an = op->ors_attrs; an && !BER_BVISNULL( &an->an_name ); an++ )
+		key->bv_len += an->an_name.bv_len + 1;
+	key->bv_val = op->o_tmpalloc( key->bv_len + 1, op->o_tmpmemctx );
+
+	ptr = key->bv_val + sprintf( key->bv_val, "%u.%u.%u.%u.%d:",
+		op->o_ssf, op->o_transport_ssf, op->o_tls_ssf, op->o_sasl_ssf,
+		op->ors_attrsonly ? 1 : 0 );
+	for ( an = op->ors_attrs, i = 0; an && !BER_BVISNULL( &an->an_name ); an++, i++ ) {
+		if ( i )
+			*ptr++ = ',';
+		ptr = lutil_strncopy( ptr, an->an_name.bv_val, an->an_name.bv_len );
+	}
+	*ptr++ = ':';
+	ptr = lutil_strncopy( ptr, op->o_ndn.bv_val, op->o_ndn.bv_len );
+	*ptr = '\0';
+	key->bv_len = ptr - key->bv_val;
+}
+
+/* Send an entry to a psearch, encoding it only once for all the
+ * psearches it is queued on that see it the same way.
+ */
+static int
+syncprov_sendentry( Operation *op, SlapReply *rs, resinfo *ri )
+{
+	syncenc *se;
+	struct berval key;
+
+	/* response callbacks may rewrite or account for the entry per op */
+	if ( op->o_vrFilter || op->o_callback )
+		return send_search_entry( op, rs );
+
+	ldap_pvt_thread_mutex_lock( &ri->ri_mutex );
+	if ( ri->ri_encok < 0 ) {
+		ri->ri_encok = syncprov_acl_shareable( op->o_bd->be_acl ) &&
+			syncprov_acl_shareable( frontendDB->be_acl );
+	}
+	if ( !ri->ri_encok ) {
+		ldap_pvt_thread_mutex_unlock( &ri->ri_mutex );
+		return send_search_entry( op, rs );
+	}
+
+	syncprov_enckey( op, &key );
+	for ( se = ri->ri_enc; se; se = se->se_next ) {
+		if ( bvmatch( &se->se_key, &key ))
+			break;
+	}
+	if ( !se ) {
+		BerElementBuffer berbuf;
+		BerElement *ber = (BerElement *)&berbuf;
+		SlapReply rs2 = { REP_SEARCH };
+
+		ber_init2( ber, NULL, LBER_USE_DER );
+		rs2.sr_entry = rs->sr_entry;
+		rs2.sr_attrs = rs->sr_attrs;
+		op->o_res_ber = ber;
+		se = ch_malloc( sizeof( syncenc ) + key.bv_len + 1 );
+		se->se_rc = send_search_entry( op, &rs2 );
+		op->o_res_ber = NULL;
+
+		BER_BVZERO( &se->se_ber );
+		if ( se->se_rc == LDAP_SUCCESS )
+			ber_flatten2( ber, &se->se_ber, 1 );
+		ber_free_buf( ber );
+		se->se_key.bv_val = (char *)(se + 1);
+		se->se_key.bv_len = key.bv_len;
+		AC_MEMCPY( se->se_key.bv_val, key.bv_val, key.bv_len + 1 );
+		se->se_next = ri->ri_enc;
+		ri->ri_enc = se;
+	}
+	ldap_pvt_thread_mutex_unlock( &ri->ri_mutex );
+	op->o_tmpfree( key.bv_val, op->o_tmpmemctx );
+
+	/* the encoding is not freed before ri */
+	if ( se->se_rc != LDAP_SUCCESS ) {
+		if ( rs->sr_flags & REP_CTRLS_MUSTBEFREED ) {
+			rs->sr_flags ^= REP_CTRLS_MUSTBEFREED;
+			slap_free_ctrls( op, rs->sr_ctrls );
+			rs->sr_ctrls = NULL;
+		}
+		return se->se_rc;
+	}
+	return slap_send_search_entry_ber( op, rs, &se->se_ber );
+}
+
 /* Send a persistent search response */
 static int
 syncprov_sendresp( Operation *op, resinfo *ri, syncops *so, int mode )
@@ -975,7 +1150,7 @@ syncprov_sendresp( Operation *op, resinfo *ri, syncops *so, int mode )
 			mode == LDAP_SYNC_ADD ? "LDAP_SYNC_ADD" : "LDAP_SYNC_MODIFY",
 			e_uuid.e_nname.bv_val );
 		rs.sr_attrs = op->ors_attrs;
-		rs.sr_err = send_search_entry( op, &rs );
+		rs.sr_err = syncprov_sendentry( op, &rs, ri );
 		break;
 	case LDAP_SYNC_DELETE:
 		Debug( LDAP_DEBUG_SYNC, "%s syncprov_sendresp: "
@@ -1017,6 +1192,7 @@ syncprov_qplay( Operation *op, syncops *so )
 		so->s_res = sr->s_next;
 		if ( !so->s_res )
 			so->s_restail = NULL;
+		so->s_qlen--;
 		ldap_pvt_thread_mutex_unlock( &so->s_mutex );
 
 		if ( !so->s_op->o_abandon ) {
@@ -1117,11 +1293,29 @@ syncprov_qstart( syncops *so )
 static int
 syncprov_qresp( opcookie *opc, syncops *so, int mode )
 {
+	syncprov_info_t	*si = opc->son->on_bi.bi_private;
 	syncres *sr;
 	resinfo *ri;
 	int srsize;
 	struct berval csn = opc->sctxcsn;
 
+	/* A consumer that can't keep up is sent back to refresh from
+	 * its cookie rather than queueing without bound. Skipping a
+	 * new cookie loses nothing, a later one supersedes it.
+	 */
+	if ( si->si_qlimit ) {
+		int full;
+
+		ldap_pvt_thread_mutex_lock( &so->s_mutex );
+		full = ( so->s_flags & PS_QUEUE_FULL ) ||
+			so->s_qlen >= si->si_qlimit;
+		if ( full && mode != LDAP_SYNC_NEW_COOKIE )
+			so->s_flags |= PS_QUEUE_FULL;
+		ldap_pvt_thread_mutex_unlock( &so->s_mutex );
+		if ( full )
+			return LDAP_BUSY;
+	}
+
 	sr = ch_malloc( sizeof( syncres ));
 	sr->s_next = NULL;
 	sr->s_mode = mode;
@@ -1172,6 +1366,8 @@ syncprov_qresp( opcookie *opc, syncops *so, int mode )
 		}
 		ri->ri_list = &opc->ssres;
 		ri->ri_e = opc->se;
+		ri->ri_enc = NULL;
+		ri->ri_encok = -1;
 		ri->ri_csn.bv_len = csn.bv_len;
 		ri->ri_isref = opc->sreference;
 		BER_BVZERO( &ri->ri_cookie );
@@ -1185,8 +1381,6 @@ syncprov_qresp( opcookie *opc, syncops *so, int mode )
 	sr->s_rilist = ri->ri_list;
 	ri->ri_list = sr;
 	if ( mode == LDAP_SYNC_NEW_COOKIE && BER_BVISNULL( &ri->ri_cookie )) {
-		syncprov_info_t	*si = opc->son->on_bi.bi_private;
-
 		slap_compose_sync_cookie( NULL, &ri->ri_cookie, si->si_ctxcsn,
 			so->s_rid, slap_serverID ? slap_serverID : -1, NULL );
 	}
@@ -1202,6 +1396,7 @@ syncprov_qresp( opcookie *opc, syncops *so, int mode )
 		so->s_restail->s_next = sr;
 	}
 	so->s_restail = sr;
+	so->s_qlen++;
 
 	/* If the base of the psearch was modified, check it next time round */
 	if ( so->s_flags & PS_WROTE_BASE ) {
@@ -1254,6 +1449,7 @@ syncprov_op_abandon( Operation *op, SlapReply *rs )
 			so->s_op->o_msgid == op->orn_msgid ) {
 				so->s_op->o_abandon = 1;
 				*sop = so->s_next;
+				si->si_ops_gen++;
 				break;
 		}
 	}
@@ -1279,6 +1475,274 @@ syncprov_op_abandon( Operation *op, SlapReply *rs )
 	return SLAP_CB_CONTINUE;
 }
 
+/* Persistent search index.
+ *
+ * With many consumers attached, testing every psearch against every
+ * written entry dominates the cost of a write. The index maps each
+ * psearch either to the equality values its filter requires (its
+ * anchors) or, when it has none, to its search base. A write then only
+ * runs the scope and filter checks on the psearches the entry could
+ * possibly match. The index is rebuilt lazily, under si_ops_mutex,
+ * whenever si_ops has changed since it was last built.
+ */
+#define SYNCPROV_PSANCHORS	16
+
+typedef struct psanchor {
+	AttributeDescription *pa_desc;
+	struct berval *pa_val;
+} psanchor;
+
+static int
+psnode_cmp( const void *v_a, const void *v_b )
+{
+	const psnode *a = v_a, *b = v_b;
+
+	if ( a->pn_desc != b->pn_desc )
+		return a->pn_desc < b->pn_desc ? -1 : 1;
+	if ( a->pn_val.bv_len != b->pn_val.bv_len )
+		return a->pn_val.bv_len < b->pn_val.bv_len ? -1 : 1;
+	return memcmp( a->pn_val.bv_val, b->pn_val.bv_val, a->pn_val.bv_len );
+}
+
+static void
+psnode_free( void *v )
+{
+	psnode *pn = v;
+
+	ch_free( pn->pn_ops );
+	ch_free( pn );
+}
+
+/* Only attributes whose equality match is a plain comparison of
+ * normalized values can be looked up directly in the entry.
+ */
+static int
+syncprov_anchorable( AttributeDescription *ad )
+{
+	AttributeType *at = ad->ad_type;
+
+	if ( ad != at->sat_ad || at->sat_subtypes ||
+		( at->sat_flags & SLAP_AT_DYNAMIC ))
+		return 0;
+	if ( !at->sat_equality ||
+		at->sat_equality->smr_match != octetStringMatch ||
+		at->sat_equality->smr_syntax != at->sat_syntax )
+		return 0;
+	return 1;
+}
+
+/* Collect the values one of which every entry matching f must hold.
+ * Returns the new number of anchors in pa, or -1 if there is no such
+ * set.
+ */
+static int
+syncprov_psanchors( Filter *f, psanchor *pa, int n )
+{
+	Filter *f2;
+	int i, rc;
+
+	switch ( f->f_choice ) {
+	case LDAP_FILTER_EQUALITY:
+		if ( n == SYNCPROV_PSANCHORS )
+			return -1;
+		if ( f->f_av_desc == slap_schema.si_ad_objectClass ) {
+			ObjectClass *oc = oc_bvfind( &f->f_av_value );
+			if ( !oc )
+				return -1;
+			pa[n].pa_val = &oc->soc_cname;
+		} else if ( syncprov_anchorable( f->f_av_desc )) {
+			pa[n].pa_val = &f->f_av_value;
+		} else {
+			return -1;
+		}
+		pa[n].pa_desc = f->f_av_desc;
+		return n + 1;
+
+	case LDAP_FILTER_AND:
+		/* objectClass values are shared by most entries, prefer
+		 * any other anchor
+		 */
+		for ( i = 0; i < 2; i++ ) {
+			for ( f2 = f->f_and; f2; f2 = f2->f_next ) {
+				if (( f2->f_choice == LDAP_FILTER_EQUALITY &&
+					f2->f_av_desc == slap_schema.si_ad_objectClass ) != i )
+					continue;
+				rc = syncprov_psanchors( f2, pa, n );
+				if ( rc >= 0 )
+					return rc;
+			}
+		}
+		return -1;
+
+	case LDAP_FILTER_OR:
+		for ( f2 = f->f_or; f2; f2 = f2->f_next ) {
+			n = syncprov_psanchors( f2, pa, n );
+			if ( n < 0 )
+				break;
+		}
+		return n;
+	}
+	return -1;
+}
+
+static void
+syncprov_psindex_add( syncprov_info_t *si, AttributeDescription *ad,
+	struct berval *val, syncops *ss )
+{
+	psnode pn, *p;
+
+	pn.pn_desc = ad;
+	pn.pn_val = *val;
+	p = ldap_tavl_find( si->si_psindex, &pn, psnode_cmp );
+	if ( !p ) {
+		p = ch_malloc( sizeof( psnode ) + val->bv_len + 1 );
+		p->pn_desc = ad;
+		p->pn_val.bv_len = val->bv_len;
+		p->pn_val.bv_val = (char *)(p+1);
+		AC_MEMCPY( p->pn_val.bv_val, val->bv_val, val->bv_len );
+		p->pn_val.bv_val[val->bv_len] = '\0';
+		p->pn_num = 0;
+		p->pn_max = 0;
+		p->pn_ops = NULL;
+		ldap_tavl_insert( &si->si_psindex, p, psnode_cmp, ldap_avl_dup_error );
+
+		if ( ad ) {
+			int i;
+			for ( i = 0; si->si_psads && si->si_psads[i]; i++ )
+				if ( si->si_psads[i] == ad )
+					break;
+			if ( !si->si_psads || !si->si_psads[i] ) {
+				si->si_psads = ch_realloc( si->si_psads,
+					( i + 2 ) * sizeof( AttributeDescription * ));
+				si->si_psads[i] = ad;
+				si->si_psads[i+1] = NULL;
+			}
+		}
+	}
+	if ( p->pn_num == p->pn_max ) {
+		p->pn_max = p->pn_max ? p->pn_max * 2 : 4;
+		p->pn_ops = ch_realloc( p->pn_ops, p->pn_max * sizeof( syncops * ));
+	}
+	p->pn_ops[p->pn_num++] = ss;
+}
+
+static void
+syncprov_psindex_free( syncprov_info_t *si )
+{
+	if ( si->si_psindex ) {
+		ldap_tavl_free( si->si_psindex, psnode_free );
+		si->si_psindex = NULL;
+	}
+	if ( si->si_psads ) {
+		ch_free( si->si_psads );
+		si->si_psads = NULL;
+	}
+}
+
+static void
+syncprov_psindex_build( syncprov_info_t *si )
+{
+	syncops *ss;
+	psanchor pa[SYNCPROV_PSANCHORS];
+
+	syncprov_psindex_free( si );
+	for ( ss = si->si_ops; ss; ss = ss->s_next ) {
+		Filter *f;
+		int i, n;
+
+		ldap_pvt_thread_mutex_lock( &ss->s_mutex );
+		f = ss->s_op->ors_filter;
+		if ( ss->s_flags & PS_FIX_FILTER )
+			f = f->f_and->f_next;
+		n = syncprov_psanchors( f, pa, 0 );
+		if ( n > 0 ) {
+			for ( i = 0; i < n; i++ )
+				syncprov_psindex_add( si, pa[i].pa_desc, pa[i].pa_val, ss );
+		} else {
+			syncprov_psindex_add( si, NULL, &ss->s_base, ss );
+		}
+		ldap_pvt_thread_mutex_unlock( &ss->s_mutex );
+	}
+	si->si_psgen = si->si_ops_gen;
+}
+
+static void
+syncprov_psindex_lookup( syncprov_info_t *si, AttributeDescription *ad,
+	struct berval *val, unsigned mark )
+{
+	psnode pn, *p;
+	int i;
+
+	pn.pn_desc = ad;
+	pn.pn_val = *val;
+	p = ldap_tavl_find( si->si_psindex, &pn, psnode_cmp );
+	if ( p ) {
+		for ( i = 0; i < p->pn_num; i++ )
+			p->pn_ops[i]->s_mark = mark;
+	}
+}
+
+static void
+syncprov_psindex_oc( syncprov_info_t *si, ObjectClass *oc, unsigned mark )
+{
+	int i;
+
+	syncprov_psindex_lookup( si, slap_schema.si_ad_objectClass,
+		&oc->soc_cname, mark );
+	for ( i = 0; oc->soc_sups && oc->soc_sups[i]; i++ )
+		syncprov_psindex_oc( si, oc->soc_sups[i], mark );
+}
+
+/* Stamp every psearch that entry e at fdn might match, and return
+ * the stamp. Must be called with si_ops_mutex held.
+ */
+static unsigned
+syncprov_psindex_mark( syncprov_info_t *si, Entry *e, struct berval *fdn )
+{
+	struct berval dn, pdn;
+	unsigned mark;
+	int i, j;
+
+	if ( si->si_psgen != si->si_ops_gen )
+		syncprov_psindex_build( si );
+
+	/* new syncops start out with a zero stamp */
+	mark = ++si->si_psmark;
+	if ( !mark )
+		mark = ++si->si_psmark;
+
+	if ( e ) {
+		for ( i = 0; si->si_psads && si->si_psads[i]; i++ ) {
+			AttributeDescription *ad = si->si_psads[i];
+			Attribute *a;
+
+			for ( a = attrs_find( e->e_attrs, ad ); a;
+				a = attrs_find( a->a_next, ad )) {
+				for ( j = 0; j < a->a_numvals; j++ ) {
+					if ( ad == slap_schema.si_ad_objectClass ) {
+						ObjectClass *oc = oc_bvfind( &a->a_nvals[j] );
+						if ( oc )
+							syncprov_psindex_oc( si, oc, mark );
+					} else {
+						syncprov_psindex_lookup( si, ad, &a->a_nvals[j], mark );
+					}
+				}
+			}
+		}
+	}
+
+	/* unanchored psearches based at fdn or any of its ancestors */
+	dn = *fdn;
+	for (;;) {
+		syncprov_psindex_lookup( si, NULL, &dn, mark );
+		if ( BER_BVISEMPTY( &dn ))
+			break;
+		dnParent( &dn, &pdn );
+		dn = pdn;
+	}
+	return mark;
+}
+
 /* Find which persistent searches are affected by this operation */
 static void
 syncprov_matchops( Operation *op, opcookie *opc, int saveit )
@@ -1291,6 +1755,7 @@ syncprov_matchops( Operation *op, opcookie *opc, int saveit )
 	Entry *e = NULL;
 	Attribute *a;
 	int rc, gonext;
+	unsigned mark;
 	struct berval newdn;
 	int freefdn = 0;
 	BackendDB *b0 = op->o_bd, db;
@@ -1351,6 +1816,8 @@ syncprov_matchops( Operation *op, opcookie *opc, int saveit )
 	}
 
 	ldap_pvt_thread_mutex_lock( &si->si_ops_mutex );
+	mark = syncprov_psindex_mark( si, e && !is_entry_glue( e ) ? e : NULL,
+		fc.fdn );
 	for (pss = &si->si_ops; *pss; pss = gonext ? &(*pss)->s_next : pss)
 	{
 		Operation op2;
@@ -1384,15 +1851,30 @@ syncprov_matchops( Operation *op, opcookie *opc, int saveit )
 		fc.fbase = 0;
 		fc.fscope = 0;
 
-		/* If the base of the search is missing, signal a refresh */
-		rc = syncprov_findbase( op, &fc );
+		/* The entry cannot match this search. It still needs to
+		 * be told about the write if it matched before. A write to
+		 * the search base or one of its ancestors is always checked,
+		 * it may have moved the base away.
+		 */
+		if ( ss->s_mark != mark && !( ss->s_flags & PS_FIND_BASE ) &&
+			!dnIsSuffix( &ss->s_base, &op->o_req_ndn ) &&
+			!dnIsSuffix( &ss->s_base, fc.fdn )) {
+			if ( saveit )
+				continue;
+			rc = LDAP_SUCCESS;
+		} else {
+			/* If the base of the search is missing, signal a refresh */
+			rc = syncprov_findbase( op, &fc );
+		}
 		if ( rc != LDAP_SUCCESS ) {
 			SlapReply rs = {REP_RESULT};
 			send_ldap_error( ss->s_op, &rs, LDAP_SYNC_REFRESH_REQUIRED,
 				"search base has changed" );
 			snext = ss->s_next;
-			if ( syncprov_drop_psearch( ss, 1 ) )
+			if ( syncprov_drop_psearch( ss, 1 ) ) {
 				*pss = snext;
+				si->si_ops_gen++;
+			}
 			gonext = 0;
 			continue;
 		}
@@ -1401,8 +1883,10 @@ syncprov_matchops( Operation *op, opcookie *opc, int saveit )
 		if ( !saveit ) {
 			syncmatches *old;
 
-			/* Did we modify the search base? */
-			if ( dn_match( &op->o_req_ndn, &ss->s_base )) {
+			/* Did we modify the search base, or move it? */
+			if ( dn_match( &op->o_req_ndn, &ss->s_base ) ||
+				( op->o_tag == LDAP_REQ_MODRDN &&
+				dnIsSuffix( &ss->s_base, &op->o_req_ndn ))) {
 				ldap_pvt_thread_mutex_lock( &ss->s_mutex );
 				ss->s_flags |= PS_WROTE_BASE;
 				ldap_pvt_thread_mutex_unlock( &ss->s_mutex );
@@ -1436,7 +1920,14 @@ syncprov_matchops( Operation *op, opcookie *opc, int saveit )
 				   phase otherwise (ITS#6555) */
 				op2.ors_filter = ss->s_op->ors_filter->f_and->f_next;
 			}
-			rc = test_filter( &op2, e, op2.ors_filter );
+			if ( ss->s_fsrc != op2.ors_filter ) {
+				/* first use, or the search was detached */
+				if ( ss->s_fprog )
+					filter_prog_free( ss->s_fprog, NULL );
+				ss->s_fprog = filter_compile( op2.ors_filter, NULL );
+				ss->s_fsrc = op2.ors_filter;
+			}
+			rc = test_filter_prog( &op2, e, ss->s_fprog );
 			ldap_pvt_thread_mutex_unlock( &ss->s_mutex );
 		}
 
@@ -1472,6 +1963,25 @@ syncprov_matchops( Operation *op, opcookie *opc, int saveit )
 			snext = ss->s_next;
 			if ( syncprov_free_syncop( ss, FS_LOCK ) ) {
 				*pss = snext;
+				si->si_ops_gen++;
+				gonext = 0;
+				continue;
+			}
+		}
+		if ( ss->s_flags & PS_QUEUE_FULL ) {
+			SlapReply rs = {REP_RESULT};
+
+			Debug( LDAP_DEBUG_SYNC, "%s syncprov_matchops: "
+				"more than %d responses queued, refresh required\n",
+				ss->s_op->o_log_prefix, si->si_qlimit );
+			send_ldap_error( ss->s_op, &rs, LDAP_SYNC_REFRESH_REQUIRED,
+				"consumer is too far behind" );
+			/* nothing more may be sent on this search */
+			ss->s_op->o_abandon = 1;
+			snext = ss->s_next;
+			if ( syncprov_drop_psearch( ss, 1 ) ) {
+				*pss = snext;
+				si->si_ops_gen++;
 				gonext = 0;
 			}
 		}
@@ -1625,16 +2135,494 @@ syncprov_checkpoint( Operation *op, slap_overinst *on )
 		if ( e == opm.ora_e )
 			be_entry_release_w( &opm, opm.ora_e );
 	}
-	opm.o_bd->bd_info = bi;
+	opm.o_bd->bd_info = bi;
+
+	if ( mod.sml_next != NULL ) {
+		slap_mods_free( mod.sml_next, 1 );
+	}
+#ifdef CHECK_CSN
+	for ( i=0; i<si->si_numcsns; i++ ) {
+		assert( !syn->ssyn_validate( syn, si->si_ctxcsn+i ));
+	}
+#endif
+}
+
+/* On-disk copy of the sessionlog, so that consumers can still be sent
+ * deltas after the provider restarts, or once they have fallen behind
+ * what is kept in memory. Records go into a ring of fixed size slots in
+ * the order they were logged. Each carries its sequence number and a
+ * checksum, so the ring can be rebuilt from the records alone. The
+ * header keeps the per-sid mincsn of what has left the ring and is
+ * rewritten before a slot is reused or the log is wiped, so whatever
+ * the file holds is valid even if slapd did not shut down cleanly.
+ *
+ * On startup the file is only trusted if it has a record, or a mincsn,
+ * up to the contextCSN of every sid in the database; a change that did
+ * not make it to the file, offline changes or a new size discard it.
+ * The newest sessionlog-size records are loaded into memory, older
+ * cookies are played back by reading the file.
+ */
+#define SLOG_FILE_MAGIC	"OLSPLOG2"
+#define SLOG_FILE_MAXSIDS	32
+#define SLOG_FILE_HDRSIZE	8192
+#define SLOG_FILE_BATCH	256	/* records read at a time */
+#define SLOG_FILE_SEED	0x736c6f67ULL
+
+typedef struct slog_filecsn {
+	int	sc_sid;
+	int	sc_len;
+	char	sc_csn[LDAP_PVT_CSNSTR_BUFSIZE];
+} slog_filecsn;
+
+typedef struct slog_filehdr {
+	char	sh_magic[8];
+	int	sh_recsize;
+	int	sh_nslots;
+	int	sh_nmin;
+	int	sh_pad;
+	unsigned long long	sh_first;	/* older records were wiped */
+	slog_filecsn	sh_mincsn[SLOG_FILE_MAXSIDS];
+} slog_filehdr;
+
+typedef struct slog_filerec {
+	unsigned long long	sr_seq;
+	unsigned char	sr_uuid[UUID_LEN];
+	int	sr_tag;
+	int	sr_sid;
+	int	sr_csnlen;
+	char	sr_csn[LDAP_PVT_CSNSTR_BUFSIZE];
+	unsigned long long	sr_sum;	/* of everything above */
+} slog_filerec;
+
+typedef struct slog_file {
+	int	sf_fd;
+	int	sf_ok;	/* file still matches the sessionlog */
+	unsigned long long	sf_first;	/* oldest record in the ring */
+	unsigned long long	sf_next;	/* sequence number of the next one */
+	ldap_pvt_thread_mutex_t	sf_iomutex;	/* the file offset */
+	slog_filehdr	sf_hdr;
+} slog_file;
+
+#define SLOG_FILE_SLOT(sh, seq)	((seq) % (unsigned long long)(sh)->sh_nslots)
+#define SLOG_FILE_OFF(sh, seq)	\
+	(SLOG_FILE_HDRSIZE + (off_t)SLOG_FILE_SLOT(sh, seq) * sizeof(slog_filerec))
+
+/* Returns the number of bytes transferred, which is short at
+ * the end of the file, or -1 on error.
+ */
+static ssize_t
+slog_file_io( slog_file *sf, void *buf, size_t len, off_t off, int wr )
+{
+	char *ptr = buf;
+	ssize_t n, done = 0;
+
+	ldap_pvt_thread_mutex_lock( &sf->sf_iomutex );
+	if ( lseek( sf->sf_fd, off, SEEK_SET ) != off ) {
+		done = -1;
+		len = 0;
+	}
+	while ( len ) {
+		n = wr ? write( sf->sf_fd, ptr, len ) : read( sf->sf_fd, ptr, len );
+		if ( n < 0 && errno == EINTR )
+			continue;
+		if ( n < 0 )
+			done = -1;
+		if ( n <= 0 )
+			break;
+		ptr += n;
+		len -= n;
+		done += n;
+	}
+	ldap_pvt_thread_mutex_unlock( &sf->sf_iomutex );
+	return done;
+}
+
+static int
+slog_file_puthdr( slog_file *sf )
+{
+	return slog_file_io( sf, &sf->sf_hdr, sizeof( sf->sf_hdr ), 0, 1 ) ==
+		sizeof( sf->sf_hdr ) ? 0 : -1;
+}
+
+static unsigned long long
+slog_file_sum( slog_filerec *sr )
+{
+	return lutil_wyhash64( (unsigned char *)sr, (char *)&sr->sr_sum - (char *)sr,
+		SLOG_FILE_SEED );
+}
+
+/* Is this intact record number seq? */
+static int
+slog_file_recok( slog_filerec *sr, unsigned long long seq )
+{
+	return sr->sr_seq == seq && sr->sr_csnlen > 0 &&
+		sr->sr_csnlen < LDAP_PVT_CSNSTR_BUFSIZE &&
+		sr->sr_sum == slog_file_sum( sr );
+}
+
+/* Read up to n records from seq on, stopping at the end of the ring.
+ * Returns how many were read.
+ */
+static int
+slog_file_read( slog_file *sf, unsigned long long seq, slog_filerec *sr, int n )
+{
+	slog_filehdr *sh = &sf->sf_hdr;
+	unsigned long long left = sh->sh_nslots - SLOG_FILE_SLOT( sh, seq );
+	ssize_t len;
+
+	if ( n > left )
+		n = left;
+	len = slog_file_io( sf, sr, n * sizeof( *sr ), SLOG_FILE_OFF( sh, seq ), 0 );
+	if ( len < 0 )
+		return -1;
+	return len / sizeof( *sr );
+}
+
+static int
+slog_file_setcsns( slog_filecsn *sc, int *num, BerVarray csns, int *sids, int numcsns )
+{
+	int i;
+
+	if ( numcsns > SLOG_FILE_MAXSIDS )
+		return -1;
+	for ( i=0; i<numcsns; i++ ) {
+		if ( csns[i].bv_len >= LDAP_PVT_CSNSTR_BUFSIZE )
+			return -1;
+		sc[i].sc_sid = sids[i];
+		sc[i].sc_len = csns[i].bv_len;
+		AC_MEMCPY( sc[i].sc_csn, csns[i].bv_val, csns[i].bv_len );
+	}
+	*num = numcsns;
+	return 0;
+}
+
+/* Raise the CSN kept for sid to csn */
+static int
+slog_file_raise( slog_filecsn *sc, int *num, int sid, struct berval *csn )
+{
+	struct berval old;
+	int i;
+
+	for ( i=0; i<*num; i++ ) {
+		if ( sc[i].sc_sid == sid ) {
+			old.bv_val = sc[i].sc_csn;
+			old.bv_len = sc[i].sc_len;
+			if ( ber_bvcmp( csn, &old ) > 0 ) {
+				AC_MEMCPY( old.bv_val, csn->bv_val, csn->bv_len );
+				sc[i].sc_len = csn->bv_len;
+			}
+			return 0;
+		}
+	}
+	if ( *num == SLOG_FILE_MAXSIDS )
+		return -1;
+	sc[i].sc_sid = sid;
+	sc[i].sc_len = csn->bv_len;
+	AC_MEMCPY( sc[i].sc_csn, csn->bv_val, csn->bv_len );
+	(*num)++;
+	return 0;
+}
+
+static slog_filecsn *
+slog_file_findcsn( slog_filecsn *sc, int num, int sid )
+{
+	int i;
+
+	for ( i=0; i<num; i++ ) {
+		if ( sc[i].sc_sid == sid )
+			return &sc[i];
+	}
+	return NULL;
+}
+
+/* Start over from the current contextCSN, forgetting all records
+ * logged so far. Called with si_csn_rwlock read-locked.
+ */
+static int
+slog_file_reset( syncprov_info_t *si, slog_file *sf )
+{
+	slog_filehdr *sh = &sf->sf_hdr;
+
+	sf->sf_first = sf->sf_next;
+	sh->sh_first = sf->sf_next;
+	if ( slog_file_setcsns( sh->sh_mincsn, &sh->sh_nmin,
+		si->si_ctxcsn, si->si_sids, si->si_numcsns ))
+		return -1;
+	return slog_file_puthdr( sf );
+}
+
+/* Reload the sessionlog from its file if that is still valid, and
+ * start logging into it.
+ */
+static void
+syncprov_slog_open( syncprov_info_t *si )
+{
+	sessionlog *sl = si->si_logs;
+	slog_file *sf;
+	slog_filehdr *sh;
+	slog_filerec *sr;
+	slog_filecsn *sc, maxcsn[SLOG_FILE_MAXSIDS], oldcsn[SLOG_FILE_MAXSIDS];
+	unsigned long long seq, last = 0, first = 0, next = 0, load;
+	int fd, i, n, nmax = 0, nold = 0, nslots, loaded = 0, reuse = 0;
+
+	nslots = si->si_logfilesize ? si->si_logfilesize : sl->sl_size;
+	fd = open( si->si_logfile, O_RDWR|O_CREAT, 0600 );
+	if ( fd < 0 ) {
+		char ebuf[128];
+		int save_errno = errno;
+		Debug( LDAP_DEBUG_ANY, "syncprov_db_open: "
+			"cannot open sessionlog file \"%s\": %d (%s)\n",
+			si->si_logfile, save_errno,
+			AC_STRERROR_R( save_errno, ebuf, sizeof(ebuf) ) );
+		return;
+	}
+	sf = ch_calloc( 1, sizeof( slog_file ));
+	sf->sf_fd = fd;
+	ldap_pvt_thread_mutex_init( &sf->sf_iomutex );
+	sh = &sf->sf_hdr;
+	sr = ch_malloc( SLOG_FILE_BATCH * sizeof( slog_filerec ));
+
+	if ( slog_file_io( sf, sh, sizeof( *sh ), 0, 0 ) == sizeof( *sh ) &&
+		!memcmp( sh->sh_magic, SLOG_FILE_MAGIC, sizeof( sh->sh_magic )) &&
+		sh->sh_recsize == sizeof( slog_filerec ) &&
+		sh->sh_nslots == nslots && sh->sh_first > 0 &&
+		sh->sh_nmin >= 0 && sh->sh_nmin <= SLOG_FILE_MAXSIDS )
+	{
+		reuse = 1;
+		for ( i=0; i<sh->sh_nmin; i++ ) {
+			if ( sh->sh_mincsn[i].sc_len <= 0 ||
+				sh->sh_mincsn[i].sc_len >= LDAP_PVT_CSNSTR_BUFSIZE )
+				reuse = 0;
+		}
+	}
+
+	/* Find the newest intact record, the ring ends there */
+	for ( seq = 0; reuse && seq < nslots; seq += n ) {
+		n = slog_file_read( sf, seq, sr, SLOG_FILE_BATCH );
+		if ( n <= 0 )
+			break;
+		for ( i=0; i<n; i++ ) {
+			if ( sr[i].sr_seq >= sh->sh_first && sr[i].sr_seq > last &&
+				SLOG_FILE_SLOT( sh, sr[i].sr_seq ) == seq + i &&
+				slog_file_recok( &sr[i], sr[i].sr_seq ))
+				last = sr[i].sr_seq;
+		}
+	}
+
+	if ( reuse ) {
+		first = sh->sh_first;
+		next = last ? last + 1 : first;
+		if ( next - first > nslots )
+			first = next - nslots;
+		load = next - first > sl->sl_size ? next - sl->sl_size : first;
+
+		/* Everything before the ring is below mincsn, the newest CSN
+		 * the file knows of for each sid is in maxcsn.
+		 */
+		nmax = nold = sh->sh_nmin;
+		AC_MEMCPY( maxcsn, sh->sh_mincsn, nmax * sizeof( slog_filecsn ));
+		AC_MEMCPY( oldcsn, sh->sh_mincsn, nold * sizeof( slog_filecsn ));
+	}
+
+	/* Every record in between has to be there */
+	for ( seq = first; reuse && seq < next; seq += n ) {
+		n = next - seq > SLOG_FILE_BATCH ? SLOG_FILE_BATCH : next - seq;
+		n = slog_file_read( sf, seq, sr, n );
+		if ( n <= 0 ) {
+			reuse = 0;
+			break;
+		}
+		for ( i=0; i<n; i++ ) {
+			slog_entry *se;
+			struct berval csn;
+
+			if ( !slog_file_recok( &sr[i], seq + i )) {
+				reuse = 0;
+				break;
+			}
+			csn.bv_val = sr[i].sr_csn;
+			csn.bv_len = sr[i].sr_csnlen;
+			if ( slog_file_raise( maxcsn, &nmax, sr[i].sr_sid, &csn )) {
+				reuse = 0;
+				break;
+			}
+			if ( seq + i < load ) {
+				if ( slog_file_raise( oldcsn, &nold, sr[i].sr_sid, &csn )) {
+					reuse = 0;
+					break;
+				}
+				continue;
+			}
+			se = ch_malloc( sizeof( slog_entry ) + UUID_LEN + csn.bv_len + 1 );
+			se->se_tag = sr[i].sr_tag;
+			se->se_sid = sr[i].sr_sid;
+			se->se_uuid.bv_val = (char *)(&se[1]);
+			se->se_uuid.bv_len = UUID_LEN;
+			AC_MEMCPY( se->se_uuid.bv_val, sr[i].sr_uuid, UUID_LEN );
+			se->se_csn.bv_val = se->se_uuid.bv_val + UUID_LEN;
+			se->se_csn.bv_len = csn.bv_len;
+			AC_MEMCPY( se->se_csn.bv_val, csn.bv_val, csn.bv_len );
+			se->se_csn.bv_val[csn.bv_len] = '\0';
+			if ( ldap_tavl_insert( &sl->sl_entries, se,
+				syncprov_sessionlog_cmp, ldap_avl_dup_error )) {
+				ch_free( se );
+			} else {
+				sl->sl_num++;
+				loaded++;
+			}
+		}
+	}
+
+	/* Nothing the database has may be missing from the file */
+	for ( i=0; reuse && i<si->si_numcsns; i++ ) {
+		struct berval csn;
+
+		sc = slog_file_findcsn( maxcsn, nmax, si->si_sids[i] );
+		if ( !sc ) {
+			reuse = 0;
+			break;
+		}
+		csn.bv_val = sc->sc_csn;
+		csn.bv_len = sc->sc_len;
+		if ( ber_bvcmp( &csn, &si->si_ctxcsn[i] ) < 0 )
+			reuse = 0;
+	}
+
+	if ( reuse ) {
+		sf->sf_first = first;
+		sf->sf_next = next;
+		if ( sl->sl_mincsn )
+			ber_bvarray_free( sl->sl_mincsn );
+		if ( sl->sl_sids )
+			ch_free( sl->sl_sids );
+		sl->sl_numcsns = nold;
+		sl->sl_mincsn = ch_malloc(( nold + 1 ) * sizeof( struct berval ));
+		sl->sl_sids = ch_malloc(( nold + 1 ) * sizeof( int ));
+		for ( i=0; i<nold; i++ ) {
+			sl->sl_sids[i] = oldcsn[i].sc_sid;
+			ber_str2bv( oldcsn[i].sc_csn, oldcsn[i].sc_len,
+				1, &sl->sl_mincsn[i] );
+		}
+		BER_BVZERO( &sl->sl_mincsn[i] );
+		slap_sort_csn_sids( sl->sl_mincsn, sl->sl_sids, sl->sl_numcsns, NULL );
+		Debug( LDAP_DEBUG_SYNC, "syncprov_db_open: "
+			"loaded %d of %llu sessionlog entries from \"%s\"\n",
+			loaded, next - first, si->si_logfile );
+	} else {
+		if ( !memcmp( sh->sh_magic, SLOG_FILE_MAGIC, sizeof( sh->sh_magic )) ) {
+			Debug( LDAP_DEBUG_ANY, "syncprov_db_open: "
+				"sessionlog file \"%s\" does not match the database, "
+				"discarding it\n",
+				si->si_logfile );
+		}
+		if ( sl->sl_entries ) {
+			ldap_tavl_free( sl->sl_entries, (AVL_FREE)ch_free );
+			sl->sl_entries = NULL;
+			sl->sl_num = 0;
+		}
+		if ( ftruncate( fd, 0 ) ) {
+			Debug( LDAP_DEBUG_ANY, "syncprov_db_open: "
+				"cannot truncate sessionlog file \"%s\"\n",
+				si->si_logfile );
+			goto fail;
+		}
+		memset( sh, 0, sizeof( *sh ));
+		AC_MEMCPY( sh->sh_magic, SLOG_FILE_MAGIC, sizeof( sh->sh_magic ));
+		sh->sh_recsize = sizeof( slog_filerec );
+		sh->sh_nslots = nslots;
+		sf->sf_next = 1;
+		if ( slog_file_reset( si, sf )) {
+			Debug( LDAP_DEBUG_ANY, "syncprov_db_open: "
+				"cannot initialize sessionlog file \"%s\"\n",
+				si->si_logfile );
+			goto fail;
+		}
+	}
+	ch_free( sr );
+	sf->sf_ok = 1;
+	sl->sl_file = sf;
+	return;
 
-	if ( mod.sml_next != NULL ) {
-		slap_mods_free( mod.sml_next, 1 );
-	}
-#ifdef CHECK_CSN
-	for ( i=0; i<si->si_numcsns; i++ ) {
-		assert( !syn->ssyn_validate( syn, si->si_ctxcsn+i ));
+fail:
+	ch_free( sr );
+	ldap_pvt_thread_mutex_destroy( &sf->sf_iomutex );
+	close( fd );
+	ch_free( sf );
+}
+
+static void
+syncprov_slog_close( syncprov_info_t *si )
+{
+	sessionlog *sl = si->si_logs;
+	slog_file *sf = sl->sl_file;
+
+	ldap_pvt_thread_rdwr_wlock( &sl->sl_mutex );
+	if ( sf->sf_ok && fsync( sf->sf_fd )) {
+		Debug( LDAP_DEBUG_ANY, "syncprov_db_close: "
+			"cannot sync sessionlog file \"%s\"\n",
+			si->si_logfile );
 	}
-#endif
+	close( sf->sf_fd );
+	sl->sl_file = NULL;
+	ldap_pvt_thread_rdwr_wunlock( &sl->sl_mutex );
+	ldap_pvt_thread_mutex_destroy( &sf->sf_iomutex );
+	ch_free( sf );
+}
+
+/* Append a new sessionlog entry to the file. Called with sl_mutex
+ * write-locked.
+ */
+static void
+syncprov_slog_write( sessionlog *sl, slog_entry *se )
+{
+	slog_file *sf = sl->sl_file;
+	slog_filehdr *sh = &sf->sf_hdr;
+	slog_filerec sr;
+
+	if ( !sf->sf_ok )
+		return;
+
+	/* Adds have no UUID recorded, they are skipped on playback anyway */
+	if (( se->se_uuid.bv_len != UUID_LEN && se->se_tag != LDAP_REQ_ADD ) ||
+		se->se_csn.bv_len >= LDAP_PVT_CSNSTR_BUFSIZE )
+		goto fail;
+
+	if ( sf->sf_next - sf->sf_first >= sh->sh_nslots ) {
+		struct berval csn;
+
+		/* The oldest record is about to be overwritten, the header
+		 * has to stop claiming it first.
+		 */
+		if ( slog_file_read( sf, sf->sf_first, &sr, 1 ) != 1 ||
+			!slog_file_recok( &sr, sf->sf_first ))
+			goto fail;
+		csn.bv_val = sr.sr_csn;
+		csn.bv_len = sr.sr_csnlen;
+		if ( slog_file_raise( sh->sh_mincsn, &sh->sh_nmin, sr.sr_sid, &csn ) ||
+			slog_file_puthdr( sf ))
+			goto fail;
+		sf->sf_first++;
+	}
+
+	memset( &sr, 0, sizeof( sr ));
+	sr.sr_seq = sf->sf_next;
+	if ( se->se_uuid.bv_len == UUID_LEN )
+		AC_MEMCPY( sr.sr_uuid, se->se_uuid.bv_val, UUID_LEN );
+	sr.sr_tag = se->se_tag;
+	sr.sr_sid = se->se_sid;
+	sr.sr_csnlen = se->se_csn.bv_len;
+	AC_MEMCPY( sr.sr_csn, se->se_csn.bv_val, se->se_csn.bv_len );
+	sr.sr_sum = slog_file_sum( &sr );
+	if ( slog_file_io( sf, &sr, sizeof( sr ),
+		SLOG_FILE_OFF( sh, sf->sf_next ), 1 ) != sizeof( sr ))
+		goto fail;
+	sf->sf_next++;
+	return;
+
+fail:
+	Debug( LDAP_DEBUG_ANY, "syncprov_add_slog: "
+		"cannot update sessionlog file, it will be discarded on restart\n" );
+	sf->sf_ok = 0;
 }
 
 static void
@@ -1663,6 +2651,13 @@ syncprov_add_slog( Operation *op )
 				sl->sl_num = 0;
 				sl->sl_entries = NULL;
 			}
+			if ( sl->sl_file && sl->sl_file->sf_ok ) {
+				/* Readers of the file notice they have been lapped */
+				ldap_pvt_thread_rdwr_rlock( &si->si_csn_rwlock );
+				if ( slog_file_reset( si, sl->sl_file ))
+					sl->sl_file->sf_ok = 0;
+				ldap_pvt_thread_rdwr_runlock( &si->si_csn_rwlock );
+			}
 			ldap_pvt_thread_rdwr_wunlock( &sl->sl_mutex );
 			return;
 		}
@@ -1711,6 +2706,8 @@ syncprov_add_slog( Operation *op )
 			ch_free( se );
 			goto leave;
 		}
+		if ( sl->sl_file )
+			syncprov_slog_write( sl, se );
 		sl->sl_num++;
 		if ( !sl->sl_playing && sl->sl_num > sl->sl_size ) {
 			TAvlnode *edge = ldap_tavl_end( sl->sl_entries, TAVL_DIR_LEFT );
@@ -1821,6 +2818,122 @@ check_uuidlist_presence(
 	return mods;
 }
 
+/*
+ * Only pick changes that are both:
+ * - newer than cookieCSN (srs->sr_state.ctxcsn)
+ * - not newer than snapshot ctxcsn (uuid_progress->ctxcsn)
+ */
+static int
+syncprov_playback_inrange( Operation *op,
+		syncprov_accesslog_deletes *uuid_progress, struct berval *csn )
+{
+	sync_control *srs = uuid_progress->srs;
+	int cmp, sid, i;
+
+	sid = slap_parse_csn_sid( csn );
+
+	cmp = 1;
+	for ( i=0; i<srs->sr_state.numcsns; i++ ) {
+		if ( sid == srs->sr_state.sids[i] ) {
+			cmp = ber_bvcmp( csn, &srs->sr_state.ctxcsn[i] );
+			break;
+		}
+	}
+	if ( cmp <= 0 ) {
+		Debug( LDAP_DEBUG_SYNC, "%s syncprov_playback_inrange: "
+				"cmp %d, csn %s too old\n",
+				op->o_log_prefix, cmp, csn->bv_val );
+		return 0;
+	}
+
+	cmp = 0;
+	for ( i=0; i<uuid_progress->numcsns; i++ ) {
+		if ( sid == uuid_progress->sids[i] ) {
+			cmp = ber_bvcmp( csn, &uuid_progress->ctxcsn[i] );
+			break;
+		}
+	}
+	if ( cmp > 0 ) {
+		Debug( LDAP_DEBUG_SYNC, "%s syncprov_playback_inrange: "
+				"cmp %d, csn %s too new\n",
+				op->o_log_prefix, cmp, csn->bv_val );
+		return 0;
+	}
+	return 1;
+}
+
+/*
+ * Unless we have handled this entry already, send a delete for it if it
+ * is gone or no longer in scope, and remember we've handled it.
+ *
+ * If we exhaust the list, clear it, forgetting entries we've handled so far.
+ */
+static void
+syncprov_playback_uuid( Operation *op,
+		syncprov_accesslog_deletes *uuid_progress,
+		struct berval *csn, struct berval *entryuuid, int is_delete )
+{
+	sync_control *srs = uuid_progress->srs;
+	struct berval *bv, csns[2] = {}, uuid[2] = {};
+	char uuidstr[40];
+	int i, rc;
+
+	uuid[0] = *entryuuid;
+	uuidstr[0] = '\0';
+	if ( LogTest( LDAP_DEBUG_SYNC ) ) {
+		lutil_uuidstr_from_normalized( uuid[0].bv_val, uuid[0].bv_len,
+			uuidstr, sizeof( uuidstr ) );
+	}
+
+	bv = ldap_avl_find( uuid_progress->uuids, uuid, sp_uuid_cmp );
+	if ( bv ) {
+		/* Already checked or sent, no change */
+		Debug( LDAP_DEBUG_SYNC, "%s syncprov_playback_uuid: "
+				"uuid %s already checked\n",
+				op->o_log_prefix, uuidstr );
+		return;
+	}
+
+	if ( !is_delete ) {
+		is_delete = check_uuidlist_presence( uuid_progress->op, uuid, 1, 1 );
+	}
+	Debug( LDAP_DEBUG_SYNC, "%s syncprov_playback_uuid: "
+			"uuid %s is %s present\n",
+			op->o_log_prefix, uuidstr,
+			is_delete ? "no longer" : "still" );
+
+	i = uuid_progress->ndel++;
+
+	bv = &uuid_progress->uuid_list[i];
+	bv->bv_val = &uuid_progress->uuid_buf[i*UUID_LEN];
+	bv->bv_len = entryuuid->bv_len;
+	AC_MEMCPY( bv->bv_val, entryuuid->bv_val, entryuuid->bv_len );
+
+	rc = ldap_avl_insert( &uuid_progress->uuids, bv, sp_uuid_cmp, ldap_avl_dup_error );
+	assert( rc == LDAP_SUCCESS );
+
+	if ( is_delete ) {
+		struct berval cookie;
+
+		csns[0] = *csn;
+		slap_compose_sync_cookie( op, &cookie, srs->sr_state.ctxcsn,
+				srs->sr_state.rid, slap_serverID ? slap_serverID : -1, csns );
+		syncprov_sendinfo( uuid_progress->op, uuid_progress->rs,
+				LDAP_TAG_SYNC_ID_SET, &cookie, 0, uuid, 1 );
+		op->o_tmpfree( cookie.bv_val, op->o_tmpmemctx );
+	}
+
+	if ( uuid_progress->ndel >= uuid_progress->list_len ) {
+		int ndel;
+
+		assert( uuid_progress->ndel == uuid_progress->list_len );
+		ndel = ldap_avl_free( uuid_progress->uuids, NULL );
+		assert( ndel == uuid_progress->ndel );
+		uuid_progress->uuids = NULL;
+		uuid_progress->ndel = 0;
+	}
+}
+
 /*
  * On each entry we get from the DB:
  * - if it's an ADD, skip
@@ -1828,8 +2941,6 @@ check_uuidlist_presence(
  * - check if it's a DELETE or missing from the DB now
  *   - send a new syncinfo entry
  * - remember we've handled it already
- *
- * If we exhaust the list, clear it, forgetting entries we've handled so far.
  */
 static int
 syncprov_accesslog_uuid_cb( Operation *op, SlapReply *rs )
@@ -1837,12 +2948,11 @@ syncprov_accesslog_uuid_cb( Operation *op, SlapReply *rs )
 	slap_callback *sc = op->o_callback;
 	syncprov_accesslog_deletes *uuid_progress = sc->sc_private;
 	Attribute *a, *attrs;
-	sync_control *srs = uuid_progress->srs;
-	struct berval *bv, csn[2] = {}, uuid[2] = {},
+	struct berval csn,
 				  add = BER_BVC("add"),
 				  delete = BER_BVC("delete"),
 				  modrdn = BER_BVC("modrdn");
-	int cmp, sid, i, is_delete = 0, rc;
+	int is_delete = 0;
 
 	if ( rs->sr_type != REP_SEARCH ) {
 		return rs->sr_err;
@@ -1887,49 +2997,14 @@ syncprov_accesslog_uuid_cb( Operation *op, SlapReply *rs )
 		}
 	}
 
-	/*
-	 * Only pick entries that are both:
-	 */
 	a = attr_find( attrs, slap_schema.si_ad_entryCSN );
 	if ( !a || a->a_numvals == 0 ) {
 		rs->sr_err = LDAP_CONSTRAINT_VIOLATION;
 		return rs->sr_err;
 	}
-	csn[0] = a->a_nvals[0];
-
-	sid = slap_parse_csn_sid( &csn[0] );
-
-	/*
-	 * newer than cookieCSN (srs->sr_state.ctxcsn)
-	 */
-	cmp = 1;
-	for ( i=0; i<srs->sr_state.numcsns; i++ ) {
-		if ( sid == srs->sr_state.sids[i] ) {
-			cmp = ber_bvcmp( &csn[0], &srs->sr_state.ctxcsn[i] );
-			break;
-		}
-	}
-	if ( cmp <= 0 ) {
-		Debug( LDAP_DEBUG_SYNC, "%s syncprov_accesslog_uuid_cb: "
-				"cmp %d, csn %s too old\n",
-				op->o_log_prefix, cmp, csn[0].bv_val );
-		return rs->sr_err;
-	}
+	csn = a->a_nvals[0];
 
-	/*
-	 * not newer than snapshot ctxcsn (uuid_progress->ctxcsn)
-	 */
-	cmp = 0;
-	for ( i=0; i<uuid_progress->numcsns; i++ ) {
-		if ( sid == uuid_progress->sids[i] ) {
-			cmp = ber_bvcmp( &csn[0], &uuid_progress->ctxcsn[i] );
-			break;
-		}
-	}
-	if ( cmp > 0 ) {
-		Debug( LDAP_DEBUG_SYNC, "%s syncprov_accesslog_uuid_cb: "
-				"cmp %d, csn %s too new\n",
-				op->o_log_prefix, cmp, csn[0].bv_val );
+	if ( !syncprov_playback_inrange( op, uuid_progress, &csn ) ) {
 		return rs->sr_err;
 	}
 
@@ -1938,56 +3013,116 @@ syncprov_accesslog_uuid_cb( Operation *op, SlapReply *rs )
 		rs->sr_err = LDAP_CONSTRAINT_VIOLATION;
 		return rs->sr_err;
 	}
-	uuid[0] = a->a_nvals[0];
 
-	bv = ldap_avl_find( uuid_progress->uuids, uuid, sp_uuid_cmp );
-	if ( bv ) {
-		/* Already checked or sent, no change */
-		Debug( LDAP_DEBUG_SYNC, "%s syncprov_accesslog_uuid_cb: "
-				"uuid %s already checked\n",
-				op->o_log_prefix, a->a_vals[0].bv_val );
-		return rs->sr_err;
+	syncprov_playback_uuid( op, uuid_progress, &csn, &a->a_nvals[0], is_delete );
+
+	return rs->sr_err;
+}
+
+/*
+ * Play back the sessionlog file for a consumer whose cookie is older
+ * than what the in-memory log holds. The file is read a batch at a time
+ * so that writers can go on meanwhile; if they wrap around the ring past
+ * the records still to be read, give up and let the caller fall back to
+ * a present phase.
+ */
+static int
+syncprov_play_slogfile( Operation *op, SlapReply *rs, sync_control *srs,
+		BerVarray ctxcsn, int numcsns, int *sids,
+		struct berval *mincsn, int minsid )
+{
+	slap_overinst		*on = (slap_overinst *)op->o_bd->bd_info;
+	syncprov_info_t *si = (syncprov_info_t *)on->on_bi.bi_private;
+	sessionlog *sl = si->si_logs;
+	slog_file *sf;
+	slog_filecsn *sc;
+	slog_filerec *sr;
+	syncprov_accesslog_deletes uuid_progress = {
+		.op = op,
+		.rs = rs,
+		.srs = srs,
+		.ctxcsn = ctxcsn,
+		.numcsns = numcsns,
+		.sids = sids,
+	};
+	unsigned long long seq, next;
+	int i, n, rc = -1;
+
+	ldap_pvt_thread_rdwr_rlock( &sl->sl_mutex );
+	sf = sl->sl_file;
+	if ( !sf || !sf->sf_ok || sf->sf_first == sf->sf_next ) {
+		ldap_pvt_thread_rdwr_runlock( &sl->sl_mutex );
+		return rc;
 	}
+	/* SID not present == new enough */
+	sc = slog_file_findcsn( sf->sf_hdr.sh_mincsn, sf->sf_hdr.sh_nmin, minsid );
+	if ( sc ) {
+		struct berval csn;
 
-	if ( !is_delete ) {
-		is_delete = check_uuidlist_presence( uuid_progress->op, uuid, 1, 1 );
+		csn.bv_val = sc->sc_csn;
+		csn.bv_len = sc->sc_len;
+		if ( ber_bvcmp( mincsn, &csn ) < 0 ) {
+			ldap_pvt_thread_rdwr_runlock( &sl->sl_mutex );
+			return rc;
+		}
 	}
-	Debug( LDAP_DEBUG_SYNC, "%s syncprov_accesslog_uuid_cb: "
-			"uuid %s is %s present\n",
-			op->o_log_prefix, a->a_vals[0].bv_val,
-			is_delete ? "no longer" : "still" );
+	seq = sf->sf_first;
+	next = sf->sf_next;
+	ldap_pvt_thread_rdwr_runlock( &sl->sl_mutex );
 
-	i = uuid_progress->ndel++;
+	Debug( LDAP_DEBUG_SYNC, "%s syncprov_play_slogfile: "
+		"playing back %llu entries from \"%s\"\n",
+		op->o_log_prefix, next - seq, si->si_logfile );
 
-	bv = &uuid_progress->uuid_list[i];
-	bv->bv_val = &uuid_progress->uuid_buf[i*UUID_LEN];
-	bv->bv_len = a->a_nvals[0].bv_len;
-	AC_MEMCPY( bv->bv_val, a->a_nvals[0].bv_val, a->a_nvals[0].bv_len );
+	uuid_progress.list_len = SLAP_SYNCUUID_SET_SIZE;
+	uuid_progress.uuid_list = op->o_tmpalloc( (uuid_progress.list_len) * sizeof(struct berval), op->o_tmpmemctx );
+	uuid_progress.uuid_buf = op->o_tmpalloc( (uuid_progress.list_len) * UUID_LEN, op->o_tmpmemctx );
+	sr = op->o_tmpalloc( SLOG_FILE_BATCH * sizeof( slog_filerec ), op->o_tmpmemctx );
 
-	rc = ldap_avl_insert( &uuid_progress->uuids, bv, sp_uuid_cmp, ldap_avl_dup_error );
-	assert( rc == LDAP_SUCCESS );
+	rc = LDAP_SUCCESS;
+	while ( rc == LDAP_SUCCESS && seq < next ) {
+		n = next - seq > SLOG_FILE_BATCH ? SLOG_FILE_BATCH : next - seq;
+		ldap_pvt_thread_rdwr_rlock( &sl->sl_mutex );
+		if ( sl->sl_file != sf || !sf->sf_ok || sf->sf_first > seq )
+			n = -1;
+		else
+			n = slog_file_read( sf, seq, sr, n );
+		ldap_pvt_thread_rdwr_runlock( &sl->sl_mutex );
+		if ( n <= 0 ) {
+			Debug( LDAP_DEBUG_SYNC, "%s syncprov_play_slogfile: "
+				"sessionlog file overrun at entry %llu\n",
+				op->o_log_prefix, seq );
+			rc = -1;
+			break;
+		}
 
-	if ( is_delete ) {
-		struct berval cookie;
+		for ( i=0; i<n; i++, seq++ ) {
+			struct berval csn, uuid;
 
-		slap_compose_sync_cookie( op, &cookie, srs->sr_state.ctxcsn,
-				srs->sr_state.rid, slap_serverID ? slap_serverID : -1, csn );
-		syncprov_sendinfo( uuid_progress->op, uuid_progress->rs,
-				LDAP_TAG_SYNC_ID_SET, &cookie, 0, uuid, 1 );
-		op->o_tmpfree( cookie.bv_val, op->o_tmpmemctx );
+			if ( !slog_file_recok( &sr[i], seq ) ) {
+				rc = -1;
+				break;
+			}
+			if ( sr[i].sr_tag == LDAP_REQ_ADD )
+				continue;
+			csn.bv_val = sr[i].sr_csn;
+			csn.bv_len = sr[i].sr_csnlen;
+			csn.bv_val[csn.bv_len] = '\0';
+			if ( !syncprov_playback_inrange( op, &uuid_progress, &csn ) )
+				continue;
+			uuid.bv_val = (char *)sr[i].sr_uuid;
+			uuid.bv_len = UUID_LEN;
+			syncprov_playback_uuid( op, &uuid_progress, &csn, &uuid,
+				sr[i].sr_tag == LDAP_REQ_DELETE );
+		}
 	}
 
-	if ( uuid_progress->ndel >= uuid_progress->list_len ) {
-		int ndel;
-
-		assert( uuid_progress->ndel == uuid_progress->list_len );
-		ndel = ldap_avl_free( uuid_progress->uuids, NULL );
-		assert( ndel == uuid_progress->ndel );
-		uuid_progress->uuids = NULL;
-		uuid_progress->ndel = 0;
-	}
+	ldap_avl_free( uuid_progress.uuids, NULL );
+	op->o_tmpfree( sr, op->o_tmpmemctx );
+	op->o_tmpfree( uuid_progress.uuid_buf, op->o_tmpmemctx );
+	op->o_tmpfree( uuid_progress.uuid_list, op->o_tmpmemctx );
 
-	return rs->sr_err;
+	return rc;
 }
 
 static int
@@ -1998,7 +3133,7 @@ syncprov_play_sessionlog( Operation *op, SlapReply *rs, sync_control *srs,
 	slap_overinst		*on = (slap_overinst *)op->o_bd->bd_info;
 	syncprov_info_t *si = (syncprov_info_t *)on->on_bi.bi_private;
 	sessionlog *sl = si->si_logs;
-	int i, j, ndel, num, nmods, mmods, do_play = 0, rc = -1;
+	int i, j, ndel, num, nmods, mmods, do_play = 0;
 	BerVarray uuids, csns;
 	struct berval uuid[2] = {}, csn[2] = {};
 	slog_entry *se;
@@ -2012,7 +3147,8 @@ syncprov_play_sessionlog( Operation *op, SlapReply *rs, sync_control *srs,
 	 */
 	if ( !sl->sl_num ) {
 		ldap_pvt_thread_rdwr_wunlock( &sl->sl_mutex );
-		return rc;
+		return syncprov_play_slogfile( op, rs, srs, ctxcsn, numcsns, sids,
+				mincsn, minsid );
 	}
 	assert( sl->sl_num > 0 );
 
@@ -2036,7 +3172,8 @@ syncprov_play_sessionlog( Operation *op, SlapReply *rs, sync_control *srs,
 
 	if ( !do_play ) {
 		ldap_pvt_thread_rdwr_wunlock( &sl->sl_mutex );
-		return rc;
+		return syncprov_play_slogfile( op, rs, srs, ctxcsn, numcsns, sids,
+				mincsn, minsid );
 	}
 
 	num = sl->sl_num;
@@ -2905,6 +4042,13 @@ syncprov_detach_op( Operation *op, syncops *so, slap_overinst *on )
 	op2->ors_filter = filter_dup( op2->ors_filter, NULL );
 	so->s_op = op2;
 
+	/* the compiled filter refers to the original op's filter */
+	if ( so->s_fprog ) {
+		filter_prog_free( so->s_fprog, NULL );
+		so->s_fprog = NULL;
+	}
+	so->s_fsrc = NULL;
+
 	/* Copy any cached group ACLs individually */
 	op2->o_groups = NULL;
 	for ( g1=op->o_groups; g1; g1=g1->ga_next ) {
@@ -3172,6 +4316,7 @@ aband:
 		sop->s_next = si->si_ops;
 		sop->s_si = si;
 		si->si_ops = sop;
+		si->si_ops_gen++;
 		ldap_pvt_thread_mutex_unlock( &si->si_ops_mutex );
 		Debug( LDAP_DEBUG_SYNC, "%s syncprov_op_search: "
 			"registered persistent search\n", op->o_log_prefix );
@@ -3288,6 +4433,7 @@ bailout:
 					while ( *sp != sop )
 						sp = &(*sp)->s_next;
 					*sp = sop->s_next;
+					si->si_ops_gen++;
 					ldap_pvt_thread_mutex_unlock( &si->si_ops_mutex );
 					ch_free( sop->s_base.bv_val );
 					ch_free( sop );
@@ -3635,7 +4781,10 @@ enum {
 	SP_SESSL,
 	SP_NOPRES,
 	SP_USEHINT,
-	SP_LOGDB
+	SP_LOGDB,
+	SP_QLIMIT,
+	SP_LOGFILE,
+	SP_LOGFILESIZE
 };
 
 static ConfigDriver sp_cf_gen;
@@ -3665,6 +4814,21 @@ static ConfigTable spcfg[] = {
 		sp_cf_gen, "( OLcfgOvAt:1.5 NAME 'olcSpSessionlogSource' "
 			"DESC 'On startup, try loading sessionlog from this subtree' "
 			"SYNTAX OMsDN SINGLE-VALUE )", NULL, NULL },
+	{ "syncprov-queuelimit", "responses", 2, 2, 0, ARG_INT|ARG_MAGIC|SP_QLIMIT,
+		sp_cf_gen, "( OLcfgOvAt:1.6 NAME 'olcSpQueueLimit' "
+			"DESC 'Max responses queued for a persistent search' "
+			"EQUALITY integerMatch "
+			"SYNTAX OMsInteger SINGLE-VALUE )", NULL, NULL },
+	{ "syncprov-sessionlog-file", "filename", 2, 2, 0, ARG_STRING|ARG_MAGIC|SP_LOGFILE,
+		sp_cf_gen, "( OLcfgOvAt:1.7 NAME 'olcSpSessionlogFile' "
+			"DESC 'File to keep the session log in across restarts' "
+			"EQUALITY caseExactMatch "
+			"SYNTAX OMsDirectoryString SINGLE-VALUE )", NULL, NULL },
+	{ "syncprov-sessionlog-filesize", "ops", 2, 2, 0, ARG_INT|ARG_MAGIC|SP_LOGFILESIZE,
+		sp_cf_gen, "( OLcfgOvAt:1.8 NAME 'olcSpSessionlogFileSize' "
+			"DESC 'Session log file size in ops' "
+			"EQUALITY integerMatch "
+			"SYNTAX OMsInteger SINGLE-VALUE )", NULL, NULL },
 	{ NULL, NULL, 0, 0, 0, ARG_IGNORED }
 };
 
@@ -3678,6 +4842,9 @@ static ConfigOCs spocs[] = {
 			"$ olcSpNoPresent "
 			"$ olcSpReloadHint "
 			"$ olcSpSessionlogSource "
+			"$ olcSpQueueLimit "
+			"$ olcSpSessionlogFile "
+			"$ olcSpSessionlogFileSize "
 		") )",
 			Cft_Overlay, spcfg },
 	{ NULL, 0, NULL }
@@ -3739,6 +4906,27 @@ sp_cf_gen(ConfigArgs *c)
 				value_add_one( &c->rvalue_nvals, &si->si_logbase );
 			}
 			break;
+		case SP_QLIMIT:
+			if ( si->si_qlimit ) {
+				c->value_int = si->si_qlimit;
+			} else {
+				rc = 1;
+			}
+			break;
+		case SP_LOGFILE:
+			if ( si->si_logfile ) {
+				c->value_string = ch_strdup( si->si_logfile );
+			} else {
+				rc = 1;
+			}
+			break;
+		case SP_LOGFILESIZE:
+			if ( si->si_logfilesize ) {
+				c->value_int = si->si_logfilesize;
+			} else {
+				rc = 1;
+			}
+			break;
 		}
 		return rc;
 	} else if ( c->op == LDAP_MOD_DELETE ) {
@@ -3763,6 +4951,18 @@ sp_cf_gen(ConfigArgs *c)
 				BER_BVZERO( &si->si_logbase );
 			}
 			break;
+		case SP_QLIMIT:
+			si->si_qlimit = 0;
+			break;
+		case SP_LOGFILE:
+			if ( si->si_logfile ) {
+				ch_free( si->si_logfile );
+				si->si_logfile = NULL;
+			}
+			break;
+		case SP_LOGFILESIZE:
+			si->si_logfilesize = 0;
+			break;
 		}
 		return rc;
 	}
@@ -3856,6 +5056,31 @@ sp_cf_gen(ConfigArgs *c)
 		rc = syncprov_setup_accesslog();
 		ch_free( c->value_dn.bv_val );
 		break;
+	case SP_QLIMIT:
+		if ( c->value_int < 0 ) {
+			snprintf( c->cr_msg, sizeof( c->cr_msg ), "%s limit %d is negative",
+				c->argv[0], c->value_int );
+			Debug( LDAP_DEBUG_CONFIG|LDAP_DEBUG_NONE,
+				"%s: %s\n", c->log, c->cr_msg );
+			return ARG_BAD_CONF;
+		}
+		si->si_qlimit = c->value_int;
+		break;
+	case SP_LOGFILE:
+		if ( si->si_logfile )
+			ch_free( si->si_logfile );
+		si->si_logfile = c->value_string;
+		break;
+	case SP_LOGFILESIZE:
+		if ( c->value_int < 0 ) {
+			snprintf( c->cr_msg, sizeof( c->cr_msg ), "%s size %d is negative",
+				c->argv[0], c->value_int );
+			Debug( LDAP_DEBUG_CONFIG|LDAP_DEBUG_NONE,
+				"%s: %s\n", c->log, c->cr_msg );
+			return ARG_BAD_CONF;
+		}
+		si->si_logfilesize = c->value_int;
+		break;
 	}
 	return rc;
 }
@@ -4058,6 +5283,12 @@ syncprov_db_open(
 	}
 
 out:
+	/* An empty database gets a sessionlog file too */
+	if ( si->si_logfile && si->si_logs && si->si_logs->sl_size &&
+		!si->si_logs->sl_file ) {
+		syncprov_slog_open( si );
+	}
+
 	op->o_bd->bd_info = (BackendInfo *)on;
 	return 0;
 }
@@ -4093,6 +5324,9 @@ syncprov_db_close(
 		op->o_ndn = be->be_rootndn;
 		syncprov_checkpoint( op, on );
 	}
+	if ( si->si_logs && si->si_logs->sl_file ) {
+		syncprov_slog_close( si );
+	}
 
 #ifdef SLAP_CONFIG_DELETE
 	if ( !slapd_shutdown ) {
@@ -4110,6 +5344,7 @@ syncprov_db_close(
 				so->s_si = NULL;
 		}
 		si->si_ops=NULL;
+		si->si_ops_gen++;
 		ldap_pvt_thread_mutex_unlock( &si->si_ops_mutex );
 	}
 	overlay_unregister_control( be, LDAP_CONTROL_SYNC );
@@ -4179,6 +5414,9 @@ syncprov_db_destroy(
 			ch_free( si->si_sids );
 		if ( si->si_logbase.bv_val )
 			ch_free( si->si_logbase.bv_val );
+		if ( si->si_logfile )
+			ch_free( si->si_logfile );
+		syncprov_psindex_free( si );
 		ldap_pvt_thread_mutex_destroy( &si->si_resp_mutex );
 		ldap_pvt_thread_mutex_destroy( &si->si_mods_mutex );
 		ldap_pvt_thread_mutex_destroy( &si->si_ops_mutex );
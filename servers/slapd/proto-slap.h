@@ -937,6 +937,19 @@ LDAP_SLAPD_F (int) dnPrettyNormal LDAP_P((
 	struct berval *normal,
 	void *ctx ));
 
+LDAP_SLAPD_F (int) dnPrettyNormalCached LDAP_P((
+	struct berval *val,
+	struct berval *pretty,
+	struct berval *normal,
+	void *ctx ));
+
+LDAP_SLAPD_V (unsigned int) slap_dn_cache_size;
+LDAP_SLAPD_F (int) dn_cache_init LDAP_P(( unsigned int size ));
+LDAP_SLAPD_F (void) dn_cache_destroy LDAP_P(( void ));
+LDAP_SLAPD_F (void) dn_cache_flush LDAP_P(( void ));
+LDAP_SLAPD_F (void) dn_cache_stats LDAP_P(( unsigned long *hits,
+	unsigned long *misses, unsigned long *evictions ));
+
 LDAP_SLAPD_F (int) dnMatch LDAP_P(( 
 	int *matchp, 
 	slap_mask_t flags, 
@@ -1053,6 +1066,7 @@ LDAP_SLAPD_V( const struct berval ) slap_EXOP_CANCEL;
 LDAP_SLAPD_V( const struct berval ) slap_EXOP_WHOAMI;
 LDAP_SLAPD_V( const struct berval ) slap_EXOP_MODIFY_PASSWD;
 LDAP_SLAPD_V( const struct berval ) slap_EXOP_START_TLS;
+LDAP_SLAPD_V( const struct berval ) slap_EXOP_START_COMPRESS;
 LDAP_SLAPD_V( const struct berval ) slap_EXOP_TXN_START;
 LDAP_SLAPD_V( const struct berval ) slap_EXOP_TXN_END;
 
@@ -1130,6 +1144,10 @@ LDAP_SLAPD_F (void) filter_destroy LDAP_P(( void ));
  */
 
 LDAP_SLAPD_F (int) test_filter LDAP_P(( Operation *op, Entry *e, Filter *f ));
+LDAP_SLAPD_F (FilterProg *) filter_compile LDAP_P(( Filter *f, void *memctx ));
+LDAP_SLAPD_F (void) filter_prog_free LDAP_P(( FilterProg *fp, void *memctx ));
+LDAP_SLAPD_F (int) test_filter_prog LDAP_P(( Operation *op, Entry *e,
+	FilterProg *fp ));
 
 /*
  * frontend.c
@@ -1636,6 +1654,8 @@ LDAP_SLAPD_F (void) slap_send_ldap_intermediate LDAP_P(( Operation *op, SlapRepl
 LDAP_SLAPD_F (void) slap_send_search_result LDAP_P(( Operation *op, SlapReply *rs ));
 LDAP_SLAPD_F (int) slap_send_search_reference LDAP_P(( Operation *op, SlapReply *rs ));
 LDAP_SLAPD_F (int) slap_send_search_entry LDAP_P(( Operation *op, SlapReply *rs ));
+LDAP_SLAPD_F (int) slap_send_search_entry_ber LDAP_P(( Operation *op,
+	SlapReply *rs, struct berval *body ));
 LDAP_SLAPD_F (int) slap_null_cb LDAP_P(( Operation *op, SlapReply *rs ));
 LDAP_SLAPD_F (int) slap_freeself_cb LDAP_P(( Operation *op, SlapReply *rs ));
 
@@ -1807,6 +1827,8 @@ LDAP_SLAPD_F (int) slap_schema_init LDAP_P((void));
 LDAP_SLAPD_F (void) schema_destroy LDAP_P(( void ));
 
 LDAP_SLAPD_F (int) slap_hash64 LDAP_P((int));
+LDAP_SLAPD_F (int) slap_index_hash LDAP_P((int));
+LDAP_SLAPD_V (slap_verbmasks) slap_index_hashes[];
 
 LDAP_SLAPD_F( slap_mr_indexer_func ) octetStringIndexer;
 LDAP_SLAPD_F( slap_mr_filter_func ) octetStringFilter;
@@ -1889,6 +1911,13 @@ LDAP_SLAPD_F (void *) slap_sl_mem_create LDAP_P((
 LDAP_SLAPD_F (void) slap_sl_mem_setctx LDAP_P(( void *ctx, void *memctx ));
 LDAP_SLAPD_F (void) slap_sl_mem_destroy LDAP_P(( void *key, void *data ));
 LDAP_SLAPD_F (void *) slap_sl_context LDAP_P(( void *ptr ));
+LDAP_SLAPD_F (int) slap_sl_mem_foreach LDAP_P((
+	slap_sl_stats_func *func, void *arg ));
+
+/*
+ * compress.c
+ */
+LDAP_SLAPD_F (SLAP_EXTOP_MAIN_FN) compress_extop;
 
 /*
  * starttls.c
@@ -1545,6 +1545,90 @@ error_return:;
 	return( rc );
 }
 
+/* Send a search entry whose protocolOp was encoded beforehand, by
+ * calling send_search_entry() with op->o_res_ber set. Only the message
+ * envelope and rs->sr_ctrls are encoded here, so one encoding can be
+ * sent on behalf of several operations.
+ */
+int
+slap_send_search_entry_ber( Operation *op, SlapReply *rs, struct berval *body )
+{
+	BerElementBuffer berbuf;
+	BerElement	*ber = (BerElement *) &berbuf;
+	struct berval	bv;
+	int		rc, bytes;
+
+	rs->sr_type = REP_SEARCH;
+
+	if ( op->ors_slimit >= 0 && rs->sr_nentries >= op->ors_slimit ) {
+		rc = LDAP_SIZELIMIT_EXCEEDED;
+		goto error_return;
+	}
+
+	bv.bv_len = body->bv_len + 64;
+	bv.bv_val = op->o_tmpalloc( bv.bv_len, op->o_tmpmemctx );
+
+	ber_init2( ber, &bv, LBER_USE_DER );
+	ber_set_option( ber, LBER_OPT_BER_MEMCTX, &op->o_tmpmemctx );
+
+	rc = ber_printf( ber, "{i" /*}*/, op->o_msgid );
+	if ( rc != -1 ) {
+		rc = ber_write( ber, body->bv_val, body->bv_len, 0 );
+	}
+	if ( rc != -1 ) {
+		rc = send_ldap_controls( op, ber, rs->sr_ctrls );
+	}
+	if ( rc != -1 ) {
+		rc = ber_printf( ber, /*{*/ "N}" );
+	}
+
+	if ( rc == -1 ) {
+		Debug( LDAP_DEBUG_ANY,
+			"send_search_entry_ber: conn %lu  ber_printf failed\n",
+			op->o_connid );
+
+		ber_free_buf( ber );
+		set_ldap_error( rs, LDAP_OTHER, "encode entry error" );
+		rc = rs->sr_err;
+		goto error_return;
+	}
+
+	Debug( LDAP_DEBUG_STATS2, "%s ENTRY dn=\"%s\"\n",
+	    op->o_log_prefix, rs->sr_entry->e_nname.bv_val );
+
+	bytes = send_ldap_ber( op, ber );
+	ber_free_buf( ber );
+
+	if ( bytes < 0 ) {
+		Debug( LDAP_DEBUG_ANY,
+			"send_search_entry_ber: conn %lu  ber write failed.\n",
+			op->o_connid );
+
+		rc = LDAP_UNAVAILABLE;
+		goto error_return;
+	}
+	rs->sr_nentries++;
+
+	ldap_pvt_thread_mutex_lock( &op->o_counters->sc_mutex );
+	ldap_pvt_mp_add_ulong( op->o_counters->sc_bytes, (unsigned long)bytes );
+	ldap_pvt_mp_add_ulong( op->o_counters->sc_entries, 1 );
+	ldap_pvt_mp_add_ulong( op->o_counters->sc_pdu, 1 );
+	ldap_pvt_thread_mutex_unlock( &op->o_counters->sc_mutex );
+
+	rc = LDAP_SUCCESS;
+
+error_return:;
+	if ( rs->sr_flags & REP_CTRLS_MUSTBEFREED ) {
+		rs->sr_flags ^= REP_CTRLS_MUSTBEFREED; /* paranoia */
+		if ( rs->sr_ctrls ) {
+			slap_free_ctrls( op, rs->sr_ctrls );
+			rs->sr_ctrls = NULL;
+		}
+	}
+
+	return( rc );
+}
+
 int
 slap_send_search_reference( Operation *op, SlapReply *rs )
 {
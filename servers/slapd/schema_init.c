@@ -112,29 +112,60 @@
 static void (*hashinit)(lutil_HASH_CTX *ctx) = lutil_HASHInit;
 static void (*hashupdate)(lutil_HASH_CTX *ctx,unsigned char const *buf, ber_len_t len) = lutil_HASHUpdate;
 static void (*hashfinal)(unsigned char digest[HASH_BYTES], lutil_HASH_CTX *ctx) = lutil_HASHFinal;
+static void (*hashwindows)(lutil_HASH_CTX *ctx,unsigned char const *buf, ber_len_t len, ber_len_t wlen, unsigned char *digests) = NULL;
 static int hashlen = LUTIL_HASH_BYTES;
+static int hashalg = SLAP_INDEX_HASH_FNV;
 #define HASH_Init(c)			hashinit(c)
 #define HASH_Update(c,buf,len)	hashupdate(c,buf,len)
 #define HASH_Final(d,c)			hashfinal(d,c)
 
-/* Toggle between 32 and 64 bit hashing, default to 32 for compatibility
-   -1 to query, returns 1 if 64 bit, 0 if 32.
-   0/1 to set 32/64, returns 0 on success, -1 on failure */
-int slap_hash64( int onoff )
+static void
+hash_select( void )
 {
-	if ( onoff < 0 ) {
-		return hashlen == LUTIL_HASH64_BYTES;
-	} else if ( onoff ) {
+	if ( hashalg == SLAP_INDEX_HASH_WYHASH ) {
+		/* 32 bit keys are the low half of the 64 bit digest */
+		hashinit = lutil_WYHASHInit;
+		hashupdate = lutil_WYHASHUpdate;
+		hashfinal = lutil_WYHASHFinal;
+		hashwindows = lutil_WYHASHWindows;
+	} else if ( hashlen == LUTIL_HASH64_BYTES ) {
 		hashinit = lutil_HASH64Init;
 		hashupdate = lutil_HASH64Update;
 		hashfinal = lutil_HASH64Final;
-		hashlen = LUTIL_HASH64_BYTES;
+		hashwindows = NULL;
 	} else {
 		hashinit = lutil_HASHInit;
 		hashupdate = lutil_HASHUpdate;
 		hashfinal = lutil_HASHFinal;
-		hashlen = LUTIL_HASH_BYTES;
+		hashwindows = NULL;
+	}
+}
+
+/* Toggle between 32 and 64 bit hashing, default to 32 for compatibility
+   -1 to query, returns 1 if 64 bit, 0 if 32.
+   0/1 to set 32/64, returns 0 on success, -1 on failure */
+int slap_hash64( int onoff )
+{
+	if ( onoff < 0 ) {
+		return hashlen == LUTIL_HASH64_BYTES;
+	}
+	hashlen = onoff ? LUTIL_HASH64_BYTES : LUTIL_HASH_BYTES;
+	hash_select();
+	return 0;
+}
+
+/* Select the index hash function, default to FNV for compatibility
+   -1 to query, returns the current SLAP_INDEX_HASH_* value.
+   Otherwise returns 0 on success, -1 on failure */
+int slap_index_hash( int alg )
+{
+	if ( alg < 0 ) {
+		return hashalg;
+	} else if ( alg != SLAP_INDEX_HASH_FNV && alg != SLAP_INDEX_HASH_WYHASH ) {
+		return -1;
 	}
+	hashalg = alg;
+	hash_select();
 	return 0;
 }
 
@@ -153,9 +184,25 @@ int slap_has64( int onoff )
 		return onoff ? -1 : 0;
 }
 
+int slap_index_hash( int alg )
+{
+	if ( alg < 0 )
+		return SLAP_INDEX_HASH_FNV;
+	else
+		return alg == SLAP_INDEX_HASH_FNV ? 0 : -1;
+}
+
 #endif
 #define HASH_CONTEXT			lutil_HASH_CTX
 
+/* Names of the index hash functions, as used in the config and
+ * recorded in databases */
+slap_verbmasks slap_index_hashes[] = {
+	{ BER_BVC("fnv"),		SLAP_INDEX_HASH_FNV },
+	{ BER_BVC("wyhash"),	SLAP_INDEX_HASH_WYHASH },
+	{ BER_BVNULL,			0 }
+};
+
 /* approx matching rules */
 #define directoryStringApproxMatchOID	"1.3.6.1.4.1.4203.666.4.4"
 #define directoryStringApproxMatch		approxMatch
@@ -721,6 +768,31 @@ hashIter(
 	HASH_Final( HASHdigest, &ctx );
 }
 
+/* Set HASHdigests from HASHcontext for every wlen window of value:len,
+ * HASH_BYTES apart */
+static void
+hashWindows(
+	HASH_CONTEXT *HASHcontext,
+	unsigned char *HASHdigests,
+	unsigned char *value,
+	ber_len_t len,
+	ber_len_t wlen)
+{
+	ber_len_t j;
+
+#ifdef LUTIL_HASH64_BYTES
+	if ( hashwindows ) {
+		hashwindows( HASHcontext, value, len, wlen, HASHdigests );
+		return;
+	}
+#endif
+
+	for ( j = 0; j + wlen <= len; j++ ) {
+		hashIter( HASHcontext, HASHdigests, &value[j], wlen );
+		HASHdigests += HASH_BYTES;
+	}
+}
+
 /* Index generation function: Attribute values -> index hash keys */
 int octetStringIndexer(
 	slap_mask_t use,
@@ -932,11 +1004,11 @@ octetStringSubstringsIndexer(
 	BerVarray *keysp,
 	void *ctx )
 {
-	ber_len_t i, nkeys;
+	ber_len_t i, nkeys, max;
 	BerVarray keys;
 
 	HASH_CONTEXT HCany, HCini, HCfin;
-	unsigned char HASHdigest[HASH_BYTES];
+	unsigned char HASHdigest[HASH_BYTES], *HASHdigests = NULL;
 	struct berval digest;
 	digest.bv_val = (char *)HASHdigest;
 	digest.bv_len = HASH_LEN;
@@ -978,8 +1050,18 @@ octetStringSubstringsIndexer(
 
 	keys = slap_sl_malloc( sizeof( struct berval ) * (nkeys+1), ctx );
 
-	if ( flags & SLAP_INDEX_SUBSTR_ANY )
+	if ( flags & SLAP_INDEX_SUBSTR_ANY ) {
 		hashPreset( &HCany, prefix, SLAP_INDEX_SUBSTR_PREFIX, syntax, mr );
+
+		/* room for the subany digests of the longest value */
+		for ( i = 0, max = 0; !BER_BVISNULL( &values[i] ); i++ ) {
+			if ( values[i].bv_len > max ) max = values[i].bv_len;
+		}
+		if ( max >= index_substr_any_len ) {
+			HASHdigests = slap_sl_malloc( HASH_BYTES *
+				( max - ( index_substr_any_len - 1 )), ctx );
+		}
+	}
 	if( flags & SLAP_INDEX_SUBSTR_INITIAL )
 		hashPreset( &HCini, prefix, SLAP_INDEX_SUBSTR_INITIAL_PREFIX, syntax, mr );
 	if( flags & SLAP_INDEX_SUBSTR_FINAL )
@@ -987,19 +1069,22 @@ octetStringSubstringsIndexer(
 
 	nkeys = 0;
 	for ( i = 0; !BER_BVISNULL( &values[i] ); i++ ) {
-		ber_len_t j,max;
+		ber_len_t j;
 
 		if( ( flags & SLAP_INDEX_SUBSTR_ANY ) &&
 			( values[i].bv_len >= index_substr_any_len ) )
 		{
 			max = values[i].bv_len - (index_substr_any_len - 1);
 
+			/* all subany keys of this value in one pass */
+			hashWindows( &HCany, HASHdigests,
+				(unsigned char *)values[i].bv_val, values[i].bv_len,
+				index_substr_any_len );
 			for( j=0; j<max; j++ ) {
-				hashIter( &HCany, HASHdigest,
-					(unsigned char *)&values[i].bv_val[j],
-					index_substr_any_len );
+				digest.bv_val = (char *)&HASHdigests[j * HASH_BYTES];
 				ber_dupbv_x( &keys[nkeys++], &digest, ctx );
 			}
+			digest.bv_val = (char *)HASHdigest;
 		}
 
 		/* skip if too short */ 
@@ -1025,6 +1110,9 @@ octetStringSubstringsIndexer(
 		}
 	}
 
+	if ( HASHdigests )
+		slap_sl_free( HASHdigests, ctx );
+
 	if( nkeys > 0 ) {
 		BER_BVZERO( &keys[nkeys] );
 		*keysp = keys;
@@ -52,10 +52,14 @@
  * The allocator helps memory fragmentation, speed and memory leaks.
  * It is not (yet) reliable as a garbage collector:
  *
- * It falls back to context NULL - plain ber_memalloc() - when the
- * context's slab is full.  A reset does not reclaim such memory.
- * Conversely, free/realloc of data not from the given context assumes
- * context NULL.  The data must not belong to another memory context.
+ * When the context's slab is full, it grows by chaining overflow chunks
+ * to the context instead of falling back to plain ber_memalloc().  A
+ * reset releases all chunks but the most recent one, which is kept for
+ * the next tasks until SLAP_SL_CHUNK_IDLE of them in a row fit in the
+ * slab.  Chunk memory is only valid until the reset, like the slab.
+ * Free/realloc of data not from the given context (its slab or one of
+ * its chunks) assumes context NULL.  The data must not belong to another
+ * context's slab or chunks.
  *
  * Code which has lost track of the current memory context can try
  * slap_sl_context() or ch_malloc.c:ch_free/ch_realloc().
@@ -70,6 +74,13 @@
  * by ORing *next* block's head with 1.  Freed blocks are only reclaimed
  * from the last block forward.  This is fast, but when a block is never
  * freed, older blocks will not be reclaimed until the slab is reset...
+ *
+ * Overflow chunks are plain bump allocators with the same block head.
+ * Blocks freed from a chunk's tail are reclaimed immediately, others
+ * go on per-context freelists by size class (floor log2 of the block
+ * size) and are reused first-fit without splitting.  Each context keeps
+ * counters of its overflow and fragmentation behaviour, which are shown
+ * per thread by back-monitor to help sizing the slab.
  */
 
 #ifdef SLAP_NO_SL_MALLOC /* Useful with memory debuggers like Valgrind */
@@ -79,6 +90,22 @@ enum { No_sl_malloc = 0 };
 #endif
 
 #define SLAP_SLAB_SOBLOCK 64
+#define SLAP_SLAB_NCLASSES	(8 * sizeof(ber_len_t))
+
+/* Resets in a row that must not overflow before the kept chunk goes */
+#define SLAP_SL_CHUNK_IDLE	64
+
+struct slab_chunk {
+	struct slab_chunk *sc_next;
+	char *sc_base;
+	char *sc_last;
+	char *sc_end;
+};
+
+struct slab_fblock {
+	ber_len_t sf_size;
+	struct slab_fblock *sf_next;
+};
 
 struct slab_object {
     void *so_ptr;
@@ -95,8 +122,19 @@ struct slab_heap {
     unsigned char **sh_map;
     LDAP_LIST_HEAD(sh_freelist, slab_object) *sh_free;
 	LDAP_LIST_HEAD(sh_so, slab_object) sh_sopool;
+	struct slab_chunk *sh_chunks;
+	struct slab_fblock *sh_cfree[SLAP_SLAB_NCLASSES];
+	ber_len_t sh_chunk_bytes;
+	int sh_overflowed;
+	int sh_chunk_idle;
+	slap_sl_stats_t sh_stats;
+	LDAP_LIST_ENTRY(slab_heap) sh_next;
 };
 
+static LDAP_LIST_HEAD(sh_heaps, slab_heap) slap_sl_heaps
+	= LDAP_LIST_HEAD_INITIALIZER(&slap_sl_heaps);
+static ldap_pvt_thread_mutex_t slap_sl_heaps_mutex;
+
 enum {
 	Align = sizeof(ber_len_t) > 2*sizeof(int)
 		? sizeof(ber_len_t) : 2*sizeof(int),
@@ -106,6 +144,11 @@ enum {
 };
 
 static struct slab_object * slap_replenish_sopool(struct slab_heap* sh);
+static void *slap_sl_chunk_alloc(struct slab_heap *sh, ber_len_t size);
+static struct slab_chunk *slap_sl_chunk_find(struct slab_heap *sh, void *ptr);
+static void slap_sl_chunk_free(struct slab_heap *sh, struct slab_chunk *sc,
+	ber_len_t *p);
+static void slap_sl_chunks_reset(struct slab_heap *sh, int all);
 #ifdef SLAPD_UNUSED
 static void print_slheap(int level, void *ctx);
 #endif
@@ -133,6 +176,8 @@ slap_sl_mem_destroy(
 	if (!sh)
 		return;
 
+	slap_sl_chunks_reset(sh, key != NULL);
+
 	if (!sh->sh_stack) {
 		for (i = 0; i <= sh->sh_maxorder - order_start; i++) {
 			so = LDAP_LIST_FIRST(&sh->sh_free[i]);
@@ -163,6 +208,9 @@ slap_sl_mem_destroy(
 	}
 
 	if (key != NULL) {
+		ldap_pvt_thread_mutex_lock(&slap_sl_heaps_mutex);
+		LDAP_LIST_REMOVE(sh, sh_next);
+		ldap_pvt_thread_mutex_unlock(&slap_sl_heaps_mutex);
 		ber_memfree_x(sh->sh_base, NULL);
 		ber_memfree_x(sh, NULL);
 	}
@@ -177,6 +225,7 @@ slap_sl_mem_init()
 	assert( Align == 1 << Align_log2 );
 
 	ber_set_option( NULL, LBER_OPT_MEMORY_FNS, &slap_sl_mfuncs );
+	ldap_pvt_thread_mutex_init( &slap_sl_heaps_mutex );
 }
 
 /* Create, reset or just return the memory context of the current thread. */
@@ -204,11 +253,14 @@ slap_sl_mem_create(
 	size = ((size + Align-1) & -Align) + Base_offset;
 
 	if (!sh) {
-		sh = ch_malloc(sizeof(struct slab_heap));
+		sh = ch_calloc(1, sizeof(struct slab_heap));
 		base = ch_malloc(size);
 		SET_MEMCTX(thrctx, sh, slap_sl_mem_destroy);
 		VGMEMP_MARK(base, size);
 		VGMEMP_CREATE(sh, 0, 0);
+		ldap_pvt_thread_mutex_lock(&slap_sl_heaps_mutex);
+		LDAP_LIST_INSERT_HEAD(&slap_sl_heaps, sh, sh_next);
+		ldap_pvt_thread_mutex_unlock(&slap_sl_heaps_mutex);
 	} else {
 		slap_sl_mem_destroy(NULL, sh);
 		base = sh->sh_base;
@@ -222,6 +274,8 @@ slap_sl_mem_create(
 	}
 	sh->sh_base = base;
 	sh->sh_end = base + size;
+	sh->sh_stats.ss_size = size;
+	sh->sh_stats.ss_resets++;
 
 	/* Align (base + head of first block) == first returned block */
 	base += Base_offset;
@@ -380,10 +434,7 @@ slap_sl_malloc(
 		/* FIXME: missing return; guessing we failed... */
 	}
 
-	Debug(LDAP_DEBUG_TRACE,
-		"sl_malloc %lu: ch_malloc\n",
-		(unsigned long) size );
-	return ch_malloc(size);
+	return slap_sl_chunk_alloc(sh, size);
 }
 
 #define LIM_SQRT(t) /* some value < sqrt(max value of unsigned type t) */ \
@@ -421,6 +472,25 @@ slap_sl_realloc(void *ptr, ber_len_t size, void *ctx)
 
 	/* Not our memory? */
 	if (No_sl_malloc || !sh || ptr < sh->sh_base || ptr >= sh->sh_end) {
+		struct slab_chunk *sc = NULL;
+
+		if (!No_sl_malloc && sh)
+			sc = slap_sl_chunk_find(sh, ptr);
+		if (sc) {
+			if (size == 0) {
+				slap_sl_chunk_free(sh, sc, p-1);
+				return NULL;
+			}
+			/* Chunk blocks keep their full size, grow by copying */
+			oldsize = p[-1] - sizeof(ber_len_t);
+			if (size <= oldsize)
+				return ptr;
+			newptr = slap_sl_malloc(size, ctx);
+			AC_MEMCPY(newptr, ptr, oldsize);
+			slap_sl_chunk_free(sh, sc, p-1);
+			return newptr;
+		}
+
 		/* Like ch_realloc(), except not trying a new context */
 		newptr = ber_memrealloc_x(ptr, size, NULL);
 		if (newptr) {
@@ -469,6 +539,8 @@ slap_sl_realloc(void *ptr, ber_len_t size, void *ctx)
 			/* Not last block, can just mark old region as free */
 			nextp[-1] = oldsize;
 			nextp[0] |= 1;
+			sh->sh_stats.ss_nonlifo++;
+			sh->sh_stats.ss_frag += oldsize;
 			return newptr;
 		}
 
@@ -496,7 +568,14 @@ slap_sl_free(void *ptr, void *ctx)
 		return;
 
 	if (No_sl_malloc || !sh || ptr < sh->sh_base || ptr >= sh->sh_end) {
-		ber_memfree_x(ptr, NULL);
+		struct slab_chunk *sc = NULL;
+
+		if (!No_sl_malloc && sh)
+			sc = slap_sl_chunk_find(sh, ptr);
+		if (sc)
+			slap_sl_chunk_free(sh, sc, p-1);
+		else
+			ber_memfree_x(ptr, NULL);
 		return;
 	}
 
@@ -509,6 +588,8 @@ slap_sl_free(void *ptr, void *ctx)
 			/* Mark it free: tail = size, head of next block |= 1 */
 			nextp[-1] = size;
 			nextp[0] |= 1;
+			sh->sh_stats.ss_nonlifo++;
+			sh->sh_stats.ss_frag += size;
 			/* We can't tell Valgrind about it yet, because we
 			 * still need read/write access to this block for
 			 * when we eventually get to reclaim it.
@@ -516,6 +597,8 @@ slap_sl_free(void *ptr, void *ctx)
 		} else {
 			/* Reclaim freed block(s) off tail */
 			while (*p & 1) {
+				if (sh->sh_stats.ss_frag >= p[-1])
+					sh->sh_stats.ss_frag -= p[-1];
 				p = (ber_len_t *) ((char *) p - p[-1]);
 			}
 			sh->sh_last = p;
@@ -671,12 +754,201 @@ slap_sl_context( void *ptr )
 	if ( slapMode & SLAP_TOOL_MODE ) return NULL;
 
 	sh = GET_MEMCTX(ldap_pvt_thread_pool_context(), &memctx);
-	if (sh && ptr >= sh->sh_base && ptr <= sh->sh_end) {
+	if (sh && ((ptr >= sh->sh_base && ptr <= sh->sh_end) ||
+			slap_sl_chunk_find(sh, ptr))) {
 		return sh;
 	}
 	return NULL;
 }
 
+/*
+ * Overflow chunks. The first chunk is as large as the slab, each
+ * further one doubles the memory held in chunks so far, so a task
+ * needs only a handful of them no matter how much it allocates.
+ */
+static void *
+slap_sl_chunk_alloc(
+	struct slab_heap *sh,
+	ber_len_t size
+)
+{
+	enum {
+		Chunk_head = (sizeof(struct slab_chunk) + Align-1) & -Align,
+		Chunk_offset = (unsigned) -sizeof(ber_len_t) % Align
+	};
+	struct slab_chunk *sc = sh->sh_chunks;
+	struct slab_fblock **prev, *sf;
+	ber_len_t *newptr, csize;
+	int i, order = -1;
+
+	/* Same block layout as the stack: head plus data, aligned */
+	size = (size + sizeof(ber_len_t) + Align-1 + !size) & -Align;
+
+	sh->sh_stats.ss_overflow++;
+	sh->sh_overflowed = 1;
+
+	/* Reuse a freed block: only list heads are tried, the head of the
+	 * floor size class may fit and those of higher classes do. The
+	 * last class holds every larger size and is searched in full. */
+	csize = size;
+	while (csize >>= 1)
+		order++;
+	for (i = order; i < SLAP_SLAB_NCLASSES; i++) {
+		for (prev = &sh->sh_cfree[i]; (sf = *prev) != NULL;
+				prev = &sf->sf_next) {
+			if (sf->sf_size >= size) {
+				*prev = sf->sf_next;
+				sh->sh_stats.ss_reused++;
+				sh->sh_stats.ss_frag -= sf->sf_size;
+				newptr = (ber_len_t *) sf;
+				return (void *) (newptr + 1);
+			}
+			if (i < SLAP_SLAB_NCLASSES - 1)
+				break;
+		}
+	}
+
+	if (!sc || size > (ber_len_t) (sc->sc_end - sc->sc_last)) {
+		csize = sh->sh_chunk_bytes;
+		if (csize < (ber_len_t) ((char *) sh->sh_end - (char *) sh->sh_base))
+			csize = (char *) sh->sh_end - (char *) sh->sh_base;
+		if (csize < size)
+			csize = size;
+		csize = (csize + Align-1) & -Align;
+
+		Debug(LDAP_DEBUG_TRACE,
+			"sl_malloc %lu: new chunk of %lu bytes\n",
+			(unsigned long) size, (unsigned long) csize );
+
+		sc = ch_malloc(Chunk_head + Chunk_offset + csize);
+		sc->sc_base = (char *) sc + Chunk_head + Chunk_offset;
+		sc->sc_last = sc->sc_base;
+		sc->sc_end = sc->sc_base + csize;
+		sc->sc_next = sh->sh_chunks;
+		sh->sh_chunks = sc;
+		sh->sh_chunk_bytes += csize;
+
+		sh->sh_stats.ss_chunks++;
+		if (sh->sh_chunk_bytes > sh->sh_stats.ss_chunk_peak)
+			sh->sh_stats.ss_chunk_peak = sh->sh_chunk_bytes;
+	}
+
+	newptr = (ber_len_t *) sc->sc_last;
+	sc->sc_last += size;
+	*newptr++ = size;
+	return (void *) newptr;
+}
+
+static struct slab_chunk *
+slap_sl_chunk_find(
+	struct slab_heap *sh,
+	void *ptr
+)
+{
+	struct slab_chunk *sc;
+
+	for (sc = sh->sh_chunks; sc; sc = sc->sc_next) {
+		if ((char *) ptr >= sc->sc_base && (char *) ptr < sc->sc_end)
+			break;
+	}
+	return sc;
+}
+
+static void
+slap_sl_chunk_free(
+	struct slab_heap *sh,
+	struct slab_chunk *sc,
+	ber_len_t *p
+)
+{
+	struct slab_fblock *sf;
+	ber_len_t size = *p, csize = size;
+	int order = -1;
+
+	if ((char *) p + size == sc->sc_last) {
+		sc->sc_last = (char *) p;
+		return;
+	}
+
+	while (csize >>= 1)
+		order++;
+	sf = (struct slab_fblock *) p;
+	sf->sf_next = sh->sh_cfree[order];
+	sh->sh_cfree[order] = sf;
+	sh->sh_stats.ss_nonlifo++;
+	sh->sh_stats.ss_frag += size;
+}
+
+/* Release the chunks of a context. The most recent (and largest) one
+ * survives a reset unless all is set, so a task that overflowed does
+ * not have to go back to malloc on every operation. It is released
+ * too once SLAP_SL_CHUNK_IDLE tasks in a row did without it.
+ */
+static void
+slap_sl_chunks_reset(
+	struct slab_heap *sh,
+	int all
+)
+{
+	struct slab_chunk *sc, *next;
+
+	if (sh->sh_overflowed) {
+		sh->sh_stats.ss_overflow_tasks++;
+		sh->sh_overflowed = 0;
+		sh->sh_chunk_idle = 0;
+	} else if (sh->sh_chunks && ++sh->sh_chunk_idle >= SLAP_SL_CHUNK_IDLE) {
+		sh->sh_chunk_idle = 0;
+		all = 1;
+	}
+
+	sc = sh->sh_chunks;
+	if (sc) {
+		next = sc->sc_next;
+		if (all) {
+			ber_memfree_x(sc, NULL);
+			sh->sh_chunks = NULL;
+			sh->sh_chunk_bytes = 0;
+		} else {
+			sc->sc_next = NULL;
+			sc->sc_last = sc->sc_base;
+			sh->sh_chunk_bytes = sc->sc_end - sc->sc_base;
+		}
+		for (sc = next; sc; sc = next) {
+			next = sc->sc_next;
+			ber_memfree_x(sc, NULL);
+		}
+	}
+	memset(sh->sh_cfree, 0, sizeof(sh->sh_cfree));
+	sh->sh_stats.ss_frag = 0;
+}
+
+/*
+ * Call func on a snapshot of the counters of every memory context.
+ * The counters are updated without locking by their owner thread,
+ * so they may be slightly stale.
+ */
+int
+slap_sl_mem_foreach(
+	slap_sl_stats_func *func,
+	void *arg
+)
+{
+	struct slab_heap *sh;
+	slap_sl_stats_t stats;
+	int rc = 0;
+
+	ldap_pvt_thread_mutex_lock(&slap_sl_heaps_mutex);
+	LDAP_LIST_FOREACH(sh, &slap_sl_heaps, sh_next) {
+		stats = sh->sh_stats;
+		stats.ss_chunk_bytes = sh->sh_chunk_bytes;
+		rc = func(&stats, arg);
+		if (rc)
+			break;
+	}
+	ldap_pvt_thread_mutex_unlock(&slap_sl_heaps_mutex);
+	return rc;
+}
+
 static struct slab_object *
 slap_replenish_sopool(
     struct slab_heap* sh
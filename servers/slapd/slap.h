@@ -283,6 +283,10 @@ typedef struct slap_ssf_set {
 /* default for ordered integer index keys */
 #define SLAP_INDEX_INTLEN_DEFAULT	4
 
+/* index hash functions */
+#define SLAP_INDEX_HASH_FNV		0
+#define SLAP_INDEX_HASH_WYHASH	1
+
 #define SLAP_INDEX_FLAGS         0xF000UL
 #define SLAP_INDEX_NOSUBTYPES    0x1000UL /* don't use index w/ subtypes */
 #define SLAP_INDEX_NOTAGS        0x2000UL /* don't use index w/ tags */
@@ -356,6 +360,7 @@ typedef struct ContentRule ContentRule;
 typedef struct AttributeAssertion AttributeAssertion;
 typedef struct SubstringsAssertion SubstringsAssertion;
 typedef struct Filter Filter;
+typedef struct FilterProg FilterProg;
 typedef struct ValuesReturnFilter ValuesReturnFilter;
 typedef struct Attribute Attribute;
 #ifdef LDAP_COMP_MATCH
@@ -1665,6 +1670,8 @@ typedef struct slap_bindconf {
 	char *sb_tls_cipher_suite;
 	char *sb_tls_protocol_min;
 	char *sb_tls_ecname;
+	char *sb_tls_ticket_lifetime;
+	char *sb_tls_ktls;
 #ifdef HAVE_OPENSSL
 	char *sb_tls_crlcheck;
 #endif
@@ -2962,6 +2969,10 @@ struct Connection {
 #ifdef HAVE_TLS
 	char	c_is_tls;		/* true if this LDAP over raw TLS */
 	char	c_needs_tls_accept;	/* true if SSL_accept should be called */
+#endif
+#ifdef HAVE_ZLIB
+	char	c_is_compressed;	/* true if compression was negotiated */
+	char	c_needs_compress;	/* true if we need to install the layer */
 #endif
 	char	c_sasl_layers;	 /* true if we need to install SASL i/o handlers */
 	char	c_sasl_done;		/* SASL completed once */
@@ -3091,6 +3102,22 @@ typedef int (*SLAP_ENTRY_INFO_FN) LDAP_P(( void *arg, Entry *e ));
 #define SLAP_SLAB_SIZE	(1024*1024)
 #define SLAP_SLAB_STACK 1
 
+/* Per-context counters of the sl_malloc allocator */
+typedef struct slap_sl_stats_t {
+	ber_len_t	ss_size;		/* slab size */
+	ber_len_t	ss_chunk_bytes;	/* bytes currently held in overflow chunks */
+	ber_len_t	ss_chunk_peak;	/* most bytes ever held in overflow chunks */
+	ber_len_t	ss_frag;		/* bytes freed out of order, not yet reclaimed */
+	unsigned long	ss_resets;		/* tasks that used the context */
+	unsigned long	ss_overflow_tasks;	/* tasks that did not fit in the slab */
+	unsigned long	ss_overflow;	/* allocations served from overflow chunks */
+	unsigned long	ss_chunks;		/* overflow chunks allocated */
+	unsigned long	ss_reused;		/* overflow allocations reusing a freed block */
+	unsigned long	ss_nonlifo;		/* frees out of stack order */
+} slap_sl_stats_t;
+
+typedef int (slap_sl_stats_func) LDAP_P(( slap_sl_stats_t *stats, void *arg ));
+
 #define SLAP_ZONE_ALLOC 1
 #undef SLAP_ZONE_ALLOC
 
@@ -49,6 +49,15 @@ starttls_extop ( Operation *op, SlapReply *rs )
 		goto done;
 	}
 
+#ifdef HAVE_ZLIB
+	/* TLS would go below compression, see compress_extop() */
+	if ( op->o_conn->c_is_compressed ) {
+		rs->sr_text = "cannot start TLS after compression";
+		rc = LDAP_OPERATIONS_ERROR;
+		goto done;
+	}
+#endif
+
 	/* can't start TLS if there are other op's around */
 	if (( !LDAP_STAILQ_EMPTY(&op->o_conn->c_ops) &&
 			(LDAP_STAILQ_FIRST(&op->o_conn->c_ops) != op ||
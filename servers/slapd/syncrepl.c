@@ -22,8 +22,15 @@
 
 #include <ac/string.h>
 #include <ac/socket.h>
+#include <ac/errno.h>
+#include <ac/unistd.h>
+#include <fcntl.h>
+#ifndef _WIN32
+#include <sys/mman.h>
+#endif
 
 #include "lutil.h"
+#include "lutil_hash.h"
 #include "slap.h"
 #include "lutil_ldap.h"
 
@@ -66,6 +73,69 @@ struct nonpresent_entry {
 	LDAP_LIST_ENTRY(nonpresent_entry) npe_link;
 };
 
+/* entryUUIDs the provider reported present during a refresh. They are
+ * appended in arrival order and only sorted once the nonpresent search
+ * starts looking them up, which keeps a multi-million entry refresh at
+ * UUIDLEN bytes per entry with no per-UUID allocation.
+ */
+typedef struct presentlist {
+	unsigned char	(*pl_uuids)[UUIDLEN];
+	unsigned long	pl_num;
+	unsigned long	pl_max;
+	unsigned long	pl_sorted;	/* pl_num when last sorted */
+	unsigned long	pl_found;	/* distinct UUIDs matched by a local entry */
+	unsigned char	*pl_hits;	/* a bit per sorted UUID, set once matched */
+} presentlist;
+
+/* Parallel apply of refresh entries. Entries are spread over lanes
+ * by a hash of their DN, each lane is applied in arrival order by at
+ * most one thread at a time. An entry whose parent is still queued
+ * goes to the parent's lane, so a parent is always added before its
+ * children. Anything that moves the cookie waits for all lanes to
+ * drain first.
+ */
+typedef struct syncapply_pend {
+	struct berval	sap_ndn;
+	int		sap_lane;
+	int		sap_count;	/* items queued for this DN */
+} syncapply_pend;
+
+typedef struct syncapply_item {
+	struct syncapply_item *sai_next;
+	LDAPMessage	*sai_msg;	/* the mods still point into it */
+	Entry		*sai_entry;
+	Modifications	*sai_modlist;
+	syncapply_pend	*sai_pend;
+	int		sai_syncstate;
+	char		sai_uuid[UUIDLEN];
+} syncapply_item;
+
+typedef struct syncapply_lane {
+	struct syncapply	*sal_sa;
+	syncapply_item	*sal_head;
+	syncapply_item	**sal_tail;
+	void		*sal_cookie;	/* pool task, if sal_sched */
+	int		sal_sched;	/* a pool task was submitted */
+	int		sal_active;	/* an item is being applied */
+	int		sal_opid;
+} syncapply_lane;
+
+typedef struct syncapply {
+	struct syncinfo_s	*sa_si;
+	BackendDB	*sa_be;
+	int		sa_nlanes;
+	int		sa_queued;	/* items not applied yet */
+	int		sa_running;	/* pool tasks not finished yet */
+	int		sa_rc;		/* first failure */
+	int		sa_plocked;	/* we hold cs_pmutex for the batch */
+	syncapply_lane	*sa_lanes;
+	Avlnode		*sa_pending;	/* syncapply_pend of queued DNs */
+	ldap_pvt_thread_mutex_t	sa_mutex;
+	ldap_pvt_thread_cond_t	sa_cond;
+} syncapply;
+
+#define SYNCAPPLY_QUEUE	64	/* items per lane before we wait */
+
 typedef struct cookie_vals {
 	struct berval *cv_vals;
 	int *cv_sids;
@@ -161,7 +231,12 @@ typedef struct syncinfo_s {
 	int			si_too_old;
 	int			si_is_configdb;
 	ber_int_t	si_msgid;
-	Avlnode			*si_presentlist;
+	presentlist		*si_presentlist;
+	int			si_applythreads;	/* lanes for parallel refresh */
+	int			si_refreshparts;	/* ranges of the initial refresh */
+	int			si_partitioning;	/* they are being applied */
+	int			si_compress;	/* ask the provider for deflate */
+	syncapply		*si_apply;
 	LDAP			*si_ld;
 	Connection		*si_conn;
 	LDAP_LIST_HEAD(np, nonpresent_entry)	si_nonpresentlist;
@@ -182,16 +257,23 @@ typedef struct syncinfo_s {
 	struct berval	si_lastCookieSent;
 	struct berval	si_monitor_ndn;
 	char	si_connaddrbuf[LDAP_IPADDRLEN];
+	unsigned long	*si_stats;	/* SS_LAST counters, see syncstats_open */
+	char	*si_statsfile;
+	int		si_statsmapped;
+	time_t	si_statsepoch;		/* si_phasems counts from here */
+	unsigned long	si_phasems;	/* last phase sample */
+	char	si_statsbusy;		/* guards the fields below */
+	char	si_statsnew;		/* set when si_statscsn changed */
+	struct timeval	si_statswhen;	/* when si_statscsn was applied */
+	char	si_statscsn[LDAP_PVT_CSNSTR_BUFSIZE];
 
 	ldap_pvt_thread_mutex_t	si_monitor_mutex;
 	ldap_pvt_thread_mutex_t	si_mutex;
 } syncinfo_t;
 
-static int syncuuid_cmp( const void *, const void * );
 static int presentlist_insert( syncinfo_t* si, struct berval *syncUUID );
-static void presentlist_delete( Avlnode **av, struct berval *syncUUID );
-static char *presentlist_find( Avlnode *av, struct berval *syncUUID );
-static int presentlist_free( Avlnode *av );
+static char *presentlist_find( presentlist *pl, struct berval *syncUUID );
+static int presentlist_free( presentlist *pl );
 static void syncrepl_del_nonpresent( Operation *, syncinfo_t *, BerVarray, struct sync_cookie *, int );
 static int syncrepl_message_to_op(
 					syncinfo_t *, Operation *, LDAPMessage *, int );
@@ -209,6 +291,7 @@ static struct berval * slap_uuidstr_from_normalized(
 					struct berval *, struct berval *, void * );
 static int syncrepl_add_glue_ancestors(
 	Operation* op, Entry *e );
+static int syncparts_refresh( Operation *op, syncinfo_t *si );
 
 #ifdef LDAP_CONTROL_X_DIRSYNC
 static int syncrepl_dirsync_message(
@@ -244,6 +327,7 @@ typedef struct logschema {
 	struct berval ls_controls;
 	struct berval ls_uuid;
 	struct berval ls_changenum;
+	struct berval ls_modbin;
 } logschema;
 
 static logschema changelog_sc = {
@@ -265,7 +349,10 @@ static logschema accesslog_sc = {
 	BER_BVC("reqNewRDN"),
 	BER_BVC("reqDeleteOldRDN"),
 	BER_BVC("reqNewSuperior"),
-	BER_BVC("reqControls")
+	BER_BVC("reqControls"),
+	BER_BVNULL,
+	BER_BVNULL,
+	BER_BVC("reqModBinary")
 };
 
 static const char *
@@ -573,7 +660,7 @@ ldap_sync_search(
 	int rc;
 	int rhint;
 	char *base;
-	char **attrs, *lattrs[9];
+	char **attrs, *lattrs[10];
 	char *filter;
 	int attrsonly;
 	int scope;
@@ -659,7 +746,8 @@ ldap_sync_search(
 		if ( si->si_syncdata == SYNCDATA_ACCESSLOG ) {
 			lattrs[6] = ls->ls_controls.bv_val;
 			lattrs[7] = slap_schema.si_ad_entryCSN->ad_cname.bv_val;
-			lattrs[8] = NULL;
+			lattrs[8] = ls->ls_modbin.bv_val;
+			lattrs[9] = NULL;
 			filter = si->si_logfilterstr.bv_val;
 			scope = LDAP_SCOPE_SUBTREE;
 		} else {
@@ -1002,6 +1090,274 @@ check_syncprov(
 	return changed;
 }
 
+/* Replication statistics. They are kept as a flat array of counters
+ * so that the same memory can be mapped from a statsfile and watched
+ * by external tools without going through cn=monitor. The layout of
+ * the array is documented in slapd.conf(5) and must only be extended
+ * at the end.
+ */
+#define SYNCSTATS_MAGIC	0x4f4c5352UL	/* "OLSR" */
+
+enum {
+	SS_MAGIC = 0,
+	SS_RID,
+	SS_PHASE,		/* SS_PHASE_* */
+	SS_RECEIVED,	/* changes received from the provider */
+	SS_APPLIED,		/* changes applied to the local DB */
+	SS_QUEUED,		/* received changes waiting for an apply thread */
+	SS_BYTES_IN,
+	SS_BYTES_OUT,
+	SS_REFRESH_MS,	/* time spent in the refresh phase */
+	SS_PERSIST_MS,	/* time spent in the persist phase */
+	SS_LAG_MS,		/* age of the CSN of the last applied change */
+	SS_LATENCY,		/* first apply latency bucket */
+	SS_LAST = SS_LATENCY + 6
+};
+#define SS_NLATENCY	( SS_LAST - SS_LATENCY )
+
+enum {
+	SS_PHASE_DOWN = 0,
+	SS_PHASE_REFRESH,
+	SS_PHASE_PERSIST
+};
+
+/* upper bounds of the apply latency buckets, in microseconds */
+static const unsigned long syncstats_bounds[SS_NLATENCY-1] = {
+	100, 1000, 10000, 100000, 1000000 };
+static const char *syncstats_labels[SS_NLATENCY] = {
+	"100us", "1ms", "10ms", "100ms", "1s", "inf" };
+
+/* The counters are bumped from the syncrepl task, the apply threads
+ * and the monitor without a lock; a mapped statsfile may be read by
+ * anyone at any time.
+ */
+#define SS_ADD(ss,i,n)	__atomic_fetch_add( &(ss)[i], (n), __ATOMIC_RELAXED )
+#define SS_SET(ss,i,v)	__atomic_store_n( &(ss)[i], (v), __ATOMIC_RELAXED )
+#define SS_GET(ss,i)	__atomic_load_n( &(ss)[i], __ATOMIC_RELAXED )
+
+/* syncstats_phase is called from the do_syncrep2 loop at most once
+ * per this many messages
+ */
+#define SYNCSTATS_BATCH	256
+
+typedef struct syncstats_timer {
+	struct timeval	st_start;
+	char	st_csn[LDAP_PVT_CSNSTR_BUFSIZE];	/* empty if unknown */
+} syncstats_timer;
+
+static void
+syncstats_open( syncinfo_t *si )
+{
+	unsigned long *ss = NULL;
+
+#ifndef _WIN32
+	if ( si->si_statsfile ) {
+		size_t size = SS_LAST * sizeof( unsigned long );
+		int fd, save_errno = 0;
+
+		fd = open( si->si_statsfile, O_RDWR|O_CREAT, 0644 );
+		if ( fd >= 0 && ftruncate( fd, size ) == 0 ) {
+			ss = mmap( NULL, size, PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0 );
+			if ( ss == MAP_FAILED )
+				ss = NULL;
+		}
+		if ( !ss ) {
+			char ebuf[128];
+			save_errno = errno;
+			Debug( LDAP_DEBUG_ANY, "syncstats_open: %s "
+				"cannot map statsfile \"%s\": %d (%s)\n",
+				si->si_ridtxt, si->si_statsfile, save_errno,
+				AC_STRERROR_R( save_errno, ebuf, sizeof(ebuf) ) );
+		}
+		if ( fd >= 0 )
+			close( fd );
+		if ( ss ) {
+			memset( ss, 0, size );
+			si->si_statsmapped = 1;
+		}
+	}
+#endif
+	if ( !ss )
+		ss = ch_calloc( SS_LAST, sizeof( unsigned long ));
+	ss[SS_RID] = si->si_rid;
+	ss[SS_MAGIC] = SYNCSTATS_MAGIC;
+	si->si_statsepoch = slap_get_time();
+	si->si_phasems = 0;
+	si->si_statsbusy = 0;
+	si->si_statsnew = 0;
+	si->si_stats = ss;
+}
+
+static void
+syncstats_close( syncinfo_t *si )
+{
+	if ( !si->si_stats )
+		return;
+#ifndef _WIN32
+	if ( si->si_statsmapped ) {
+		SS_SET( si->si_stats, SS_PHASE, SS_PHASE_DOWN );
+		munmap( si->si_stats, SS_LAST * sizeof( unsigned long ));
+	} else
+#endif
+	{
+		ch_free( si->si_stats );
+	}
+	si->si_stats = NULL;
+	si->si_statsmapped = 0;
+}
+
+/* Charge the time since the last sample to the phase we were in,
+ * note the phase we are in now and work out the lag from the last
+ * change recorded by syncstats_end. Called per batch of messages and
+ * by the monitor, never per change.
+ */
+static void
+syncstats_phase( syncinfo_t *si )
+{
+	unsigned long *ss = si->si_stats;
+	struct timeval now;
+	unsigned long ms, last;
+
+	if ( !ss )
+		return;
+
+	gettimeofday( &now, NULL );
+	ms = ( now.tv_sec - si->si_statsepoch ) * 1000 + now.tv_usec / 1000;
+	last = __atomic_exchange_n( &si->si_phasems, ms, __ATOMIC_RELAXED );
+	if ( last && ms > last ) {
+		switch ( SS_GET( ss, SS_PHASE )) {
+		case SS_PHASE_REFRESH:
+			SS_ADD( ss, SS_REFRESH_MS, ms - last );
+			break;
+		case SS_PHASE_PERSIST:
+			SS_ADD( ss, SS_PERSIST_MS, ms - last );
+			break;
+		}
+	}
+	if ( !si->si_ld )
+		SS_SET( ss, SS_PHASE, SS_PHASE_DOWN );
+	else if ( si->si_refreshDone )
+		SS_SET( ss, SS_PHASE, SS_PHASE_PERSIST );
+	else
+		SS_SET( ss, SS_PHASE, SS_PHASE_REFRESH );
+
+	/* If an apply thread is filling in the CSN, catch it next time */
+	if ( __atomic_load_n( &si->si_statsnew, __ATOMIC_ACQUIRE ) &&
+		!__atomic_test_and_set( &si->si_statsbusy, __ATOMIC_ACQUIRE ))
+	{
+		struct lutil_tm tm;
+		struct lutil_timet tt;
+
+		if ( lutil_parsetime( si->si_statscsn, &tm ) == 0 ) {
+			long lag;
+
+			lutil_tm2time( &tm, &tt );
+			lag = ( si->si_statswhen.tv_sec - (long)tt.tt_sec ) * 1000 +
+				si->si_statswhen.tv_usec / 1000 - (long)tt.tt_nsec / 1000000;
+			SS_SET( ss, SS_LAG_MS, lag > 0 ? lag : 0 );
+		}
+		si->si_statsnew = 0;
+		__atomic_clear( &si->si_statsbusy, __ATOMIC_RELEASE );
+	}
+}
+
+/* Start timing the apply of a change carrying csn */
+static void
+syncstats_begin( syncinfo_t *si, syncstats_timer *st, struct berval *csn )
+{
+	st->st_csn[0] = '\0';
+	if ( !si->si_stats )
+		return;
+	if ( csn && !BER_BVISEMPTY( csn ) &&
+		csn->bv_len < sizeof( st->st_csn )) {
+		AC_MEMCPY( st->st_csn, csn->bv_val, csn->bv_len );
+		st->st_csn[csn->bv_len] = '\0';
+	}
+	gettimeofday( &st->st_start, NULL );
+}
+
+/* Count the change in the latency histogram and leave its CSN for
+ * syncstats_phase. The CSN is only copied, parsing it is left to the
+ * next sample.
+ */
+static void
+syncstats_end( syncinfo_t *si, syncstats_timer *st )
+{
+	unsigned long *ss = si->si_stats;
+	unsigned long usec;
+	struct timeval now;
+	int i;
+
+	if ( !ss )
+		return;
+
+	gettimeofday( &now, NULL );
+	usec = ( now.tv_sec - st->st_start.tv_sec ) * 1000000 +
+		now.tv_usec - st->st_start.tv_usec;
+	for ( i = 0; i < SS_NLATENCY-1 && usec >= syncstats_bounds[i]; i++ )
+		;
+
+	SS_ADD( ss, SS_APPLIED, 1 );
+	SS_ADD( ss, SS_LATENCY+i, 1 );
+
+	/* If someone else holds the slot, a later change will fill it in */
+	if ( st->st_csn[0] &&
+		!__atomic_test_and_set( &si->si_statsbusy, __ATOMIC_ACQUIRE ))
+	{
+		strcpy( si->si_statscsn, st->st_csn );
+		si->si_statswhen = now;
+		__atomic_store_n( &si->si_statsnew, 1, __ATOMIC_RELEASE );
+		__atomic_clear( &si->si_statsbusy, __ATOMIC_RELEASE );
+	}
+}
+
+/* Sockbuf layer counting the bytes exchanged with the provider */
+static int
+syncstats_sb_setup( Sockbuf_IO_Desc *sbiod, void *arg )
+{
+	sbiod->sbiod_pvt = arg;
+	return 0;
+}
+
+static int
+syncstats_sb_ctrl( Sockbuf_IO_Desc *sbiod, int opt, void *arg )
+{
+	return LBER_SBIOD_CTRL_NEXT( sbiod, opt, arg );
+}
+
+static ber_slen_t
+syncstats_sb_read( Sockbuf_IO_Desc *sbiod, void *buf, ber_len_t len )
+{
+	unsigned long *ss = sbiod->sbiod_pvt;
+	ber_slen_t ret;
+
+	ret = LBER_SBIOD_READ_NEXT( sbiod, buf, len );
+	if ( ret > 0 )
+		SS_ADD( ss, SS_BYTES_IN, ret );
+	return ret;
+}
+
+static ber_slen_t
+syncstats_sb_write( Sockbuf_IO_Desc *sbiod, void *buf, ber_len_t len )
+{
+	unsigned long *ss = sbiod->sbiod_pvt;
+	ber_slen_t ret;
+
+	ret = LBER_SBIOD_WRITE_NEXT( sbiod, buf, len );
+	if ( ret > 0 )
+		SS_ADD( ss, SS_BYTES_OUT, ret );
+	return ret;
+}
+
+static Sockbuf_IO syncstats_sbio = {
+	syncstats_sb_setup,	/* sbi_setup */
+	NULL,			/* sbi_remove */
+	syncstats_sb_ctrl,	/* sbi_ctrl */
+	syncstats_sb_read,	/* sbi_read */
+	syncstats_sb_write,	/* sbi_write */
+	NULL			/* sbi_close */
+};
+
 static int
 do_syncrep1(
 	Operation *op,
@@ -1020,6 +1376,13 @@ do_syncrep1(
 	if ( rc != LDAP_SUCCESS ) {
 		goto done;
 	}
+	if ( si->si_stats ) {
+		Sockbuf *sb;
+		ldap_get_option( si->si_ld, LDAP_OPT_SOCKBUF, &sb );
+		ber_sockbuf_add_io( sb, &syncstats_sbio,
+			LBER_SBIOD_LEVEL_PROVIDER + 1, si->si_stats );
+		syncstats_phase( si );
+	}
 	op->o_protocol = LDAP_VERSION3;
 
 	/* Set SSF to strongest of TLS, SASL SSFs */
@@ -1050,6 +1413,17 @@ do_syncrep1(
 
 	ldap_set_option( si->si_ld, LDAP_OPT_REFERRALS, LDAP_OPT_OFF );
 
+	if ( si->si_compress ) {
+		/* not fatal, the provider may simply not offer it */
+		int crc = ldap_start_compress_s( si->si_ld, LDAP_COMPRESS_DEFLATE,
+			NULL, NULL );
+		if ( crc != LDAP_SUCCESS ) {
+			Debug( LDAP_DEBUG_ANY, "do_syncrep1: %s "
+				"compression not started (%d) %s\n",
+				si->si_ridtxt, crc, ldap_err2string( crc ) );
+		}
+	}
+
 	si->si_syncCookie.rid = si->si_rid;
 
 	/* whenever there are multiple data sources possible, advertise sid */
@@ -1156,6 +1530,18 @@ do_syncrep1(
 			}
 		}
 
+		/* nothing to start from, populate in parallel first */
+		if ( !si->si_syncCookie.ctxcsn && si->si_refreshparts > 1 &&
+			!si->si_refreshDone && !si->si_rewrite && !si->si_is_configdb )
+		{
+			rc = syncparts_refresh( op, si );
+			if ( rc == SYNC_BUSY ) {
+				return rc;
+			} else if ( rc != LDAP_SUCCESS ) {
+				goto done;
+			}
+		}
+
 		if ( !cmdline_cookie_found ) {
 			/* ITS#6367: recreate the cookie so it has our SID, not our peer's */
 			ch_free( si->si_syncCookie.octet_str.bv_val );
@@ -1196,6 +1582,7 @@ done:
 			ldap_unbind_ext( si->si_ld, NULL, NULL );
 			si->si_ld = NULL;
 		}
+		syncstats_phase( si );
 	}
 
 	return rc;
@@ -1269,33 +1656,784 @@ check_csn_age(
 					si->si_ridtxt, csn->bv_val, dn->bv_val );
 				return CV_CSN_OLD;
 			}
-			rc = CV_CSN_OK;
-			break;
+			rc = CV_CSN_OK;
+			break;
+		}
+	}
+	if ( slot )
+		*slot = i;
+	return rc;
+}
+
+static int
+get_pmutex(
+	syncinfo_t *si
+)
+{
+	if ( !si->si_is_configdb ) {
+		ldap_pvt_thread_mutex_lock( &si->si_cookieState->cs_pmutex );
+	} else {
+		/* avoid deadlock when replicating cn=config */
+		while ( ldap_pvt_thread_mutex_trylock( &si->si_cookieState->cs_pmutex )) {
+			if ( slapd_shutdown )
+				return SYNC_SHUTDOWN;
+			if ( !ldap_pvt_thread_pool_pausewait( &connection_pool ))
+				ldap_pvt_thread_yield();
+		}
+	}
+
+	return 0;
+}
+
+/* Set up an operation to apply entries with, like do_syncrepl does */
+static void
+syncrepl_initop( syncinfo_t *si, BackendDB *be, Operation *op, int opid )
+{
+	op->o_connid = SLAPD_SYNC_RID2SYNCCONN(si->si_rid);
+	op->o_opid = opid;
+	op->o_managedsait = SLAP_CONTROL_NONCRITICAL;
+	if ( !si->si_schemachecking )
+		op->o_no_schema_check = 1;
+	op->o_bd = be;
+	op->o_dn = op->o_bd->be_rootdn;
+	op->o_ndn = op->o_bd->be_rootndn;
+}
+
+/* Apply one item, called without sa_mutex */
+static int
+syncapply_item_apply( syncapply *sa, Operation *op, syncapply_item *sai )
+{
+	struct berval syncUUID[2];
+	int rc;
+
+	syncUUID[0].bv_val = sai->sai_uuid;
+	syncUUID[0].bv_len = UUIDLEN;
+	(void)slap_uuidstr_from_normalized( &syncUUID[1], &syncUUID[0], op->o_tmpmemctx );
+
+	op->o_tag = LDAP_REQ_ADD;
+	op->o_req_dn = sai->sai_entry->e_name;
+	op->o_req_ndn = sai->sai_entry->e_nname;
+	rc = syncrepl_entry( sa->sa_si, op, sai->sai_entry, &sai->sai_modlist,
+		sai->sai_syncstate, syncUUID, NULL );
+
+	if ( sai->sai_modlist )
+		slap_mods_free( sai->sai_modlist, 1 );
+	ldap_msgfree( sai->sai_msg );
+	return rc;
+}
+
+static int
+syncapply_pend_cmp( const void *v1, const void *v2 )
+{
+	const syncapply_pend *p1 = v1, *p2 = v2;
+
+	return ber_bvcmp( &p1->sap_ndn, &p2->sap_ndn );
+}
+
+/* Take the next item of a lane that nobody is applying right now.
+ * Called with sa_mutex held.
+ */
+static syncapply_item *
+syncapply_next( syncapply_lane *sal )
+{
+	syncapply_item *sai = sal->sal_head;
+
+	if ( !sai || sal->sal_active )
+		return NULL;
+	sal->sal_head = sai->sai_next;
+	if ( !sal->sal_head )
+		sal->sal_tail = &sal->sal_head;
+	sal->sal_active = 1;
+	return sai;
+}
+
+/* Note the result of an item and free it. Called with sa_mutex held. */
+static void
+syncapply_done( syncapply *sa, syncapply_lane *sal, syncapply_item *sai, int rc )
+{
+	syncapply_pend *sap = sai->sai_pend;
+
+	if ( --sap->sap_count == 0 ) {
+		ldap_avl_delete( &sa->sa_pending, sap, syncapply_pend_cmp );
+		ch_free( sap );
+	}
+	ch_free( sai );
+	sal->sal_active = 0;
+	sa->sa_queued--;
+	if ( sa->sa_si->si_stats )
+		SS_SET( sa->sa_si->si_stats, SS_QUEUED, sa->sa_queued );
+	if ( rc != LDAP_SUCCESS && sa->sa_rc == LDAP_SUCCESS )
+		sa->sa_rc = rc;
+	ldap_pvt_thread_cond_broadcast( &sa->sa_cond );
+}
+
+static void *
+syncapply_task( void *ctx, void *arg )
+{
+	syncapply_lane *sal = arg;
+	syncapply *sa = sal->sal_sa;
+	syncapply_item *sai;
+	Connection conn = {0};
+	OperationBuffer opbuf;
+	Operation *op;
+	int rc;
+
+	connection_fake_init( &conn, &opbuf, ctx );
+	op = &opbuf.ob_op;
+	syncrepl_initop( sa->sa_si, sa->sa_be, op, sal->sal_opid );
+
+	ldap_pvt_thread_mutex_lock( &sa->sa_mutex );
+	while (( sai = syncapply_next( sal ))) {
+		ldap_pvt_thread_mutex_unlock( &sa->sa_mutex );
+		rc = syncapply_item_apply( sa, op, sai );
+		ldap_pvt_thread_mutex_lock( &sa->sa_mutex );
+		syncapply_done( sa, sal, sai, rc );
+	}
+	sal->sal_sched = 0;
+	sa->sa_running--;
+	ldap_pvt_thread_cond_broadcast( &sa->sa_cond );
+	ldap_pvt_thread_mutex_unlock( &sa->sa_mutex );
+	return NULL;
+}
+
+/* Start a pool task for a lane that has items but nobody to apply
+ * them. Called with sa_mutex held.
+ */
+static void
+syncapply_kick( syncapply *sa, syncapply_lane *sal )
+{
+	if ( sal->sal_head && !sal->sal_sched && !sal->sal_active &&
+		ldap_pvt_thread_pool_submit2( &connection_pool,
+			syncapply_task, sal, &sal->sal_cookie ) == 0 )
+	{
+		sal->sal_sched = 1;
+		sa->sa_running++;
+	}
+	/* if that failed, the next wait applies them */
+}
+
+/* Wait until at most limit items are queued, applying items ourselves
+ * rather than just waiting on the pool. With limit 0 this is a full
+ * barrier: every lane is drained, no task is left behind and the
+ * pending CSN lock is released. Returns the first failure.
+ */
+static int
+syncapply_wait( syncapply *sa, int limit )
+{
+	syncapply_item *sai;
+	Connection conn = {0};
+	OperationBuffer opbuf;
+	Operation *op = NULL;
+	int i, rc;
+
+	ldap_pvt_thread_mutex_lock( &sa->sa_mutex );
+	while ( sa->sa_queued > limit ) {
+		sai = NULL;
+		for ( i = 0; i < sa->sa_nlanes; i++ ) {
+			if (( sai = syncapply_next( &sa->sa_lanes[i] )))
+				break;
+		}
+		if ( !sai ) {
+			ldap_pvt_thread_cond_wait( &sa->sa_cond, &sa->sa_mutex );
+			continue;
+		}
+		ldap_pvt_thread_mutex_unlock( &sa->sa_mutex );
+		if ( !op ) {
+			/* our caller's op still lives in this thread's memory context */
+			connection_fake_init2( &conn, &opbuf, ldap_pvt_thread_pool_context(), 0 );
+			op = &opbuf.ob_op;
+			syncrepl_initop( sa->sa_si, sa->sa_be, op, sa->sa_nlanes + 1 );
+		}
+		rc = syncapply_item_apply( sa, op, sai );
+		ldap_pvt_thread_mutex_lock( &sa->sa_mutex );
+		syncapply_done( sa, &sa->sa_lanes[i], sai, rc );
+		syncapply_kick( sa, &sa->sa_lanes[i] );
+	}
+	if ( !limit ) {
+		for ( i = 0; i < sa->sa_nlanes; i++ ) {
+			syncapply_lane *sal = &sa->sa_lanes[i];
+			if ( sal->sal_sched &&
+				ldap_pvt_thread_pool_retract( sal->sal_cookie ) )
+			{
+				sal->sal_sched = 0;
+				sa->sa_running--;
+			}
+		}
+		while ( sa->sa_running )
+			ldap_pvt_thread_cond_wait( &sa->sa_cond, &sa->sa_mutex );
+		if ( sa->sa_plocked ) {
+			sa->sa_plocked = 0;
+			ldap_pvt_thread_mutex_unlock( &sa->sa_si->si_cookieState->cs_pmutex );
+		}
+	}
+	rc = sa->sa_rc;
+	if ( !limit )
+		sa->sa_rc = LDAP_SUCCESS;
+	ldap_pvt_thread_mutex_unlock( &sa->sa_mutex );
+	return rc;
+}
+
+/* Pick the lane for an entry: the one its DN is already queued in,
+ * else the one its parent is queued in, else by a hash of the DN.
+ * Called with sa_mutex held.
+ */
+static int
+syncapply_lane_of( syncapply *sa, struct berval *ndn )
+{
+	syncapply_pend key, *sap;
+
+	key.sap_ndn = *ndn;
+	sap = ldap_avl_find( sa->sa_pending, &key, syncapply_pend_cmp );
+	if ( sap )
+		return sap->sap_lane;
+	if ( !BER_BVISEMPTY( ndn )) {
+		dnParent( ndn, &key.sap_ndn );
+		sap = ldap_avl_find( sa->sa_pending, &key, syncapply_pend_cmp );
+		if ( sap )
+			return sap->sap_lane;
+	}
+	return lutil_wyhash64( (unsigned char *)ndn->bv_val, ndn->bv_len, 0 ) %
+		sa->sa_nlanes;
+}
+
+/* Hand a refresh entry to its lane, taking over msg, entry and
+ * modlist on success.
+ */
+static int
+syncapply_queue(
+	syncinfo_t *si,
+	LDAPMessage *msg,
+	Entry *entry,
+	Modifications *modlist,
+	int syncstate,
+	struct berval *syncUUID )
+{
+	syncapply *sa = si->si_apply;
+	syncapply_lane *sal;
+	syncapply_pend key, *sap;
+	syncapply_item *sai;
+	int rc;
+
+	/* keep other consumers of this DB out until the next barrier */
+	if ( !sa->sa_plocked ) {
+		if (( rc = get_pmutex( si )))
+			return rc;
+		sa->sa_plocked = 1;
+	}
+	if (( rc = syncapply_wait( sa, sa->sa_nlanes * SYNCAPPLY_QUEUE )))
+		return rc;
+
+	sai = ch_malloc( sizeof( syncapply_item ));
+	sai->sai_next = NULL;
+	sai->sai_msg = msg;
+	sai->sai_entry = entry;
+	sai->sai_modlist = modlist;
+	sai->sai_syncstate = syncstate;
+	AC_MEMCPY( sai->sai_uuid, syncUUID[0].bv_val, UUIDLEN );
+
+	ldap_pvt_thread_mutex_lock( &sa->sa_mutex );
+	key.sap_ndn = entry->e_nname;
+	sap = ldap_avl_find( sa->sa_pending, &key, syncapply_pend_cmp );
+	if ( !sap ) {
+		sap = ch_malloc( sizeof( syncapply_pend ) + entry->e_nname.bv_len + 1 );
+		sap->sap_ndn.bv_val = (char *)(sap+1);
+		sap->sap_ndn.bv_len = entry->e_nname.bv_len;
+		AC_MEMCPY( sap->sap_ndn.bv_val, entry->e_nname.bv_val,
+			entry->e_nname.bv_len + 1 );
+		sap->sap_lane = syncapply_lane_of( sa, &entry->e_nname );
+		sap->sap_count = 0;
+		ldap_avl_insert( &sa->sa_pending, sap, syncapply_pend_cmp,
+			ldap_avl_dup_error );
+	}
+	sap->sap_count++;
+	sai->sai_pend = sap;
+	sal = &sa->sa_lanes[sap->sap_lane];
+	*sal->sal_tail = sai;
+	sal->sal_tail = &sai->sai_next;
+	sa->sa_queued++;
+	if ( si->si_stats )
+		SS_SET( si->si_stats, SS_QUEUED, sa->sa_queued );
+	syncapply_kick( sa, sal );
+	ldap_pvt_thread_mutex_unlock( &sa->sa_mutex );
+	return LDAP_SUCCESS;
+}
+
+static syncapply *
+syncapply_init( syncinfo_t *si, BackendDB *be )
+{
+	syncapply *sa;
+	int i;
+
+	sa = ch_calloc( 1, sizeof( syncapply ) +
+		si->si_applythreads * sizeof( syncapply_lane ));
+	sa->sa_si = si;
+	sa->sa_be = be;
+	sa->sa_nlanes = si->si_applythreads;
+	sa->sa_lanes = (syncapply_lane *)(sa+1);
+	for ( i = 0; i < sa->sa_nlanes; i++ ) {
+		sa->sa_lanes[i].sal_sa = sa;
+		sa->sa_lanes[i].sal_tail = &sa->sa_lanes[i].sal_head;
+		sa->sa_lanes[i].sal_opid = i + 1;
+	}
+	ldap_pvt_thread_mutex_init( &sa->sa_mutex );
+	ldap_pvt_thread_cond_init( &sa->sa_cond );
+	return sa;
+}
+
+static void
+syncapply_free( syncapply *sa )
+{
+	(void)syncapply_wait( sa, 0 );
+	ldap_pvt_thread_cond_destroy( &sa->sa_cond );
+	ldap_pvt_thread_mutex_destroy( &sa->sa_mutex );
+	ch_free( sa );
+}
+
+/* Partitioned initial refresh. A consumer that starts out without any
+ * state can split its first refresh into ranges of entryUUIDs, each
+ * searched for over its own connection and applied by its own thread.
+ * Parents may then arrive after their children, syncrepl_entry() copes
+ * with that by adding glue. Once all ranges are done, the oldest cookie
+ * any of them got becomes the starting point of the regular session,
+ * which picks up whatever changed while they ran.
+ */
+typedef struct syncpart {
+	struct syncparts	*sp_parts;
+	int		sp_index;
+	int		sp_sched;	/* a pool task was submitted */
+	int		sp_done;
+	int		sp_rc;
+	void		*sp_task;	/* pool task, if sp_sched */
+	unsigned long	sp_nentries;
+	struct sync_cookie	sp_cookie;
+} syncpart;
+
+typedef struct syncparts {
+	syncinfo_t	*sps_si;
+	BackendDB	*sps_be;
+	int		sps_nparts;
+	int		sps_running;	/* pool tasks not finished yet */
+	syncpart	*sps_part;
+	ldap_pvt_thread_mutex_t	sps_mutex;
+	ldap_pvt_thread_cond_t	sps_cond;
+} syncparts;
+
+#define SYNCPARTS_MAX	64
+
+/* Let a pool pause through: wake whoever waits for the partitions so
+ * it can pause too, then pause ourselves.
+ */
+static void
+syncparts_pausecheck( syncparts *sps )
+{
+	if ( ldap_pvt_thread_pool_pausing( &connection_pool ) <= 0 )
+		return;
+	ldap_pvt_thread_mutex_lock( &sps->sps_mutex );
+	ldap_pvt_thread_cond_broadcast( &sps->sps_cond );
+	ldap_pvt_thread_mutex_unlock( &sps->sps_mutex );
+	ldap_pvt_thread_pool_pausewait( &connection_pool );
+}
+
+/* The configured filter restricted to partition i of n, split on the
+ * first octet of the entryUUID.
+ */
+static void
+syncpart_filter( syncinfo_t *si, int i, int n, struct berval *fbv )
+{
+	char lo[ sizeof("(entryUUID>=00000000-0000-0000-0000-000000000000)") ];
+	char hi[ sizeof("(!(entryUUID>=00000000-0000-0000-0000-000000000000))") ];
+
+	lo[0] = hi[0] = '\0';
+	if ( i > 0 )
+		snprintf( lo, sizeof( lo ),
+			"(entryUUID>=%02x000000-0000-0000-0000-000000000000)",
+			256 * i / n );
+	if ( i < n - 1 )
+		snprintf( hi, sizeof( hi ),
+			"(!(entryUUID>=%02x000000-0000-0000-0000-000000000000))",
+			256 * ( i + 1 ) / n );
+
+	fbv->bv_len = STRLENOF( "(&)" ) + si->si_filterstr.bv_len +
+		strlen( lo ) + strlen( hi );
+	fbv->bv_val = ch_malloc( fbv->bv_len + 1 );
+	snprintf( fbv->bv_val, fbv->bv_len + 1, "(&%s%s%s)",
+		si->si_filterstr.bv_val, lo, hi );
+}
+
+/* Apply one entry of a partition, the way do_syncrep2 does */
+static int
+syncpart_entry( syncinfo_t *si, Operation *op, LDAP *ld, LDAPMessage *msg )
+{
+	BerElementBuffer berbuf;
+	BerElement *ber = (BerElement *)&berbuf;
+	LDAPControl **rctrls = NULL, *rctrlp = NULL;
+	Modifications *modlist = NULL;
+	Entry *entry = NULL;
+	struct berval syncUUID[2];
+	int rc = LDAP_PROTOCOL_ERROR, syncstate, retry = 1;
+
+	ldap_get_entry_controls( ld, msg, &rctrls );
+	if ( rctrls )
+		rctrlp = ldap_control_find( LDAP_CONTROL_SYNC_STATE, rctrls, NULL );
+	if ( rctrlp ) {
+		ber_init2( ber, &rctrlp->ldctl_value, LBER_USE_DER );
+		if ( ber_scanf( ber, "{em" /*"}"*/, &syncstate, &syncUUID[0] )
+				!= LBER_ERROR && syncUUID[0].bv_len == UUIDLEN )
+		{
+again:
+			rc = syncrepl_message_to_entry( si, op, msg,
+				&modlist, &entry, syncstate, syncUUID );
+		}
+	}
+	if ( rc == LDAP_SUCCESS ) {
+		if ( si->si_stats && retry )
+			SS_ADD( si->si_stats, SS_RECEIVED, 1 );
+		rc = syncrepl_entry( si, op, entry, &modlist,
+			syncstate, syncUUID, NULL );
+		slap_sl_free( syncUUID[1].bv_val, op->o_tmpmemctx );
+		/* Another partition may have just added this DN, either as
+		 * glue for one of its own entries or for real; once more and
+		 * it will be found and modified instead.
+		 */
+		if ( rc == LDAP_ALREADY_EXISTS && retry-- ) {
+			if ( modlist ) {
+				slap_mods_free( modlist, 1 );
+				modlist = NULL;
+			}
+			entry = NULL;
+			goto again;
+		}
+	} else {
+		Debug( LDAP_DEBUG_ANY, "syncpart_entry: %s "
+			"got malformed search entry (%d)\n",
+			si->si_ridtxt, rc );
+	}
+	if ( modlist )
+		slap_mods_free( modlist, 1 );
+	ldap_controls_free( rctrls );
+	return rc;
+}
+
+/* Run the refresh of one partition over a connection of its own */
+static int
+syncpart_search( syncparts *sps, syncpart *sp, Operation *op )
+{
+	syncinfo_t *si = sps->sps_si;
+	BerElementBuffer berbuf;
+	BerElement *ber = (BerElement *)&berbuf;
+	LDAPControl c[3], *ctrls[4], **rctrls, *rctrlp;
+	LDAPMessage *msg;
+	LDAP *ld = NULL;
+	struct berval filter, cookie;
+	struct timeval tout = { 1, 0 };
+	ber_len_t len;
+	int rc, err, msgid;
+
+	rc = slap_client_connect( &ld, &si->si_bindconf );
+	if ( rc != LDAP_SUCCESS )
+		return rc;
+
+	ldap_set_option( ld, LDAP_OPT_TIMELIMIT, &si->si_tlimit );
+	rc = LDAP_DEREF_NEVER;
+	ldap_set_option( ld, LDAP_OPT_DEREF, &rc );
+	ldap_set_option( ld, LDAP_OPT_REFERRALS, LDAP_OPT_OFF );
+	if ( si->si_compress )
+		(void)ldap_start_compress_s( ld, LDAP_COMPRESS_DEFLATE, NULL, NULL );
+
+	/* a plain refreshOnly without a cookie, like a fresh consumer's */
+	ber_init2( ber, NULL, LBER_USE_DER );
+	ber_set_option( ber, LBER_OPT_BER_MEMCTX, &op->o_tmpmemctx );
+	ber_printf( ber, "{eb}", LDAP_SYNC_REFRESH_ONLY, 1 );
+	if ( ber_flatten2( ber, &c[0].ldctl_value, 0 ) == -1 ) {
+		ber_free_buf( ber );
+		rc = LDAP_NO_MEMORY;
+		goto done;
+	}
+	c[0].ldctl_oid = LDAP_CONTROL_SYNC;
+	c[0].ldctl_iscritical = si->si_ctype < 0;
+	ctrls[0] = &c[0];
+
+	c[1].ldctl_oid = LDAP_CONTROL_MANAGEDSAIT;
+	BER_BVZERO( &c[1].ldctl_value );
+	c[1].ldctl_iscritical = 1;
+	ctrls[1] = &c[1];
+
+	if ( !BER_BVISNULL( &si->si_bindconf.sb_authzId ) ) {
+		c[2].ldctl_oid = LDAP_CONTROL_PROXY_AUTHZ;
+		c[2].ldctl_value = si->si_bindconf.sb_authzId;
+		c[2].ldctl_iscritical = 1;
+		ctrls[2] = &c[2];
+		ctrls[3] = NULL;
+	} else {
+		ctrls[2] = NULL;
+	}
+
+	syncpart_filter( si, sp->sp_index, sps->sps_nparts, &filter );
+	Debug( LDAP_DEBUG_SYNC, "syncpart_search: %s partition %d filter=%s\n",
+		si->si_ridtxt, sp->sp_index, filter.bv_val );
+	rc = ldap_search_ext( ld, si->si_base.bv_val, si->si_scope,
+		filter.bv_val, si->si_attrs, si->si_attrsonly,
+		ctrls, NULL, NULL, si->si_slimit, &msgid );
+	ch_free( filter.bv_val );
+	ber_free_buf( ber );
+	if ( rc != LDAP_SUCCESS )
+		goto done;
+
+	for (;;) {
+		if ( slapd_shutdown ) {
+			rc = SYNC_SHUTDOWN;
+			break;
+		}
+		syncparts_pausecheck( sps );
+
+		msg = NULL;
+		err = ldap_result( ld, msgid, LDAP_MSG_ONE, &tout, &msg );
+		if ( err == 0 )
+			continue;
+		if ( err < 0 ) {
+			ldap_get_option( ld, LDAP_OPT_RESULT_CODE, &rc );
+			if ( rc == LDAP_SUCCESS )
+				rc = LDAP_OTHER;
+			break;
+		}
+
+		switch ( ldap_msgtype( msg ) ) {
+		case LDAP_RES_SEARCH_ENTRY:
+			si->si_lastcontact = slap_get_time();
+			rc = syncpart_entry( si, op, ld, msg );
+			sp->sp_nentries++;
+			break;
+
+		case LDAP_RES_SEARCH_RESULT:
+			err = LDAP_OTHER;
+			rctrls = NULL;
+			ldap_parse_result( ld, msg, &err, NULL, NULL, NULL,
+				&rctrls, 0 );
+			rc = err;
+			rctrlp = rctrls ?
+				ldap_control_find( LDAP_CONTROL_SYNC_DONE, rctrls, NULL ) : NULL;
+			if ( rc == LDAP_SUCCESS && rctrlp ) {
+				ber_init2( ber, &rctrlp->ldctl_value, LBER_USE_DER );
+				if ( ber_scanf( ber, "{" /*"}"*/ ) != LBER_ERROR &&
+					ber_peek_tag( ber, &len ) == LDAP_TAG_SYNC_COOKIE &&
+					ber_scanf( ber, "m", &cookie ) != LBER_ERROR &&
+					!BER_BVISNULL( &cookie ) )
+				{
+					ber_dupbv( &sp->sp_cookie.octet_str, &cookie );
+					slap_parse_sync_cookie( &sp->sp_cookie, NULL );
+				}
+			}
+			ldap_controls_free( rctrls );
+			ldap_msgfree( msg );
+			goto done;
+
+		default:
+			/* nothing else is expected from a refreshOnly */
+			break;
+		}
+		ldap_msgfree( msg );
+		if ( rc != LDAP_SUCCESS )
+			break;
+	}
+
+done:
+	ldap_unbind_ext( ld, NULL, NULL );
+	return rc;
+}
+
+/* newmem is 0 when called from syncparts_refresh: the caller's op
+ * still lives in this thread's memory context.
+ */
+static void
+syncpart_run( syncparts *sps, syncpart *sp, void *ctx, int newmem )
+{
+	Connection conn = {0};
+	OperationBuffer opbuf;
+	Operation *op;
+
+	connection_fake_init2( &conn, &opbuf, ctx, newmem );
+	op = &opbuf.ob_op;
+	syncrepl_initop( sps->sps_si, sps->sps_be, op, sp->sp_index + 1 );
+	sp->sp_rc = syncpart_search( sps, sp, op );
+
+	Debug( LDAP_DEBUG_SYNC, "syncpart_run: %s partition %d "
+		"done, %lu entries (%d)\n",
+		sps->sps_si->si_ridtxt, sp->sp_index, sp->sp_nentries, sp->sp_rc );
+}
+
+static void *
+syncpart_task( void *ctx, void *arg )
+{
+	syncpart *sp = arg;
+	syncparts *sps = sp->sp_parts;
+
+	syncpart_run( sps, sp, ctx, 1 );
+
+	ldap_pvt_thread_mutex_lock( &sps->sps_mutex );
+	sp->sp_done = 1;
+	sps->sps_running--;
+	ldap_pvt_thread_cond_broadcast( &sps->sps_cond );
+	ldap_pvt_thread_mutex_unlock( &sps->sps_mutex );
+	return NULL;
+}
+
+/* Every partition saw the provider at a different moment: keep the
+ * oldest CSN of each sid. If they don't agree on the sids there is
+ * nothing safe to start from and the caller gets no cookie.
+ */
+static int
+syncparts_merge( syncparts *sps, struct sync_cookie *sc )
+{
+	struct sync_cookie *first = &sps->sps_part[0].sp_cookie;
+	int i, j;
+
+	if ( !first->ctxcsn )
+		return -1;
+	for ( i = 1; i < sps->sps_nparts; i++ ) {
+		struct sync_cookie *other = &sps->sps_part[i].sp_cookie;
+		if ( other->numcsns != first->numcsns )
+			return -1;
+		for ( j = 0; j < first->numcsns; j++ ) {
+			if ( other->sids[j] != first->sids[j] )
+				return -1;
+		}
+	}
+
+	slap_dup_sync_cookie( sc, first );
+	for ( i = 1; i < sps->sps_nparts; i++ ) {
+		struct sync_cookie *other = &sps->sps_part[i].sp_cookie;
+		for ( j = 0; j < sc->numcsns; j++ ) {
+			if ( ber_bvcmp( &other->ctxcsn[j], &sc->ctxcsn[j] ) < 0 )
+				ber_bvreplace( &sc->ctxcsn[j], &other->ctxcsn[j] );
+		}
+	}
+	return 0;
+}
+
+/* Populate an empty consumer with si_refreshparts parallel refreshes
+ * and leave the resulting cookie in si_syncCookie. The calling thread
+ * runs the first partition itself, and whichever the pool didn't get
+ * to. Returns SYNC_BUSY or SYNC_SHUTDOWN as do_syncrep1 would, any
+ * other failure leaves it to a regular refresh to finish the job.
+ */
+static int
+syncparts_refresh( Operation *op, syncinfo_t *si )
+{
+	syncparts sps = { 0 };
+	struct sync_cookie sc = { NULL };
+	unsigned long nentries = 0;
+	int i, rc;
+
+	if (( rc = start_refresh( si )))
+		return rc;
+
+	/* keep other consumers of this DB out until we're done */
+	if (( rc = get_pmutex( si ))) {
+		refresh_finished( si );
+		return rc;
+	}
+
+	sps.sps_si = si;
+	sps.sps_be = si->si_be;
+	sps.sps_nparts = si->si_refreshparts;
+	sps.sps_part = ch_calloc( sps.sps_nparts, sizeof( syncpart ));
+	ldap_pvt_thread_mutex_init( &sps.sps_mutex );
+	ldap_pvt_thread_cond_init( &sps.sps_cond );
+
+	Debug( LDAP_DEBUG_SYNC, "syncparts_refresh: %s "
+		"starting initial refresh in %d partitions\n",
+		si->si_ridtxt, sps.sps_nparts );
+
+	si->si_partitioning = 1;
+	ldap_pvt_thread_mutex_lock( &sps.sps_mutex );
+	for ( i = 0; i < sps.sps_nparts; i++ ) {
+		syncpart *sp = &sps.sps_part[i];
+		sp->sp_parts = &sps;
+		sp->sp_index = i;
+		if ( i && ldap_pvt_thread_pool_submit2( &connection_pool,
+			syncpart_task, sp, &sp->sp_task ) == 0 )
+		{
+			sp->sp_sched = 1;
+			sps.sps_running++;
+		}
+	}
+	ldap_pvt_thread_mutex_unlock( &sps.sps_mutex );
+
+	for ( i = 0; i < sps.sps_nparts; i++ ) {
+		syncpart *sp = &sps.sps_part[i];
+		if ( sp->sp_sched ) {
+			ldap_pvt_thread_mutex_lock( &sps.sps_mutex );
+			if ( !ldap_pvt_thread_pool_retract( sp->sp_task ) ) {
+				ldap_pvt_thread_mutex_unlock( &sps.sps_mutex );
+				continue;
+			}
+			sp->sp_sched = 0;
+			sps.sps_running--;
+			ldap_pvt_thread_mutex_unlock( &sps.sps_mutex );
 		}
+		syncpart_run( &sps, sp, ldap_pvt_thread_pool_context(), 0 );
+		sp->sp_done = 1;
 	}
-	if ( slot )
-		*slot = i;
-	return rc;
-}
 
-static int
-get_pmutex(
-	syncinfo_t *si
-)
-{
-	if ( !si->si_is_configdb ) {
-		ldap_pvt_thread_mutex_lock( &si->si_cookieState->cs_pmutex );
-	} else {
-		/* avoid deadlock when replicating cn=config */
-		while ( ldap_pvt_thread_mutex_trylock( &si->si_cookieState->cs_pmutex )) {
-			if ( slapd_shutdown )
-				return SYNC_SHUTDOWN;
-			if ( !ldap_pvt_thread_pool_pausewait( &connection_pool ))
-				ldap_pvt_thread_yield();
+	ldap_pvt_thread_mutex_lock( &sps.sps_mutex );
+	while ( sps.sps_running ) {
+		if ( ldap_pvt_thread_pool_pausing( &connection_pool ) > 0 ) {
+			ldap_pvt_thread_mutex_unlock( &sps.sps_mutex );
+			ldap_pvt_thread_pool_pausewait( &connection_pool );
+			ldap_pvt_thread_mutex_lock( &sps.sps_mutex );
+			continue;
 		}
+		ldap_pvt_thread_cond_wait( &sps.sps_cond, &sps.sps_mutex );
 	}
+	ldap_pvt_thread_mutex_unlock( &sps.sps_mutex );
+	si->si_partitioning = 0;
+	ldap_pvt_thread_mutex_unlock( &si->si_cookieState->cs_pmutex );
 
-	return 0;
+	rc = LDAP_SUCCESS;
+	for ( i = 0; i < sps.sps_nparts; i++ ) {
+		nentries += sps.sps_part[i].sp_nentries;
+		if ( sps.sps_part[i].sp_rc != LDAP_SUCCESS && rc == LDAP_SUCCESS )
+			rc = sps.sps_part[i].sp_rc;
+	}
+
+	if ( rc == LDAP_SUCCESS && syncparts_merge( &sps, &sc ) == 0 ) {
+		rc = syncrepl_updateCookie( si, op, &sc, 1 );
+		if ( rc == LDAP_SUCCESS ) {
+			ber_bvarray_free( si->si_syncCookie.ctxcsn );
+			ch_free( si->si_syncCookie.sids );
+			si->si_syncCookie.ctxcsn = sc.ctxcsn;
+			si->si_syncCookie.sids = sc.sids;
+			si->si_syncCookie.numcsns = sc.numcsns;
+			sc.ctxcsn = NULL;
+			sc.sids = NULL;
+		}
+		slap_sync_cookie_free( &sc, 0 );
+	} else if ( rc == LDAP_SUCCESS ) {
+		Debug( LDAP_DEBUG_ANY, "syncparts_refresh: %s "
+			"partitions returned inconsistent cookies\n",
+			si->si_ridtxt );
+		rc = LDAP_OTHER;
+	}
+
+	Debug( rc ? LDAP_DEBUG_ANY : LDAP_DEBUG_SYNC, "syncparts_refresh: %s "
+		"initial refresh of %lu entries in %d partitions done (%d)\n",
+		si->si_ridtxt, nentries, sps.sps_nparts, rc );
+
+	for ( i = 0; i < sps.sps_nparts; i++ )
+		slap_sync_cookie_free( &sps.sps_part[i].sp_cookie, 0 );
+	ch_free( sps.sps_part );
+	ldap_pvt_thread_cond_destroy( &sps.sps_cond );
+	ldap_pvt_thread_mutex_destroy( &sps.sps_mutex );
+
+	/* ldap_sync_search() takes it again */
+	ldap_pvt_thread_mutex_lock( &si->si_cookieState->cs_refresh_mutex );
+	if ( si->si_cookieState->cs_refreshing == si )
+		si->si_cookieState->cs_refreshing = NULL;
+	ldap_pvt_thread_mutex_unlock( &si->si_cookieState->cs_refresh_mutex );
+
+	if ( rc == SYNC_SHUTDOWN )
+		return rc;
+	return LDAP_SUCCESS;
 }
 
 static int
@@ -1321,6 +2459,7 @@ do_syncrep2(
 	struct timeval tout = { 0, 0 };
 
 	int		refreshDeletes = 0;
+	int		nmsgs = 0;
 	int		refreshing = !si->si_refreshDone &&
 			!( si->si_syncdata && si->si_logstate == SYNCLOG_LOGGING );
 	char empty[6] = "empty";
@@ -1337,6 +2476,17 @@ do_syncrep2(
 
 	slap_dup_sync_cookie( &syncCookie_req, &si->si_syncCookie );
 
+	if ( si->si_applythreads > 1 && !si->si_apply && refreshing &&
+		!si->si_rewrite && !si->si_is_configdb &&
+		si->si_syncdata != SYNCDATA_CHANGELOG
+#ifdef LDAP_CONTROL_X_DIRSYNC
+		&& si->si_ctype != MSAD_DIRSYNC
+#endif
+		)
+	{
+		si->si_apply = syncapply_init( si, op->o_bd );
+	}
+
 	if ( abs(si->si_type) == LDAP_SYNC_REFRESH_AND_PERSIST && si->si_refreshDone ) {
 		tout.tv_sec = 0;
 	} else {
@@ -1361,9 +2511,18 @@ do_syncrep2(
 			rc = SYNC_SHUTDOWN;
 			goto done;
 		}
+		/* only refresh entries may overtake each other */
+		if ( si->si_apply &&
+			( !refreshing || ldap_msgtype( msg ) != LDAP_RES_SEARCH_ENTRY ) &&
+			( rc = syncapply_wait( si->si_apply, 0 )))
+			goto done;
 		si->si_lastcontact = slap_get_time();
+		if ( ++nmsgs % SYNCSTATS_BATCH == 0 )
+			syncstats_phase( si );
 		switch( ldap_msgtype( msg ) ) {
 		case LDAP_RES_SEARCH_ENTRY:
+			if ( si->si_stats )
+				SS_ADD( si->si_stats, SS_RECEIVED, 1 );
 #ifdef LDAP_CONTROL_X_DIRSYNC
 			if ( si->si_ctype == MSAD_DIRSYNC ) {
 				BER_BVZERO( &syncUUID[0] );
@@ -1498,6 +2657,13 @@ do_syncrep2(
 						}
 						si->si_too_old = 0;
 
+						/* entries with a cookie are applied in order */
+						if ( si->si_apply &&
+							( rc = syncapply_wait( si->si_apply, 0 ))) {
+							ldap_controls_free( rctrls );
+							goto done;
+						}
+
 						/* check pending CSNs too */
 						if (( rc = get_pmutex( si )))
 							goto done;
@@ -1563,18 +2729,50 @@ logerr:
 			} else if ( ( rc = syncrepl_message_to_entry( si, op, msg,
 				&modlist, &entry, syncstate, syncUUID ) ) == LDAP_SUCCESS )
 			{
-				if ( punlock < 0 ) {
-					if (( rc = get_pmutex( si )))
-						goto done;
-				}
-				if ( ( rc = syncrepl_entry( si, op, entry, &modlist,
-					syncstate, syncUUID, syncCookie.ctxcsn ) ) == LDAP_SUCCESS &&
-					syncCookie.ctxcsn )
+				if ( si->si_apply && refreshing && punlock < 0 &&
+					!syncCookie.ctxcsn && syncstate == LDAP_SYNC_PRESENT )
 				{
-					rc = syncrepl_updateCookie( si, op, &syncCookie, 0 );
+					/* only touches the present list */
+					rc = syncrepl_entry( si, op, entry, &modlist,
+						syncstate, syncUUID, NULL );
+				} else if ( si->si_apply && refreshing && punlock < 0 &&
+					!syncCookie.ctxcsn && entry &&
+					( syncstate == LDAP_SYNC_ADD || syncstate == LDAP_SYNC_MODIFY ))
+				{
+					rc = syncapply_queue( si, msg, entry, modlist,
+						syncstate, syncUUID );
+					slap_sl_free( syncUUID[1].bv_val, op->o_tmpmemctx );
+					BER_BVZERO( &syncUUID[1] );
+					if ( rc == LDAP_SUCCESS ) {
+						msg = NULL;
+						modlist = NULL;
+					} else {
+						entry_free( entry );
+					}
+				} else {
+					if ( si->si_apply && punlock < 0 &&
+						( rc = syncapply_wait( si->si_apply, 0 )))
+					{
+						if ( entry )
+							entry_free( entry );
+						ldap_controls_free( rctrls );
+						if ( modlist )
+							slap_mods_free( modlist, 1 );
+						goto done;
+					}
+					if ( punlock < 0 ) {
+						if (( rc = get_pmutex( si )))
+							goto done;
+					}
+					if ( ( rc = syncrepl_entry( si, op, entry, &modlist,
+						syncstate, syncUUID, syncCookie.ctxcsn ) ) == LDAP_SUCCESS &&
+						syncCookie.ctxcsn )
+					{
+						rc = syncrepl_updateCookie( si, op, &syncCookie, 0 );
+					}
+					if ( punlock < 0 )
+						ldap_pvt_thread_mutex_unlock( &si->si_cookieState->cs_pmutex );
 				}
-				if ( punlock < 0 )
-					ldap_pvt_thread_mutex_unlock( &si->si_cookieState->cs_pmutex );
 			}
 			if ( punlock >= 0 ) {
 				/* on failure, revert pending CSN */
@@ -1978,6 +3176,9 @@ logerr:
 		ldap_msgfree( msg );
 		msg = NULL;
 		if ( ldap_pvt_thread_pool_pausing( &connection_pool )) {
+			if ( si->si_apply &&
+				( rc = syncapply_wait( si->si_apply, 0 )))
+				goto done;
 			slap_sync_cookie_free( &syncCookie, 0 );
 			slap_sync_cookie_free( &syncCookie_req, 0 );
 			return SYNC_PAUSED;
@@ -1991,6 +3192,11 @@ logerr:
 	}
 
 done:
+	if ( si->si_apply ) {
+		int arc = syncapply_wait( si->si_apply, 0 );
+		if ( arc && !rc )
+			rc = arc;
+	}
 	if ( err != LDAP_SUCCESS ) {
 		Debug( LDAP_DEBUG_ANY,
 			"do_syncrep2: %s (%d) %s\n",
@@ -1999,6 +3205,8 @@ done:
 	if ( refreshing && ( rc || si->si_refreshDone ) ) {
 		refresh_finished( si );
 	}
+	if ( nmsgs )
+		syncstats_phase( si );
 
 	slap_sync_cookie_free( &syncCookie, 0 );
 	slap_sync_cookie_free( &syncCookie_req, 0 );
@@ -2015,6 +3223,7 @@ done:
 		}
 		ldap_unbind_ext( si->si_ld, NULL, NULL );
 		si->si_ld = NULL;
+		syncstats_phase( si );
 	}
 
 	return rc;
@@ -2048,6 +3257,7 @@ do_syncrepl(
 		return NULL;
 
 	if ( !si->si_monitorInited ) {
+		syncstats_open( si );
 		syncrepl_monitor_add( si );
 		si->si_monitorInited = 1;
 	}
@@ -2447,6 +3657,121 @@ syncrepl_accesslog_mods(
 	return rc;
 }
 
+/* Same as syncrepl_accesslog_mods, from a reqModBinary value. It holds
+ * the modification list of an LDAP ModifyRequest.
+ */
+static int
+syncrepl_accesslog_binmods(
+	syncinfo_t *si,
+	struct berval *val,
+	struct Modifications **modres
+)
+{
+	BerElementBuffer berbuf;
+	BerElement *ber = (BerElement *)&berbuf;
+	ber_tag_t tag;
+	ber_len_t len;
+	char *last;
+	const char *text;
+	Modifications *mod, *modlist = NULL, **modtail;
+	int rc = 0;
+
+	modtail = &modlist;
+	ber_init2( ber, val, 0 );
+
+	for ( tag = ber_first_element( ber, &len, &last );
+		tag != LBER_DEFAULT;
+		tag = ber_next_element( ber, &len, last ) )
+	{
+		AttributeDescription *ad = NULL;
+		struct berval type, bv2;
+		BerVarray vals = NULL;
+		ber_int_t mop;
+		short op;
+		int i;
+
+		if ( ber_scanf( ber, "{e{m[W]}}", &mop, &type, &vals )
+			== LBER_ERROR )
+		{
+			Debug( LDAP_DEBUG_ANY, "syncrepl_accesslog_binmods: %s "
+				"decoding error\n", si->si_ridtxt );
+			rc = -1;
+			break;
+		}
+
+		switch ( mop ) {
+		case LDAP_MOD_ADD:	op = LDAP_MOD_ADD; break;
+		case LDAP_MOD_DELETE:	op = LDAP_MOD_DELETE; break;
+		case LDAP_MOD_REPLACE:	op = LDAP_MOD_REPLACE; break;
+		case LDAP_MOD_INCREMENT:	op = LDAP_MOD_INCREMENT; break;
+		default:
+			ber_bvarray_free( vals );
+			continue;
+		}
+
+		if ( slap_bv2ad( &type, &ad, &text ) ) {
+			/* Invalid */
+			Debug( LDAP_DEBUG_ANY, "syncrepl_accesslog_binmods: %s "
+				"Invalid attribute %s, %s\n",
+				si->si_ridtxt, type.bv_val, text );
+			ber_bvarray_free( vals );
+			rc = -1;
+			break;
+		}
+
+		/* Ignore dynamically generated and excluded attrs */
+		if ( ( ad->ad_type->sat_flags & SLAP_AT_DYNAMIC ) ||
+			ldap_charray_inlist( si->si_exattrs,
+				ad->ad_type->sat_cname.bv_val ) )
+		{
+			ber_bvarray_free( vals );
+			continue;
+		}
+
+		mod = (Modifications *) ch_malloc( sizeof( Modifications ) );
+		mod->sml_flags = 0;
+		mod->sml_op = op;
+		mod->sml_next = NULL;
+		mod->sml_desc = ad;
+		mod->sml_type = ad->ad_cname;
+		mod->sml_values = vals;
+		mod->sml_nvalues = NULL;
+		mod->sml_numvals = 0;
+
+		if ( is_at_single_value( ad->ad_type ) ) {
+			if ( op == LDAP_MOD_ADD ) {
+				/* ITS#9295 an ADD might conflict with an existing value */
+				mod->sml_op = LDAP_MOD_REPLACE;
+			} else if ( op == LDAP_MOD_DELETE ) {
+				/* ITS#9295 the above REPLACE could invalidate subsequent
+				 * DELETEs */
+				mod->sml_op = SLAP_MOD_SOFTDEL;
+			}
+		}
+
+		for ( i = 0; vals && !BER_BVISNULL( &vals[i] ); i++ ) {
+			if ( si->si_rewrite && ad->ad_type->sat_syntax ==
+				slap_schema.si_syn_distinguishedName )
+			{
+				REWRITE_VAL( si, ad, vals[i], bv2 );
+				ch_free( vals[i].bv_val );
+				vals[i] = bv2;
+			}
+		}
+		mod->sml_numvals = i;
+
+		*modtail = mod;
+		modtail = &mod->sml_next;
+	}
+
+	if ( rc ) {
+		slap_mods_free( modlist, 1 );
+		modlist = NULL;
+	}
+	*modres = modlist;
+	return rc;
+}
+
 static int
 syncrepl_dsee_uuid(
 	struct berval *dseestr,
@@ -3057,7 +4382,7 @@ syncrepl_message_to_op(
 	size_t textlen = sizeof txtbuf;
 
 	struct berval	bdn, dn = BER_BVNULL, ndn;
-	struct berval	bv, bv2, *bvals = NULL;
+	struct berval	bv, bv2, *bvals = NULL, *modvals = NULL;
 	struct berval	rdn = BER_BVNULL, sup = BER_BVNULL,
 		prdn = BER_BVNULL, nrdn = BER_BVNULL,
 		psup = BER_BVNULL, nsup = BER_BVNULL;
@@ -3065,6 +4390,7 @@ syncrepl_message_to_op(
 	int		rc, deleteOldRdn = 0, freeReqDn = 0;
 	int		do_graduate = 0, do_unlock = 0;
 	unsigned long changenum = 0;
+	syncstats_timer	st = { { 0, 0 } };
 
 	if ( ldap_msgtype( msg ) != LDAP_RES_SEARCH_ENTRY ) {
 		Debug( LDAP_DEBUG_ANY, "syncrepl_message_to_op: %s "
@@ -3129,13 +4455,24 @@ syncrepl_message_to_op(
 			}
 			op->o_tag = modops[i].mask;
 		} else if ( !ber_bvstrcasecmp( &bv, &ls->ls_mod ) ) {
-			/* Parse attribute into modlist */
+			/* Parse attribute into modlist, the text form only
+			 * if there's no reqModBinary */
 			if ( si->si_syncdata == SYNCDATA_ACCESSLOG ) {
-				rc = syncrepl_accesslog_mods( si, bvals, &modlist );
+				if ( !modlist && !modvals ) {
+					modvals = bvals;
+					continue;
+				}
 			} else {
 				dsee_mods = bvals[0];
 			}
-			if ( rc ) goto done;
+		} else if ( !BER_BVISNULL( &ls->ls_modbin ) &&
+			!ber_bvstrcasecmp( &bv, &ls->ls_modbin ) )
+		{
+			rc = syncrepl_accesslog_binmods( si, bvals, &modlist );
+			if ( rc ) {
+				ch_free( bvals );
+				goto done;
+			}
 		} else if ( !ber_bvstrcasecmp( &bv, &ls->ls_newRdn ) ) {
 			rdn = bvals[0];
 		} else if ( !ber_bvstrcasecmp( &bv, &ls->ls_delRdn ) ) {
@@ -3177,10 +4514,20 @@ syncrepl_message_to_op(
 			}
 			slap_queue_csn( op, bvals );
 			do_graduate = 1;
+			syncstats_begin( si, &st, bvals );
 		}
 		ch_free( bvals );
 	}
 
+	if ( modvals ) {
+		if ( !modlist )
+			rc = syncrepl_accesslog_mods( si, modvals, &modlist );
+		ch_free( modvals );
+		modvals = NULL;
+		if ( rc )
+			goto done;
+	}
+
 	/* don't parse mods until we've gotten the uuid */
 	if ( si->si_syncdata == SYNCDATA_CHANGELOG && !BER_BVISNULL( &dsee_mods )) {
 		rc = syncrepl_changelog_mods( si, op->o_tag,
@@ -3339,6 +4686,8 @@ syncrepl_message_to_op(
 	}
 	if ( si->si_syncdata == SYNCDATA_CHANGELOG && !rc )
 		si->si_lastchange = changenum;
+	if ( rc == LDAP_SUCCESS && st.st_start.tv_sec )
+		syncstats_end( si, &st );
 
 done:
 	if ( do_graduate )
@@ -3348,6 +4697,9 @@ done:
 	op->o_bd = si->si_be;
 	op->o_tmpfree( op->o_csn.bv_val, op->o_tmpmemctx );
 	BER_BVZERO( &op->o_csn );
+	if ( modvals ) {
+		ch_free( modvals );
+	}
 	if ( modlist ) {
 		slap_mods_free( modlist, op->o_tag != LDAP_REQ_ADD );
 	}
@@ -3991,104 +5343,113 @@ typedef struct dninfo {
 	AttributeDescription *newDesc;	/* for renames */
 } dninfo;
 
-#define HASHUUID	1
+/* Sort order of the present list */
+static int
+presentlist_cmp( const void *v_uuid1, const void *v_uuid2 )
+{
+	return memcmp( v_uuid1, v_uuid2, UUIDLEN );
+}
 
-/* return 1 if inserted, 0 otherwise */
+/* Append a UUID, return 0 if it is not a valid one. Duplicates are
+ * accepted and only dropped when the list gets sorted. */
 static int
 presentlist_insert(
 	syncinfo_t* si,
 	struct berval *syncUUID )
 {
-	char *val;
+	presentlist *pl;
 
-#ifdef HASHUUID
-	Avlnode **av;
-	unsigned short s;
-
-	if ( !si->si_presentlist )
-		si->si_presentlist = ch_calloc(65536, sizeof( Avlnode * ));
+	if ( syncUUID->bv_len != UUIDLEN )
+		return 0;
 
-	av = (Avlnode **)si->si_presentlist;
+	/* parallel apply workers add to it too */
+	if ( si->si_apply )
+		ldap_pvt_thread_mutex_lock( &si->si_apply->sa_mutex );
+	pl = si->si_presentlist;
+	if ( !pl ) {
+		pl = ch_calloc( 1, sizeof( presentlist ) );
+		si->si_presentlist = pl;
+	}
+	if ( pl->pl_num == pl->pl_max ) {
+		pl->pl_max = pl->pl_max ? pl->pl_max * 2 : 1024;
+		pl->pl_uuids = ch_realloc( pl->pl_uuids, pl->pl_max * UUIDLEN );
+	}
 
-	val = ch_malloc(UUIDLEN-2);
-	memcpy(&s, syncUUID->bv_val, 2);
-	memcpy(val, syncUUID->bv_val+2, UUIDLEN-2);
+	/* Duplicates are only weeded out once the list is sorted */
+	AC_MEMCPY( pl->pl_uuids[pl->pl_num], syncUUID->bv_val, UUIDLEN );
+	pl->pl_num++;
+	if ( si->si_apply )
+		ldap_pvt_thread_mutex_unlock( &si->si_apply->sa_mutex );
 
-	if ( ldap_avl_insert( &av[s], val,
-		syncuuid_cmp, ldap_avl_dup_error ) )
-	{
-		ch_free( val );
-		return 0;
-	}
-#else
-	val = ch_malloc(UUIDLEN);
+	return 1;
+}
 
-	AC_MEMCPY( val, syncUUID->bv_val, UUIDLEN );
+/* Sort whatever was appended since the last lookup and drop duplicates.
+ * Matches are only counted from the last sort on, lookups are not
+ * expected before the refresh is done adding to the list. */
+static void
+presentlist_sort( presentlist *pl )
+{
+	unsigned long i, j;
 
-	if ( ldap_avl_insert( &si->si_presentlist, val,
-		syncuuid_cmp, ldap_avl_dup_error ) )
-	{
-		ch_free( val );
-		return 0;
+	qsort( pl->pl_uuids, pl->pl_num, UUIDLEN, presentlist_cmp );
+	for ( i = 0, j = 1; j < pl->pl_num; j++ ) {
+		if ( memcmp( pl->pl_uuids[i], pl->pl_uuids[j], UUIDLEN ) ) {
+			i++;
+			if ( i != j )
+				AC_MEMCPY( pl->pl_uuids[i], pl->pl_uuids[j], UUIDLEN );
+		}
 	}
-#endif
+	if ( pl->pl_num )
+		pl->pl_num = i + 1;
+	pl->pl_sorted = pl->pl_num;
 
-	return 1;
+	ch_free( pl->pl_hits );
+	pl->pl_hits = ch_calloc( 1, pl->pl_num / 8 + 1 );
+	pl->pl_found = 0;
 }
 
 static char *
 presentlist_find(
-	Avlnode *av,
+	presentlist *pl,
 	struct berval *val )
 {
-#ifdef HASHUUID
-	Avlnode **a2 = (Avlnode **)av;
-	unsigned short s;
+	char *found;
 
-	if (!av)
+	if ( !pl || val->bv_len != UUIDLEN )
 		return NULL;
 
-	memcpy(&s, val->bv_val, 2);
-	return ldap_avl_find( a2[s], val->bv_val+2, syncuuid_cmp );
-#else
-	return ldap_avl_find( av, val->bv_val, syncuuid_cmp );
-#endif
-}
+	if ( pl->pl_sorted != pl->pl_num )
+		presentlist_sort( pl );
 
-static int
-presentlist_free( Avlnode *av )
-{
-#ifdef HASHUUID
-	Avlnode **a2 = (Avlnode **)av;
-	int i, count = 0;
+	found = bsearch( val->bv_val, pl->pl_uuids, pl->pl_num, UUIDLEN,
+		presentlist_cmp );
+	if ( found ) {
+		unsigned long i = ( found - (char *)pl->pl_uuids ) / UUIDLEN;
 
-	if ( av ) {
-		for (i=0; i<65536; i++) {
-			if (a2[i])
-				count += ldap_avl_free( a2[i], ch_free );
+		if ( !( pl->pl_hits[i / 8] & ( 1 << ( i % 8 )))) {
+			pl->pl_hits[i / 8] |= 1 << ( i % 8 );
+			pl->pl_found++;
 		}
-		ch_free( av );
 	}
-	return count;
-#else
-	return ldap_avl_free( av, ch_free );
-#endif
+	return found;
 }
 
-static void
-presentlist_delete(
-	Avlnode **av,
-	struct berval *val )
+/* returns the number of UUIDs that were never looked up */
+static int
+presentlist_free( presentlist *pl )
 {
-#ifdef HASHUUID
-	Avlnode **a2 = *(Avlnode ***)av;
-	unsigned short s;
-
-	memcpy(&s, val->bv_val, 2);
-	ldap_avl_delete( &a2[s], val->bv_val+2, syncuuid_cmp );
-#else
-	ldap_avl_delete( av, val->bv_val, syncuuid_cmp );
-#endif
+	int count = 0;
+
+	if ( pl ) {
+		if ( pl->pl_sorted != pl->pl_num )
+			presentlist_sort( pl );
+		count = pl->pl_num - pl->pl_found;
+		ch_free( pl->pl_hits );
+		ch_free( pl->pl_uuids );
+		ch_free( pl );
+	}
+	return count;
 }
 
 static int
@@ -4114,13 +5475,15 @@ syncrepl_entry(
 	dninfo dni = {0};
 	int	retry = 1;
 	int	freecsn = 1;
+	syncstats_timer	st;
 
 	Debug( LDAP_DEBUG_SYNC,
 		"syncrepl_entry: %s LDAP_RES_SEARCH_ENTRY(LDAP_SYNC_%s) csn=%s tid %p\n",
 		si->si_ridtxt, syncrepl_state2str( syncstate ), syncCSN ? syncCSN->bv_val : "(none)", (void *)op->o_tid );
 
 	if (( syncstate == LDAP_SYNC_PRESENT || syncstate == LDAP_SYNC_ADD ) ) {
-		if ( !si->si_refreshPresent && !si->si_refreshDone ) {
+		if ( !si->si_refreshPresent && !si->si_refreshDone &&
+			!si->si_partitioning ) {
 			syncuuid_inserted = presentlist_insert( si, syncUUID );
 		}
 	}
@@ -4133,6 +5496,13 @@ syncrepl_entry(
 		}
 	}
 
+	if ( si->si_stats ) {
+		Attribute *a = NULL;
+		if ( entry )
+			a = attr_find( entry->e_attrs, slap_schema.si_ad_entryCSN );
+		syncstats_begin( si, &st, a ? &a->a_nvals[0] : syncCSN );
+	}
+
 	if ( syncstate != LDAP_SYNC_DELETE ) {
 		Attribute	*a = attr_find( entry->e_attrs, slap_schema.si_ad_entryUUID );
 
@@ -4696,6 +6066,8 @@ done:
 		op->o_tmpfree( op->o_csn.bv_val, op->o_tmpmemctx );
 	}
 	BER_BVZERO( &op->o_csn );
+	if ( rc == LDAP_SUCCESS )
+		syncstats_end( si, &st );
 	return rc;
 }
 
@@ -5909,9 +7281,6 @@ nonpresent_callback(
 					si->si_ridtxt, np_entry->npe_name->bv_val );
 			}
 
-		} else {
-			presentlist_delete( &si->si_presentlist, &a->a_nvals[0] );
-			ch_free( present_uuid );
 		}
 	}
 	return LDAP_SUCCESS;
@@ -6020,16 +7389,6 @@ done:;
 	return new;
 }
 
-static int
-syncuuid_cmp( const void* v_uuid1, const void* v_uuid2 )
-{
-#ifdef HASHUUID
-	return ( memcmp( v_uuid1, v_uuid2, UUIDLEN-2 ));
-#else
-	return ( memcmp( v_uuid1, v_uuid2, UUIDLEN ));
-#endif
-}
-
 void
 syncinfo_free( syncinfo_t *sie, int free_all )
 {
@@ -6089,6 +7448,10 @@ syncinfo_free( syncinfo_t *sie, int free_all )
 		if ( sie->si_logbase.bv_val ) {
 			ch_free( sie->si_logbase.bv_val );
 		}
+		syncstats_close( sie );
+		if ( sie->si_statsfile ) {
+			ch_free( sie->si_statsfile );
+		}
 		if ( sie->si_be && SLAP_SYNC_SUBENTRY( sie->si_be )) {
 			ch_free( sie->si_contextdn.bv_val );
 		}
@@ -6142,6 +7505,9 @@ syncinfo_free( syncinfo_t *sie, int free_all )
 		if ( sie->si_presentlist ) {
 		    presentlist_free( sie->si_presentlist );
 		}
+		if ( sie->si_apply ) {
+			syncapply_free( sie->si_apply );
+		}
 		while ( !LDAP_LIST_EMPTY( &sie->si_nonpresentlist ) ) {
 			struct nonpresent_entry* npe;
 			npe = LDAP_LIST_FIRST( &sie->si_nonpresentlist );
@@ -6244,6 +7610,10 @@ config_suffixm( ConfigArgs *c, syncinfo_t *si )
 #define SUFFIXMSTR		"suffixmassage"
 #define	STRICT_REFRESH	"strictrefresh"
 #define LAZY_COMMIT		"lazycommit"
+#define APPLYTHREADSSTR	"applythreads"
+#define STATSFILESTR	"statsfile"
+#define COMPRESSSTR		"compress"
+#define REFRESHPARTSSTR	"refreshpartitions"
 
 /* FIXME: undocumented */
 #define EXATTRSSTR		"exattrs"
@@ -6731,6 +8101,56 @@ parse_syncrepl_line(
 				return 1;
 			}
 			si->si_got |= GOT_SLIMIT;
+		} else if ( !strncasecmp( c->argv[ i ], APPLYTHREADSSTR "=",
+					STRLENOF( APPLYTHREADSSTR "=" ) ) )
+		{
+			val = c->argv[ i ] + STRLENOF( APPLYTHREADSSTR "=" );
+			if ( lutil_atoi( &si->si_applythreads, val ) != 0 ||
+				si->si_applythreads < 1 )
+			{
+				snprintf( c->cr_msg, sizeof( c->cr_msg ),
+					"invalid apply threads value \"%s\".\n",
+					val );
+				Debug( LDAP_DEBUG_ANY, "%s: %s.\n", c->log, c->cr_msg );
+				return 1;
+			}
+		} else if ( !strncasecmp( c->argv[ i ], REFRESHPARTSSTR "=",
+					STRLENOF( REFRESHPARTSSTR "=" ) ) )
+		{
+			val = c->argv[ i ] + STRLENOF( REFRESHPARTSSTR "=" );
+			if ( lutil_atoi( &si->si_refreshparts, val ) != 0 ||
+				si->si_refreshparts < 1 ||
+				si->si_refreshparts > SYNCPARTS_MAX )
+			{
+				snprintf( c->cr_msg, sizeof( c->cr_msg ),
+					"invalid refresh partitions value \"%s\".\n",
+					val );
+				Debug( LDAP_DEBUG_ANY, "%s: %s.\n", c->log, c->cr_msg );
+				return 1;
+			}
+		} else if ( !strncasecmp( c->argv[ i ], STATSFILESTR "=",
+					STRLENOF( STATSFILESTR "=" ) ) )
+		{
+			val = c->argv[ i ] + STRLENOF( STATSFILESTR "=" );
+			if ( si->si_statsfile ) {
+				ch_free( si->si_statsfile );
+			}
+			si->si_statsfile = ch_strdup( val );
+		} else if ( !strncasecmp( c->argv[ i ], COMPRESSSTR "=",
+					STRLENOF( COMPRESSSTR "=" ) ) )
+		{
+			val = c->argv[ i ] + STRLENOF( COMPRESSSTR "=" );
+			if ( !strcasecmp( val, LDAP_COMPRESS_DEFLATE ) ) {
+				si->si_compress = 1;
+			} else if ( !strcasecmp( val, "none" ) ) {
+				si->si_compress = 0;
+			} else {
+				snprintf( c->cr_msg, sizeof( c->cr_msg ),
+					"unknown compression method \"%s\".\n",
+					val );
+				Debug( LDAP_DEBUG_ANY, "%s: %s.\n", c->log, c->cr_msg );
+				return 1;
+			}
 		} else if ( !strncasecmp( c->argv[ i ], TLIMITSTR "=",
 					STRLENOF( TLIMITSTR "=" ) ) )
 		{
@@ -6852,7 +8272,17 @@ static ObjectClass	*oc_olmSyncRepl;
 static AttributeDescription	*ad_olmProviderURIList,
 	*ad_olmConnection, *ad_olmSyncPhase,
 	*ad_olmNextConnect, *ad_olmLastConnect, *ad_olmLastContact,
-	*ad_olmLastCookieRcvd, *ad_olmLastCookieSent;
+	*ad_olmLastCookieRcvd, *ad_olmLastCookieSent,
+	*ad_olmChangesReceived, *ad_olmChangesApplied, *ad_olmApplyQueue,
+	*ad_olmBytesReceived, *ad_olmBytesSent, *ad_olmRefreshTime,
+	*ad_olmPersistTime, *ad_olmCSNLag, *ad_olmApplyLatency;
+
+/* the counters from SS_RECEIVED up to SS_LATENCY, in that order */
+static AttributeDescription **syncstats_ads[] = {
+	&ad_olmChangesReceived, &ad_olmChangesApplied, &ad_olmApplyQueue,
+	&ad_olmBytesReceived, &ad_olmBytesSent, &ad_olmRefreshTime,
+	&ad_olmPersistTime, &ad_olmCSNLag
+};
 
 static struct {
 	char *name;
@@ -6928,6 +8358,69 @@ static struct {
 		"NO-USER-MODIFICATION "
 		"USAGE dSAOperation )",
 		&ad_olmLastCookieSent },
+	{ "( olmSyncReplAttributes:9 "
+		"NAME ( 'olmSRChangesReceived' ) "
+		"DESC 'Number of changes received from provider' "
+		"SUP monitorCounter "
+		"NO-USER-MODIFICATION "
+		"USAGE dSAOperation )",
+		&ad_olmChangesReceived },
+	{ "( olmSyncReplAttributes:10 "
+		"NAME ( 'olmSRChangesApplied' ) "
+		"DESC 'Number of changes applied locally' "
+		"SUP monitorCounter "
+		"NO-USER-MODIFICATION "
+		"USAGE dSAOperation )",
+		&ad_olmChangesApplied },
+	{ "( olmSyncReplAttributes:11 "
+		"NAME ( 'olmSRApplyQueue' ) "
+		"DESC 'Number of received changes waiting to be applied' "
+		"SUP monitorCounter "
+		"NO-USER-MODIFICATION "
+		"USAGE dSAOperation )",
+		&ad_olmApplyQueue },
+	{ "( olmSyncReplAttributes:12 "
+		"NAME ( 'olmSRBytesReceived' ) "
+		"DESC 'Number of bytes received from provider' "
+		"SUP monitorCounter "
+		"NO-USER-MODIFICATION "
+		"USAGE dSAOperation )",
+		&ad_olmBytesReceived },
+	{ "( olmSyncReplAttributes:13 "
+		"NAME ( 'olmSRBytesSent' ) "
+		"DESC 'Number of bytes sent to provider' "
+		"SUP monitorCounter "
+		"NO-USER-MODIFICATION "
+		"USAGE dSAOperation )",
+		&ad_olmBytesSent },
+	{ "( olmSyncReplAttributes:14 "
+		"NAME ( 'olmSRRefreshTime' ) "
+		"DESC 'Milliseconds spent in refresh phase' "
+		"SUP monitorCounter "
+		"NO-USER-MODIFICATION "
+		"USAGE dSAOperation )",
+		&ad_olmRefreshTime },
+	{ "( olmSyncReplAttributes:15 "
+		"NAME ( 'olmSRPersistTime' ) "
+		"DESC 'Milliseconds spent in persist phase' "
+		"SUP monitorCounter "
+		"NO-USER-MODIFICATION "
+		"USAGE dSAOperation )",
+		&ad_olmPersistTime },
+	{ "( olmSyncReplAttributes:16 "
+		"NAME ( 'olmSRCSNLag' ) "
+		"DESC 'Age in milliseconds of the CSN of the last applied change' "
+		"SUP monitorCounter "
+		"NO-USER-MODIFICATION "
+		"USAGE dSAOperation )",
+		&ad_olmCSNLag },
+	{ "( olmSyncReplAttributes:17 "
+		"NAME ( 'olmSRApplyLatency' ) "
+		"DESC 'Histogram of apply latencies, as bucket bound and count' "
+		"SUP monitoredInfo "
+		"NO-USER-MODIFICATION "
+		"USAGE dSAOperation )",
+		&ad_olmApplyLatency },
 	{ NULL }
 };
 
@@ -6947,6 +8440,15 @@ static struct {
 			"$ olmSRLastContact "
 			"$ olmSRLastCookieRcvd "
 			"$ olmSRLastCookieSent "
+			"$ olmSRChangesReceived "
+			"$ olmSRChangesApplied "
+			"$ olmSRApplyQueue "
+			"$ olmSRBytesReceived "
+			"$ olmSRBytesSent "
+			"$ olmSRRefreshTime "
+			"$ olmSRPersistTime "
+			"$ olmSRCSNLag "
+			"$ olmSRApplyLatency "
 			") )",
 		&oc_olmSyncRepl },
 	{ NULL }
@@ -7124,6 +8626,33 @@ syncrepl_monitor_update(
 		ber_bvreplace( &a->a_vals[0], &si->si_lastCookieSent );
 	ldap_pvt_thread_mutex_unlock( &si->si_monitor_mutex );
 
+	if ( si->si_stats ) {
+		char buf[ 64 ];
+		struct berval bv;
+		int i;
+
+		syncstats_phase( si );
+		bv.bv_val = buf;
+		for ( i = 0; i < SS_LATENCY - SS_RECEIVED; i++ ) {
+			a = a->a_next;
+			if ( !a || a->a_desc != *syncstats_ads[i] )
+				break;
+			bv.bv_len = snprintf( buf, sizeof( buf ), "%lu",
+				SS_GET( si->si_stats, SS_RECEIVED + i ));
+			ber_bvreplace( &a->a_vals[0], &bv );
+		}
+		if ( i == SS_LATENCY - SS_RECEIVED ) {
+			a = a->a_next;
+			if ( a && a->a_desc == ad_olmApplyLatency ) {
+				for ( i = 0; i < SS_NLATENCY && !BER_BVISNULL( &a->a_vals[i] ); i++ ) {
+					bv.bv_len = snprintf( buf, sizeof( buf ), "%s %lu",
+						syncstats_labels[i], SS_GET( si->si_stats, SS_LATENCY + i ));
+					ber_bvreplace( &a->a_vals[i], &bv );
+				}
+			}
+		}
+	}
+
 	return SLAP_CB_CONTINUE;
 }
 
@@ -7201,6 +8730,20 @@ syncrepl_monitor_add(
 		attr_merge_normalize_one( e, ad_olmLastCookieRcvd, &bv, NULL );
 		attr_merge_normalize_one( e, ad_olmLastCookieSent, &bv, NULL );
 	}
+	if ( si->si_stats ) {
+		char buf[ 64 ];
+		struct berval bv = BER_BVC("0");
+		int i;
+
+		for ( i = 0; i < SS_LATENCY - SS_RECEIVED; i++ )
+			attr_merge_one( e, *syncstats_ads[i], &bv, NULL );
+		bv.bv_val = buf;
+		for ( i = 0; i < SS_NLATENCY; i++ ) {
+			bv.bv_len = snprintf( buf, sizeof( buf ), "%s 0",
+				syncstats_labels[i] );
+			attr_merge_one( e, ad_olmApplyLatency, &bv, NULL );
+		}
+	}
 	{
 		monitor_callback_t *cb = ch_calloc( sizeof( monitor_callback_t ), 1 );
 		cb->mc_update = syncrepl_monitor_update;
@@ -7589,6 +9132,31 @@ syncrepl_unparse( syncinfo_t *si, struct berval *bv )
 		ptr = lutil_strcopy( ptr, " " LAZY_COMMIT );
 	}
 
+	if ( si->si_applythreads > 1 ) {
+		len = snprintf( ptr, WHATSLEFT, " " APPLYTHREADSSTR "=%d", si->si_applythreads );
+		if ( WHATSLEFT <= len ) return;
+		ptr += len;
+	}
+
+	if ( si->si_refreshparts > 1 ) {
+		len = snprintf( ptr, WHATSLEFT, " " REFRESHPARTSSTR "=%d", si->si_refreshparts );
+		if ( WHATSLEFT <= len ) return;
+		ptr += len;
+	}
+
+	if ( si->si_statsfile ) {
+		len = strlen( si->si_statsfile );
+		if ( WHATSLEFT <= STRLENOF( " " STATSFILESTR "=\"" "\"" ) + len ) return;
+		ptr = lutil_strcopy( ptr, " " STATSFILESTR "=\"" );
+		ptr = lutil_strcopy( ptr, si->si_statsfile );
+		*ptr++ = '"';
+	}
+
+	if ( si->si_compress ) {
+		if ( WHATSLEFT <= STRLENOF( " " COMPRESSSTR "=" LDAP_COMPRESS_DEFLATE ) ) return;
+		ptr = lutil_strcopy( ptr, " " COMPRESSSTR "=" LDAP_COMPRESS_DEFLATE );
+	}
+
 	bc.bv_len = ptr - buf;
 	bc.bv_val = buf;
 	ber_dupbv( bv, &bc );
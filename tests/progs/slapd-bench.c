@@ -0,0 +1,1072 @@
+/* $OpenLDAP$ */
+/* This work is part of OpenLDAP Software <http://www.openldap.org/>.
+ *
+ * Copyright 1999-2022 The OpenLDAP Foundation.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted only as authorized by the OpenLDAP
+ * Public License.
+ *
+ * A copy of this license is available in file LICENSE in the
+ * top-level directory of the distribution or, alternatively, at
+ * <http://www.OpenLDAP.org/license.html>.
+ */
+
+/*
+ * Drive a server, usually lloadd, from many concurrent clients with a mix
+ * of operations, optionally at a fixed rate, and report throughput and
+ * latency percentiles per operation type in a form that scripts can parse.
+ *
+ * The mix is either synthetic (-m) or replayed from the stats log of a
+ * slapd (-F): its BIND, SRCH and MOD lines are sent again in order, spread
+ * across the clients. The log has no passwords, named binds are done with
+ * the -D/-w credentials instead. Modifies replace the -a attribute.
+ *
+ * With a target rate, each operation has a slot it should start at and
+ * its latency is counted from there, so time spent behind schedule while
+ * the server is slow is not lost.
+ */
+
+#include "portable.h"
+
+/* Requires libldap with threads */
+#ifndef NO_THREADS
+
+#include <stdio.h>
+#include "ldap_pvt_thread.h"
+
+#include "ac/stdlib.h"
+
+#include "ac/ctype.h"
+#include "ac/param.h"
+#include "ac/socket.h"
+#include "ac/string.h"
+#include "ac/time.h"
+#include "ac/unistd.h"
+
+#ifdef HAVE_SYS_RESOURCE_H
+#include <sys/resource.h>
+#endif
+
+#include "ldap.h"
+#include "lutil.h"
+
+#include "ldap_pvt.h"
+
+#include "slapd-common.h"
+
+#define MAX_CLIENTS	1024
+#define MAX_UPSTREAMS	32
+#define DEFAULT_FILTER	"(objectClass=person)"
+#define DEFAULT_ATTR	"description"
+
+enum {
+	OP_BIND,
+	OP_READ,
+	OP_SEARCH,
+	OP_MODIFY,
+	OP_LAST
+};
+
+static const char *op_names[] = { "bind", "read", "search", "modify" };
+
+/*
+ * Latencies in microseconds go into buckets of their own below
+ * HIST_LINEAR, above that every power of two is split into HIST_SUB
+ * buckets, which keeps the error within about 3%.
+ */
+#define HIST_LINEAR	64
+#define HIST_SUB	32
+#define HIST_SHIFTS	35
+#define HIST_BUCKETS	(HIST_LINEAR + HIST_SHIFTS * HIST_SUB)
+
+typedef struct bench_stats {
+	unsigned long	bs_count;
+	unsigned long	bs_errors;
+	unsigned long	bs_busy;
+	unsigned long	bs_max;
+	unsigned long	bs_hist[HIST_BUCKETS];
+} bench_stats;
+
+typedef struct bench_client {
+	ldap_pvt_thread_t	bc_tid;
+	int		bc_idx;
+	LDAP		*bc_ld;
+	unsigned long	bc_rand;
+	unsigned long	bc_notified;
+	unsigned long	bc_failed;
+	bench_stats	bc_stats[OP_LAST];
+} bench_client;
+
+typedef struct bench_request {
+	int		br_op;
+	char		*br_dn;		/* bind DN, search base or entry */
+	int		br_scope;
+	char		*br_filter;
+} bench_request;
+
+typedef struct bench_upstream {
+	char		*bu_tier;
+	char		*bu_uri;
+	long		bu_before;
+	long		bu_after;
+} bench_upstream;
+
+/*
+ * Shared globals (command line args)
+ */
+static struct tester_conn_args	*config;
+static char		*base = NULL;
+static char		*filter = DEFAULT_FILTER;
+static char		*attr = DEFAULT_ATTR;
+static int		nobind = 0;
+static int		nclients = 1;
+static int		npsearches = 0;
+static int		seconds = 0;
+static int		rate = 0;
+static int		mix[OP_LAST] = { 0, 100, 0, 0 };
+static int		mixtotal = 100;
+
+static char		**entries = NULL;
+static int		nentries = 0;
+
+static bench_request	*requests = NULL;
+static int		nrequests = 0;
+static int		nextrequest = 0;
+static ldap_pvt_thread_mutex_t	request_mutex;
+
+static long long	bench_start, bench_end;
+static volatile int	bench_done = 0;
+
+static bench_client	*clients;
+static bench_client	*psearches;
+
+static void
+usage( char *name, int opt )
+{
+	if ( opt ) {
+		fprintf( stderr, "%s: unable to handle option \'%c\'\n\n",
+			name, opt );
+	}
+
+	fprintf( stderr, "usage: %s " TESTER_COMMON_HELP
+		"-b <searchbase> "
+		"[-N] "
+		"[-a <attr>] "
+		"[-B <tier>=<uri>] "
+		"[-c <clients>] "
+		"[-F <stats log>] "
+		"[-f <searchfilter>] "
+		"[-m <op>:<weight>[,...]] "
+		"[-o <output>] "
+		"[-P <pid>] "
+		"[-p <psearches>] "
+		"[-q <ops/sec>] "
+		"[-s <seconds>]\n",
+		name );
+	exit( EXIT_FAILURE );
+}
+
+static long long
+now_us( void )
+{
+	struct timeval	tv;
+
+	gettimeofday( &tv, NULL );
+	return (long long)tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
+static void
+sleep_us( long long us )
+{
+	struct timeval	tv;
+
+	tv.tv_sec = us / 1000000;
+	tv.tv_usec = us % 1000000;
+	select( 0, NULL, NULL, NULL, &tv );
+}
+
+/* xorshift, rand() is shared by all the threads */
+static unsigned long
+bench_rand( bench_client *bc, unsigned long n )
+{
+	unsigned long	x = bc->bc_rand;
+
+	x ^= x << 13;
+	x ^= x >> 7;
+	x ^= x << 17;
+	bc->bc_rand = x;
+	return n ? x % n : x;
+}
+
+static int
+hist_index( unsigned long v )
+{
+	int	k = 0;
+
+	if ( v < HIST_LINEAR )
+		return v;
+
+	while ( v >> ( k + 1 ) )
+		k++;
+	if ( k - 6 >= HIST_SHIFTS )
+		return HIST_BUCKETS - 1;
+	return HIST_LINEAR + ( k - 6 ) * HIST_SUB +
+		(int)( ( v >> ( k - 5 ) ) - HIST_SUB );
+}
+
+/* The middle of the bucket */
+static unsigned long
+hist_value( int i )
+{
+	int	k, m;
+
+	if ( i < HIST_LINEAR )
+		return i;
+
+	k = ( i - HIST_LINEAR ) / HIST_SUB + 6;
+	m = ( i - HIST_LINEAR ) % HIST_SUB + HIST_SUB;
+	return ( ( 2UL * m + 1 ) << ( k - 6 ) );
+}
+
+static unsigned long
+hist_percentile( bench_stats *bs, double p )
+{
+	unsigned long	rank, seen = 0;
+	int		i;
+
+	if ( !bs->bs_count )
+		return 0;
+
+	rank = p * bs->bs_count;
+	if ( rank < p * bs->bs_count )
+		rank++;
+	if ( !rank )
+		rank = 1;
+
+	for ( i = 0; i < HIST_BUCKETS; i++ ) {
+		seen += bs->bs_hist[i];
+		if ( seen >= rank ) {
+			unsigned long	v = hist_value( i );
+
+			return v < bs->bs_max ? v : bs->bs_max;
+		}
+	}
+	return bs->bs_max;
+}
+
+static void
+stats_add( bench_stats *bs, unsigned long us, int rc )
+{
+	bs->bs_count++;
+	if ( rc != LDAP_SUCCESS ) {
+		bs->bs_errors++;
+		if ( rc == LDAP_BUSY )
+			bs->bs_busy++;
+	}
+	if ( us > bs->bs_max )
+		bs->bs_max = us;
+	bs->bs_hist[ hist_index( us ) ]++;
+}
+
+static void
+stats_merge( bench_stats *to, bench_stats *from )
+{
+	int	i;
+
+	to->bs_count += from->bs_count;
+	to->bs_errors += from->bs_errors;
+	to->bs_busy += from->bs_busy;
+	if ( from->bs_max > to->bs_max )
+		to->bs_max = from->bs_max;
+	for ( i = 0; i < HIST_BUCKETS; i++ )
+		to->bs_hist[i] += from->bs_hist[i];
+}
+
+static int
+parse_mix( char *arg )
+{
+	char	**ops = ldap_str2charray( arg, "," );
+	int	i, j;
+
+	if ( ops == NULL )
+		return -1;
+
+	memset( mix, 0, sizeof(mix) );
+	mixtotal = 0;
+	for ( i = 0; ops[i] != NULL; i++ ) {
+		char	*weight = strchr( ops[i], ':' );
+		int	w = 1;
+
+		if ( weight ) {
+			*weight++ = '\0';
+			if ( lutil_atoi( &w, weight ) != 0 || w < 0 ) {
+				ldap_charray_free( ops );
+				return -1;
+			}
+		}
+		for ( j = 0; j < OP_LAST; j++ ) {
+			if ( !strcasecmp( ops[i], op_names[j] ) )
+				break;
+		}
+		if ( j == OP_LAST ) {
+			ldap_charray_free( ops );
+			return -1;
+		}
+		mix[j] = w;
+		mixtotal += w;
+	}
+	ldap_charray_free( ops );
+
+	return mixtotal ? 0 : -1;
+}
+
+/* Extract the value of key="..." that ends in end */
+static char *
+log_value( char *line, const char *key, const char *end )
+{
+	char	*p, *q;
+
+	p = strstr( line, key );
+	if ( p == NULL )
+		return NULL;
+	p += strlen( key );
+
+	if ( end ) {
+		q = strstr( p, end );
+	} else {
+		q = strrchr( p, '"' );
+	}
+	if ( q == NULL )
+		return NULL;
+
+	return ber_strndup( p, q - p );
+}
+
+static int
+load_requests( char *file )
+{
+	FILE	*fp;
+	char	line[ BUFSIZ * 4 ];
+	int	size = 0;
+
+	fp = fopen( file, "r" );
+	if ( fp == NULL ) {
+		tester_perror( "fopen", file );
+		return -1;
+	}
+
+	while ( fgets( line, sizeof(line), fp ) != NULL ) {
+		bench_request	br = { 0 };
+		char		*p;
+
+		if ( ( p = strstr( line, " SRCH base=\"" ) ) != NULL ) {
+			br.br_op = OP_SEARCH;
+			br.br_dn = log_value( p, "base=\"", "\" scope=" );
+			p = strstr( p, "\" scope=" );
+			br.br_scope = p ? atoi( p + sizeof("\" scope=") - 1 ) : 0;
+			br.br_filter = p ? log_value( p, "filter=\"", NULL ) : NULL;
+			if ( br.br_filter == NULL ) {
+				ber_memfree( br.br_dn );
+				continue;
+			}
+			/* Base searches are what clients use to read an entry */
+			if ( br.br_scope == LDAP_SCOPE_BASE )
+				br.br_op = OP_READ;
+
+		} else if ( ( p = strstr( line, " BIND dn=\"" ) ) != NULL ) {
+			br.br_op = OP_BIND;
+			br.br_dn = log_value( p, "dn=\"", "\" method=" );
+
+		} else if ( ( p = strstr( line, " MOD dn=\"" ) ) != NULL ) {
+			br.br_op = OP_MODIFY;
+			br.br_dn = log_value( p, "dn=\"", NULL );
+
+		} else {
+			continue;
+		}
+
+		if ( br.br_dn == NULL )
+			continue;
+
+		if ( nrequests == size ) {
+			size = size ? size * 2 : 1024;
+			requests = realloc( requests, size * sizeof(bench_request) );
+			if ( requests == NULL ) {
+				tester_error( "realloc failed" );
+				exit( EXIT_FAILURE );
+			}
+		}
+		requests[ nrequests++ ] = br;
+	}
+	fclose( fp );
+
+	return nrequests ? 0 : -1;
+}
+
+static int
+load_entries( void )
+{
+	LDAP		*ld = NULL;
+	LDAPMessage	*res = NULL, *e;
+	char		*attrs[] = { LDAP_NO_ATTRS, NULL };
+	int		rc, i;
+
+	tester_init_ld( &ld, config, nobind );
+
+	rc = ldap_search_ext_s( ld, base, LDAP_SCOPE_SUBTREE, filter,
+		attrs, 0, NULL, NULL, NULL, LDAP_NO_LIMIT, &res );
+	if ( rc != LDAP_SUCCESS && rc != LDAP_SIZELIMIT_EXCEEDED ) {
+		tester_ldap_error( ld, "ldap_search_ext_s", NULL );
+		ldap_unbind_ext( ld, NULL, NULL );
+		return -1;
+	}
+
+	nentries = ldap_count_entries( ld, res );
+	entries = calloc( nentries + 1, sizeof(char *) );
+	if ( entries == NULL ) {
+		tester_error( "calloc failed" );
+		exit( EXIT_FAILURE );
+	}
+	for ( i = 0, e = ldap_first_entry( ld, res ); e != NULL;
+			i++, e = ldap_next_entry( ld, e ) ) {
+		entries[i] = ldap_get_dn( ld, e );
+	}
+
+	ldap_msgfree( res );
+	ldap_unbind_ext( ld, NULL, NULL );
+
+	return nentries ? 0 : -1;
+}
+
+/* Operations done as part of the synthetic mix */
+static void
+next_request( bench_client *bc, bench_request *br )
+{
+	unsigned long	r;
+	int		i;
+
+	if ( nrequests ) {
+		ldap_pvt_thread_mutex_lock( &request_mutex );
+		*br = requests[ nextrequest ];
+		nextrequest = ( nextrequest + 1 ) % nrequests;
+		ldap_pvt_thread_mutex_unlock( &request_mutex );
+		return;
+	}
+
+	r = bench_rand( bc, mixtotal );
+	for ( i = 0; r >= mix[i]; i++ )
+		r -= mix[i];
+
+	br->br_op = i;
+	br->br_scope = LDAP_SCOPE_SUBTREE;
+	br->br_filter = filter;
+	switch ( i ) {
+	case OP_BIND:
+		br->br_dn = config->binddn;
+		break;
+	case OP_READ:
+	case OP_MODIFY:
+		br->br_dn = entries[ bench_rand( bc, nentries ) ];
+		break;
+	case OP_SEARCH:
+		br->br_dn = base;
+		break;
+	}
+}
+
+static int
+do_request( bench_client *bc, bench_request *br, unsigned long n )
+{
+	LDAPMessage	*res = NULL;
+	int		rc = LDAP_OTHER;
+
+	switch ( br->br_op ) {
+	case OP_BIND: {
+		struct berval	cred = BER_BVNULL;
+		char		*dn = br->br_dn;
+
+		if ( dn == NULL || *dn == '\0' ) {
+			dn = NULL;
+		} else {
+			cred = config->pass;
+		}
+		rc = ldap_sasl_bind_s( bc->bc_ld, dn, LDAP_SASL_SIMPLE, &cred,
+			NULL, NULL, NULL );
+		} break;
+
+	case OP_READ:
+		rc = ldap_search_ext_s( bc->bc_ld, br->br_dn, LDAP_SCOPE_BASE,
+			"(objectClass=*)", NULL, 0, NULL, NULL, NULL,
+			LDAP_NO_LIMIT, &res );
+		break;
+
+	case OP_SEARCH:
+		rc = ldap_search_ext_s( bc->bc_ld, br->br_dn, br->br_scope,
+			br->br_filter, NULL, 0, NULL, NULL, NULL,
+			LDAP_NO_LIMIT, &res );
+		break;
+
+	case OP_MODIFY: {
+		LDAPMod		mod, *mods[2];
+		char		value[BUFSIZ], *values[2];
+
+		snprintf( value, sizeof(value), "slapd-bench %ld %d %lu",
+			(long) pid, bc->bc_idx, n );
+		values[0] = value;
+		values[1] = NULL;
+		mod.mod_op = LDAP_MOD_REPLACE;
+		mod.mod_type = attr;
+		mod.mod_values = values;
+		mods[0] = &mod;
+		mods[1] = NULL;
+
+		rc = ldap_modify_ext_s( bc->bc_ld, br->br_dn, mods, NULL, NULL );
+		} break;
+	}
+
+	if ( res )
+		ldap_msgfree( res );
+
+	if ( rc != LDAP_SUCCESS && debug ) {
+		tester_ldap_error( bc->bc_ld, op_names[ br->br_op ], br->br_dn );
+	}
+	return rc;
+}
+
+static void *
+bench_client_thread( void *arg )
+{
+	bench_client	*bc = arg;
+	long long	interval = 0, next, start, end;
+	unsigned long	n;
+
+	tester_init_ld( &bc->bc_ld, config, nobind | TESTER_INIT_NOEXIT );
+
+	/* Spread the clients over the first interval */
+	next = bench_start;
+	if ( rate ) {
+		interval = 1000000LL * nclients / rate;
+		next += interval * bc->bc_idx / nclients;
+	}
+
+	for ( n = 0; ; n++ ) {
+		bench_request	br;
+		int		rc;
+
+		if ( seconds ) {
+			if ( ( interval ? next : now_us() ) >= bench_end )
+				break;
+		} else if ( n >= (unsigned long)config->loops ) {
+			break;
+		}
+
+		next_request( bc, &br );
+
+		if ( interval ) {
+			long long	now = now_us();
+
+			if ( next > now )
+				sleep_us( next - now );
+			start = next;
+			next += interval;
+		} else {
+			start = now_us();
+		}
+
+		if ( bc->bc_ld == NULL ) {
+			/* Do not spin while the server is away */
+			sleep_us( 10000 );
+			tester_init_ld( &bc->bc_ld, config,
+				nobind | TESTER_INIT_NOEXIT );
+		}
+
+		if ( bc->bc_ld == NULL ) {
+			rc = LDAP_SERVER_DOWN;
+		} else {
+			rc = do_request( bc, &br, n );
+		}
+		end = now_us();
+		stats_add( &bc->bc_stats[ br.br_op ], end - start, rc );
+
+		switch ( rc ) {
+		case LDAP_SERVER_DOWN:
+		case LDAP_CONNECT_ERROR:
+		case LDAP_TIMEOUT:
+			if ( bc->bc_ld != NULL ) {
+				ldap_unbind_ext( bc->bc_ld, NULL, NULL );
+				bc->bc_ld = NULL;
+			}
+			break;
+		}
+	}
+
+	if ( bc->bc_ld != NULL ) {
+		ldap_unbind_ext( bc->bc_ld, NULL, NULL );
+		bc->bc_ld = NULL;
+	}
+	return NULL;
+}
+
+/*
+ * Hold a refreshAndPersist search open until the clients are done and
+ * count the changes it is told about.
+ */
+static void *
+bench_psearch_thread( void *arg )
+{
+	bench_client	*bc = arg;
+	char		*attrs[] = { LDAP_NO_ATTRS, NULL };
+	struct berval	ctlval;
+	BerElement	*ber;
+	LDAPControl	ctrl, *ctrls[2];
+	struct timeval	wait = { 0, 100000 };
+	int		msgid, rc, refreshing = 1;
+
+	ber = ber_alloc_t( LBER_USE_DER );
+	if ( ber == NULL ||
+		ber_printf( ber, "{e}", LDAP_SYNC_REFRESH_AND_PERSIST ) < 0 ||
+		ber_flatten2( ber, &ctlval, 0 ) < 0 )
+	{
+		tester_error( "unable to encode the sync control" );
+		exit( EXIT_FAILURE );
+	}
+	ctrl.ldctl_oid = LDAP_CONTROL_SYNC;
+	ctrl.ldctl_value = ctlval;
+	ctrl.ldctl_iscritical = 1;
+	ctrls[0] = &ctrl;
+	ctrls[1] = NULL;
+
+	tester_init_ld( &bc->bc_ld, config, nobind | TESTER_INIT_NOEXIT );
+	if ( bc->bc_ld == NULL ) {
+		bc->bc_failed++;
+		goto done;
+	}
+
+	rc = ldap_search_ext( bc->bc_ld, base, LDAP_SCOPE_SUBTREE,
+		"(objectClass=*)", attrs, 0, ctrls, NULL, NULL, LDAP_NO_LIMIT,
+		&msgid );
+	if ( rc != LDAP_SUCCESS ) {
+		tester_ldap_error( bc->bc_ld, "ldap_search_ext", NULL );
+		bc->bc_failed++;
+		goto done;
+	}
+
+	while ( !bench_done ) {
+		LDAPMessage	*res, *msg;
+
+		rc = ldap_result( bc->bc_ld, msgid, LDAP_MSG_RECEIVED, &wait, &res );
+		if ( rc == 0 )
+			continue;
+		if ( rc < 0 ) {
+			tester_ldap_error( bc->bc_ld, "ldap_result", NULL );
+			bc->bc_failed++;
+			break;
+		}
+
+		for ( msg = ldap_first_message( bc->bc_ld, res ); msg;
+			msg = ldap_next_message( bc->bc_ld, msg ) )
+		{
+			switch ( ldap_msgtype( msg ) ) {
+			case LDAP_RES_SEARCH_ENTRY:
+				if ( !refreshing )
+					bc->bc_notified++;
+				break;
+
+			case LDAP_RES_INTERMEDIATE:
+				refreshing = 0;
+				break;
+
+			case LDAP_RES_SEARCH_RESULT:
+				tester_ldap_error( bc->bc_ld, "persistent search ended",
+					NULL );
+				bc->bc_failed++;
+				ldap_msgfree( res );
+				goto done;
+			}
+		}
+		ldap_msgfree( res );
+	}
+
+done:;
+	if ( bc->bc_ld != NULL ) {
+		ldap_unbind_ext( bc->bc_ld, NULL, NULL );
+		bc->bc_ld = NULL;
+	}
+	ber_free( ber, 1 );
+	return NULL;
+}
+
+/* How many operations the upstream has completed, -1 if unknown */
+static long
+upstream_completed( char *uri )
+{
+	LDAP		*ld = NULL;
+	LDAPMessage	*res = NULL, *e;
+	struct berval	**vals;
+	char		*attrs[] = { "monitorOpCompleted", NULL };
+	int		version = LDAP_VERSION3;
+	long		completed = -1;
+
+	if ( ldap_initialize( &ld, uri ) != LDAP_SUCCESS )
+		return -1;
+	(void) ldap_set_option( ld, LDAP_OPT_PROTOCOL_VERSION, &version );
+
+	if ( ldap_search_ext_s( ld, "cn=Operations,cn=Monitor", LDAP_SCOPE_BASE,
+			"(objectClass=*)", attrs, 0, NULL, NULL, NULL,
+			LDAP_NO_LIMIT, &res ) == LDAP_SUCCESS &&
+			( e = ldap_first_entry( ld, res ) ) != NULL &&
+			( vals = ldap_get_values_len( ld, e, attrs[0] ) ) != NULL ) {
+		completed = strtol( vals[0]->bv_val, NULL, 10 );
+		ldap_value_free_len( vals );
+	}
+
+	if ( res )
+		ldap_msgfree( res );
+	ldap_unbind_ext( ld, NULL, NULL );
+	return completed;
+}
+
+/* What an upstream did during the run, -1 if unknown */
+static long
+upstream_ops( bench_upstream *bu )
+{
+	if ( bu->bu_before < 0 || bu->bu_after < 0 )
+		return -1;
+
+	/* Restarted while we were running, it counts from zero again */
+	if ( bu->bu_after < bu->bu_before )
+		return bu->bu_after;
+
+	return bu->bu_after - bu->bu_before;
+}
+
+/* CPU time used by a process so far in microseconds, -1 if unknown */
+static long long
+process_cpu( long ppid )
+{
+	FILE		*fp;
+	char		path[64], line[BUFSIZ], *p;
+	unsigned long	utime, stime;
+	long		ticks;
+
+	snprintf( path, sizeof(path), "/proc/%ld/stat", ppid );
+	fp = fopen( path, "r" );
+	if ( fp == NULL )
+		return -1;
+	p = fgets( line, sizeof(line), fp );
+	fclose( fp );
+
+	/* The command name may contain anything, skip past it */
+	if ( p == NULL || ( p = strrchr( line, ')' ) ) == NULL )
+		return -1;
+	if ( sscanf( p + 1, " %*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %lu %lu",
+			&utime, &stime ) != 2 )
+		return -1;
+
+	ticks = sysconf( _SC_CLK_TCK );
+	if ( ticks <= 0 )
+		return -1;
+	return (long long)( utime + stime ) * 1000000 / ticks;
+}
+
+static long long
+self_cpu( void )
+{
+#ifdef HAVE_SYS_RESOURCE_H
+	struct rusage	ru;
+
+	if ( getrusage( RUSAGE_SELF, &ru ) == 0 ) {
+		return (long long)( ru.ru_utime.tv_sec + ru.ru_stime.tv_sec ) *
+			1000000 + ru.ru_utime.tv_usec + ru.ru_stime.tv_usec;
+	}
+#endif
+	return -1;
+}
+
+static void
+print_stats( FILE *out, const char *name, bench_stats *bs, double elapsed )
+{
+	fprintf( out, "op name=%s count=%lu errors=%lu busy=%lu "
+		"ops_per_sec=%.1f p50_us=%lu p99_us=%lu p999_us=%lu max_us=%lu\n",
+		name, bs->bs_count, bs->bs_errors, bs->bs_busy,
+		elapsed > 0 ? bs->bs_count / elapsed : 0.0,
+		hist_percentile( bs, 0.50 ), hist_percentile( bs, 0.99 ),
+		hist_percentile( bs, 0.999 ), bs->bs_max );
+}
+
+int
+main( int argc, char **argv )
+{
+	int		i, j;
+	char		*replay = NULL, *output = NULL;
+	long		balancer = 0;
+	bench_upstream	upstreams[MAX_UPSTREAMS];
+	int		nupstreams = 0;
+	long long	cpu_before = -1, cpu_after = -1, self_before, self_after;
+	double		elapsed;
+	bench_stats	*total;
+	FILE		*out = stdout;
+	int		needentries = 0;
+
+	config = tester_init( "slapd-bench", TESTER_BENCH );
+
+	while ( ( i = getopt( argc, argv, TESTER_COMMON_OPTS
+			"a:B:b:c:F:f:m:No:P:p:q:s:" ) ) != EOF )
+	{
+		switch ( i ) {
+		case 'a':		/* attribute to modify */
+			attr = optarg;
+			break;
+
+		case 'B': {		/* upstream to sample */
+			char	*uri = strchr( optarg, '=' );
+
+			if ( uri == NULL || nupstreams == MAX_UPSTREAMS )
+				usage( argv[0], i );
+			*uri++ = '\0';
+			upstreams[nupstreams].bu_tier = optarg;
+			upstreams[nupstreams].bu_uri = uri;
+			nupstreams++;
+			} break;
+
+		case 'b':		/* search base */
+			base = optarg;
+			break;
+
+		case 'c':		/* the number of clients */
+			if ( lutil_atoi( &nclients, optarg ) != 0 || nclients < 1 )
+				usage( argv[0], i );
+			if ( nclients > MAX_CLIENTS )
+				nclients = MAX_CLIENTS;
+			break;
+
+		case 'F':		/* stats log to replay */
+			replay = optarg;
+			break;
+
+		case 'f':		/* the search request */
+			filter = optarg;
+			break;
+
+		case 'm':		/* the operation mix */
+			if ( parse_mix( optarg ) != 0 )
+				usage( argv[0], i );
+			break;
+
+		case 'N':
+			nobind = TESTER_INIT_ONLY;
+			break;
+
+		case 'o':		/* where the results go */
+			output = optarg;
+			break;
+
+		case 'P':		/* the balancer process */
+			if ( lutil_atol( &balancer, optarg ) != 0 )
+				usage( argv[0], i );
+			break;
+
+		case 'p':		/* the number of persistent searches */
+			if ( lutil_atoi( &npsearches, optarg ) != 0 || npsearches < 0 )
+				usage( argv[0], i );
+			if ( npsearches > MAX_CLIENTS )
+				npsearches = MAX_CLIENTS;
+			break;
+
+		case 'q':		/* the target rate */
+			if ( lutil_atoi( &rate, optarg ) != 0 || rate < 0 )
+				usage( argv[0], i );
+			break;
+
+		case 's':		/* how long to run for */
+			if ( lutil_atoi( &seconds, optarg ) != 0 || seconds < 0 )
+				usage( argv[0], i );
+			break;
+
+		default:
+			if ( tester_config_opt( config, i, optarg ) == LDAP_SUCCESS ) {
+				break;
+			}
+			usage( argv[0], i );
+			break;
+		}
+	}
+
+	if ( config->uri == NULL || base == NULL )
+		usage( argv[0], 0 );
+
+	tester_config_finish( config );
+	ldap_pvt_thread_initialize();
+	ldap_pvt_thread_mutex_init( &request_mutex );
+
+	if ( replay ) {
+		if ( load_requests( replay ) != 0 ) {
+			fprintf( stderr, "%s: no requests to replay in %s.\n",
+				argv[0], replay );
+			exit( EXIT_FAILURE );
+		}
+	} else {
+		needentries = mix[OP_READ] || mix[OP_MODIFY];
+	}
+	if ( needentries && load_entries() != 0 ) {
+		fprintf( stderr, "%s: no entries matching %s under %s.\n",
+			argv[0], filter, base );
+		exit( EXIT_FAILURE );
+	}
+
+	clients = calloc( nclients, sizeof(bench_client) );
+	psearches = calloc( npsearches ? npsearches : 1, sizeof(bench_client) );
+	total = calloc( OP_LAST + 1, sizeof(bench_stats) );
+	if ( clients == NULL || psearches == NULL || total == NULL ) {
+		tester_error( "calloc failed" );
+		exit( EXIT_FAILURE );
+	}
+
+	for ( i = 0; i < npsearches; i++ ) {
+		psearches[i].bc_idx = i;
+		ldap_pvt_thread_create( &psearches[i].bc_tid, 0,
+			bench_psearch_thread, &psearches[i] );
+	}
+
+	for ( i = 0; i < nupstreams; i++ ) {
+		upstreams[i].bu_before = upstream_completed( upstreams[i].bu_uri );
+	}
+	if ( balancer )
+		cpu_before = process_cpu( balancer );
+	self_before = self_cpu();
+
+	bench_start = now_us();
+	bench_end = bench_start + 1000000LL * seconds;
+	for ( i = 0; i < nclients; i++ ) {
+		clients[i].bc_idx = i;
+		clients[i].bc_rand = ( (unsigned long)pid << 16 ) ^
+			( 2654435761UL * ( i + 1 ) ) ^ bench_start;
+		if ( !clients[i].bc_rand )
+			clients[i].bc_rand = i + 1;
+		ldap_pvt_thread_create( &clients[i].bc_tid, 0,
+			bench_client_thread, &clients[i] );
+	}
+	for ( i = 0; i < nclients; i++ ) {
+		ldap_pvt_thread_join( clients[i].bc_tid, NULL );
+	}
+	elapsed = ( now_us() - bench_start ) / 1000000.0;
+
+	self_after = self_cpu();
+	if ( balancer )
+		cpu_after = process_cpu( balancer );
+	for ( i = 0; i < nupstreams; i++ ) {
+		upstreams[i].bu_after = upstream_completed( upstreams[i].bu_uri );
+	}
+
+	bench_done = 1;
+	for ( i = 0; i < npsearches; i++ ) {
+		ldap_pvt_thread_join( psearches[i].bc_tid, NULL );
+	}
+
+	for ( i = 0; i < nclients; i++ ) {
+		for ( j = 0; j < OP_LAST; j++ ) {
+			stats_merge( &total[j], &clients[i].bc_stats[j] );
+			stats_merge( &total[OP_LAST], &clients[i].bc_stats[j] );
+		}
+	}
+
+	if ( output && ( out = fopen( output, "w" ) ) == NULL ) {
+		tester_perror( "fopen", output );
+		exit( EXIT_FAILURE );
+	}
+
+	fprintf( out, "run clients=%d seconds=%.3f target_rate=%d "
+		"psearches=%d replay=%s\n",
+		nclients, elapsed, rate, npsearches, replay ? replay : "-" );
+
+	for ( j = 0; j < OP_LAST; j++ ) {
+		if ( total[j].bs_count )
+			print_stats( out, op_names[j], &total[j], elapsed );
+	}
+	print_stats( out, "all", &total[OP_LAST], elapsed );
+
+	for ( i = 0; i < nupstreams; i++ ) {
+		long	ops = upstream_ops( &upstreams[i] );
+
+		fprintf( out, "upstream tier=%s uri=%s ops=%ld ops_per_sec=%.1f\n",
+			upstreams[i].bu_tier, upstreams[i].bu_uri, ops,
+			ops >= 0 && elapsed > 0 ? ops / elapsed : 0.0 );
+	}
+
+	/* Each tier once, in the order they were first given */
+	for ( i = 0; i < nupstreams; i++ ) {
+		long	ops = 0;
+		int	known = 0;
+
+		for ( j = 0; j < i; j++ ) {
+			if ( !strcmp( upstreams[i].bu_tier, upstreams[j].bu_tier ) )
+				break;
+		}
+		if ( j < i )
+			continue;
+
+		for ( j = i; j < nupstreams; j++ ) {
+			long	n;
+
+			if ( strcmp( upstreams[i].bu_tier, upstreams[j].bu_tier ) ||
+					( n = upstream_ops( &upstreams[j] ) ) < 0 )
+				continue;
+			ops += n;
+			known++;
+		}
+		fprintf( out, "tier name=%s upstreams=%d ops=%ld ops_per_sec=%.1f\n",
+			upstreams[i].bu_tier, known, ops,
+			elapsed > 0 ? ops / elapsed : 0.0 );
+	}
+
+	if ( cpu_before >= 0 && cpu_after >= 0 ) {
+		fprintf( out, "cpu name=balancer pid=%ld cpu_us=%lld us_per_op=%.2f\n",
+			balancer, cpu_after - cpu_before,
+			total[OP_LAST].bs_count ?
+				(double)( cpu_after - cpu_before ) / total[OP_LAST].bs_count :
+				0.0 );
+	}
+	if ( self_before >= 0 && self_after >= 0 ) {
+		fprintf( out, "cpu name=client pid=%ld cpu_us=%lld us_per_op=%.2f\n",
+			(long) pid, self_after - self_before,
+			total[OP_LAST].bs_count ?
+				(double)( self_after - self_before ) / total[OP_LAST].bs_count :
+				0.0 );
+	}
+
+	if ( npsearches ) {
+		unsigned long	notified = 0, failed = 0;
+
+		for ( i = 0; i < npsearches; i++ ) {
+			notified += psearches[i].bc_notified;
+			failed += psearches[i].bc_failed;
+		}
+		fprintf( out, "psearch searches=%d notifications=%lu errors=%lu\n",
+			npsearches, notified, failed );
+	}
+
+	if ( out != stdout )
+		fclose( out );
+
+	if ( !total[OP_LAST].bs_count ) {
+		tester_error( "no operations were done" );
+		exit( EXIT_FAILURE );
+	}
+	exit( EXIT_SUCCESS );
+}
+
+#else /* NO_THREADS */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+int
+main( int argc, char **argv )
+{
+	fprintf( stderr, "%s: not available when configured --without-threads\n", argv[0] );
+	exit( EXIT_FAILURE );
+}
+
+#endif /* NO_THREADS */
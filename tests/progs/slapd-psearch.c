@@ -0,0 +1,330 @@
+/* $OpenLDAP$ */
+/* This work is part of OpenLDAP Software <http://www.openldap.org/>.
+ *
+ * Copyright 1999-2022 The OpenLDAP Foundation.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted only as authorized by the OpenLDAP
+ * Public License.
+ *
+ * A copy of this license is available in file LICENSE in the
+ * top-level directory of the distribution or, alternatively, at
+ * <http://www.OpenLDAP.org/license.html>.
+ */
+
+/* Simulate many syncrepl consumers sitting in persist mode and time
+ * the writes they are notified about.
+ */
+
+#include "portable.h"
+
+#include <stdio.h>
+
+#include "ac/stdlib.h"
+
+#include "ac/ctype.h"
+#include "ac/param.h"
+#include "ac/socket.h"
+#include "ac/string.h"
+#include "ac/time.h"
+#include "ac/unistd.h"
+#include "ac/wait.h"
+
+#include "ldap.h"
+#include "lutil.h"
+
+#include "slapd-common.h"
+
+#define SEARCHES	100
+
+static void
+do_psearch( struct tester_conn_args *config, char *base, char *filter,
+		int nsearches, int nconns, char *entry, char *attr, char *value );
+
+
+static void
+usage( char *name, int opt )
+{
+	if ( opt ) {
+		fprintf( stderr, "%s: unable to handle option \'%c\'\n\n",
+			name, opt );
+	}
+
+	fprintf( stderr, "usage: %s " TESTER_COMMON_HELP
+		"-b <searchbase> "
+		"-a <attr:val> "
+		"-e <entry> "
+		"[-f <searchfilter>] "
+		"[-n <searches>] "
+		"[-c <connections>]\n",
+		name );
+	exit( EXIT_FAILURE );
+}
+
+int
+main( int argc, char **argv )
+{
+	int		i;
+	char		*base = NULL;
+	char		*filter = "(objectClass=*)";
+	char		*entry = NULL;
+	char		*ava = NULL;
+	char		*value = NULL;
+	int		nsearches = SEARCHES;
+	int		nconns = 0;
+	struct tester_conn_args	*config;
+
+	config = tester_init( "slapd-psearch", TESTER_PSEARCH );
+
+	while ( ( i = getopt( argc, argv, TESTER_COMMON_OPTS "a:b:c:e:f:n:" ) ) != EOF )
+	{
+		switch ( i ) {
+		case 'i':
+			/* ignored (!) by now */
+			break;
+
+		case 'b':		/* base DN of the persistent searches */
+			base = optarg;
+			break;
+
+		case 'f':		/* filter, "%d" expands to the search number */
+			filter = optarg;
+			break;
+
+		case 'n':		/* number of persistent searches */
+			if ( lutil_atoi( &nsearches, optarg ) != 0 || nsearches < 1 ) {
+				usage( argv[0], i );
+			}
+			break;
+
+		case 'c':		/* number of connections to spread them over,
+					 * one per search by default like real consumers */
+			if ( lutil_atoi( &nconns, optarg ) != 0 || nconns < 1 ) {
+				usage( argv[0], i );
+			}
+			break;
+
+		case 'e':		/* entry to modify */
+			entry = optarg;
+			break;
+
+		case 'a':
+			ava = optarg;
+			break;
+
+		default:
+			if ( tester_config_opt( config, i, optarg ) == LDAP_SUCCESS ) {
+				break;
+			}
+			usage( argv[0], i );
+			break;
+		}
+	}
+
+	if (( base == NULL ) || ( entry == NULL ) || ( ava == NULL ))
+		usage( argv[0], 0 );
+
+	if ( *entry == '\0' ) {
+		fprintf( stderr, "%s: invalid EMPTY entry DN.\n",
+				argv[0] );
+		exit( EXIT_FAILURE );
+	}
+
+	if ( !( value = strchr( ava, ':' ))) {
+		fprintf( stderr, "%s: invalid AVA.\n",
+				argv[0] );
+		exit( EXIT_FAILURE );
+	}
+	*value++ = '\0';
+	while ( *value && isspace( (unsigned char) *value ))
+		value++;
+
+	if ( nconns == 0 || nconns > nsearches )
+		nconns = nsearches;
+
+	tester_config_finish( config );
+
+	for ( i = 0; i < config->outerloops; i++ ) {
+		do_psearch( config, base, filter, nsearches, nconns,
+			entry, ava, value );
+	}
+
+	exit( EXIT_SUCCESS );
+}
+
+/* Read what arrives on ld until nothing has for tv, or until the
+ * searches that were refreshing are all done. Returns the number of
+ * search entries seen, or -1 on error.
+ */
+static int
+drain( LDAP *ld, int *refreshing, struct timeval *tv )
+{
+	LDAPMessage	*res, *msg;
+	int		rc = 0, n = 0, waiting = *refreshing;
+
+	while ( ( !waiting || *refreshing ) &&
+		( rc = ldap_result( ld, LDAP_RES_ANY, LDAP_MSG_RECEIVED,
+			tv, &res ) ) > 0 )
+	{
+		for ( msg = ldap_first_message( ld, res ); msg;
+			msg = ldap_next_message( ld, msg ) )
+		{
+			switch ( ldap_msgtype( msg ) ) {
+			case LDAP_RES_SEARCH_ENTRY:
+				n++;
+				break;
+
+			case LDAP_RES_INTERMEDIATE:
+				/* syncInfo, the refresh phase is over */
+				if ( *refreshing > 0 )
+					(*refreshing)--;
+				break;
+
+			case LDAP_RES_SEARCH_RESULT:
+				tester_ldap_error( ld, "persistent search ended", NULL );
+				ldap_msgfree( res );
+				return -1;
+			}
+		}
+		ldap_msgfree( res );
+	}
+	if ( rc < 0 ) {
+		tester_ldap_error( ld, "ldap_result", NULL );
+		return -1;
+	}
+	return n;
+}
+
+static void
+do_psearch( struct tester_conn_args *config, char *base, char *filter,
+		int nsearches, int nconns, char *entry, char *attr, char *value )
+{
+	LDAP	**lds, *ld = NULL;
+	int	*refreshing;
+	int	i, j, rc = LDAP_SUCCESS;
+	long	notified = 0;
+	char	*attrs[] = { LDAP_NO_ATTRS, NULL };
+	char	fbuf[ BUFSIZ ], vbuf[ BUFSIZ ];
+	struct berval	ctlval;
+	BerElement	*ber;
+	LDAPControl	ctrl, *ctrls[2];
+	struct timeval	zero = { 0, 0 }, wait = { 1, 0 }, start, end;
+	double	elapsed = 0;
+
+	struct ldapmod mod;
+	struct ldapmod *mods[2];
+	char *values[2];
+
+	ber = ber_alloc_t( LBER_USE_DER );
+	if ( ber == NULL ||
+		ber_printf( ber, "{e}", LDAP_SYNC_REFRESH_AND_PERSIST ) < 0 ||
+		ber_flatten2( ber, &ctlval, 0 ) < 0 )
+	{
+		tester_error( "unable to encode the sync control" );
+		exit( EXIT_FAILURE );
+	}
+	ctrl.ldctl_oid = LDAP_CONTROL_SYNC;
+	ctrl.ldctl_value = ctlval;
+	ctrl.ldctl_iscritical = 1;
+	ctrls[0] = &ctrl;
+	ctrls[1] = NULL;
+
+	lds = calloc( nconns, sizeof( LDAP * ) );
+	refreshing = calloc( nconns, sizeof( int ) );
+	if ( lds == NULL || refreshing == NULL ) {
+		tester_error( "calloc failed" );
+		exit( EXIT_FAILURE );
+	}
+
+	fprintf( stderr, "PID=%ld - Psearch(%d): base=\"%s\", filter=\"%s\", "
+		"searches=%d, connections=%d, entry=\"%s\".\n",
+		(long) pid, config->loops, base, filter, nsearches, nconns, entry );
+
+	for ( i = 0; i < nconns; i++ ) {
+		tester_init_ld( &lds[i], config, 0 );
+	}
+
+	for ( i = 0; i < nsearches; i++ ) {
+		int msgid;
+
+		snprintf( fbuf, sizeof( fbuf ), filter, i );
+		j = i % nconns;
+		rc = ldap_search_ext( lds[j], base, LDAP_SCOPE_SUBTREE, fbuf,
+			attrs, 0, ctrls, NULL, NULL, LDAP_NO_LIMIT, &msgid );
+		if ( rc != LDAP_SUCCESS ) {
+			tester_ldap_error( lds[j], "ldap_search_ext", NULL );
+			goto done;
+		}
+		refreshing[j]++;
+	}
+
+	/* wait for every search to enter the persist phase */
+	for ( j = 0; j < nconns; j++ ) {
+		while ( refreshing[j] > 0 ) {
+			if ( drain( lds[j], &refreshing[j], &wait ) < 0 ) {
+				rc = -1;
+				goto done;
+			}
+		}
+	}
+
+	tester_init_ld( &ld, config, 0 );
+
+	values[0] = vbuf;
+	values[1] = NULL;
+	mod.mod_op = LDAP_MOD_REPLACE;
+	mod.mod_type = attr;
+	mod.mod_values = values;
+	mods[0] = &mod;
+	mods[1] = NULL;
+
+	for ( i = 0; i < config->loops; i++ ) {
+		snprintf( vbuf, sizeof( vbuf ), "%s%d", value, i );
+
+		gettimeofday( &start, NULL );
+		rc = ldap_modify_ext_s( ld, entry, mods, NULL, NULL );
+		gettimeofday( &end, NULL );
+		if ( rc != LDAP_SUCCESS ) {
+			tester_ldap_error( ld, "ldap_modify_ext_s", NULL );
+			goto done;
+		}
+		elapsed += ( end.tv_sec - start.tv_sec ) * 1000.0 +
+			( end.tv_usec - start.tv_usec ) / 1000.0;
+
+		/* keep the notifications from backing up on the server */
+		for ( j = 0; j < nconns; j++ ) {
+			int n = drain( lds[j], &refreshing[j], &zero );
+			if ( n < 0 ) {
+				rc = -1;
+				goto done;
+			}
+			notified += n;
+		}
+	}
+
+	/* give the last notifications a moment to arrive */
+	for ( j = 0; j < nconns; j++ ) {
+		int n = drain( lds[j], &refreshing[j], j ? &zero : &wait );
+		if ( n > 0 )
+			notified += n;
+	}
+
+	fprintf( stderr, "  PID=%ld - Psearch: %d modifies, %.3f ms/modify, "
+		"%ld notifications.\n",
+		(long) pid, config->loops,
+		config->loops ? elapsed / config->loops : 0.0, notified );
+
+done:;
+	fprintf( stderr, "  PID=%ld - Psearch done (%d).\n", (long) pid, rc );
+
+	if ( ld != NULL )
+		ldap_unbind_ext( ld, NULL, NULL );
+	for ( j = 0; j < nconns; j++ ) {
+		if ( lds[j] != NULL )
+			ldap_unbind_ext( lds[j], NULL, NULL );
+	}
+	free( refreshing );
+	free( lds );
+	ber_free( ber, 1 );
+}
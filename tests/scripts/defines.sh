@@ -266,6 +266,7 @@ LDAPEXOP="$CLIENTDIR/ldapexop $TOOLARGS"
 SLAPDTESTER=$PROGDIR/slapd-tester
 LDIFFILTER=$PROGDIR/ldif-filter
 SLAPDMTREAD=$PROGDIR/slapd-mtread
+SLAPDBENCH=$PROGDIR/slapd-bench
 LVL=${SLAPD_DEBUG-0x4105}
 LOCALHOST=localhost
 LOCALIP=127.0.0.1